@@ -0,0 +1,177 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Per-message AEAD cost, per cipher suite and message size: the encrypt and
+// decrypt a session runs on every message, with the same context reuse, and
+// nothing else. No sockets and no threads, so the rows say what picking a suite
+// is worth on this CPU, which is the choice DefaultCipherSuites() makes.
+//
+// Rows reuse the throughput format: the library column is the suite, the
+// transport column the direction.
+//
+
+#include "common/harness.h"
+
+#include "znet/cipher_suite.h"
+#include "znet/encryption.h"
+#include "znet/version.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace znet;
+
+namespace {
+
+constexpr size_t kNonceLen = 12;
+constexpr size_t kTagLen = 16;
+// distinct sealed messages the decrypt pass cycles through, so it is not
+// timing one message that stays hot in L1
+constexpr size_t kSealedRing = 64;
+
+const char* ShortName(CipherSuite suite) {
+  switch (suite) {
+    case CipherSuite::Aes256Gcm:
+      return "aes256gcm";
+    case CipherSuite::Aes128Gcm:
+      return "aes128gcm";
+    case CipherSuite::ChaCha20Poly1305:
+      return "chacha20";
+    default:
+      return "?";
+  }
+}
+
+// nonce as the session lays it out: salt, stream, then the counter big-endian
+void BuildNonce(uint64_t counter, unsigned char* out) {
+  std::memset(out, 0x5a, 5);
+  for (size_t i = 0; i < 7; i++) {
+    out[5 + i] = static_cast<unsigned char>((counter >> (8 * (6 - i))) & 0xFFu);
+  }
+}
+
+struct Sealed {
+  std::vector<unsigned char> ciphertext;
+  unsigned char nonce[kNonceLen];
+  unsigned char tag[kTagLen];
+};
+
+// one message size through one suite, both directions; false if the cipher
+// misbehaved, so a broken suite cannot pass for a fast one
+bool Run(CipherSuite suite, const bench::Workload& w) {
+  const EVP_CIPHER* cipher = GetCipherSuiteEvp(suite);
+  unsigned char key[32];
+  for (size_t i = 0; i < sizeof(key); i++) {
+    key[i] = static_cast<unsigned char>(i * 11 + 3);
+  }
+  const std::string payload = bench::MakePayload(w.payload_bytes);
+  const auto* plaintext = reinterpret_cast<const unsigned char*>(payload.data());
+  const int len = static_cast<int>(payload.size());
+  const unsigned char aad[1] = {2};
+
+  std::vector<bench::LoopResult> encrypt_reps;
+  std::vector<bench::LoopResult> decrypt_reps;
+  for (int rep = 0; rep < bench::Reps(); rep++) {
+    EVP_CIPHER_CTX* enc = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX* dec = EVP_CIPHER_CTX_new();
+    std::vector<unsigned char> out(payload.size());
+    unsigned char nonce[kNonceLen];
+    unsigned char tag[kTagLen];
+
+    auto start = bench::Clock::now();
+    for (uint32_t i = 0; i < w.messages; i++) {
+      BuildNonce(i, nonce);
+      if (EncryptData(enc, cipher, i == 0, key, nonce, aad, 1, plaintext, len,
+                      out.data(), tag) != len) {
+        EVP_CIPHER_CTX_free(enc);
+        EVP_CIPHER_CTX_free(dec);
+        return false;
+      }
+    }
+    bench::LoopResult encrypted;
+    encrypted.delivered = w.messages;
+    encrypted.seconds =
+        std::chrono::duration<double>(bench::Clock::now() - start).count();
+    encrypt_reps.push_back(encrypted);
+
+    // sealed up front and outside the timing, then opened round-robin
+    std::vector<Sealed> ring(kSealedRing);
+    for (size_t i = 0; i < ring.size(); i++) {
+      ring[i].ciphertext.resize(payload.size());
+      BuildNonce(w.messages + i, ring[i].nonce);
+      EncryptData(enc, cipher, false, key, ring[i].nonce, aad, 1, plaintext,
+                  len, ring[i].ciphertext.data(), ring[i].tag);
+    }
+    start = bench::Clock::now();
+    for (uint32_t i = 0; i < w.messages; i++) {
+      const Sealed& sealed = ring[i % ring.size()];
+      if (DecryptData(dec, cipher, i == 0, key, sealed.nonce, aad, 1,
+                      sealed.ciphertext.data(), len, sealed.tag,
+                      out.data()) != len) {
+        EVP_CIPHER_CTX_free(enc);
+        EVP_CIPHER_CTX_free(dec);
+        return false;
+      }
+    }
+    bench::LoopResult decrypted;
+    decrypted.delivered = w.messages;
+    decrypted.seconds =
+        std::chrono::duration<double>(bench::Clock::now() - start).count();
+    decrypt_reps.push_back(decrypted);
+
+    EVP_CIPHER_CTX_free(enc);
+    EVP_CIPHER_CTX_free(dec);
+    if (std::memcmp(out.data(), plaintext, payload.size()) != 0) {
+      return false;
+    }
+  }
+  bench::ReportThroughput(ShortName(suite), "enc", w, encrypt_reps);
+  bench::ReportThroughput(ShortName(suite), "dec", w, decrypt_reps);
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("znet %s\n", VersionString());
+  bench::AnnounceRunSettings();
+  std::printf("  hardware AES: %s; default order:", HasHardwareAes() ? "yes" : "no");
+  for (CipherSuite suite : DefaultCipherSuites()) {
+    std::printf(" %s", ShortName(suite));
+  }
+  std::printf("\n");
+
+  // a game's input and state messages, a near-MTU one, and a large one
+  const bench::Workload workloads[] = {
+      {"64B", 64, 1000000},
+      {"256B", 256, 500000},
+      {"1KB", 1024, 200000},
+      {"8KB", 8192, 40000},
+  };
+  int failures = 0;
+  for (CipherSuite suite : {CipherSuite::Aes256Gcm, CipherSuite::Aes128Gcm,
+                            CipherSuite::ChaCha20Poly1305}) {
+    bench::PrintHeader(GetCipherSuiteString(suite).c_str(), "memory");
+    if (!IsCipherSuiteAvailable(suite)) {
+      bench::Note("not in this OpenSSL build");
+      continue;
+    }
+    for (const auto& w : workloads) {
+      if (!Run(suite, w)) {
+        std::printf("%-10s FAILED %s\n", ShortName(suite), w.name);
+        failures++;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -30,6 +30,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace bench {
@@ -168,6 +169,73 @@ inline std::string MakePayload(size_t bytes) {
   return MakePayload(bytes, PayloadKindFromEnv());
 }
 
+// `count` different payloads of the same kind and size. Sending one payload
+// over and over would flatter any compressor that remembers earlier messages,
+// znet's TCP stream mode among them: it would be compressing exact repeats.
+//
+// Snapshots are consecutive ticks of one world at 60 Hz, a quarter of the
+// entities moving each tick and the rest as they were, since that is the
+// redundancy real state updates carry from one message to the next. The other
+// kinds are consecutive stretches of one generated run.
+inline std::vector<std::string> MakePayloads(size_t bytes, size_t count) {
+  const PayloadKind kind = PayloadKindFromEnv();
+  std::vector<std::string> out;
+  out.reserve(count);
+  if (kind != PayloadKind::Snapshot) {
+    const std::string run = MakePayload(bytes * count, kind);
+    for (size_t i = 0; i < count; i++) {
+      out.push_back(run.substr(i * bytes, bytes));
+    }
+    return out;
+  }
+
+  // the same {id, position[3], velocity[3], flags} layout MakePayload uses
+  struct Entity {
+    uint16_t id;
+    float position[3];
+    float velocity[3];
+    uint8_t flags;
+  };
+  constexpr size_t kEntityBytes = 2 + 12 + 12 + 1;
+  uint32_t state = 0x9E3779B9u;
+  auto next = [&state]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+  std::vector<Entity> world((bytes + kEntityBytes - 1) / kEntityBytes);
+  for (size_t i = 0; i < world.size(); i++) {
+    Entity& e = world[i];
+    e.id = static_cast<uint16_t>(i + 1);
+    for (int axis = 0; axis < 3; axis++) {
+      e.position[axis] = static_cast<float>(next() % 4096u) / 16.0f;
+      e.velocity[axis] = static_cast<float>(next() % 2048u) / 256.0f - 4.0f;
+    }
+    e.flags = static_cast<uint8_t>(next() & 0x0Fu);
+  }
+  for (size_t tick = 0; tick < count; tick++) {
+    std::string message;
+    message.reserve(world.size() * kEntityBytes);
+    for (Entity& e : world) {
+      if (tick > 0 && next() % 4u == 0) {
+        for (int axis = 0; axis < 3; axis++) {
+          e.position[axis] += e.velocity[axis] / 60.0f;
+        }
+      }
+      message.append(reinterpret_cast<const char*>(&e.id), sizeof(e.id));
+      message.append(reinterpret_cast<const char*>(e.position),
+                     sizeof(e.position));
+      message.append(reinterpret_cast<const char*>(e.velocity),
+                     sizeof(e.velocity));
+      message.append(reinterpret_cast<const char*>(&e.flags), sizeof(e.flags));
+    }
+    message.resize(bytes);
+    out.push_back(std::move(message));
+  }
+  return out;
+}
+
 /** @brief ZNET_BENCH_REPS, clamped to [1, 99]. */
 inline int Reps() {
   static int reps = []() {
@@ -0,0 +1,243 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Decode-and-dispatch cost per packet, against how many packet types a
+// protocol registers: Codec::Deserialize over a buffer of small frames into a
+// PacketHandler, which finds the serializer and then the handler through two
+// hash maps, and into a DensePacketHandler, which does both through one table
+// slot. No sockets, no compression and no encryption, so what the first two
+// rows differ by is the dispatch. The third is the dense table again with
+// serializers that decode in place into pooled packets, and the per-packet
+// line counts the heap allocations each path makes.
+//
+// Rows reuse the throughput format: the library column is the handler, the
+// case column the number of registered types.
+//
+
+#include "common/harness.h"
+
+#include "znet/codec.h"
+#include "znet/packet_handler.h"
+#include "znet/version.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace znet;
+
+namespace {
+
+// every allocation the process makes, so a row can say how many its decode
+// path costs per packet. the benchmark is single-threaded.
+size_t g_allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  g_allocations++;
+  if (void* p = std::malloc(size != 0 ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// frames per decoded buffer, ids cycling through every registered type so
+// neither lookup gets to answer the same question twice in a row
+constexpr size_t kFramesPerBuffer = 4096;
+
+template <PacketId Id>
+class BenchPacket : public Packet {
+ public:
+  BenchPacket() : Packet(Id) {}
+  uint32_t value = 0;
+};
+
+template <PacketId Id>
+class BenchSerializer : public PacketSerializer<BenchPacket<Id>> {
+ public:
+  std::shared_ptr<Buffer> SerializeTyped(std::shared_ptr<BenchPacket<Id>> packet,
+                                         std::shared_ptr<Buffer> buffer) override {
+    buffer->WriteInt<uint32_t>(packet->value);
+    return buffer;
+  }
+  std::shared_ptr<BenchPacket<Id>> DeserializeTyped(
+      std::shared_ptr<Buffer> buffer) override {
+    auto packet = std::make_shared<BenchPacket<Id>>();
+    packet->value = buffer->ReadInt<uint32_t>();
+    return packet;
+  }
+};
+
+// the same wire format, read into a packet the route hands it
+template <PacketId Id>
+class InPlaceSerializer : public BenchSerializer<Id> {
+ public:
+  bool DeserializeInto(Buffer& buffer, BenchPacket<Id>& packet) {
+    packet.value = buffer.ReadInt<uint32_t>();
+    return true;
+  }
+};
+
+template <typename Seq>
+struct Protocol;
+
+// one protocol of sizeof...(Ids) packet types, ids 0..N-1, with both handlers
+template <size_t... Ids>
+struct Protocol<std::index_sequence<Ids...>> {
+  class MapHandler : public PacketHandler<MapHandler, BenchPacket<Ids>...> {
+   public:
+    template <PacketId Id>
+    void OnPacket(const BenchPacket<Id>& packet) {
+      sum += packet.value;
+    }
+    uint64_t sum = 0;
+  };
+
+  class DenseHandler
+      : public DensePacketHandler<
+            DenseHandler, PacketRoute<Ids, BenchPacket<Ids>, BenchSerializer<Ids>>...> {
+   public:
+    template <PacketId Id>
+    void OnPacket(const BenchPacket<Id>& packet) {
+      sum += packet.value;
+    }
+    uint64_t sum = 0;
+  };
+
+  class PooledHandler
+      : public DensePacketHandler<
+            PooledHandler,
+            PacketRoute<Ids, BenchPacket<Ids>, InPlaceSerializer<Ids>>...> {
+   public:
+    template <PacketId Id>
+    void OnPacket(const BenchPacket<Id>& packet) {
+      sum += packet.value;
+    }
+    uint64_t sum = 0;
+  };
+
+  static constexpr size_t kTypes = sizeof...(Ids);
+};
+
+template <typename Proto>
+std::shared_ptr<Buffer> MakeFrames(Codec& codec) {
+  auto out = std::make_shared<Buffer>();
+  for (size_t i = 0; i < kFramesPerBuffer; i++) {
+    // any one type's serializer frames the same bytes; only the id differs
+    auto packet = std::make_shared<BenchPacket<0>>();
+    packet->value = static_cast<uint32_t>(i);
+    auto frame = codec.Serialize(packet, 0);
+    frame->ReadVarInt<PacketId>();
+    out->WriteVarInt<PacketId>(static_cast<PacketId>(i % Proto::kTypes));
+    out->Write(frame->read_cursor_data(), frame->readable_bytes());
+  }
+  return out;
+}
+
+struct DecodeCost {
+  uint64_t sum = 0;  // checked, so no path can skip work the others do
+  double allocations_per_packet = 0.0;
+};
+
+// decodes `frames` until `w.messages` packets went through
+template <typename Handler>
+bench::LoopResult Decode(Codec& codec, const std::shared_ptr<Buffer>& frames,
+                         const bench::Workload& w, DecodeCost* cost) {
+  Handler handler;
+  bench::LoopResult result;
+  const size_t allocations = g_allocations;
+  auto start = bench::Clock::now();
+  while (result.delivered < w.messages) {
+    frames->set_read_cursor(0);
+    codec.Deserialize(frames, handler);
+    result.delivered += static_cast<uint32_t>(kFramesPerBuffer);
+  }
+  result.seconds =
+      std::chrono::duration<double>(bench::Clock::now() - start).count();
+  cost->sum = handler.sum;
+  cost->allocations_per_packet =
+      static_cast<double>(g_allocations - allocations) / result.delivered;
+  return result;
+}
+
+double NanosPerPacket(const std::vector<bench::LoopResult>& reps) {
+  double best = 0.0;
+  for (const auto& r : reps) {
+    const double ns = r.seconds * 1e9 / r.delivered;
+    best = best == 0.0 || ns < best ? ns : best;
+  }
+  return best;
+}
+
+template <size_t N>
+bool Run(const char* name) {
+  using Proto = Protocol<std::make_index_sequence<N>>;
+  Codec codec;
+  Proto::DenseHandler::RegisterSerializers(codec);
+  const auto frames = MakeFrames<Proto>(codec);
+  const bench::Workload w{name, sizeof(uint32_t), 4000 * kFramesPerBuffer / 8};
+
+  std::vector<bench::LoopResult> map_reps;
+  std::vector<bench::LoopResult> dense_reps;
+  std::vector<bench::LoopResult> pooled_reps;
+  DecodeCost map;
+  DecodeCost dense;
+  DecodeCost pooled;
+  for (int rep = 0; rep < bench::Reps(); rep++) {
+    map_reps.push_back(
+        Decode<typename Proto::MapHandler>(codec, frames, w, &map));
+    dense_reps.push_back(
+        Decode<typename Proto::DenseHandler>(codec, frames, w, &dense));
+    pooled_reps.push_back(
+        Decode<typename Proto::PooledHandler>(codec, frames, w, &pooled));
+    if (map.sum == 0 || map.sum != dense.sum || map.sum != pooled.sum) {
+      return false;
+    }
+  }
+  bench::ReportThroughput("map", "memory", w, map_reps);
+  bench::ReportThroughput("dense", "memory", w, dense_reps);
+  bench::ReportThroughput("pooled", "memory", w, pooled_reps);
+  std::printf("%-10s %-6s per packet %-6s  map %6.1f ns %4.2f allocs  "
+              "dense %6.1f ns %4.2f allocs  pooled %6.1f ns %4.2f allocs\n",
+              "", "", name, NanosPerPacket(map_reps),
+              map.allocations_per_packet, NanosPerPacket(dense_reps),
+              dense.allocations_per_packet, NanosPerPacket(pooled_reps),
+              pooled.allocations_per_packet);
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  std::printf("znet %s\n", VersionString());
+  bench::AnnounceRunSettings();
+  bench::Note("cases are the number of registered packet types");
+  bench::PrintHeader("dispatch", "memory");
+  int failures = 0;
+  auto check = [&failures](bool ok, const char* name) {
+    if (!ok) {
+      std::printf("%-10s FAILED %s\n", "dispatch", name);
+      failures++;
+    }
+  };
+  check(Run<4>("4"), "4");
+  check(Run<32>("32"), "32");
+  check(Run<256>("256"), "256");
+  return failures == 0 ? 0 : 1;
+}
@@ -13,6 +13,11 @@
 // game server has. Rewards the opposite arrangement from znet_bench's
 // one-session pipeline.
 //
+// The second table sends the same rounds two ways at up to a few thousand
+// sessions: a SendPacket() per session, each encoding the packet for itself,
+// and one Server::Broadcast() a round, which serializes and compresses it once
+// and leaves the workers only the per-session encryption.
+//
 
 #include "common/harness.h"
 #include "common/znet_tuning.h"
@@ -27,6 +32,7 @@
 #include "znet/server_events.h"
 #include "znet/version.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdio>
@@ -89,11 +95,39 @@ struct FanoutResult {
   uint32_t delivered = 0;
   double seconds = 0.0;
   bool timed_out = false;
+  uint32_t sessions = 0;  // connected at both ends, and counted
 };
 
+// clients started before waiting for them to connect
+constexpr uint32_t kConnectWave = 64;
+
+// past this many sessions the bench bounds would preallocate gigabytes
+constexpr uint32_t kMaxBenchBoundedClients = 64;
+
+// ApplyBenchQueueBounds, scaled down to what one case can ever have queued:
+// every round, twice over. Its 65536-slot queues are a few MB a session,
+// which a few thousand sessions cannot afford.
+void FitQueueBounds(SessionOptions& options, uint32_t per_client) {
+  size_t bound = 1024;
+  while (bound < 2 * static_cast<size_t>(per_client)) {
+    bound *= 2;
+  }
+  options.common.send_queue_capacity = bound;
+  options.zdt.outbound_queue_capacity = bound;
+  options.zdt.max_inbox_datagrams = bound;
+}
+
+void ApplyQueueBounds(SessionOptions& options, uint32_t client_count,
+                      uint32_t per_client) {
+  bench::ApplyBenchQueueBounds(options);
+  if (client_count > kMaxBenchBoundedClients) {
+    FitQueueBounds(options, per_client);
+  }
+}
+
 FanoutResult RunFanout(const char* profile, ConnectionType type,
                        uint32_t client_count, uint32_t per_client,
-                       size_t payload_bytes, bool secure) {
+                       size_t payload_bytes, bool secure, bool broadcast) {
   const std::string payload = bench::MakePayload(payload_bytes);
   const char* transport = type == ConnectionType::TCP ? "TCP" : "ZDT";
   std::atomic_uint32_t received{0};
@@ -108,7 +142,7 @@ FanoutResult RunFanout(const char* profile, ConnectionType type,
   server_config.child_options.common.compression =
       secure ? CompressionType::Default : CompressionType::None;
   // same bounds as znet_bench, so the two tables measure the same regime
-  bench::ApplyBenchQueueBounds(server_config.child_options);
+  ApplyQueueBounds(server_config.child_options, client_count, per_client);
 
   Server server{server_config};
   server.SetEventCallback([&](Event& event) {
@@ -132,7 +166,7 @@ FanoutResult RunFanout(const char* profile, ConnectionType type,
   clients.reserve(client_count);
   for (uint32_t i = 0; i < client_count; i++) {
     ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(10), type};
-    bench::ApplyBenchQueueBounds(client_config.options);
+    ApplyQueueBounds(client_config.options, client_count, per_client);
     auto client = std::unique_ptr<Client>(new Client{client_config});
     client->SetEventCallback([&](Event& event) {
       EventDispatcher dispatcher{event};
@@ -147,6 +181,15 @@ FanoutResult RunFanout(const char* profile, ConnectionType type,
     client->Bind();
     client->Connect();
     clients.push_back(std::move(client));
+    // in waves: a few thousand handshakes at once can starve each other past
+    // the connection timeout on a small machine
+    if (clients.size() % kConnectWave == 0) {
+      auto wave_deadline = bench::Clock::now() + std::chrono::seconds(10);
+      while (clients_ready.load() < clients.size() &&
+             bench::Clock::now() < wave_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    }
   }
 
   auto teardown = [&]() {
@@ -176,29 +219,66 @@ FanoutResult RunFanout(const char* profile, ConnectionType type,
     std::lock_guard<std::mutex> lock(sessions_mutex);
     targets = sessions;
   }
-  if (targets.size() < client_count) {
-    std::printf("%-10s %-6s fanout     %ux%u  only %zu/%u sessions connected\n",
-                profile, transport, client_count, per_client, targets.size(),
+  // a large case runs with the few handshakes a loaded machine loses left
+  // out, and reports how many it had
+  const uint32_t connected = std::min(static_cast<uint32_t>(targets.size()),
+                                      clients_ready.load());
+  const bool enough = client_count > kMaxBenchBoundedClients
+                          ? connected * 10 >= client_count * 9
+                          : connected >= client_count;
+  if (!enough) {
+    std::printf("%-10s %-6s fanout     %ux%u  only %u/%u sessions connected\n",
+                profile, transport, client_count, per_client, connected,
                 client_count);
     teardown();
     return {};
   }
 
-  const uint32_t total = client_count * per_client;
+  // a session's connect event runs before its worker has it, and a broadcast
+  // only reaches the sessions on a worker, so wait until one would reach them
+  // all: a probe whose filter counts them and keeps none
+  if (broadcast) {
+    auto probe_deadline = bench::Clock::now() + std::chrono::seconds(10);
+    bool listed_all = false;
+    while (!listed_all && bench::Clock::now() < probe_deadline) {
+      auto listed = std::make_shared<std::atomic<uint32_t>>(0);
+      server.Broadcast(std::make_shared<FanoutPacket>(),
+                       [listed](PeerSession&) {
+                         listed->fetch_add(1);
+                         return false;
+                       });
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      listed_all = listed->load() >= connected;
+    }
+  }
+
+  const uint32_t total = connected * per_client;
   auto deadline = bench::Clock::now() + std::chrono::seconds(120);
   auto started = bench::Clock::now();
 
-  // a refusal is backpressure: spin, don't drop
-  for (uint32_t round = 0; round < per_client; round++) {
-    for (std::shared_ptr<PeerSession>& session : targets) {
+  if (broadcast) {
+    // one packet a round for everyone. a broadcast cannot be retried for just
+    // the sessions whose queue was full, so the queues hold every round
+    // instead
+    for (uint32_t round = 0; round < per_client; round++) {
       auto packet = std::make_shared<FanoutPacket>();
       packet->seq = round;
       packet->payload = payload;
-      while (session->SendPacket(packet) != Result::Success) {
-        if (bench::Clock::now() > deadline || !session->IsAlive()) {
-          break;
+      server.Broadcast(packet);
+    }
+  } else {
+    // a refusal is backpressure: spin, don't drop
+    for (uint32_t round = 0; round < per_client; round++) {
+      for (std::shared_ptr<PeerSession>& session : targets) {
+        auto packet = std::make_shared<FanoutPacket>();
+        packet->seq = round;
+        packet->payload = payload;
+        while (session->SendPacket(packet) != Result::Success) {
+          if (bench::Clock::now() > deadline || !session->IsAlive()) {
+            break;
+          }
+          std::this_thread::yield();
         }
-        std::this_thread::yield();
       }
     }
   }
@@ -209,6 +289,7 @@ FanoutResult RunFanout(const char* profile, ConnectionType type,
 
   FanoutResult out;
   out.ok = true;
+  out.sessions = connected;
   out.delivered = received.load();
   out.seconds =
       std::chrono::duration<double>(bench::Clock::now() - started).count();
@@ -265,7 +346,10 @@ void ReportFanout(const char* profile, ConnectionType type,
               mid.seconds, rate, mib);
   if (mid.timed_out) {
     std::printf("  TIMEOUT (%u/%u in 120 s)", mid.delivered,
-                client_count * per_client);
+                mid.sessions * per_client);
+  }
+  if (mid.sessions < client_count) {
+    std::printf("  (%u sessions connected)", mid.sessions);
   }
   if (reps.size() > 1) {
     double lo = sorted.front().seconds > 0
@@ -281,10 +365,12 @@ void ReportFanout(const char* profile, ConnectionType type,
 }
 
 void RunCase(const char* profile, ConnectionType type, uint32_t clients,
-             uint32_t per_client, size_t payload, bool secure) {
+             uint32_t per_client, size_t payload, bool secure,
+             bool broadcast = false) {
   std::vector<FanoutResult> reps;
   for (int rep = 0; rep < bench::Reps(); rep++) {
-    FanoutResult r = RunFanout(profile, type, clients, per_client, payload, secure);
+    FanoutResult r = RunFanout(profile, type, clients, per_client, payload,
+                               secure, broadcast);
     if (r.ok) {
       reps.push_back(r);
     }
@@ -324,6 +410,21 @@ int main() {
     RunCase("znet", ConnectionType::TCP, c.clients, c.per_client, c.payload, true);
   }
 
+  // per-session sends against one broadcast a round, the same rounds each
+  const Case broadcast_cases[] = {
+      {64, 1000, 1024},
+      {512, 100, 1024},
+      {2048, 25, 1024},
+  };
+  bench::Note("znet sends per session, znet-bcast once a round via Broadcast()");
+  for (ConnectionType type : {ConnectionType::ZDT, ConnectionType::TCP}) {
+    for (const Case& c : broadcast_cases) {
+      RunCase("znet", type, c.clients, c.per_client, c.payload, true);
+      RunCase("znet-bcast", type, c.clients, c.per_client, c.payload, true,
+              /*broadcast=*/true);
+    }
+  }
+
   Cleanup();
   return 0;
 }
@@ -0,0 +1,351 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Group fan-out at game-server scale: 10,000 sessions in 500 overlapping
+// groups, rooms or areas of interest, with every group sent one state update
+// a round. The sessions are real PeerSessions, encrypted and compressing, that
+// handshake over an in-memory link and then send into a sink. There are no
+// sockets, because ten thousand connections do not fit in one benchmark
+// process, so the rows are the fan-out alone: getting each member its sealed
+// message.
+//
+// Sessions are split across worker threads the way a Server splits them, and
+// each worker drains only its own. The two rows differ in who fans out:
+//   per-member  the application keeps the member lists and calls SendPacket()
+//               once per member, so each session serializes and compresses
+//               the update for itself.
+//   group       one send per group is posted to each worker's SessionGroups,
+//               the table a Server keeps per worker, which queues it to the
+//               members there; they share one serialized, compressed payload
+//               and only encrypt their own copy.
+//
+// Rows reuse the throughput format: the library column is the row above, the
+// case column sessions/groups, and a message is one member's copy.
+//
+
+#include "common/harness.h"
+
+#include "znet/codec.h"
+#include "znet/init.h"
+#include "znet/packet.h"
+#include "znet/peer_session.h"
+#include "znet/session_groups.h"
+#include "znet/shared_message.h"
+#include "znet/transport.h"
+#include "znet/version.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace znet;
+
+namespace {
+
+constexpr uint32_t kSessions = 10000;
+constexpr uint32_t kGroups = 500;
+// each session's groups; a group averages kSessions * kGroupsPerSession /
+// kGroups members
+constexpr uint32_t kGroupsPerSession = 5;
+constexpr uint32_t kRounds = 20;
+constexpr size_t kPayloadBytes = 256;
+
+// every serialization either row makes, so it can say how many it needed
+std::atomic<uint64_t> g_serialized{0};
+
+// what Apply() would walk for a broadcast; group sends never look at it
+const SessionGroups::SessionMap kNoSessions;
+
+enum GroupPacketType : PacketId { kPacketState = 1 };
+
+class StatePacket : public Packet {
+ public:
+  StatePacket() : Packet(kPacketState) {}
+  uint32_t seq = 0;
+  std::string payload;
+};
+
+class StateSerializer : public PacketSerializer<StatePacket> {
+ public:
+  std::shared_ptr<Buffer> SerializeTyped(std::shared_ptr<StatePacket> packet,
+                                         std::shared_ptr<Buffer> buffer) override {
+    g_serialized.fetch_add(1, std::memory_order_relaxed);
+    buffer->WriteInt<uint32_t>(packet->seq);
+    buffer->WriteString(packet->payload);
+    return buffer;
+  }
+  std::shared_ptr<StatePacket> DeserializeTyped(
+      std::shared_ptr<Buffer> buffer) override {
+    auto packet = std::make_shared<StatePacket>();
+    packet->seq = buffer->ReadInt<uint32_t>();
+    packet->payload = buffer->ReadString();
+    return packet;
+  }
+};
+
+// Carries the handshake to the other end while linked, and counts whatever is
+// sent once it is not.
+class LinkTransport : public TransportLayer {
+ public:
+  std::shared_ptr<Buffer> Receive() override {
+    if (inbox.empty()) {
+      return nullptr;
+    }
+    auto buffer = inbox.front();
+    inbox.pop_front();
+    return buffer;
+  }
+  bool Send(std::shared_ptr<Buffer> buffer, SendOptions = {}) override {
+    if (peer != nullptr) {
+      peer->inbox.push_back(std::move(buffer));
+    } else {
+      sent++;
+    }
+    return true;
+  }
+  Result Close(CloseOptions = {}) override {
+    closed = true;
+    return Result::Success;
+  }
+  bool IsClosed() const override { return closed; }
+  void Update() override {}
+  void Flush() override {}
+  std::chrono::steady_clock::time_point NextDeadline() const override {
+    return std::chrono::steady_clock::time_point::max();
+  }
+
+  LinkTransport* peer = nullptr;
+  std::deque<std::shared_ptr<Buffer>> inbox;
+  uint64_t sent = 0;  // worker only
+  bool closed = false;
+};
+
+struct Member {
+  std::shared_ptr<PeerSession> session;
+  LinkTransport* sink;
+};
+
+// One worker's share: its sessions, its group table, and a codec only it uses.
+struct Shard {
+  std::vector<Member> members;
+  SessionGroups groups;
+  std::shared_ptr<Codec> codec;
+};
+
+// A ready session whose far end has been let go of, or null if the handshake
+// did not finish.
+std::shared_ptr<PeerSession> Connect(const SessionOptions& options,
+                                     PortNumber port, LinkTransport** sink) {
+  auto local = std::unique_ptr<LinkTransport>(new LinkTransport());
+  auto remote = std::unique_ptr<LinkTransport>(new LinkTransport());
+  local->peer = remote.get();
+  remote->peer = local.get();
+  *sink = local.get();
+  LinkTransport* far = remote.get();
+
+  std::shared_ptr<InetAddress> local_addr = InetAddress::from("127.0.0.1", port);
+  std::shared_ptr<InetAddress> remote_addr = InetAddress::from("127.0.0.2", port);
+  auto session = std::make_shared<PeerSession>(
+      local_addr, remote_addr, std::move(local), ConnectionType::ZDT,
+      /*is_initiator=*/false, /*self_managed=*/false, options);
+  PeerSession peer(remote_addr, local_addr, std::move(remote),
+                   ConnectionType::ZDT, /*is_initiator=*/true,
+                   /*self_managed=*/false, options);
+  for (int i = 0; i < 20 && !(session->IsReady() && peer.IsReady()); i++) {
+    peer.Process();
+    session->Process();
+  }
+  // unlinked before the far end goes, so nothing it says on the way out
+  // reaches this one
+  (*sink)->peer = nullptr;
+  far->peer = nullptr;
+  return session->IsReady() ? session : nullptr;
+}
+
+// Runs `work` on every shard at once, one thread each, and waits for them.
+template <typename Fn>
+void OnEveryShard(std::vector<Shard>& shards, Fn work) {
+  std::vector<std::thread> threads;
+  threads.reserve(shards.size());
+  for (Shard& shard : shards) {
+    threads.emplace_back([&shard, &work]() { work(shard); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+uint64_t SentSoFar(const std::vector<Shard>& shards) {
+  uint64_t sent = 0;
+  for (const Shard& shard : shards) {
+    for (const Member& member : shard.members) {
+      sent += member.sink->sent;
+    }
+  }
+  return sent;
+}
+
+struct RoundsResult {
+  bench::LoopResult loop;
+  double serialized_per_round = 0.0;
+};
+
+// `kRounds` rounds of one update to every group; false if a member missed one
+bool RunRounds(std::vector<Shard>& shards,
+               const std::vector<std::vector<uint32_t>>& group_members,
+               const std::string& payload, bool by_group, RoundsResult* out) {
+  const uint64_t sent_before = SentSoFar(shards);
+  const uint64_t serialized_before = g_serialized.load();
+  uint64_t expected = 0;
+  auto start = bench::Clock::now();
+  for (uint32_t round = 0; round < kRounds; round++) {
+    for (uint32_t group = 0; group < kGroups; group++) {
+      auto packet = std::make_shared<StatePacket>();
+      packet->seq = round;
+      packet->payload = payload;
+      expected += group_members[group].size();
+      if (by_group) {
+        auto message = std::make_shared<SharedMessage>(packet);
+        for (Shard& shard : shards) {
+          shard.groups.PostSend(group, message, {});
+        }
+        continue;
+      }
+      for (uint32_t index : group_members[group]) {
+        const Member& member =
+            shards[index % shards.size()].members[index / shards.size()];
+        // sized to hold a round, so a refusal is a bug rather than
+        // backpressure
+        if (member.session->SendPacket(packet) != znet::Result::Success) {
+          return false;
+        }
+      }
+    }
+    OnEveryShard(shards, [](Shard& shard) {
+      shard.groups.Apply(kNoSessions);
+      for (Member& member : shard.members) {
+        member.session->DrainOutbound();
+      }
+    });
+  }
+  out->loop.seconds =
+      std::chrono::duration<double>(bench::Clock::now() - start).count();
+  const uint64_t sent = SentSoFar(shards) - sent_before;
+  out->loop.delivered = static_cast<uint32_t>(sent);
+  out->serialized_per_round =
+      static_cast<double>(g_serialized.load() - serialized_before) / kRounds;
+  return sent == expected;
+}
+
+}  // namespace
+
+int main() {
+  if (Init() != znet::Result::Success) {
+    std::fprintf(stderr, "failed to initialize znet\n");
+    return 1;
+  }
+  std::printf("znet %s\n", VersionString());
+  bench::AnnounceRunSettings();
+
+  const size_t worker_count =
+      std::max<size_t>(1, std::min<size_t>(8, std::thread::hardware_concurrency()));
+  SessionOptions options;
+  options.common.encryption = true;
+  options.common.compression = CompressionType::Default;
+  // a round queues each session kGroupsPerSession updates; the default 512
+  // slots would be 240 MB across ten thousand sessions
+  options.common.send_queue_capacity = 64;
+
+  std::vector<Shard> shards(worker_count);
+  for (Shard& shard : shards) {
+    shard.codec = std::make_shared<Codec>();
+    shard.codec->Add(kPacketState, std::make_unique<StateSerializer>());
+  }
+  auto connect_start = bench::Clock::now();
+  for (uint32_t i = 0; i < kSessions; i++) {
+    LinkTransport* sink = nullptr;
+    auto session = Connect(options, static_cast<PortNumber>(1 + i % 60000), &sink);
+    if (!session) {
+      std::printf("%-10s FAILED handshake %u\n", "group", i);
+      return 1;
+    }
+    // round-robin, so session i is member i / workers of shard i % workers
+    Shard& shard = shards[i % worker_count];
+    session->SetCodec(shard.codec);
+    shard.members.push_back(Member{std::move(session), sink});
+  }
+  std::printf("  %u sessions handshaken in %.1f s across %zu workers\n",
+              kSessions,
+              std::chrono::duration<double>(bench::Clock::now() - connect_start)
+                  .count(),
+              worker_count);
+
+  // each session joins kGroupsPerSession distinct groups at random, the same
+  // draw every run
+  std::vector<std::vector<uint32_t>> group_members(kGroups);
+  uint32_t state = 0x9E3779B9u;
+  auto next = [&state]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+  for (uint32_t i = 0; i < kSessions; i++) {
+    std::vector<uint32_t> joined;
+    while (joined.size() < kGroupsPerSession) {
+      const uint32_t group = next() % kGroups;
+      if (std::find(joined.begin(), joined.end(), group) == joined.end()) {
+        joined.push_back(group);
+        group_members[group].push_back(i);
+        Shard& shard = shards[i % worker_count];
+        shard.groups.PostAdd(group, shard.members[i / worker_count].session);
+      }
+    }
+  }
+  OnEveryShard(shards, [](Shard& shard) { shard.groups.Apply(kNoSessions); });
+
+  char case_name[32];
+  std::snprintf(case_name, sizeof(case_name), "%uk/%u", kSessions / 1000,
+                kGroups);
+  const std::string payload = bench::MakePayload(kPayloadBytes);
+  bench::PrintHeader("groups", "memory");
+  bench::Note("one state update to every group a round; a message is one member's copy");
+
+  std::vector<bench::LoopResult> member_reps;
+  std::vector<bench::LoopResult> group_reps;
+  RoundsResult member;
+  RoundsResult group;
+  for (int rep = 0; rep < bench::Reps(); rep++) {
+    if (!RunRounds(shards, group_members, payload, /*by_group=*/false,
+                   &member) ||
+        !RunRounds(shards, group_members, payload, /*by_group=*/true, &group)) {
+      std::printf("%-10s FAILED a member missed an update\n", "group");
+      return 1;
+    }
+    member_reps.push_back(member.loop);
+    group_reps.push_back(group.loop);
+  }
+  const bench::Workload w{case_name, kPayloadBytes, member.loop.delivered};
+  bench::ReportThroughput("per-member", "memory", w, member_reps);
+  bench::ReportThroughput("group", "memory", w, group_reps);
+  std::printf("%-10s %-6s serialized per round  per-member %.0f  group %.0f\n",
+              "", "", member.serialized_per_round, group.serialized_per_round);
+
+  // the sessions go before the codecs their shards hold
+  shards.clear();
+  Cleanup();
+  return 0;
+}
@@ -75,7 +75,7 @@ if [ -n "$SPEC" ]; then
     echo "netem: $NETEM (lo, mtu 1500)"
 fi
 
-[ $# -ge 1 ] || set -- znet-bench baseline-bench fanout-bench enet-bench raknet-bench gns-bench
+[ $# -ge 1 ] || set -- znet-bench baseline-bench fanout-bench group-bench cipher-bench dispatch-bench enet-bench raknet-bench gns-bench
 
 for bin in "$@"; do
     if [ ! -x "$DIR/$bin" ]; then
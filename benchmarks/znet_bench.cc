@@ -31,10 +31,12 @@
 #include "znet/server_events.h"
 #include "znet/version.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cctype>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -88,25 +90,47 @@ class SinkHandler : public PacketHandler<SinkHandler, BenchPacket> {
 // Echoes back, for the round-trip measurement.
 class EchoHandler : public PacketHandler<EchoHandler, BenchPacket> {
  public:
-  explicit EchoHandler(std::shared_ptr<PeerSession> session)
-      : session_(std::move(session)) {}
+  explicit EchoHandler(std::shared_ptr<PeerSession> session,
+                       SendOptions options = {})
+      : session_(std::move(session)), options_(options) {}
   void OnPacket(std::shared_ptr<BenchPacket> packet) {
-    session_->SendPacket(packet);
+    session_->SendPacket(packet, options_);
   }
 
  private:
   std::shared_ptr<PeerSession> session_;
+  SendOptions options_;
+};
+
+// When each stream echo came back, by seq. Written on the client's worker,
+// read once the stream is over.
+struct StreamLog {
+  std::mutex mutex;
+  std::vector<std::pair<uint32_t, bench::Clock::time_point>> arrivals;
 };
 
 class ReplyHandler : public PacketHandler<ReplyHandler, BenchPacket> {
  public:
-  explicit ReplyHandler(std::atomic_uint32_t* replies) : replies_(replies) {}
-  void OnPacket(std::shared_ptr<BenchPacket>) { replies_->fetch_add(1); }
+  ReplyHandler(std::atomic_uint32_t* replies, StreamLog* log)
+      : replies_(replies), log_(log) {}
+  void OnPacket(std::shared_ptr<BenchPacket> packet) {
+    if (log_ != nullptr) {
+      std::lock_guard<std::mutex> lock(log_->mutex);
+      log_->arrivals.emplace_back(packet->seq, bench::Clock::now());
+    }
+    replies_->fetch_add(1);
+  }
 
  private:
   std::atomic_uint32_t* replies_;
+  StreamLog* log_;
 };
 
+// Stream case: input-shaped traffic on a channel of its own, which is what
+// ZDTOptions::fec_channels protects in the "+fec" rows.
+constexpr uint8_t kStreamChannel = 2;
+const SendOptions kStreamOptions = SendOptions().Channel(kStreamChannel);
+
 // Congestion case: bulk and probe share a session, told apart by size. Probes
 // return on channel 1 so ZDT keeps them off the bulk sequence space; TCP
 // ignores the channel and has one stream.
@@ -145,8 +169,39 @@ struct Profile {
 
 Profile g_profile{"", true, CompressionType::Default};
 
+// ZDTOptions::segmentation_offload, on both ends; the extra 8KB row
+bool g_offload = false;
+
+// ZDTOptions::congestion_algorithm, on both ends; the extra congestion rows
+ZDTCongestionAlgorithm g_congestion = ZDTCongestionAlgorithm::Delay;
+
+// ZDTOptions::fec_channels covering the stream channel, on both ends; the
+// extra stream row
+bool g_fec = false;
+
+// ZDTOptions::datagram_encryption, on both ends; the extra 64B row
+bool g_seal = false;
+
+// CompressionType::ZstandardStream instead of the profile's compression; the
+// extra TCP row per workload
+bool g_stream = false;
+
+// ZDTOptions::bundle_messages on the sending side; the extra ZDT 64B row
+bool g_bundle = false;
+
+// distinct payloads a throughput run cycles through, at least twice the
+// stream's 128 KiB window between repeats of one, so compression that
+// remembers earlier messages is not handed exact copies
+size_t PayloadVariety(size_t payload_bytes) {
+  const size_t span = 256 * 1024;
+  return std::max<size_t>(16, span / std::max<size_t>(payload_bytes, 1));
+}
+
 std::string LibraryName() {
-  return std::string("znet") + g_profile.suffix;
+  return std::string("znet") + g_profile.suffix + (g_offload ? "+gso" : "") +
+         (g_congestion == ZDTCongestionAlgorithm::Bbr ? "+bbr" : "") +
+         (g_fec ? "+fec" : "") + (g_seal ? "+seal" : "") +
+         (g_stream ? "+zstream" : "") + (g_bundle ? "+bundle" : "");
 }
 
 // znet's TCP framing keeps a whole message in one buffer; ZDT fragments.
@@ -161,6 +216,7 @@ bench::Impairment g_impair;
 enum class ServerRole {
   Sink,        // count it; the throughput case
   Echo,        // bounce it back; the latency case
+  Stream,      // bounce it back on the stream channel
   Congestion,  // echo probes, count the rest
 };
 
@@ -176,6 +232,7 @@ struct Harnessed {
   size_t probe_bytes = 0;
   std::atomic_uint32_t* server_received = nullptr;
   std::atomic_uint32_t* client_replies = nullptr;
+  StreamLog* stream_log = nullptr;
 };
 
 // Brings up a loopback server/client pair and blocks until the session is live.
@@ -184,8 +241,15 @@ bool Connect(Harnessed& h, ConnectionType type, PortNumber port,
   ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(10), type};
   // Only the server configures these; the client adopts what it announces.
   server_config.child_options.common.encryption = g_profile.encryption;
-  server_config.child_options.common.compression = g_profile.compression;
+  server_config.child_options.common.compression =
+      g_stream ? CompressionType::ZstandardStream : g_profile.compression;
   bench::ApplyBenchQueueBounds(server_config.child_options);
+  server_config.child_options.zdt.segmentation_offload = g_offload;
+  server_config.child_options.zdt.congestion_algorithm = g_congestion;
+  server_config.child_options.zdt.datagram_encryption = g_seal;
+  if (g_fec) {
+    server_config.child_options.zdt.fec_channels = {kStreamChannel};
+  }
   h.server = std::make_unique<Server>(server_config);
   h.server->SetEventCallback([&h](Event& event) {
     EventDispatcher dispatcher{event};
@@ -197,6 +261,10 @@ bool Connect(Harnessed& h, ConnectionType type, PortNumber port,
               ev.session()->SetHandler(
                   std::make_shared<EchoHandler>(ev.session()));
               break;
+            case ServerRole::Stream:
+              ev.session()->SetHandler(
+                  std::make_shared<EchoHandler>(ev.session(), kStreamOptions));
+              break;
             case ServerRole::Congestion:
               ev.session()->SetHandler(std::make_shared<CongestionHandler>(
                   ev.session(), h.probe_bytes, h.server_received));
@@ -218,6 +286,13 @@ bool Connect(Harnessed& h, ConnectionType type, PortNumber port,
   ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(10), type};
   // the sending side, so its queue bounds matter most
   bench::ApplyBenchQueueBounds(client_config.options);
+  client_config.options.zdt.segmentation_offload = g_offload;
+  client_config.options.zdt.congestion_algorithm = g_congestion;
+  client_config.options.zdt.datagram_encryption = g_seal;
+  client_config.options.zdt.bundle_messages = g_bundle;
+  if (g_fec) {
+    client_config.options.zdt.fec_channels = {kStreamChannel};
+  }
   h.client = std::make_unique<Client>(client_config);
   h.client->SetEventCallback([&h](Event& event) {
     EventDispatcher dispatcher{event};
@@ -225,7 +300,7 @@ bool Connect(Harnessed& h, ConnectionType type, PortNumber port,
         [&h](ClientConnectedToServerEvent& ev) {
           ev.session()->SetCodec(MakeCodec());
           ev.session()->SetHandler(
-              std::make_shared<ReplyHandler>(h.client_replies));
+              std::make_shared<ReplyHandler>(h.client_replies, h.stream_log));
           h.client_session = ev.session();
           h.ready = true;
           return false;
@@ -280,27 +355,53 @@ void MaybePrintMetrics(const Harnessed& h, ConnectionType type,
     return;
   }
   SessionMetrics m = h.client_session->metrics();
-  std::printf("%-10s %-6s metrics    %-6s  mtu %5u  cwnd %5u  dgram_tx %8llu  "
-              "rtx %6llu  tlp %5llu  nak_rx %5llu  in_drop %5llu  "
-              "reasm_drop %5llu  srtt %6u us  rtt_min %6u us  rto %7u us\n",
+  std::printf("%-10s %-6s metrics    %-6s  mtu %5u  cwnd %5u  pace %7u/s  "
+              "dgram_tx %8llu  rtx %6llu  tlp %5llu  nak_rx %5llu  "
+              "fec_tx %5llu  fec_rec %5llu  "
+              "in_drop %5llu  reasm_drop %5llu  srtt %6u us  rtt_min %6u us  "
+              "rto %7u us\n",
               LibraryName().c_str(), TransportName(type), case_name,
-              m.zdt.mtu, m.zdt.cwnd,
+              m.zdt.mtu, m.zdt.cwnd, m.zdt.pacing_rate,
               static_cast<unsigned long long>(m.zdt.datagrams_sent),
               static_cast<unsigned long long>(m.zdt.retransmits),
               static_cast<unsigned long long>(m.zdt.tail_probes),
               static_cast<unsigned long long>(m.zdt.naks_received),
+              static_cast<unsigned long long>(m.zdt.fec_parity_sent),
+              static_cast<unsigned long long>(m.zdt.fec_recovered),
               static_cast<unsigned long long>(m.zdt.inbound_dropped),
               static_cast<unsigned long long>(m.zdt.reassemblies_dropped),
               m.zdt.srtt_us, m.zdt.rtt_min_us, m.zdt.rto_us);
 }
 
+// What compression made of the run: payload against wire bytes per message,
+// from the client's counters. Printed once per row, for the last rep.
+void PrintCompressionRatio(const Harnessed& h, ConnectionType type,
+                           const bench::Workload& w) {
+  if (!h.client_session ||
+      (!g_stream && g_profile.compression == CompressionType::None)) {
+    return;
+  }
+  SessionMetrics m = h.client_session->metrics();
+  if (m.common.messages_sent == 0 || m.common.message_bytes_sent == 0) {
+    return;
+  }
+  const double messages = static_cast<double>(m.common.messages_sent);
+  const double payload = m.common.payload_bytes_sent / messages;
+  const double wire = m.common.message_bytes_sent / messages;
+  std::printf("%-10s %-6s ratio      %-6s  payload %8.1f B  wire %8.1f B  "
+              "%.2fx\n",
+              LibraryName().c_str(), TransportName(type), w.name, payload, wire,
+              payload / wire);
+}
+
 void RunThroughput(ConnectionType type, const bench::Workload& w) {
   if (type == ConnectionType::TCP && !TCPCanCarry(w.payload_bytes)) {
     std::printf("%-10s %-6s throughput %-6s  unsupported (exceeds ZNET_MAX_BUFFER_SIZE framing)\n",
                 LibraryName().c_str(), TransportName(type), w.name);
     return;
   }
-  const std::string payload = bench::MakePayload(w.payload_bytes);
+  const std::vector<std::string> payloads =
+      bench::MakePayloads(w.payload_bytes, PayloadVariety(w.payload_bytes));
   std::vector<bench::LoopResult> reps;
   for (int rep = 0; rep < bench::Reps(); rep++) {
     std::atomic_uint32_t received{0};
@@ -327,7 +428,7 @@ void RunThroughput(ConnectionType type, const bench::Workload& w) {
           }
           auto packet = std::make_shared<BenchPacket>();
           packet->seq = seq;
-          packet->payload = payload;
+          packet->payload = payloads[seq % payloads.size()];
           // refusal is the backpressure signal the loop drains on
           if (h.client_session->SendPacket(packet) != Result::Success) {
             return false;
@@ -344,6 +445,9 @@ void RunThroughput(ConnectionType type, const bench::Workload& w) {
         },
         bench::ThroughputWarmup(g_impair)));
     MaybePrintMetrics(h, type, w.name);
+    if (rep + 1 == bench::Reps()) {
+      PrintCompressionRatio(h, type, w);
+    }
     Teardown(h);
   }
   bench::ReportThroughput(LibraryName().c_str(), TransportName(type), w, reps);
@@ -395,6 +499,66 @@ void RunLatency(ConnectionType type, const bench::Workload& w) {
                        rep_samples);
 }
 
+// A 64 B message every 2 ms on the stream channel, each echoed, for as long as
+// the workload's count takes whatever the link's delay. Unlike the ping-pong a
+// lost message is followed by more, so the loss is noticed by a NAK or rebuilt
+// from parity rather than waited out. ZDT only, for the +fec pair; the rtt
+// column counts echoes that came back.
+void RunStream(const bench::Workload& w) {
+  constexpr auto kInterval = std::chrono::milliseconds(2);
+  constexpr auto kDrainTimeout = std::chrono::seconds(5);
+  const std::string payload = bench::MakePayload(w.payload_bytes);
+  std::vector<std::vector<double>> rep_samples;
+  for (int rep = 0; rep < bench::Reps(); rep++) {
+    std::atomic_uint32_t received{0};
+    std::atomic_uint32_t replies{0};
+    StreamLog log;
+    bench::Clock::duration connect_time{};
+    Harnessed h;
+    h.role = ServerRole::Stream;
+    h.server_received = &received;
+    h.client_replies = &replies;
+    h.stream_log = &log;
+    if (!ConnectWithRetry(h, ConnectionType::ZDT, &connect_time)) {
+      std::printf("%-10s %-6s latency    %-6s  FAILED to connect\n",
+                  LibraryName().c_str(), "ZDT", w.name);
+      Teardown(h);
+      continue;
+    }
+
+    std::vector<bench::Clock::time_point> sent_at(w.messages);
+    auto next = bench::Clock::now();
+    for (uint32_t seq = 0; seq < w.messages && h.client_session->IsAlive();
+         seq++) {
+      std::this_thread::sleep_until(next);
+      next += kInterval;
+      auto packet = std::make_shared<BenchPacket>();
+      packet->seq = seq;
+      packet->payload = payload;
+      sent_at[seq] = bench::Clock::now();
+      h.client_session->SendPacket(packet, kStreamOptions);
+    }
+    const auto deadline = bench::Clock::now() + kDrainTimeout;
+    while (replies.load() < w.messages && bench::Clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    MaybePrintMetrics(h, ConnectionType::ZDT, w.name);
+    Teardown(h);
+
+    std::vector<double> samples;
+    std::lock_guard<std::mutex> lock(log.mutex);
+    for (const auto& arrival : log.arrivals) {
+      if (arrival.first < sent_at.size()) {
+        samples.push_back(std::chrono::duration<double, std::micro>(
+                              arrival.second - sent_at[arrival.first])
+                              .count());
+      }
+    }
+    rep_samples.push_back(std::move(samples));
+  }
+  bench::ReportLatency(LibraryName().c_str(), "ZDT", w, rep_samples);
+}
+
 void RunCongestion(ConnectionType type, const bench::CongestionCase& c) {
   if (type == ConnectionType::TCP && !TCPCanCarry(c.bulk_bytes)) {
     std::printf("%-10s %-6s congestion %-6s  unsupported (exceeds ZNET_MAX_BUFFER_SIZE framing)\n",
@@ -445,7 +609,8 @@ void RunCongestion(ConnectionType type, const bench::CongestionCase& c) {
           auto packet = std::make_shared<BenchPacket>();
           packet->seq = seq;
           packet->payload = probe_payload;
-          return h.client_session->SendPacket(packet, kProbeOptions);
+          return h.client_session->SendPacket(packet, kProbeOptions) ==
+                 Result::Success;
         },
         [&]() {
           bench::PumpCounts counts;
@@ -510,9 +675,47 @@ int main() {
           continue;
         }
         RunThroughput(type, w);
+        // bulk full-MTU datagrams are what the offload is for, so the 8KB
+        // case runs again with it on; the row beside it is the difference
+        if (type == ConnectionType::ZDT && std::string(w.name) == "8KB") {
+          g_offload = true;
+          RunThroughput(type, w);
+          g_offload = false;
+        }
+        // small messages are where the per-message nonce and tag weigh most,
+        // so on an encrypted profile 64B runs again with whole datagrams
+        // sealed instead
+        if (type == ConnectionType::ZDT && profile.encryption &&
+            std::string(w.name) == "64B") {
+          g_seal = true;
+          RunThroughput(type, w);
+          g_seal = false;
+        }
+        // and with queued messages bundled into one before they are
+        // encrypted, which TCP does by default
+        if (type == ConnectionType::ZDT && std::string(w.name) == "64B") {
+          g_bundle = true;
+          RunThroughput(type, w);
+          g_bundle = false;
+        }
+        // one compression context for the life of the connection, so
+        // structure repeated across messages compresses too; TCP only
+        if (type == ConnectionType::TCP && profile.encryption) {
+          g_stream = true;
+          RunThroughput(type, w);
+          g_stream = false;
+        }
       }
       if (!skip_latency) {
         RunLatency(type, bench::ImpairedLatencyWorkload(g_impair));
+        // and the stream, with and without parity on its channel
+        if (type == ConnectionType::ZDT) {
+          const bench::Workload stream{"64B stream", 64, 2000};
+          RunStream(stream);
+          g_fec = true;
+          RunStream(stream);
+          g_fec = false;
+        }
       }
       if (!skip_congestion) {
         for (const auto& c : bench::DefaultCongestionCases()) {
@@ -520,6 +723,13 @@ int main() {
             continue;
           }
           RunCongestion(type, c);
+          // and again under the model-based controller, so each case has
+          // both controllers' rows side by side
+          if (type == ConnectionType::ZDT) {
+            g_congestion = ZDTCongestionAlgorithm::Bbr;
+            RunCongestion(type, c);
+            g_congestion = ZDTCongestionAlgorithm::Delay;
+          }
         }
       }
     }
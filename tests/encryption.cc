@@ -281,3 +281,121 @@ TEST(SessionExport, RejectsOutOfRangeRequests) {
       pair.client->ExportKeyingMaterial("auth v1", huge.data(), huge.size()),
       Result::InvalidArgument);
 }
+
+// --- Cipher suites ------------------------------------------------------------
+
+namespace {
+
+SessionOptions WithSuites(std::vector<CipherSuite> suites) {
+  SessionOptions options;
+  options.common.cipher_suites = std::move(suites);
+  return options;
+}
+
+}  // namespace
+
+TEST(CipherSuites, ServerOrderDecidesUnlessSomeoneWantsChaCha) {
+  const CipherSuite aes256 = CipherSuite::Aes256Gcm;
+  const CipherSuite aes128 = CipherSuite::Aes128Gcm;
+  const CipherSuite chacha = CipherSuite::ChaCha20Poly1305;
+  CipherSuite out = CipherSuite::None;
+
+  ASSERT_TRUE(SelectCipherSuite({aes128, aes256}, {aes256, aes128}, out));
+  EXPECT_EQ(out, aes128) << "between two AES machines the server's order wins";
+
+  if (IsCipherSuiteAvailable(chacha)) {
+    // a client without AES instructions leads with ChaCha20-Poly1305, and the
+    // server decrypting it on AES hardware costs less than the client would
+    ASSERT_TRUE(SelectCipherSuite({aes256, aes128, chacha},
+                                  {chacha, aes128, aes256}, out));
+    EXPECT_EQ(out, chacha);
+    ASSERT_TRUE(SelectCipherSuite({chacha, aes256}, {aes256, chacha}, out));
+    EXPECT_EQ(out, chacha);
+    // but never one the other end left off
+    ASSERT_TRUE(SelectCipherSuite({aes256}, {chacha, aes256}, out));
+    EXPECT_EQ(out, aes256);
+  }
+
+  out = CipherSuite::None;
+  EXPECT_FALSE(SelectCipherSuite({aes256}, {aes128}, out));
+  EXPECT_EQ(out, CipherSuite::None) << "untouched on failure";
+  EXPECT_FALSE(SelectCipherSuite({aes256}, {}, out));
+}
+
+TEST(CipherSuites, DefaultsFollowTheCpu) {
+  const std::vector<CipherSuite> defaults = DefaultCipherSuites();
+  ASSERT_FALSE(defaults.empty());
+  if (HasHardwareAes()) {
+    EXPECT_EQ(defaults.front(), CipherSuite::Aes256Gcm);
+  } else if (IsCipherSuiteAvailable(CipherSuite::ChaCha20Poly1305)) {
+    EXPECT_EQ(defaults.front(), CipherSuite::ChaCha20Poly1305);
+  }
+}
+
+// Each suite carries a session end to end, under its own mode byte, and both
+// ends report the one they agreed on.
+TEST(CipherSuites, EverySuiteRoundTrips) {
+  ASSERT_EQ(Init(), Result::Success);
+  std::vector<uint8_t> modes;
+  for (CipherSuite suite : {CipherSuite::Aes256Gcm, CipherSuite::Aes128Gcm,
+                            CipherSuite::ChaCha20Poly1305}) {
+    if (!IsCipherSuiteAvailable(suite)) {
+      continue;
+    }
+    SCOPED_TRACE(GetCipherSuiteString(suite));
+    Pair pair(true, WithSuites({suite}));
+    ASSERT_TRUE(pair.Handshake());
+    EXPECT_EQ(pair.client->cipher_suite(), suite);
+    EXPECT_EQ(pair.server->cipher_suite(), suite);
+
+    for (uint32_t i = 0; i < 5; i++) {
+      FakeTransport::Frame frame = pair.Emit(i, 0);
+      if (i == 0) {
+        modes.push_back(
+            static_cast<uint8_t>(frame.buffer->read_cursor_data()[0]));
+      }
+      pair.Deliver(frame);
+    }
+    ASSERT_EQ(pair.server_got.size(), 5u);
+    for (uint32_t i = 0; i < 5; i++) {
+      EXPECT_EQ(pair.server_got[i], i);
+    }
+  }
+  std::sort(modes.begin(), modes.end());
+  EXPECT_EQ(std::unique(modes.begin(), modes.end()), modes.end())
+      << "each suite needs a mode byte of its own";
+}
+
+// The mode byte is associated data, so relabeling a message as another suite's
+// fails rather than being decrypted under the wrong cipher.
+TEST(CipherSuites, MessageRelabeledAsAnotherSuiteIsRefused) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(true, WithSuites({CipherSuite::Aes128Gcm}));
+  ASSERT_TRUE(pair.Handshake());
+  FakeTransport::Frame aes128 = pair.Emit(1, 0);
+  FakeTransport::Frame relabeled = Pair::Snapshot(aes128);
+  char* bytes = const_cast<char*>(relabeled.buffer->read_cursor_data());
+  bytes[0] = 2;  // AES-256-GCM's mode
+
+  pair.Deliver(relabeled);
+  EXPECT_TRUE(pair.server_got.empty());
+  pair.Deliver(aes128);
+  EXPECT_EQ(pair.server_got.size(), 1u) << "the original still opens";
+}
+
+TEST(CipherSuites, NothingInCommonClosesTheSession) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(true, WithSuites({CipherSuite::Aes128Gcm}),
+            WithSuites({CipherSuite::Aes256Gcm}));
+  EXPECT_FALSE(pair.Handshake());
+  EXPECT_TRUE(pair.server_wire->closed);
+  EXPECT_EQ(pair.client->cipher_suite(), CipherSuite::None);
+}
+
+TEST(CipherSuites, UnencryptedSessionReportsNone) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/false);
+  ASSERT_TRUE(pair.Handshake());
+  EXPECT_EQ(pair.client->cipher_suite(), CipherSuite::None);
+  EXPECT_EQ(pair.server->cipher_suite(), CipherSuite::None);
+}
@@ -25,6 +25,7 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <vector>
@@ -52,6 +53,10 @@ class FakeTransport : public TransportLayer {
     return buffer;
   }
   bool Send(std::shared_ptr<Buffer> buffer, SendOptions options = {}) override {
+    if (refuse_sends || (max_message_size != 0 &&
+                         buffer->readable_bytes() > max_message_size)) {
+      return false;
+    }
     sent.push_back(Frame{std::move(buffer), OrderingDomain(options)});
     return true;
   }
@@ -67,10 +72,23 @@ class FakeTransport : public TransportLayer {
   bool IsClosed() const override { return closed; }
   void Update() override {}
   void Flush() override {}
+  // no timers of its own, so whatever the session reports is the session's
+  std::chrono::steady_clock::time_point NextDeadline() const override {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  size_t BundleBudget() const override { return bundle_budget; }
+  size_t MaxMessageSize() const override { return max_message_size; }
 
   std::vector<Frame> sent;
   std::deque<std::shared_ptr<Buffer>> inbox;
   bool closed = false;
+  // off unless a test turns it on, so every other test sees one message per
+  // packet
+  size_t bundle_budget = 0;
+  // a session reads this at Ready(), so a test sets it before the handshake
+  size_t max_message_size = 0;
+  // fails every Send() from here on, as a transport that has given up would
+  bool refuse_sends = false;
 };
 
 enum TestPacketType : PacketId { kPacketProbe = 1 };
@@ -123,17 +141,32 @@ struct Pair {
   std::vector<uint32_t> server_got;
 
   // `base` carries any further per-session options a test wants to exercise;
-  // encryption and compression are pinned here because most tests assume them
+  // encryption and compression are pinned here because most tests assume them.
+  // Compression is left alone when a test names one explicitly.
   explicit Pair(bool encryption = true,
-                const SessionOptions& base = SessionOptions()) {
+                const SessionOptions& base = SessionOptions())
+      : Pair(encryption, base, base) {}
+
+  // for the options that are read on both ends, and a test wants to differ;
+  // `type` is what the sessions believe they run over, for the few decisions
+  // that depend on it
+  Pair(bool encryption, const SessionOptions& client_base,
+       const SessionOptions& server_base,
+       ConnectionType type = ConnectionType::ZDT) {
     auto client_transport = std::unique_ptr<FakeTransport>(new FakeTransport());
     auto server_transport = std::unique_ptr<FakeTransport>(new FakeTransport());
     client_wire = client_transport.get();
     server_wire = server_transport.get();
 
-    SessionOptions options = base;
-    options.common.encryption = encryption;
-    options.common.compression = CompressionType::None;
+    SessionOptions client_options = client_base;
+    client_options.common.encryption = encryption;
+    SessionOptions server_options = server_base;
+    server_options.common.encryption = encryption;
+    for (SessionOptions* options : {&client_options, &server_options}) {
+      if (options->common.compression == CompressionType::Default) {
+        options->common.compression = CompressionType::None;
+      }
+    }
 
     std::shared_ptr<InetAddress> client_addr =
         InetAddress::from("127.0.0.1", 1000);
@@ -141,12 +174,12 @@ struct Pair {
         InetAddress::from("127.0.0.1", 2000);
     client.reset(new PeerSession(client_addr, server_addr,
                                  std::move(client_transport),
-                                 ConnectionType::ZDT, /*is_initiator=*/true,
-                                 /*self_managed=*/false, options));
+                                 type, /*is_initiator=*/true,
+                                 /*self_managed=*/false, client_options));
     server.reset(new PeerSession(server_addr, client_addr,
                                  std::move(server_transport),
-                                 ConnectionType::ZDT, /*is_initiator=*/false,
-                                 /*self_managed=*/false, options));
+                                 type, /*is_initiator=*/false,
+                                 /*self_managed=*/false, server_options));
   }
 
   // Moves every parked frame across and lets both ends process it.
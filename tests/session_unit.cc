@@ -22,16 +22,24 @@
 
 #include "znet/codec.h"
 #include "znet/init.h"
+#include "znet/message_pipeline.h"
 #include "znet/mpsc_queue.h"
 #include "znet/outbound_queue.h"
 #include "znet/packet_serializer.h"
+#include "znet/session_groups.h"
+#include "znet/spsc_queue.h"
+#include "znet/worker_signal.h"
 
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <memory>
 #include <set>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 using namespace znet;
@@ -154,6 +162,71 @@ TEST(MpscQueueTest, ManyProducersLoseNothing) {
   EXPECT_EQ(seen.size(), static_cast<size_t>(kThreads * kPer));
 }
 
+// --- SpscQueue ----------------------------------------------------------------
+
+TEST(SpscQueueTest, PreservesOrderAcrossBlocks) {
+  SpscQueue<int> q(/*limit=*/100, /*block_size=*/4);
+  for (int round = 0; round < 3; round++) {
+    // more than a block at a time, and a different amount each round, so the
+    // block boundaries fall in different places
+    const int count = 10 + round * 7;
+    for (int i = 0; i < count; i++) {
+      ASSERT_TRUE(q.Push(round * 100 + i));
+    }
+    EXPECT_EQ(q.size(), static_cast<size_t>(count));
+    std::vector<int> out;
+    EXPECT_EQ(q.DrainTo(out), static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) {
+      EXPECT_EQ(out[static_cast<size_t>(i)], round * 100 + i);
+    }
+    EXPECT_TRUE(q.Empty());
+  }
+}
+
+TEST(SpscQueueTest, RefusesAtTheLimitAndLeavesTheValueAlone) {
+  SpscQueue<std::shared_ptr<int>> q(/*limit=*/3, /*block_size=*/2);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(q.Push(std::make_shared<int>(i)));
+  }
+  auto refused = std::make_shared<int>(99);
+  EXPECT_FALSE(q.Push(std::move(refused)))
+      << "the limit is exact, not rounded to a block";
+  ASSERT_TRUE(refused) << "a refused value stays with the caller";
+
+  std::shared_ptr<int> out;
+  ASSERT_TRUE(q.Pop(out));
+  EXPECT_EQ(*out, 0);
+  EXPECT_TRUE(q.Push(std::move(refused))) << "one taken, one accepted";
+}
+
+TEST(SpscQueueTest, OneProducerLosesAndReordersNothing) {
+  constexpr int kCount = 200000;
+  // small blocks and a small limit, so the producer is forever crossing into
+  // blocks the consumer has only just left
+  SpscQueue<int> q(/*limit=*/64, /*block_size=*/8);
+  std::thread producer([&] {
+    for (int i = 0; i < kCount; i++) {
+      int value = i;
+      while (!q.Push(std::move(value))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  int expected = 0;
+  while (expected < kCount) {
+    int v = -1;
+    if (q.Pop(v)) {
+      // EXPECT, not ASSERT: returning would leave the producer unjoined
+      EXPECT_EQ(v, expected);
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(q.Empty());
+}
+
 // --- OutboundQueue ------------------------------------------------------------
 
 namespace {
@@ -236,6 +309,29 @@ TEST(OutboundQueueTest, ClaimIsExclusiveAndNonBlocking) {
   EXPECT_FALSE(reentered_ran) << "and must not encode anything";
 }
 
+// A drain that bundles still holds packets when the queue runs dry, and has to
+// send them before another thread can take the claim and encode ahead of them.
+TEST(OutboundQueueTest, FinishRunsAfterTheLastItemWithTheClaimHeld) {
+  OutboundQueue q(16);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(q.Push(AnyPacket(), {}));
+  }
+  int seen = 0;
+  int seen_at_finish = -1;
+  bool claim_held = false;
+  q.Drain([&](OutboundQueue::Item&) { seen++; return true; },
+          [&] {
+            seen_at_finish = seen;
+            claim_held = !q.Drain([](OutboundQueue::Item&) { return true; });
+          });
+  EXPECT_EQ(seen_at_finish, 3);
+  EXPECT_TRUE(claim_held);
+
+  bool finished = false;
+  q.Drain([](OutboundQueue::Item&) { return true; }, [&] { finished = true; });
+  EXPECT_TRUE(finished) << "an empty queue still finishes the drain it won";
+}
+
 // --- the policy that fixed the bimodal throughput -----------------------------
 
 TEST(OutboundQueuePolicyTest, WithoutAnEncoderTheWorkerAlwaysEncodes) {
@@ -552,6 +648,175 @@ TEST(CodecDecodeTest, DumpWritesTheEvidenceToTheLog) {
       << "the dump names itself so it can be found in a log";
 }
 
+// --- Dense dispatch -----------------------------------------------------------
+
+namespace {
+
+class DenseCollector
+    : public DensePacketHandler<DenseCollector,
+                                PacketRoute<7, TinyPacket, GoodSerializer>,
+                                PacketRoute<8, OtherPacket, OtherSerializer>> {
+ public:
+  void OnPacket(const TinyPacket& packet) { tiny.push_back(packet.value); }
+  void OnPacket(std::shared_ptr<OtherPacket> packet) {
+    other.push_back(packet->value);
+  }
+  std::vector<uint32_t> tiny;
+  std::vector<uint32_t> other;
+};
+
+class FailingDenseCollector
+    : public DensePacketHandler<FailingDenseCollector,
+                                PacketRoute<7, TinyPacket, OverreadingSerializer>,
+                                PacketRoute<8, OtherPacket, OtherSerializer>> {
+ public:
+  void OnPacket(const OtherPacket& packet) { other.push_back(packet.value); }
+  std::vector<uint32_t> other;
+};
+
+// routes one id and counts what reaches Handle() from the codec instead
+class DensePacketHandlerProbe
+    : public DensePacketHandler<DensePacketHandlerProbe,
+                                PacketRoute<7, TinyPacket, GoodSerializer>> {
+ public:
+  void Handle(std::shared_ptr<Packet> packet) override {
+    handled++;
+    DensePacketHandler::Handle(std::move(packet));
+  }
+  void OnPacket(const TinyPacket&) { tiny++; }
+  int tiny = 0;
+  int handled = 0;
+};
+
+// decodes in place, which puts its routes on the pooled path
+class InPlaceSerializer : public GoodSerializer {
+ public:
+  bool DeserializeInto(Buffer& buffer, TinyPacket& packet) {
+    packet.value = buffer.ReadInt<uint32_t>();
+    return true;
+  }
+};
+
+class PooledCollector
+    : public DensePacketHandler<PooledCollector,
+                                PacketRoute<7, TinyPacket, InPlaceSerializer>> {
+ public:
+  void OnPacket(const TinyPacket& packet) {
+    seen.push_back(&packet);
+    values.push_back(packet.value);
+  }
+  std::vector<const TinyPacket*> seen;
+  std::vector<uint32_t> values;
+};
+
+class KeepingCollector
+    : public DensePacketHandler<KeepingCollector,
+                                PacketRoute<7, TinyPacket, InPlaceSerializer>> {
+ public:
+  void OnPacket(std::shared_ptr<TinyPacket> packet) {
+    kept.push_back(std::move(packet));
+  }
+  std::vector<std::shared_ptr<TinyPacket>> kept;
+};
+
+std::shared_ptr<Buffer> TinyFrame(uint32_t value) {
+  Codec codec;
+  codec.Add(7, std::make_unique<GoodSerializer>());
+  auto packet = std::make_shared<TinyPacket>();
+  packet->value = value;
+  return codec.Serialize(packet, 0);
+}
+
+// claims TinyPacket's id without being one
+class ImpostorPacket : public Packet {
+ public:
+  ImpostorPacket() : Packet(7) {}
+};
+
+}  // namespace
+
+TEST(DenseDispatchTest, DecodesThroughItsOwnRoutesWithoutTheCodecs) {
+  static_assert(DenseCollector::kTableSize == 9, "a slot per id up to 8");
+  Codec codec;  // nothing registered: the routes carry their serializers
+  DenseCollector handler;
+
+  DecodeStats stats = codec.Deserialize(
+      Concat({TinyFrame(), OtherFrame(), TinyFrame()}), handler);
+  EXPECT_EQ(handler.tiny, (std::vector<uint32_t>{0xABCD1234u, 0xABCD1234u}));
+  EXPECT_EQ(handler.other, (std::vector<uint32_t>{0x11223344u}));
+  EXPECT_EQ(stats.invalid_frames, 0u);
+  EXPECT_FALSE(stats.framing_lost);
+}
+
+TEST(DenseDispatchTest, UnroutedIdsStillGoThroughTheCodec) {
+  Codec codec;
+  codec.Add(8, std::make_unique<OtherSerializer>());
+  DensePacketHandlerProbe handler;  // routes 7 only
+
+  DecodeStats stats =
+      codec.Deserialize(Concat({TinyFrame(), OtherFrame()}), handler);
+  EXPECT_EQ(handler.tiny, 1);
+  EXPECT_EQ(handler.handled, 1) << "8 was decoded by the codec's serializer";
+  EXPECT_EQ(stats.invalid_frames, 0u);
+}
+
+TEST(DenseDispatchTest, BadFramesCountAsTheyDoThroughTheCodec) {
+  Codec codec;
+  FailingDenseCollector handler;
+
+  DecodeStats stats =
+      codec.Deserialize(Concat({OtherFrame(), TinyFrame(), OtherFrame()}),
+                        handler);
+  EXPECT_EQ(handler.other.size(), 1u) << "nothing after the overrun";
+  EXPECT_EQ(stats.invalid_frames, 1u);
+  EXPECT_TRUE(stats.framing_lost);
+}
+
+TEST(DenseDispatchTest, HandleRoutesByIdButChecksTheType) {
+  DenseCollector handler;
+  handler.Handle(std::make_shared<TinyPacket>());
+  handler.Handle(std::make_shared<ImpostorPacket>());
+  EXPECT_EQ(handler.tiny.size(), 1u) << "the impostor was dropped";
+}
+
+TEST(DenseDispatchTest, DecodesInPlaceIntoOnePacketPerThread) {
+  Codec codec;
+  PooledCollector handler;
+  codec.Deserialize(Concat({TinyFrame(1), TinyFrame(2), TinyFrame(3)}),
+                    handler);
+  EXPECT_EQ(handler.values, (std::vector<uint32_t>{1, 2, 3}));
+  ASSERT_EQ(handler.seen.size(), 3u);
+  EXPECT_EQ(handler.seen[0], handler.seen[1]) << "the packet was reused";
+  EXPECT_EQ(handler.seen[1], handler.seen[2]);
+  // the allocator hands a freed block straight back, so equal addresses alone
+  // would not tell reuse from a free and a fresh allocation
+  EXPECT_EQ(detail::PooledPacket<TinyPacket>().get(), handler.seen[0])
+      << "and it stayed in the pool between frames";
+}
+
+TEST(DenseDispatchTest, APacketAHandlerKeepsIsNotReused) {
+  Codec codec;
+  KeepingCollector handler;
+  codec.Deserialize(Concat({TinyFrame(1), TinyFrame(2), TinyFrame(3)}),
+                    handler);
+  ASSERT_EQ(handler.kept.size(), 3u);
+  EXPECT_NE(handler.kept[0], handler.kept[1]);
+  EXPECT_NE(handler.kept[1], handler.kept[2]);
+  EXPECT_EQ(handler.kept[0]->value, 1u) << "not overwritten by a later frame";
+  EXPECT_EQ(handler.kept[2]->value, 3u);
+}
+
+TEST(DenseDispatchTest, RegistersItsSerializersForSending) {
+  Codec codec;
+  DenseCollector::RegisterSerializers(codec);
+  auto frame = codec.Serialize(std::make_shared<OtherPacket>(), 0);
+  ASSERT_TRUE(frame);
+
+  DenseCollector handler;
+  codec.Deserialize(frame, handler);
+  EXPECT_EQ(handler.other, (std::vector<uint32_t>{0x11223344u}));
+}
+
 // --- Invalid-frame threshold over a session -----------------------------------
 
 namespace {
@@ -658,3 +923,886 @@ TEST(ByteMetrics, WireBytesAreCountedWithoutACodec) {
   EXPECT_EQ(after.payload_bytes_received, before.payload_bytes_received)
       << "payload bytes only count what reached a handler";
 }
+
+// --- Bundling -----------------------------------------------------------------
+
+namespace {
+
+void Queue(Pair& pair, uint32_t seq, uint8_t channel) {
+  auto packet = std::make_shared<ProbePacket>();
+  packet->seq = seq;
+  ASSERT_EQ(pair.client->SendPacket(packet, SendOptions().Channel(channel)),
+            Result::Success);
+}
+
+void DeliverAll(Pair& pair) {
+  for (auto& frame : pair.client_wire->sent) {
+    pair.Deliver(frame);
+  }
+  pair.client_wire->sent.clear();
+}
+
+}  // namespace
+
+TEST(Bundling, ConsecutivePacketsShareOneMessage) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+  pair.client_wire->bundle_budget = 1000;
+
+  const auto before = pair.client->metrics().common;
+  for (uint32_t i = 0; i < 5; i++) {
+    Queue(pair, i, 0);
+  }
+  EXPECT_TRUE(pair.client->DrainOutbound());
+  ASSERT_EQ(pair.client_wire->sent.size(), 1u)
+      << "one compression header, nonce and tag for all five";
+  DeliverAll(pair);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3, 4}));
+
+  const auto after = pair.client->metrics().common;
+  EXPECT_EQ(after.messages_sent - before.messages_sent, 1u);
+  EXPECT_EQ(after.packets_sent - before.packets_sent, 5u);
+}
+
+TEST(Bundling, WithoutABudgetEachPacketIsItsOwnMessage) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+
+  for (uint32_t i = 0; i < 3; i++) {
+    Queue(pair, i, 0);
+  }
+  pair.client->DrainOutbound();
+  EXPECT_EQ(pair.client_wire->sent.size(), 3u);
+  DeliverAll(pair);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2}));
+}
+
+// A message goes out with one set of options, so a change of channel ends the
+// bundle even when the old channel comes straight back.
+TEST(Bundling, DifferentOptionsStartANewMessage) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+  pair.client_wire->bundle_budget = 1000;
+
+  Queue(pair, 0, 0);
+  Queue(pair, 1, 0);
+  Queue(pair, 2, 1);
+  Queue(pair, 3, 0);
+  pair.client->DrainOutbound();
+  ASSERT_EQ(pair.client_wire->sent.size(), 3u);
+  EXPECT_EQ(pair.client_wire->sent[0].channel, 0u);
+  EXPECT_EQ(pair.client_wire->sent[1].channel, 1u);
+  EXPECT_EQ(pair.client_wire->sent[2].channel, 0u);
+  DeliverAll(pair);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3}));
+}
+
+// The packet that takes a bundle past the budget starts the next one rather
+// than being lost or sent twice.
+TEST(Bundling, TheBudgetSplitsARun) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+  // a probe frame is ten bytes: two of id, four of length, four of body
+  const size_t frame = 10;
+  size_t budget = 64;
+  while (MessagePipeline::PayloadBudget(budget) < 3 * frame) {
+    budget++;
+  }
+  pair.client_wire->bundle_budget = budget;
+
+  for (uint32_t i = 0; i < 7; i++) {
+    Queue(pair, i, 0);
+  }
+  pair.client->DrainOutbound();
+  ASSERT_EQ(pair.client_wire->sent.size(), 3u) << "three, three and one";
+  for (const auto& sent : pair.client_wire->sent) {
+    EXPECT_LE(sent.buffer->readable_bytes(), budget);
+  }
+  DeliverAll(pair);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3, 4, 5, 6}));
+}
+
+// --- Shared messages ----------------------------------------------------------
+
+namespace {
+
+// the probe's wire format, counting how often a packet is serialized
+class CountingSerializer : public ProbeSerializer {
+ public:
+  explicit CountingSerializer(size_t* count) : count_(count) {}
+  std::shared_ptr<Buffer> SerializeTyped(std::shared_ptr<ProbePacket> packet,
+                                         std::shared_ptr<Buffer> buffer) override {
+    (*count_)++;
+    return ProbeSerializer::SerializeTyped(std::move(packet), std::move(buffer));
+  }
+
+ private:
+  size_t* count_;
+};
+
+std::shared_ptr<Codec> MakeCountingCodec(size_t* count) {
+  auto codec = std::make_shared<Codec>();
+  codec->Add(kPacketProbe, std::unique_ptr<PacketSerializerBase>(
+                               new CountingSerializer(count)));
+  return codec;
+}
+
+std::shared_ptr<SharedMessage> MakeShared(uint32_t seq) {
+  auto packet = std::make_shared<ProbePacket>();
+  packet->seq = seq;
+  return std::make_shared<SharedMessage>(packet);
+}
+
+}  // namespace
+
+TEST(SharedMessageTest, SerializedOnceForEveryRecipient) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  std::vector<std::unique_ptr<Pair>> pairs;
+  for (int i = 0; i < 3; i++) {
+    pairs.emplace_back(new Pair(/*encryption=*/true));
+    ASSERT_TRUE(pairs.back()->Handshake());
+    pairs.back()->client->SetCodec(MakeCountingCodec(&serialized));
+  }
+
+  auto message = MakeShared(42);
+  for (auto& pair : pairs) {
+    ASSERT_EQ(pair->client->SendShared(message), Result::Success);
+  }
+  for (auto& pair : pairs) {
+    pair->client->DrainOutbound();
+    ASSERT_EQ(pair->client_wire->sent.size(), 1u);
+    DeliverAll(*pair);
+    EXPECT_EQ(pair->server_got, (std::vector<uint32_t>{42}));
+  }
+  EXPECT_EQ(serialized, 1u);
+}
+
+// A shared message is its own message, so a bundle in progress goes out
+// first and the order of sends holds.
+TEST(SharedMessageTest, OrderedWithSendPacketAndEndsABundle) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+  pair.client_wire->bundle_budget = 1000;
+
+  Queue(pair, 0, 0);
+  Queue(pair, 1, 0);
+  ASSERT_EQ(pair.client->SendShared(MakeShared(2)), Result::Success);
+  Queue(pair, 3, 0);
+  pair.client->DrainOutbound();
+  EXPECT_EQ(pair.client_wire->sent.size(), 3u);
+  DeliverAll(pair);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3}));
+}
+
+TEST(SharedMessageTest, RefusedWithoutAPacketOrBeforeTheHandshake) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  EXPECT_EQ(pair.client->SendShared(MakeShared(1)), Result::NotReady);
+  ASSERT_TRUE(pair.Handshake());
+  EXPECT_EQ(pair.client->SendShared(nullptr), Result::InvalidArgument);
+  EXPECT_EQ(pair.client->SendShared(std::make_shared<SharedMessage>(nullptr)),
+            Result::InvalidArgument);
+}
+
+#ifdef ZNET_USE_ZSTD
+// Sessions that compress differently each get an encoding of their own, and a
+// stream's depends on what it sent before, so it is never shared at all.
+TEST(SharedMessageTest, EncodedOncePerCompressionAndNeverForAStream) {
+  ASSERT_EQ(Init(), Result::Success);
+  SessionOptions zstd;
+  zstd.common.compression = CompressionType::Zstandard;
+  zstd.common.compression_threshold = 0;
+  SessionOptions stream;
+  stream.common.compression = CompressionType::ZstandardStream;
+  stream.common.dictionary_compression_threshold = 0;
+
+  std::vector<std::unique_ptr<Pair>> pairs;
+  pairs.emplace_back(new Pair(/*encryption=*/false));
+  pairs.emplace_back(new Pair(/*encryption=*/false));
+  pairs.emplace_back(new Pair(/*encryption=*/false, zstd));
+  pairs.emplace_back(new Pair(/*encryption=*/false, zstd));
+  pairs.emplace_back(
+      new Pair(/*encryption=*/false, stream, stream, ConnectionType::TCP));
+  pairs.emplace_back(
+      new Pair(/*encryption=*/false, stream, stream, ConnectionType::TCP));
+  size_t serialized = 0;
+  for (auto& pair : pairs) {
+    ASSERT_TRUE(pair->Handshake());
+    pair->client->SetCodec(MakeCountingCodec(&serialized));
+  }
+
+  auto message = MakeShared(7);
+  for (auto& pair : pairs) {
+    ASSERT_EQ(pair->client->SendShared(message), Result::Success);
+    pair->client->DrainOutbound();
+    ASSERT_EQ(pair->client_wire->sent.size(), 1u);
+    DeliverAll(*pair);
+    EXPECT_EQ(pair->server_got, (std::vector<uint32_t>{7}));
+  }
+  EXPECT_EQ(serialized, 4u) << "once uncompressed, once zstd, once per stream";
+}
+#endif
+
+// --- Session groups -----------------------------------------------------------
+
+namespace {
+
+// a worker's table holds its sessions shared; a Pair owns its own
+std::shared_ptr<PeerSession> Borrow(
+    const std::unique_ptr<PeerSession>& session) {
+  return std::shared_ptr<PeerSession>(session.get(), [](PeerSession*) {});
+}
+
+std::vector<std::unique_ptr<Pair>> ReadyPairs(int count, size_t* serialized) {
+  std::vector<std::unique_ptr<Pair>> pairs;
+  for (int i = 0; i < count; i++) {
+    pairs.emplace_back(new Pair(/*encryption=*/true));
+    EXPECT_TRUE(pairs.back()->Handshake());
+    pairs.back()->client->SetCodec(MakeCountingCodec(serialized));
+  }
+  return pairs;
+}
+
+// group operations never look at the worker's own sessions; a broadcast does
+const SessionGroups::SessionMap kNoSessions;
+
+void DrainAndDeliver(std::vector<std::unique_ptr<Pair>>& pairs) {
+  for (auto& pair : pairs) {
+    pair->client->DrainOutbound();
+    DeliverAll(*pair);
+  }
+}
+
+}  // namespace
+
+TEST(SessionGroupsTest, OverlappingGroupsReachTheirMembersOnly) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  auto pairs = ReadyPairs(3, &serialized);
+  SessionGroups groups;
+  groups.PostAdd(1, Borrow(pairs[0]->client));
+  groups.PostAdd(1, Borrow(pairs[1]->client));
+  groups.PostAdd(2, Borrow(pairs[1]->client));
+  groups.PostAdd(2, Borrow(pairs[2]->client));
+  groups.PostSend(1, MakeShared(5), {});
+  groups.PostSend(2, MakeShared(6), {});
+  groups.Apply(kNoSessions);
+  EXPECT_EQ(groups.members(1), 2u);
+  EXPECT_EQ(groups.members(2), 2u);
+
+  DrainAndDeliver(pairs);
+  EXPECT_EQ(pairs[0]->server_got, (std::vector<uint32_t>{5}));
+  EXPECT_EQ(pairs[1]->server_got, (std::vector<uint32_t>{5, 6}));
+  EXPECT_EQ(pairs[2]->server_got, (std::vector<uint32_t>{6}));
+  EXPECT_EQ(serialized, 2u) << "once per group send, not per member";
+}
+
+// Operations run in the order they were posted, however many are waiting,
+// and only the first of a batch asks for the worker to be woken.
+TEST(SessionGroupsTest, PostedOperationsRunInOrder) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  auto pairs = ReadyPairs(1, &serialized);
+  SessionGroups groups;
+  EXPECT_TRUE(groups.PostAdd(1, Borrow(pairs[0]->client)));
+  EXPECT_FALSE(groups.PostSend(1, MakeShared(1), {}));
+  EXPECT_FALSE(groups.PostRemove(1, Borrow(pairs[0]->client)));
+  EXPECT_FALSE(groups.PostSend(1, MakeShared(2), {}));
+  groups.Apply(kNoSessions);
+  EXPECT_TRUE(groups.PostAdd(1, Borrow(pairs[0]->client)));
+  groups.Apply(kNoSessions);
+  // added twice is in it once
+  groups.PostAdd(1, Borrow(pairs[0]->client));
+  groups.PostSend(1, MakeShared(3), {});
+  groups.Apply(kNoSessions);
+
+  DrainAndDeliver(pairs);
+  EXPECT_EQ(pairs[0]->server_got, (std::vector<uint32_t>{1, 3}));
+}
+
+TEST(SessionGroupsTest, ForgetAndDestroyLeaveNothingBehind) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  auto pairs = ReadyPairs(2, &serialized);
+  SessionGroups groups;
+  for (GroupId group : {1u, 2u}) {
+    groups.PostAdd(group, Borrow(pairs[0]->client));
+    groups.PostAdd(group, Borrow(pairs[1]->client));
+  }
+  groups.Apply(kNoSessions);
+  groups.Forget(*pairs[0]->client);
+  EXPECT_EQ(groups.members(1), 1u);
+  EXPECT_EQ(groups.members(2), 1u);
+
+  groups.PostDestroy(1);
+  groups.PostSend(1, MakeShared(1), {});
+  groups.PostSend(2, MakeShared(2), {});
+  groups.Apply(kNoSessions);
+  EXPECT_EQ(groups.members(1), 0u);
+  DrainAndDeliver(pairs);
+  EXPECT_TRUE(pairs[0]->server_got.empty());
+  EXPECT_EQ(pairs[1]->server_got, (std::vector<uint32_t>{2}));
+
+  // destroying took it out of the session's own list too
+  groups.Forget(*pairs[1]->client);
+  EXPECT_EQ(groups.members(2), 0u);
+}
+
+// A member that closed is dropped by the next send rather than kept until its
+// worker gets around to it, and the rest still get theirs.
+TEST(SessionGroupsTest, SendDropsAClosedMember) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  auto pairs = ReadyPairs(3, &serialized);
+  SessionGroups groups;
+  for (auto& pair : pairs) {
+    groups.PostAdd(1, Borrow(pair->client));
+  }
+  groups.Apply(kNoSessions);
+  pairs[0]->client->Close();
+  groups.PostSend(1, MakeShared(9), {});
+  groups.Apply(kNoSessions);
+  EXPECT_EQ(groups.members(1), 2u);
+
+  DrainAndDeliver(pairs);
+  EXPECT_EQ(pairs[1]->server_got, (std::vector<uint32_t>{9}));
+  EXPECT_EQ(pairs[2]->server_got, (std::vector<uint32_t>{9}));
+}
+
+// A broadcast walks the worker's sessions rather than a group, and is ordered
+// with the group sends around it.
+TEST(SessionGroupsTest, BroadcastReachesTheSessionsTheFilterKeeps) {
+  ASSERT_EQ(Init(), Result::Success);
+  size_t serialized = 0;
+  auto pairs = ReadyPairs(3, &serialized);
+  SessionGroups::SessionMap sessions;
+  for (auto& pair : pairs) {
+    sessions[pair->client->remote_address()] = Borrow(pair->client);
+  }
+  SessionGroups groups;
+  groups.PostAdd(1, Borrow(pairs[0]->client));
+  groups.PostSend(1, MakeShared(1), {});
+  PeerSession* skipped = pairs[2]->client.get();
+  groups.PostBroadcast(
+      MakeShared(2),
+      [skipped](PeerSession& session) { return &session != skipped; }, {});
+  groups.PostSend(1, MakeShared(3), {});
+  groups.Apply(sessions);
+
+  DrainAndDeliver(pairs);
+  EXPECT_EQ(pairs[0]->server_got, (std::vector<uint32_t>{1, 2, 3}));
+  EXPECT_EQ(pairs[1]->server_got, (std::vector<uint32_t>{2}));
+  EXPECT_TRUE(pairs[2]->server_got.empty());
+  EXPECT_EQ(serialized, 3u);
+}
+
+// --- Inbound pipeline allocations --------------------------------------------
+
+namespace {
+
+// where each payload handed to the codec lived. The buffer and its storage
+// staying put across messages is what "no allocation" looks like from outside:
+// Buffer::mem_allocations() is compiled in per translation unit, and the
+// library's buffers are not built with it. The weak reference pins the
+// buffer's make_shared block without counting as a holder, so a buffer freed
+// and replaced cannot come back at the same address and pass for the same one.
+struct PayloadSeen {
+  const Buffer* buffer;
+  const char* storage;
+  std::weak_ptr<Buffer> pin;
+};
+
+class LocatingProbeSerializer : public PacketSerializer<ProbePacket> {
+ public:
+  LocatingProbeSerializer(std::vector<PayloadSeen>* seen,
+                          std::vector<std::shared_ptr<Buffer>>* kept)
+      : seen_(seen), kept_(kept) {}
+
+  std::shared_ptr<Buffer> SerializeTyped(std::shared_ptr<ProbePacket> packet,
+                                         std::shared_ptr<Buffer> buffer) override {
+    buffer->WriteInt<uint32_t>(packet->seq);
+    return buffer;
+  }
+  std::shared_ptr<ProbePacket> DeserializeTyped(std::shared_ptr<Buffer> buffer) override {
+    seen_->push_back(PayloadSeen{buffer.get(), buffer->data(), buffer});
+    if (kept_) {
+      kept_->push_back(buffer);
+    }
+    auto packet = std::make_shared<ProbePacket>();
+    packet->seq = buffer->ReadInt<uint32_t>();
+    return packet;
+  }
+
+ private:
+  std::vector<PayloadSeen>* seen_;
+  std::vector<std::shared_ptr<Buffer>>* kept_;
+};
+
+std::shared_ptr<Codec> MakeLocatingCodec(
+    std::vector<PayloadSeen>* seen,
+    std::vector<std::shared_ptr<Buffer>>* kept = nullptr) {
+  auto codec = std::make_shared<Codec>();
+  codec->Add(kPacketProbe,
+             std::make_unique<LocatingProbeSerializer>(seen, kept));
+  return codec;
+}
+
+}  // namespace
+
+TEST(InboundPipeline, DecryptsInsideTheReceivedBuffer) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true);
+  ASSERT_TRUE(pair.Handshake());
+  std::vector<PayloadSeen> seen;
+  pair.server->SetCodec(MakeLocatingCodec(&seen));
+  pair.server->SetHandler(std::make_shared<CollectHandler>(&pair.server_got));
+
+  for (uint32_t i = 0; i < 4; i++) {
+    auto frame = pair.Emit(i, 0);
+    const Buffer* received = frame.buffer.get();
+    const char* storage = frame.buffer->data();
+    pair.Deliver(frame);
+    ASSERT_EQ(seen.size(), i + 1);
+    EXPECT_EQ(seen.back().buffer, received) << "decryption made a new buffer";
+    EXPECT_EQ(seen.back().storage, storage) << "decryption grew the buffer";
+  }
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3}));
+}
+
+#ifdef ZNET_USE_ZSTD
+TEST(InboundPipeline, DecompressesIntoAScratchThatStopsGrowing) {
+  ASSERT_EQ(Init(), Result::Success);
+  SessionOptions base;
+  base.common.compression_threshold = 0;  // the probe is a handful of bytes
+  Pair pair(/*encryption=*/true, base);
+  ASSERT_TRUE(pair.Handshake());
+  pair.client->SetOutCompression(CompressionType::Zstandard);
+  std::vector<PayloadSeen> seen;
+  pair.server->SetCodec(MakeLocatingCodec(&seen));
+  pair.server->SetHandler(std::make_shared<CollectHandler>(&pair.server_got));
+
+  pair.Deliver(pair.Emit(0, 0));  // sizes the scratch
+  ASSERT_EQ(seen.size(), 1u);
+  const Buffer* warm_buffer = seen.back().buffer;
+  const char* warm_storage = seen.back().storage;
+  for (uint32_t i = 1; i < 8; i++) {
+    pair.Deliver(pair.Emit(i, 0));
+    ASSERT_EQ(seen.size(), i + 1);
+    EXPECT_EQ(seen.back().buffer, warm_buffer) << "a new buffer per message";
+    EXPECT_EQ(seen.back().storage, warm_storage) << "the scratch regrew";
+  }
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+// A handler may keep the payload it was given; reusing the scratch then would
+// rewrite bytes it still reads.
+TEST(InboundPipeline, HeldPayloadIsNotReusedAsScratch) {
+  ASSERT_EQ(Init(), Result::Success);
+  SessionOptions base;
+  base.common.compression_threshold = 0;
+  Pair pair(/*encryption=*/true, base);
+  ASSERT_TRUE(pair.Handshake());
+  pair.client->SetOutCompression(CompressionType::Zstandard);
+  std::vector<PayloadSeen> seen;
+  std::vector<std::shared_ptr<Buffer>> kept;
+  pair.server->SetCodec(MakeLocatingCodec(&seen, &kept));
+  pair.server->SetHandler(std::make_shared<CollectHandler>(&pair.server_got));
+
+  pair.Deliver(pair.Emit(0x11111111, 0));
+  ASSERT_EQ(kept.size(), 1u);
+  const std::string first(kept[0]->data(), kept[0]->size());
+  pair.Deliver(pair.Emit(0x22222222, 0));
+  ASSERT_EQ(seen.size(), 2u);
+  EXPECT_NE(seen[1].buffer, seen[0].buffer);
+  EXPECT_EQ(std::string(kept[0]->data(), kept[0]->size()), first);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{0x11111111, 0x22222222}));
+}
+#endif
+
+// --- Compression dictionary ---------------------------------------------------
+
+#ifdef ZNET_USE_ZSTD
+namespace {
+
+// a game's state update: the same handful of fields every time, different
+// values. Too short and too varied on its own for zstd to find anything.
+std::string StateUpdate(uint32_t i, const char* kind) {
+  uint32_t x = i * 2654435761u;
+  char text[160];
+  std::snprintf(text, sizeof(text),
+                "{\"%s\":%u,\"pos\":[%d,%d,%d],\"vel\":[%d,%d],\"hp\":%u,"
+                "\"anim\":\"%s\",\"tick\":%u}",
+                kind, x % 5000, static_cast<int>(x % 2048) - 1024,
+                static_cast<int>((x >> 8) % 512),
+                static_cast<int>((x >> 16) % 2048) - 1024,
+                static_cast<int>((x >> 4) % 64) - 32,
+                static_cast<int>((x >> 12) % 64) - 32, (x >> 20) % 100,
+                (x & 1) ? "walk_forward" : "idle_breathe", i);
+  return text;
+}
+
+std::shared_ptr<CompressionDictionary> TrainOn(const char* kind) {
+  std::vector<std::string> samples;
+  for (uint32_t i = 0; i < 2000; i++) {
+    samples.push_back(StateUpdate(i, kind));
+  }
+  return CompressionDictionary::Train(samples, 4 * 1024);
+}
+
+std::shared_ptr<Buffer> BufferOf(const std::string& text) {
+  return std::make_shared<Buffer>(text.data(), text.size());
+}
+
+}  // namespace
+
+TEST(CompressionDictionaryTest, CompressesMessagesTooSmallToCompressAlone) {
+  auto dictionary = TrainOn("entity");
+  ASSERT_NE(dictionary, nullptr);
+  EXPECT_NE(dictionary->id(), 0u);
+
+  // past the training range, so not a sample the dictionary has seen
+  const std::string message = StateUpdate(100000, "entity");
+  auto plain =
+      compr::HandleOutWithType(CompressionType::Zstandard, BufferOf(message));
+  auto primed = compr::HandleOutWithType(CompressionType::Zstandard,
+                                         BufferOf(message), dictionary.get());
+  ASSERT_NE(plain, nullptr);
+  ASSERT_NE(primed, nullptr);
+  EXPECT_GT(plain->readable_bytes() * 10, message.size() * 9)
+      << "without a dictionary there is nothing to gain";
+  EXPECT_LT(primed->readable_bytes() * 2, message.size())
+      << "primed: " << primed->readable_bytes() << " of " << message.size();
+  EXPECT_EQ(static_cast<CompressionType>(primed->read_cursor_data()[0]),
+            CompressionType::ZstandardDictionary);
+
+  auto restored = compr::HandleInDynamic(primed, nullptr, dictionary.get());
+  ASSERT_NE(restored, nullptr);
+  EXPECT_EQ(std::string(restored->read_cursor_data(), restored->readable_bytes()),
+            message);
+}
+
+TEST(CompressionDictionaryTest, MessageNeedsTheDictionaryItWasCompressedWith) {
+  auto dictionary = TrainOn("entity");
+  ASSERT_NE(dictionary, nullptr);
+  auto primed = compr::HandleOutWithType(CompressionType::Zstandard,
+                                         BufferOf(StateUpdate(7, "entity")),
+                                         dictionary.get());
+  ASSERT_NE(primed, nullptr);
+  EXPECT_EQ(compr::HandleInDynamic(primed), nullptr);
+}
+
+TEST(CompressionDictionaryTest, ReloadsFromItsBytesAndRefusesOneWithoutAnId) {
+  auto dictionary = TrainOn("entity");
+  ASSERT_NE(dictionary, nullptr);
+  auto reloaded = CompressionDictionary::FromBytes(dictionary->bytes().data(),
+                                                   dictionary->bytes().size());
+  ASSERT_NE(reloaded, nullptr);
+  EXPECT_EQ(reloaded->id(), dictionary->id());
+
+  const std::string raw = "just some bytes, not a trained dictionary";
+  EXPECT_EQ(CompressionDictionary::FromBytes(raw.data(), raw.size()), nullptr);
+}
+
+namespace {
+
+SessionOptions WithDictionary(std::shared_ptr<CompressionDictionary> dictionary) {
+  SessionOptions options;
+  options.common.compression = CompressionType::Zstandard;
+  options.common.compression_dictionary = std::move(dictionary);
+  options.common.dictionary_compression_threshold = 0;
+  return options;
+}
+
+}  // namespace
+
+TEST(CompressionDictionaryTest, HandshakeAgreesWhenBothEndsHaveIt) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto dictionary = TrainOn("entity");
+  ASSERT_NE(dictionary, nullptr);
+  // unencrypted, so the compression byte can be read off the wire
+  Pair pair(/*encryption=*/false, WithDictionary(dictionary));
+  ASSERT_TRUE(pair.Handshake());
+  EXPECT_EQ(pair.client->compression_dictionary_id(), dictionary->id());
+  EXPECT_EQ(pair.server->compression_dictionary_id(), dictionary->id());
+
+  auto frame = pair.Emit(42, 0);
+  // the plaintext mode byte, then the compression byte
+  ASSERT_GE(frame.buffer->readable_bytes(), 2u);
+  EXPECT_EQ(static_cast<CompressionType>(frame.buffer->read_cursor_data()[1]),
+            CompressionType::ZstandardDictionary);
+  pair.Deliver(frame);
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{42}));
+}
+
+TEST(CompressionDictionaryTest, MismatchFallsBackToPlainCompression) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto ours = TrainOn("entity");
+  auto theirs = TrainOn("player");
+  ASSERT_NE(ours, nullptr);
+  ASSERT_NE(theirs, nullptr);
+  ASSERT_NE(ours->id(), theirs->id());
+  Pair mismatched(/*encryption=*/true, WithDictionary(ours),
+                  WithDictionary(theirs));
+  ASSERT_TRUE(mismatched.Handshake());
+  EXPECT_EQ(mismatched.client->compression_dictionary_id(), 0u);
+  EXPECT_EQ(mismatched.server->compression_dictionary_id(), 0u);
+  mismatched.Deliver(mismatched.Emit(1, 0));
+  EXPECT_EQ(mismatched.server_got, (std::vector<uint32_t>{1}));
+
+  SessionOptions plain;
+  plain.common.compression = CompressionType::Zstandard;
+  Pair one_sided(/*encryption=*/true, plain, WithDictionary(ours));
+  ASSERT_TRUE(one_sided.Handshake());
+  EXPECT_EQ(one_sided.server->compression_dictionary_id(), 0u);
+}
+#endif
+
+// --- Stream compression -------------------------------------------------------
+
+#ifdef ZNET_USE_ZSTD
+TEST(StreamCompression, StructureRepeatedAcrossMessagesCompressesAway) {
+  compr::StreamCompressor compressor(nullptr);
+  compr::StreamDecompressor decompressor(nullptr);
+  size_t raw = 0;
+  size_t framed = 0;
+  size_t streamed = 0;
+  for (uint32_t i = 0; i < 200; i++) {
+    const std::string message = StateUpdate(i, "entity");
+    raw += message.size();
+    auto alone =
+        compr::HandleOutWithType(CompressionType::Zstandard, BufferOf(message));
+    ASSERT_NE(alone, nullptr);
+    framed += alone->readable_bytes();
+
+    auto compressed = compressor.Compress(*BufferOf(message));
+    ASSERT_NE(compressed, nullptr);
+    streamed += compressed->readable_bytes();
+    ASSERT_EQ(static_cast<CompressionType>(compressed->ReadInt<uint8_t>()),
+              CompressionType::ZstandardStream);
+    auto restored = decompressor.Decompress(*compressed, nullptr);
+    ASSERT_NE(restored, nullptr) << "message " << i;
+    ASSERT_EQ(std::string(restored->read_cursor_data(),
+                          restored->readable_bytes()),
+              message);
+  }
+  EXPECT_GT(framed * 10, raw * 9) << "one message at a time finds nothing";
+  EXPECT_LT(streamed * 2, raw) << "streamed " << streamed << " of " << raw;
+}
+
+namespace {
+
+SessionOptions Streaming() {
+  SessionOptions options;
+  options.common.compression = CompressionType::ZstandardStream;
+  // a stream goes by the dictionary threshold; zero here keeps the ZDT
+  // downgrade compressing the same messages
+  options.common.compression_threshold = 0;
+  options.common.dictionary_compression_threshold = 0;
+  return options;
+}
+
+}  // namespace
+
+// unencrypted throughout, so the compression byte can be read off the wire
+TEST(StreamCompression, OnlyTcpStreams) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair tcp(/*encryption=*/false, Streaming(), Streaming(), ConnectionType::TCP);
+  ASSERT_TRUE(tcp.Handshake());
+  for (uint32_t i = 0; i < 20; i++) {
+    auto frame = tcp.Emit(i, 0);
+    // the plaintext mode byte, then the compression byte
+    ASSERT_GE(frame.buffer->readable_bytes(), 2u);
+    EXPECT_EQ(static_cast<CompressionType>(frame.buffer->read_cursor_data()[1]),
+              CompressionType::ZstandardStream);
+    tcp.Deliver(frame);
+  }
+  ASSERT_EQ(tcp.server_got.size(), 20u);
+  EXPECT_EQ(tcp.server_got.back(), 19u);
+
+  Pair zdt(/*encryption=*/false, Streaming(), Streaming(), ConnectionType::ZDT);
+  ASSERT_TRUE(zdt.Handshake());
+  auto frame = zdt.Emit(1, 0);
+  EXPECT_EQ(static_cast<CompressionType>(frame.buffer->read_cursor_data()[1]),
+            CompressionType::Zstandard);
+  zdt.Deliver(frame);
+  EXPECT_EQ(zdt.server_got, (std::vector<uint32_t>{1}));
+}
+
+TEST(StreamCompression, UndecodableMessageClosesTheSession) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/false, Streaming(), Streaming(), ConnectionType::TCP);
+  ASSERT_TRUE(pair.Handshake());
+
+  // the stream's first message opens, after the sequence byte, with zstd's
+  // frame magic; without it the decoder cannot even start
+  auto frame = Pair::Snapshot(pair.Emit(1, 0));
+  ASSERT_GE(frame.buffer->readable_bytes(), 7u);
+  std::memset(frame.buffer->data_mutable() + 3, 0xFF, 4);
+  pair.Deliver(frame);
+  EXPECT_FALSE(pair.server->IsAlive());
+  EXPECT_TRUE(pair.server_got.empty());
+}
+
+namespace {
+
+enum : PacketId { kPacketBlob = 2 };
+
+class BlobPacket : public Packet {
+ public:
+  BlobPacket() : Packet(kPacketBlob) {}
+  std::string bytes;
+};
+
+class BlobSerializer : public PacketSerializer<BlobPacket> {
+ public:
+  std::shared_ptr<Buffer> SerializeTyped(std::shared_ptr<BlobPacket> packet,
+                                         std::shared_ptr<Buffer> buffer) override {
+    buffer->WriteString(packet->bytes);
+    return buffer;
+  }
+  std::shared_ptr<BlobPacket> DeserializeTyped(
+      std::shared_ptr<Buffer> buffer) override {
+    auto packet = std::make_shared<BlobPacket>();
+    packet->bytes = buffer->ReadString();
+    return packet;
+  }
+};
+
+}  // namespace
+
+TEST(StreamCompression, OversizedMessageIsRefusedBeforeTheStream) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true, Streaming(), Streaming(), ConnectionType::TCP);
+  pair.client_wire->max_message_size = 1024;
+  ASSERT_TRUE(pair.Handshake());
+  auto codec = MakeCodec();
+  codec->Add(kPacketBlob, std::make_unique<BlobSerializer>());
+  pair.client->SetCodec(codec);
+
+  // far too large for the transport, but repetitive enough that it would have
+  // compressed to fit: only the worst case is known up front
+  auto blob = std::make_shared<BlobPacket>();
+  blob->bytes.assign(4096, 'x');
+  ASSERT_EQ(pair.client->SendPacket(blob), Result::Success);
+  pair.client->DrainOutbound();
+  EXPECT_TRUE(pair.client_wire->sent.empty());
+  EXPECT_TRUE(pair.client->IsAlive());
+
+  // had the blob gone into the stream, this would refer to it
+  pair.Deliver(pair.Emit(1, 0));
+  EXPECT_TRUE(pair.server->IsAlive());
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{1}));
+}
+
+TEST(StreamCompression, MessageTheTransportRefusesClosesTheSession) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/true, Streaming(), Streaming(), ConnectionType::TCP);
+  ASSERT_TRUE(pair.Handshake());
+  pair.Deliver(pair.Emit(1, 0));
+  ASSERT_EQ(pair.server_got, (std::vector<uint32_t>{1}));
+
+  pair.client_wire->refuse_sends = true;
+  auto packet = std::make_shared<ProbePacket>();
+  packet->seq = 2;
+  ASSERT_EQ(pair.client->SendPacket(packet), Result::Success);
+  pair.client->DrainOutbound();
+  EXPECT_FALSE(pair.client->IsAlive());
+}
+
+TEST(StreamCompression, LostMessageIsCaughtByTheNextOne) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair(/*encryption=*/false, Streaming(), Streaming(), ConnectionType::TCP);
+  ASSERT_TRUE(pair.Handshake());
+  pair.Deliver(pair.Emit(1, 0));
+  pair.Emit(2, 0);  // never arrives
+  pair.Deliver(pair.Emit(3, 0));
+  EXPECT_FALSE(pair.server->IsAlive());
+  EXPECT_EQ(pair.server_got, (std::vector<uint32_t>{1}));
+}
+#endif
+
+// --- Per-session wake ---------------------------------------------------------
+
+// The server's workers only process sessions that woke or whose deadline came,
+// so every way a session acquires work has to end in a wake.
+TEST(SessionWake, SendingToAnIdleSessionWakesItsOwner) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair;
+  ASSERT_TRUE(pair.Handshake());
+  int wakes = 0;
+  pair.client->SetWakeCallback([&] { wakes++; });
+
+  auto packet = std::make_shared<ProbePacket>();
+  ASSERT_EQ(pair.client->SendPacket(packet), Result::Success);
+  EXPECT_EQ(wakes, 1);
+  const auto due = pair.client->NextDeadline();
+  EXPECT_LE(due, std::chrono::steady_clock::now())
+      << "a queued packet is due at once";
+  pair.client->Process();
+  EXPECT_EQ(pair.client->NextDeadline(),
+            std::chrono::steady_clock::time_point::max());
+}
+
+TEST(SessionWake, CloseWakesItsOwner) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair;
+  ASSERT_TRUE(pair.Handshake());
+  int wakes = 0;
+  pair.server->SetWakeCallback([&] { wakes++; });
+
+  EXPECT_EQ(pair.server->Close(), Result::Success);
+  EXPECT_EQ(wakes, 1) << "the owner has to look to notice the death";
+  const auto due = pair.server->NextDeadline();
+  EXPECT_LE(due, std::chrono::steady_clock::now());
+}
+
+TEST(SessionWake, TryQueueAdmitsOneUntilCleared) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair;
+  EXPECT_TRUE(pair.server->TryQueue());
+  EXPECT_FALSE(pair.server->TryQueue()) << "already on a ready list";
+  pair.server->ClearQueued();
+  EXPECT_TRUE(pair.server->TryQueue());
+}
+
+// Process() stops at its receive cap; a readiness edge will not come again for
+// what it left, so the session has to say it is due.
+TEST(SessionWake, ReceiveCapLeavesTheSessionDue) {
+  ASSERT_EQ(Init(), Result::Success);
+  Pair pair;
+  ASSERT_TRUE(pair.Handshake());
+  for (uint32_t i = 0; i < 300; i++) {
+    pair.server_wire->inbox.push_back(pair.Emit(i, 0).buffer);
+  }
+  pair.server->Process();
+  EXPECT_FALSE(pair.server_wire->inbox.empty());
+  const auto due = pair.server->NextDeadline();
+  EXPECT_LE(due, std::chrono::steady_clock::now());
+
+  pair.server->Process();
+  EXPECT_TRUE(pair.server_wire->inbox.empty());
+  EXPECT_EQ(pair.server->NextDeadline(),
+            std::chrono::steady_clock::time_point::max());
+  EXPECT_EQ(pair.server_got.size(), 300u);
+}
+
+TEST(WorkerSignalTest, RaiseForListsButOnlyWakesFromOtherThreads) {
+  WorkerSignal signal;
+  signal.owner.store(std::this_thread::get_id());
+
+  // the list is weak and never dereferenced here, so empty entries will do
+  signal.RaiseFor(std::weak_ptr<PeerSession>());
+  EXPECT_EQ(signal.ready.size(), 1u) << "listed even from the owner";
+  EXPECT_FALSE(signal.woken.load()) << "nothing asleep to interrupt";
+
+  std::thread other([&] { signal.RaiseFor(std::weak_ptr<PeerSession>()); });
+  other.join();
+  EXPECT_EQ(signal.ready.size(), 2u);
+  EXPECT_TRUE(signal.woken.load());
+}
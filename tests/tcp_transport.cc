@@ -32,6 +32,7 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -161,6 +162,29 @@ TEST(TCPKeepalive, ZeroDisablesBothTimers) {
   EXPECT_FALSE(b.IsClosed());
 }
 
+// a server worker only ticks a quiet connection when this comes due, so it has
+// to track both timers Update() runs
+TEST(TCPKeepalive, NextDeadlineIsTheSoonerTimer) {
+  ASSERT_EQ(Init(), Result::Success);
+  SocketPair pair;
+  ASSERT_TRUE(pair.ok);
+  const auto before = std::chrono::steady_clock::now();
+  TCPTransportLayer pinging(pair.a, Timers(50, 1000));
+  TCPTransportLayer idling(pair.b, Timers(0, 80));
+  const auto after = std::chrono::steady_clock::now();
+
+  EXPECT_GE(pinging.NextDeadline(), before + std::chrono::milliseconds(50));
+  EXPECT_LE(pinging.NextDeadline(), after + std::chrono::milliseconds(50));
+  EXPECT_GE(idling.NextDeadline(), before + std::chrono::milliseconds(80));
+  EXPECT_LE(idling.NextDeadline(), after + std::chrono::milliseconds(80));
+
+  SocketPair quiet;
+  ASSERT_TRUE(quiet.ok);
+  TCPTransportLayer untimed(quiet.a, Timers(0, 0));
+  TCPTransportLayer untimed_peer(quiet.b, Timers(0, 0));
+  EXPECT_EQ(untimed.NextDeadline(), std::chrono::steady_clock::time_point::max());
+}
+
 // --- Round-trip latency -------------------------------------------------------
 
 namespace {
@@ -331,6 +355,250 @@ TEST(TCPLatency, RoundTripBeatsTheOldTickFloor) {
   server.Wait();
 }
 
+// --- Broadcast and groups -----------------------------------------------------
+
+namespace {
+
+// Relays every echo packet a session gets to all of them, from the handler,
+// on the worker that is driving the session.
+class RelayHandler : public PacketHandler<RelayHandler, EchoPacket> {
+ public:
+  explicit RelayHandler(Server* server) : server_(server) {}
+  void OnPacket(std::shared_ptr<EchoPacket> packet) {
+    EXPECT_EQ(server_->Broadcast(packet), Result::Success);
+  }
+
+ private:
+  Server* server_;
+};
+
+// A listening TCP server, and the clients Connect() adds, each counting the
+// echo packets it gets. `on_connect` runs in the server's connect event, for
+// each session in turn.
+class ServerWithClients {
+ public:
+  explicit ServerWithClients(
+      std::function<void(const std::shared_ptr<PeerSession>&)> on_connect)
+      : on_connect_(std::move(on_connect)) {
+    ServerConfig server_config{"127.0.0.1", FreeTcpPortLocal(),
+                               std::chrono::seconds(5), ConnectionType::TCP};
+    server.reset(new Server(server_config));
+    server->SetEventCallback([this](Event& event) {
+      EventDispatcher dispatcher{event};
+      dispatcher.Dispatch<IncomingClientConnectedEvent>(
+          [this](IncomingClientConnectedEvent& ev) {
+            ev.session()->SetCodec(MakeEchoCodec());
+            if (on_connect_) {
+              on_connect_(ev.session());
+            }
+            return false;
+          });
+    });
+    ok = server->Bind() == Result::Success &&
+         server->Listen() == Result::Success;
+  }
+
+  bool Connect(int count) {
+    for (int i = 0; ok && i < count; i++) {
+      ClientConfig client_config{"127.0.0.1", server->bind_address()->port(),
+                                 std::chrono::seconds(5), ConnectionType::TCP};
+      clients.emplace_back(new Client(client_config));
+      auto flag = std::make_shared<PongFlag>();
+      got.push_back(flag);
+      clients.back()->SetEventCallback([this, flag](Event& event) {
+        EventDispatcher dispatcher{event};
+        dispatcher.Dispatch<ClientConnectedToServerEvent>(
+            [this, flag](ClientConnectedToServerEvent& ev) {
+              ev.session()->SetCodec(MakeEchoCodec());
+              ev.session()->SetHandler(flag);
+              std::lock_guard<std::mutex> lock(mutex_);
+              sessions_.push_back(ev.session());
+              return false;
+            });
+      });
+      ok = clients.back()->Bind() == Result::Success &&
+           clients.back()->Connect() == Result::Success;
+    }
+    return ok && AllServed();
+  }
+
+  ~ServerWithClients() {
+    for (auto& client : clients) {
+      client->Disconnect();
+    }
+    server->Stop();
+    for (auto& client : clients) {
+      client->Wait();
+    }
+    server->Wait();
+  }
+
+  std::shared_ptr<PeerSession> client_session(size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index < sessions_.size() ? sessions_[index] : nullptr;
+  }
+
+  int total() const {
+    int sum = 0;
+    for (auto& flag : got) {
+      sum += flag->got.load();
+    }
+    return sum;
+  }
+
+  // waits for at least `expected` in total, then a little longer, so a
+  // packet that should not have been sent has the chance to show
+  int Settle(int expected) const {
+    const auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (total() < expected && std::chrono::steady_clock::now() < until) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return total();
+  }
+
+  bool ok = false;
+  std::unique_ptr<Server> server;
+  std::vector<std::unique_ptr<Client>> clients;
+  std::vector<std::shared_ptr<PongFlag>> got;
+
+ private:
+  // Whether every client's session is on a worker, where a broadcast posted
+  // after this reaches it. A session's connect event runs before it is
+  // handed over, so seeing that is not enough.
+  bool AllServed() {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline) {
+      // one count per attempt, so a late filter from an earlier one cannot
+      // be mistaken for this one's
+      auto listed = std::make_shared<std::atomic<size_t>>(0);
+      server->Broadcast(std::make_shared<EchoPacket>(),
+                        [listed](PeerSession&) {
+                          (*listed)++;
+                          return false;
+                        });
+      const auto until =
+          std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+      while (listed->load() < clients.size() &&
+             std::chrono::steady_clock::now() < until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (listed->load() == clients.size()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::function<void(const std::shared_ptr<PeerSession>&)> on_connect_;
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<PeerSession>> sessions_;  // the clients' own
+};
+
+}  // namespace
+
+TEST(ServerBroadcast, ReachesEveryReadySessionTheFilterKeeps) {
+  ASSERT_EQ(Init(), Result::Success);
+  ServerWithClients room(nullptr);
+  ASSERT_TRUE(room.Connect(3));
+
+  // the filter runs on each worker, so possibly on several at once
+  std::atomic<int> seen{0};
+  EXPECT_EQ(room.server->Broadcast(std::make_shared<EchoPacket>(),
+                                   [&seen](PeerSession&) { return seen++ != 0; }),
+            Result::Success);
+  EXPECT_EQ(room.Settle(2), 2);
+  EXPECT_EQ(room.server->Broadcast(std::make_shared<EchoPacket>()),
+            Result::Success);
+  EXPECT_EQ(room.Settle(5), 5);
+  for (auto& flag : room.got) {
+    EXPECT_GE(flag->got.load(), 1);
+  }
+  EXPECT_EQ(room.server->Broadcast(nullptr), Result::InvalidArgument);
+}
+
+// A handler runs on a worker that holds its own sessions. Broadcasting from
+// there used to wait on every worker's, its own included.
+TEST(ServerBroadcast, FromAPacketHandler) {
+  ASSERT_EQ(Init(), Result::Success);
+  Server* server = nullptr;
+  ServerWithClients room([&server](const std::shared_ptr<PeerSession>& session) {
+    session->SetHandler(std::make_shared<RelayHandler>(server));
+  });
+  server = room.server.get();
+  ASSERT_TRUE(room.Connect(3));
+
+  auto session = room.client_session(0);
+  ASSERT_NE(session, nullptr);
+  ASSERT_EQ(session->SendPacket(std::make_shared<EchoPacket>()),
+            Result::Success);
+  EXPECT_EQ(room.Settle(3), 3);
+}
+
+// Groups overlap, and a session is in each only between its add and its
+// removal, or the group's end.
+TEST(ServerGroups, SendReachesTheMembersOnly) {
+  ASSERT_EQ(Init(), Result::Success);
+  Server* server = nullptr;
+  GroupId low = 0;
+  GroupId high = 0;
+  std::mutex accepted_mutex;
+  std::vector<std::shared_ptr<PeerSession>> accepted;
+  // the first three go in `low` and the last three in `high`, from the
+  // connect event, before the session is even on a worker
+  ServerWithClients room([&](const std::shared_ptr<PeerSession>& session) {
+    std::lock_guard<std::mutex> lock(accepted_mutex);
+    const size_t index = accepted.size();
+    accepted.push_back(session);
+    if (index < 3) {
+      EXPECT_TRUE(server->AddToGroup(low, session));
+    }
+    if (index >= 1) {
+      EXPECT_TRUE(server->AddToGroup(high, session));
+      EXPECT_TRUE(server->AddToGroup(high, session));  // the same as once
+    }
+  });
+  server = room.server.get();
+  low = server->CreateGroup();
+  high = server->CreateGroup();
+  ASSERT_NE(low, 0u);
+  ASSERT_NE(low, high);
+  ASSERT_TRUE(room.Connect(4));
+
+  ASSERT_EQ(server->SendToGroup(low, std::make_shared<EchoPacket>()),
+            Result::Success);
+  ASSERT_EQ(server->SendToGroup(high, std::make_shared<EchoPacket>()),
+            Result::Success);
+  EXPECT_EQ(room.Settle(6), 6);
+  std::vector<int> counts;
+  for (auto& flag : room.got) {
+    counts.push_back(flag->got.load());
+  }
+  std::sort(counts.begin(), counts.end());
+  EXPECT_EQ(counts, (std::vector<int>{1, 1, 2, 2}));
+
+  std::shared_ptr<PeerSession> last;
+  {
+    std::lock_guard<std::mutex> lock(accepted_mutex);
+    last = accepted.back();
+  }
+  EXPECT_TRUE(server->RemoveFromGroup(high, last));
+  ASSERT_EQ(server->SendToGroup(high, std::make_shared<EchoPacket>()),
+            Result::Success);
+  EXPECT_EQ(room.Settle(8), 8);
+
+  server->DestroyGroup(low);
+  ASSERT_EQ(server->SendToGroup(low, std::make_shared<EchoPacket>()),
+            Result::Success);
+  EXPECT_EQ(room.Settle(8), 8);
+
+  // nothing the server does not drive can join
+  EXPECT_FALSE(server->AddToGroup(high, room.client_session(0)));
+  EXPECT_FALSE(server->AddToGroup(high, nullptr));
+  EXPECT_EQ(server->SendToGroup(high, nullptr), Result::InvalidArgument);
+}
+
 TEST(TCPKeepalive, DataSurvivesInterleavedControlFrames) {
   ASSERT_EQ(Init(), Result::Success);
   SocketPair pair;
@@ -347,6 +615,7 @@ TEST(TCPKeepalive, DataSurvivesInterleavedControlFrames) {
     auto payload = std::make_shared<Buffer>();
     payload->WriteInt<uint32_t>(i);
     ASSERT_TRUE(a.Send(payload));
+    a.Flush();
     a.Update();
     b.Update();
     while (auto got = b.Receive()) {
@@ -506,3 +775,257 @@ TEST(TCPFraming, OversizedFrameLengthCloses) {
   EXPECT_TRUE(transport.IsClosed());
   CloseSocket(pair.a);
 }
+
+// --- Write batching: Send() stages frames and a flush writes them together.
+
+namespace {
+
+TCPOptions Batch(size_t max_write_batch) {
+  TCPOptions tcp;
+  tcp.max_write_batch = max_write_batch;
+  return tcp;
+}
+
+std::shared_ptr<Buffer> Payload(const std::vector<uint8_t>& bytes) {
+  auto buffer = std::make_shared<Buffer>();
+  buffer->Write(bytes.data(), bytes.size());
+  return buffer;
+}
+
+std::vector<std::vector<uint8_t>> ReceiveAll(TCPTransportLayer& transport,
+                                             size_t expected) {
+  std::vector<std::vector<uint8_t>> got;
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (got.size() < expected &&
+         std::chrono::steady_clock::now() < deadline) {
+    while (auto frame = transport.Receive()) {
+      got.push_back(FrameBytes(frame));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return got;
+}
+
+}  // namespace
+
+// Nothing leaves before the flush, and then every staged frame leaves in
+// order, in fewer writes than frames.
+TEST(TCPBatching, FlushWritesStagedFramesInOrder) {
+  ASSERT_EQ(Init(), Result::Success);
+  SocketPair pair;
+  ASSERT_TRUE(pair.ok);
+  TCPTransportLayer a(pair.a, Timers(0, 0));
+  TCPTransportLayer b(pair.b, Timers(0, 0));
+
+  // a buffer without headroom and one with it, so both framings are staged
+  std::vector<std::vector<uint8_t>> payloads;
+  for (size_t i = 0; i < 32; i++) {
+    payloads.push_back(PatternPayload(1 + i * 37));
+    auto buffer = Payload(payloads.back());
+    if (i % 2 == 1) {
+      buffer = std::make_shared<Buffer>();
+      buffer->ReserveHeadroom(8);
+      buffer->Write(payloads.back().data(), payloads.back().size());
+    }
+    ASSERT_TRUE(a.Send(buffer));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(b.Receive()) << "staged frames must wait for the flush";
+
+  a.Flush();
+  EXPECT_EQ(ReceiveAll(b, payloads.size()), payloads);
+#if ZNET_ENABLE_METRICS
+  SessionMetrics m;
+  a.FillMetrics(m);
+  EXPECT_EQ(m.tcp.flushes, 1u);
+  EXPECT_EQ(m.tcp.frames_sent, payloads.size());
+  EXPECT_LT(m.tcp.writes, m.tcp.frames_sent);
+#endif
+}
+
+// A full batch goes out from Send() itself; a zero budget makes that every
+// frame, one write each.
+TEST(TCPBatching, BudgetFlushesInline) {
+  ASSERT_EQ(Init(), Result::Success);
+  SocketPair pair;
+  ASSERT_TRUE(pair.ok);
+  TCPTransportLayer a(pair.a, Timers(0, 0), Batch(0));
+  TCPTransportLayer b(pair.b, Timers(0, 0));
+
+  std::vector<std::vector<uint8_t>> payloads = {
+      PatternPayload(3), PatternPayload(400), PatternPayload(9)};
+  for (const auto& payload : payloads) {
+    ASSERT_TRUE(a.Send(Payload(payload)));
+  }
+  EXPECT_EQ(ReceiveAll(b, payloads.size()), payloads);
+#if ZNET_ENABLE_METRICS
+  SessionMetrics m;
+  a.FillMetrics(m);
+  EXPECT_EQ(m.tcp.writes, payloads.size());
+  EXPECT_EQ(m.tcp.frames_sent, payloads.size());
+#endif
+}
+
+// A graceful close owes the peer what Send() already accepted.
+TEST(TCPBatching, CloseFlushesStagedFrames) {
+  ASSERT_EQ(Init(), Result::Success);
+  SocketPair pair;
+  ASSERT_TRUE(pair.ok);
+  TCPTransportLayer a(pair.a, Timers(0, 0));
+  TCPTransportLayer b(pair.b, Timers(0, 0));
+
+  std::vector<std::vector<uint8_t>> payloads = {PatternPayload(5),
+                                                PatternPayload(70)};
+  for (const auto& payload : payloads) {
+    ASSERT_TRUE(a.Send(Payload(payload)));
+  }
+  EXPECT_EQ(a.Close(), Result::Success);
+  EXPECT_EQ(ReceiveAll(b, payloads.size()), payloads);
+}
+
+// --- Readiness poller ---------------------------------------------------------
+
+namespace {
+
+const ReadinessPoller::Kind kPollerKinds[] = {ReadinessPoller::Kind::Default,
+                                              ReadinessPoller::Kind::Portable};
+
+// Waits up to `ms` for any report, collecting every token seen.
+std::vector<uint64_t> WaitReady(ReadinessPoller& poller, int ms) {
+  std::vector<uint64_t> ready;
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  while (ready.empty() && std::chrono::steady_clock::now() < deadline) {
+    poller.Wait(ready, std::chrono::milliseconds(5));
+  }
+  return ready;
+}
+
+void DrainSocket(SocketHandle socket) {
+  uint8_t scratch[256];
+  while (SocketRecv(socket, scratch, sizeof(scratch)) > 0) {
+  }
+}
+
+}  // namespace
+
+TEST(ReadinessPoller, ReportsTheReadableSocketByToken) {
+  ASSERT_EQ(Init(), Result::Success);
+  for (auto kind : kPollerKinds) {
+    SCOPED_TRACE(kind == ReadinessPoller::Kind::Default ? "default" : "portable");
+    SocketPair quiet;
+    SocketPair loud;
+    ASSERT_TRUE(quiet.ok && loud.ok);
+    auto poller = ReadinessPoller::Create(kind);
+    ASSERT_TRUE(poller->Add(quiet.b, 1));
+    ASSERT_TRUE(poller->Add(loud.b, 2));
+    EXPECT_EQ(poller->size(), 2u);
+
+    const uint8_t byte = 7;
+    ASSERT_EQ(SocketSend(loud.a, &byte, 1), 1);
+    EXPECT_EQ(WaitReady(*poller, 2000), std::vector<uint64_t>{2});
+
+    poller->Remove(quiet.b);
+    poller->Remove(loud.b);
+    EXPECT_EQ(poller->size(), 0u);
+    for (SocketHandle s : {quiet.a, quiet.b, loud.a, loud.b}) {
+      CloseSocket(s);
+    }
+  }
+}
+
+// the contract the single poll thread leans on: unread bytes are reported once,
+// not on every wait, and a socket read dry is reported again on new data
+TEST(ReadinessPoller, ReportsOnceUntilDrainedAndRearmed) {
+  ASSERT_EQ(Init(), Result::Success);
+  for (auto kind : kPollerKinds) {
+    SCOPED_TRACE(kind == ReadinessPoller::Kind::Default ? "default" : "portable");
+    SocketPair pair;
+    ASSERT_TRUE(pair.ok);
+    auto poller = ReadinessPoller::Create(kind);
+    ASSERT_TRUE(poller->Add(pair.b, 9));
+
+    const uint8_t byte = 1;
+    ASSERT_EQ(SocketSend(pair.a, &byte, 1), 1);
+    EXPECT_EQ(WaitReady(*poller, 2000).size(), 1u);
+    EXPECT_TRUE(WaitReady(*poller, 50).empty())
+        << "an undrained socket must not re-fire";
+
+    DrainSocket(pair.b);
+    poller->Rearm(pair.b);
+    ASSERT_EQ(SocketSend(pair.a, &byte, 1), 1);
+    EXPECT_EQ(WaitReady(*poller, 2000), std::vector<uint64_t>{9});
+
+    poller->Remove(pair.b);
+    CloseSocket(pair.a);
+    CloseSocket(pair.b);
+  }
+}
+
+TEST(ReadinessPoller, RemovedSocketIsNotReported) {
+  ASSERT_EQ(Init(), Result::Success);
+  for (auto kind : kPollerKinds) {
+    SCOPED_TRACE(kind == ReadinessPoller::Kind::Default ? "default" : "portable");
+    SocketPair pair;
+    ASSERT_TRUE(pair.ok);
+    auto poller = ReadinessPoller::Create(kind);
+    ASSERT_TRUE(poller->Add(pair.b, 3));
+    poller->Remove(pair.b);
+
+    const uint8_t byte = 1;
+    ASSERT_EQ(SocketSend(pair.a, &byte, 1), 1);
+    EXPECT_TRUE(WaitReady(*poller, 50).empty());
+    CloseSocket(pair.a);
+    CloseSocket(pair.b);
+  }
+}
+
+// a peer going away is the reader's to notice, so it must wake one
+TEST(ReadinessPoller, HangupIsReported) {
+  ASSERT_EQ(Init(), Result::Success);
+  for (auto kind : kPollerKinds) {
+    SCOPED_TRACE(kind == ReadinessPoller::Kind::Default ? "default" : "portable");
+    SocketPair pair;
+    ASSERT_TRUE(pair.ok);
+    auto poller = ReadinessPoller::Create(kind);
+    ASSERT_TRUE(poller->Add(pair.b, 4));
+    CloseSocket(pair.a);
+    EXPECT_EQ(WaitReady(*poller, 2000), std::vector<uint64_t>{4});
+    poller->Remove(pair.b);
+    CloseSocket(pair.b);
+  }
+}
+
+// the transport is the poller's reader: Receive() reading dry rearms, and the
+// destructor unregisters before the descriptor goes back to the OS
+TEST(ReadinessPoller, TransportRearmsAndUnregisters) {
+  ASSERT_EQ(Init(), Result::Success);
+  for (auto kind : kPollerKinds) {
+    SCOPED_TRACE(kind == ReadinessPoller::Kind::Default ? "default" : "portable");
+    SocketPair pair;
+    ASSERT_TRUE(pair.ok);
+    auto poller = ReadinessPoller::Create(kind);
+    ASSERT_TRUE(poller->Add(pair.b, 5));
+    {
+      TCPTransportLayer transport(pair.b, Timers(0, 0), TCPOptions(), poller);
+      const uint8_t frame[3] = {0, 1, 0x42};
+      for (int round = 0; round < 3; round++) {
+        ASSERT_EQ(SocketSend(pair.a, frame, sizeof(frame)), 3);
+        ASSERT_EQ(WaitReady(*poller, 2000), std::vector<uint64_t>{5})
+            << "round " << round;
+        std::shared_ptr<Buffer> got;
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (!got && std::chrono::steady_clock::now() < deadline) {
+          got = transport.Receive();
+        }
+        ASSERT_TRUE(got);
+        EXPECT_EQ(got->ReadInt<uint8_t>(), 0x42);
+        EXPECT_FALSE(transport.Receive());  // reads dry, which rearms
+      }
+    }
+    EXPECT_EQ(poller->size(), 0u);
+    CloseSocket(pair.a);
+  }
+}
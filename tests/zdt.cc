@@ -11,8 +11,11 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstring>
+#include <mutex>
 #include <random>
 #include <set>
 #include <string>
@@ -112,6 +115,35 @@ TEST(ZDTHeader, RoundTrip) {
   EXPECT_EQ(out.block_count, 0);
 }
 
+TEST(ZDTHeader, ConnectionIdRoundTrip) {
+  ZDTHeader header;
+  header.flags = kFlagOnline | kFlagConnectionId;
+  header.connection_id = 0xC0FFEE42;
+  header.packet_seq = 7;
+  header.ack = 3;
+
+  Buffer buffer(Endianness::BigEndian);
+  WriteZDTHeader(buffer, header);
+  EXPECT_EQ(buffer.size(), kZDTHeaderSize + kZDTConnectionIdSize);
+
+  // the server's demux reads the id without parsing the header
+  ZDTConnectionId peeked = 0;
+  ASSERT_TRUE(PeekZDTConnectionId(buffer.data(), buffer.size(), peeked));
+  EXPECT_EQ(peeked, header.connection_id);
+
+  ZDTHeader out;
+  ASSERT_TRUE(ReadZDTHeader(buffer, out));
+  EXPECT_EQ(out.connection_id, header.connection_id);
+  EXPECT_EQ(out.packet_seq, header.packet_seq);
+  EXPECT_EQ(out.ack, header.ack);
+
+  // without the flag there is no id to find
+  ZDTHeader plain;
+  Buffer without(Endianness::BigEndian);
+  WriteZDTHeader(without, plain);
+  EXPECT_FALSE(PeekZDTConnectionId(without.data(), without.size(), peeked));
+}
+
 TEST(ZDTHeader, AckBlocksRoundTrip) {
   ZDTHeader header;
   header.packet_seq = 0x0102;
@@ -461,6 +493,153 @@ TEST(ZDTUdpSocket, Loopback) {
   ASSERT_TRUE(from && from->is_valid());
 }
 
+// A batch arrives whole and in order however the platform moves it; on Linux
+// the queued datagrams come back from a single call.
+TEST(ZDTUdpSocket, BatchSendAndReceive) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto receiver = MakeBoundSocket();
+  auto sender = MakeBoundSocket();
+  auto receiver_addr = receiver->local_address();
+  ASSERT_TRUE(receiver_addr);
+
+  const size_t kDatagrams = 10;
+  std::vector<std::vector<uint8_t>> sent;
+  std::vector<SocketSlice> slices;
+  for (size_t i = 0; i < kDatagrams; i++) {
+    sent.push_back(std::vector<uint8_t>(1 + i * 10, static_cast<uint8_t>(i)));
+  }
+  for (const auto& datagram : sent) {
+    slices.push_back(SocketSlice{datagram.data(), datagram.size()});
+  }
+  EXPECT_EQ(sender->SendBatchTo(*receiver_addr, slices.data(), slices.size()),
+            kDatagrams);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  std::vector<std::array<uint8_t, 256>> storage(16);
+  std::vector<DatagramSlot> slots(storage.size());
+  for (size_t i = 0; i < slots.size(); i++) {
+    slots[i].data = storage[i].data();
+    slots[i].cap = storage[i].size();
+  }
+  const PeerKey sender_key = PeerKey::From(*sender->local_address());
+  std::vector<std::vector<uint8_t>> got;
+  size_t largest_call = 0;
+  for (int poll = 0; poll < 200 && got.size() < kDatagrams; poll++) {
+    size_t count = 0;
+    if (receiver->RecvBatch(slots.data(), slots.size(), count) !=
+        RecvResult::Received) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    largest_call = std::max(largest_call, count);
+    for (size_t i = 0; i < count; i++) {
+      ASSERT_TRUE(slots[i].from == sender_key);
+      got.emplace_back(storage[i].data(), storage[i].data() + slots[i].len);
+    }
+  }
+  EXPECT_EQ(got, sent);
+#ifdef ZNET_TARGET_LINUX
+  EXPECT_EQ(largest_call, kDatagrams) << "recvmmsg should take the whole queue";
+#endif
+}
+
+// Segmentation offload, where the kernel has it. Each run must come back out
+// as the datagrams that went in: split by the kernel for a plain reader, or
+// reported with its segment size to one that asked for coalescing.
+namespace {
+
+std::vector<std::vector<uint8_t>> OffloadRun() {
+  // a run the kernel can segment: equal sizes, then one shorter to close it
+  std::vector<std::vector<uint8_t>> datagrams;
+  for (uint8_t i = 0; i < 5; i++) {
+    datagrams.push_back(std::vector<uint8_t>(1200, i));
+  }
+  datagrams.push_back(std::vector<uint8_t>(300, 9));
+  return datagrams;
+}
+
+size_t SendRun(UDPSocket& sender, const InetAddress& to,
+               const std::vector<std::vector<uint8_t>>& datagrams) {
+  std::vector<SocketSlice> slices;
+  for (const auto& datagram : datagrams) {
+    slices.push_back(SocketSlice{datagram.data(), datagram.size()});
+  }
+  return sender.SendBatchTo(to, slices.data(), slices.size());
+}
+
+}  // namespace
+
+TEST(ZDTUdpSocket, SegmentedSendArrivesAsSeparateDatagrams) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto receiver = MakeBoundSocket();
+  auto sender = MakeBoundSocket();
+  if (!sender->EnableSendOffload()) {
+    GTEST_SKIP() << "no UDP segmentation offload here";
+  }
+  const auto sent = OffloadRun();
+  EXPECT_EQ(SendRun(*sender, *receiver->local_address(), sent), sent.size());
+  EXPECT_EQ(CollectDatagrams(*receiver, sent.size()), sent);
+}
+
+TEST(ZDTUdpSocket, CoalescedReceiveReportsItsSegments) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto receiver = MakeBoundSocket();
+  auto sender = MakeBoundSocket();
+  if (!sender->EnableSendOffload() || !receiver->EnableReceiveOffload()) {
+    GTEST_SKIP() << "no UDP segmentation offload here";
+  }
+  const auto sent = OffloadRun();
+  ASSERT_EQ(SendRun(*sender, *receiver->local_address(), sent), sent.size());
+
+  std::vector<uint8_t> storage(UDPSocket::kMaxOffloadBytes);
+  DatagramSlot slot;
+  slot.data = storage.data();
+  slot.cap = storage.size();
+  std::vector<std::vector<uint8_t>> got;
+  for (int poll = 0; poll < 200 && got.size() < sent.size(); poll++) {
+    size_t count = 0;
+    if (receiver->RecvBatch(&slot, 1, count) != RecvResult::Received) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    // split the way the server's router does
+    const size_t step = slot.segment_size != 0 ? slot.segment_size : slot.len;
+    for (size_t offset = 0; offset < slot.len; offset += step) {
+      const size_t len = std::min(step, slot.len - offset);
+      got.emplace_back(storage.data() + offset, storage.data() + offset + len);
+    }
+  }
+  EXPECT_EQ(got, sent);
+}
+
+// Launch times only schedule datagrams; they must never lose or reorder one.
+// Without an fq or etf qdisc on the route the kernel ignores them, so this
+// checks delivery, not spacing. The run mixes due and future times so the
+// segmented path has to split where they change.
+TEST(ZDTUdpSocket, TimedSendArrivesWhole) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto receiver = MakeBoundSocket();
+  auto sender = MakeBoundSocket();
+  if (!sender->EnableTxTime()) {
+    GTEST_SKIP() << "no SO_TXTIME here";
+  }
+  sender->EnableSendOffload();
+  const auto sent = OffloadRun();
+  std::vector<SocketSlice> slices;
+  for (const auto& datagram : sent) {
+    slices.push_back(SocketSlice{datagram.data(), datagram.size()});
+  }
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<std::chrono::steady_clock::time_point> launch;
+  for (size_t i = 0; i < sent.size(); i++) {
+    launch.push_back(now + std::chrono::milliseconds(i / 2));
+  }
+  EXPECT_EQ(sender->SendBatchTo(*receiver->local_address(), slices.data(),
+                                slices.size(), launch.data()),
+            sent.size());
+  EXPECT_EQ(CollectDatagrams(*receiver, sent.size()), sent);
+}
+
 // --- Transport data path ------------------------------------------------------
 
 // The session crypto scopes its message sequence and its replay window to
@@ -1386,6 +1565,199 @@ TEST(ZDTMetrics, CountsRealTraffic) {
   std::this_thread::sleep_for(std::chrono::milliseconds(100));
 }
 
+// One echo round trip over a real session, returning the client's counters.
+static SessionMetrics EchoRoundTrip(bool datagram_encryption) {
+  PortNumber port = FreeUdpPort();
+  RoundTripState state;
+  std::shared_ptr<PeerSession> client_session;
+
+  ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  server_config.child_options.zdt.datagram_encryption = datagram_encryption;
+  Server server{server_config};
+  server.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<IncomingClientConnectedEvent>(
+        [&](IncomingClientConnectedEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ServerEchoHandler>(ev.session()));
+          return false;
+        });
+  });
+  EXPECT_EQ(server.Bind(), Result::Success);
+  EXPECT_EQ(server.Listen(), Result::Success);
+
+  ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  client_config.options.zdt.datagram_encryption = datagram_encryption;
+  Client client{client_config};
+  client.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<ClientConnectedToServerEvent>(
+        [&](ClientConnectedToServerEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(std::make_shared<ClientReplyHandler>(&state));
+          client_session = ev.session();
+          auto packet = std::make_shared<DemoPacket>();
+          packet->text = "sealed?";
+          ev.session()->SendPacket(packet);
+          return false;
+        });
+  });
+  EXPECT_EQ(client.Bind(), Result::Success);
+  EXPECT_EQ(client.Connect(), Result::Success);
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!state.got_reply && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_TRUE(state.got_reply.load());
+  EXPECT_EQ(state.reply_text, "reply:sealed?");
+  SessionMetrics metrics;
+  if (client_session) {
+    metrics = client_session->metrics();
+  }
+
+  client.Disconnect();
+  server.Stop();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  return metrics;
+}
+
+// With datagram_encryption on both ends the session still encrypts, but the
+// 24 bytes each message carried for its own nonce and tag are gone.
+TEST(ZDTMetrics, DatagramEncryptionDropsThePerMessageOverhead) {
+  ASSERT_EQ(Init(), Result::Success);
+  SessionMetrics per_message = EchoRoundTrip(false);
+  SessionMetrics sealed = EchoRoundTrip(true);
+  ASSERT_GT(per_message.common.messages_sent, 0u);
+  ASSERT_EQ(sealed.common.messages_sent, per_message.common.messages_sent);
+  const uint64_t per_message_overhead = per_message.common.message_bytes_sent -
+                                        per_message.common.payload_bytes_sent;
+  const uint64_t sealed_overhead =
+      sealed.common.message_bytes_sent - sealed.common.payload_bytes_sent;
+  EXPECT_GE(per_message_overhead, sealed_overhead + 24)
+      << "at least the demo packet should have shed its nonce and tag";
+}
+
+// Once warm, receiving reuses the datagram it arrived in and the buffer its
+// message is delivered in: the misses stop while the hits keep counting.
+TEST(ZDTMetrics, SteadyReceiveReusesPooledBuffers) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config;
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(),
+                           config, /*drains_own_socket=*/true,
+                           /*inbox=*/nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(
+      server_socket, client_socket->local_address(), config,
+      /*drains_own_socket=*/false,
+      std::make_shared<ZDTInbox>(config.max_inbox_datagrams,
+                                 std::make_shared<ZDTDatagramPool>(16)),
+      connection, QuietCommon());
+
+  constexpr int kMessages = 50;
+  constexpr int kWarmUp = 5;
+  SessionMetrics warm;
+  for (int i = 0; i < kMessages; i++) {
+    if (i == kWarmUp) {
+      server.FillMetrics(warm);
+    }
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(static_cast<uint32_t>(i));
+    ASSERT_TRUE(client.Send(payload, MakeSendOptions(false, false, 0)));
+    client.Update();
+    for (const auto& datagram : CollectDatagrams(*server_socket, 1)) {
+      server.OnDatagram(datagram.data(), datagram.size());
+    }
+    server.Update();
+    auto received = server.Receive();
+    ASSERT_TRUE(received != nullptr) << "message " << i;
+    EXPECT_EQ(received->ReadInt<uint32_t>(), static_cast<uint32_t>(i));
+  }
+  server.Update();  // hands the last drained datagram back
+
+  SessionMetrics sm;
+  server.FillMetrics(sm);
+  // a datagram is pushed before the previous one is handed back, so the
+  // warm-up allocates a couple of each; after it, nothing
+  EXPECT_GT(warm.zdt.pool_misses, 0u);
+  EXPECT_EQ(sm.zdt.pool_misses, warm.zdt.pool_misses);
+  EXPECT_EQ(sm.zdt.pool_hits - warm.zdt.pool_hits,
+            2u * (kMessages - kWarmUp));
+}
+
+// Once warm, a steady transfer runs in the state it already has: the sent
+// ring, the unacked slots, the reorder windows and the reassembly buffers all
+// stop growing, so state_bytes holds still on both ends.
+TEST(ZDTMetrics, SteadyTransferStateStopsGrowing) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config;
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(),
+                           config, /*drains_own_socket=*/false,
+                           /*inbox=*/nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(),
+                           config, /*drains_own_socket=*/false,
+                           /*inbox=*/nullptr, connection, QuietCommon());
+
+  constexpr int kRounds = 60;
+  constexpr int kWarmUp = 20;
+  constexpr int kSmallPerRound = 16;
+  const std::string large(4000, 'x');  // several fragments at any MTU
+  SessionMetrics client_warm;
+  SessionMetrics server_warm;
+  size_t received = 0;
+  for (int round = 0; round < kRounds; round++) {
+    if (round == kWarmUp) {
+      client.FillMetrics(client_warm);
+      server.FillMetrics(server_warm);
+    }
+    for (int i = 0; i < kSmallPerRound; i++) {
+      auto payload = std::make_shared<Buffer>();
+      payload->WriteInt<uint32_t>(static_cast<uint32_t>(i));
+      // channel 0 ordered, channel 1 unordered
+      const bool ordered = i % 2 == 0;
+      ASSERT_TRUE(client.Send(
+          payload, MakeSendOptions(true, ordered, ordered ? 0 : 1)));
+    }
+    auto payload = std::make_shared<Buffer>();
+    payload->Write(large.data(), large.size());
+    ASSERT_TRUE(client.Send(payload, MakeSendOptions(true, true, 2)));
+    // a loopback round trip holds the window near its floor, so a round
+    // takes a few ticks to go through
+    const size_t sent = static_cast<size_t>((round + 1) * (kSmallPerRound + 1));
+    for (int tick = 0; tick < 100 && received < sent; tick++) {
+      client.Update();
+      Pump(*server_socket, server);
+      server.Update();
+      Pump(*client_socket, client);
+      while (server.Receive()) {
+        received++;
+      }
+    }
+  }
+  client.Update();  // takes the last acks
+
+  EXPECT_EQ(received, static_cast<size_t>(kRounds * (kSmallPerRound + 1)));
+  SessionMetrics client_end;
+  SessionMetrics server_end;
+  client.FillMetrics(client_end);
+  server.FillMetrics(server_end);
+  EXPECT_GT(client_warm.zdt.state_bytes, 0u);
+  EXPECT_EQ(client_end.zdt.state_bytes, client_warm.zdt.state_bytes);
+  EXPECT_EQ(server_end.zdt.state_bytes, server_warm.zdt.state_bytes);
+}
+
 // The same SessionMetrics shape serves both transports: common counters are
 // populated either way, and each transport fills only its own group.
 TEST(ZDTMetrics, TCPUsesTheSameShape) {
@@ -1552,15 +1924,24 @@ TEST(ZDTMetrics, CountsRetransmitsAndDuplicates) {
 }
 #endif  // ZNET_ENABLE_METRICS
 
-// --- Full application round-trip over ZDT (the "usable TCP-equivalent" proof)
-
-TEST(ZDTIntegration, AppPacketRoundTripOverUdp) {
+// A fragmented message each way with the offload on at both ends: the runs of
+// full datagrams are what it batches, and the server's router splits whatever
+// the kernel coalesced. Where the kernel lacks the offload this is the plain
+// path, which must pass just the same.
+TEST(ZDTIntegration, SegmentationOffloadRoundTrip) {
   ASSERT_EQ(Init(), Result::Success);
   PortNumber port = FreeUdpPort();
   RoundTripState state;
+  // random, so compression cannot shrink it back into one datagram
+  std::mt19937 rng(5);
+  std::string text(8000, ' ');
+  for (char& c : text) {
+    c = static_cast<char>('a' + rng() % 26);
+  }
 
   ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(5),
                              ConnectionType::ZDT};
+  server_config.child_options.zdt.segmentation_offload = true;
   Server server{server_config};
   server.SetEventCallback([&](Event& event) {
     EventDispatcher dispatcher{event};
@@ -1579,6 +1960,7 @@ TEST(ZDTIntegration, AppPacketRoundTripOverUdp) {
 
   ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(5),
                              ConnectionType::ZDT};
+  client_config.options.zdt.segmentation_offload = true;
   Client client{client_config};
   client.SetEventCallback([&](Event& event) {
     EventDispatcher dispatcher{event};
@@ -1590,7 +1972,7 @@ TEST(ZDTIntegration, AppPacketRoundTripOverUdp) {
           ev.session()->SetHandler(
               std::make_shared<ClientReplyHandler>(&state));
           auto packet = std::make_shared<DemoPacket>();
-          packet->text = "hello";
+          packet->text = text;
           ev.session()->SendPacket(packet);
           return false;
         });
@@ -1602,107 +1984,405 @@ TEST(ZDTIntegration, AppPacketRoundTripOverUdp) {
   while (!state.got_reply && std::chrono::steady_clock::now() < deadline) {
     std::this_thread::sleep_for(std::chrono::milliseconds(5));
   }
-
   EXPECT_TRUE(state.got_reply.load()) << "client never received the echo";
-  EXPECT_EQ(state.reply_text, "reply:hello");
+  EXPECT_EQ(state.reply_text, "reply:" + text);
 
   client.Disconnect();
   server.Stop();
   std::this_thread::sleep_for(std::chrono::milliseconds(100));
 }
 
-// --- Full channel matrix (M4) -------------------------------------------------
-
-// reliable + unordered: every message arrives exactly once (dedup on retransmit),
-// order not guaranteed.
-TEST(ZDTChannels, ReliableUnorderedDeliversAllExactlyOnce) {
+// Several sockets on one port: each client is read by whichever one the kernel
+// hashed it to, and every one still completes its handshake and round trip.
+TEST(ZDTIntegration, ReceiveSocketsShareThePort) {
   ASSERT_EQ(Init(), Result::Success);
-  auto server_socket = MakeBoundSocket();
-  auto client_socket = MakeBoundSocket();
-  ZDTOptions config = FastConfig();
-  ZDTConnection connection;
-  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
-                           false, nullptr, connection, QuietCommon());
-  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
-                           false, nullptr, connection, QuietCommon());
+  PortNumber port = FreeUdpPort();
+  constexpr size_t kClients = 8;
+  std::array<RoundTripState, kClients> states;
 
-  const uint32_t kMessages = 200;
-  SendOptions options = MakeSendOptions(true, false, 1);
-  for (uint32_t i = 0; i < kMessages; i++) {
-    auto payload = std::make_shared<Buffer>();
-    payload->WriteInt<uint32_t>(i);
-    client.Send(payload, options);
-  }
+  ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  server_config.options.receive_sockets = 4;
+  Server server{server_config};
+  server.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<IncomingClientConnectedEvent>(
+        [&](IncomingClientConnectedEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ServerEchoHandler>(ev.session()));
+          return false;
+        });
+  });
+  ASSERT_EQ(server.Bind(), Result::Success);
+  ASSERT_EQ(server.Listen(), Result::Success);
 
-  std::mt19937 rng(7);
-  auto drop = [&]() { return (rng() % 100) < 30; };
-  auto pump = [&](UDPSocket& from, ZDTTransportLayer& to) { Pump(from, to, drop); };
+  std::vector<std::unique_ptr<Client>> clients;
+  for (size_t i = 0; i < kClients; i++) {
+    ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(5),
+                               ConnectionType::ZDT};
+    auto client = std::make_unique<Client>(client_config);
+    RoundTripState* state = &states[i];
+    client->SetEventCallback([state, i](Event& event) {
+      EventDispatcher dispatcher{event};
+      dispatcher.Dispatch<ClientConnectedToServerEvent>(
+          [state, i](ClientConnectedToServerEvent& ev) {
+            auto codec = std::make_shared<Codec>();
+            codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+            ev.session()->SetCodec(codec);
+            ev.session()->SetHandler(
+                std::make_shared<ClientReplyHandler>(state));
+            auto packet = std::make_shared<DemoPacket>();
+            packet->text = "client " + std::to_string(i);
+            ev.session()->SendPacket(packet);
+            return false;
+          });
+    });
+    ASSERT_EQ(client->Bind(), Result::Success);
+    ASSERT_EQ(client->Connect(), Result::Success);
+    clients.push_back(std::move(client));
+  }
 
-  std::set<uint32_t> unique;
-  size_t total = 0;
-  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
-  while (unique.size() < kMessages &&
-         std::chrono::steady_clock::now() < deadline) {
-    client.Update();
-    pump(*server_socket, server);
-    server.Update();
-    pump(*client_socket, client);
-    while (auto buffer = server.Receive()) {
-      unique.insert(buffer->ReadInt<uint32_t>());
-      total++;
+  auto all_replied = [&]() {
+    for (const auto& state : states) {
+      if (!state.got_reply) {
+        return false;
+      }
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return true;
+  };
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!all_replied() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  for (size_t i = 0; i < kClients; i++) {
+    EXPECT_TRUE(states[i].got_reply.load()) << "client " << i;
+    EXPECT_EQ(states[i].reply_text, "reply:client " + std::to_string(i));
   }
 
-  ASSERT_EQ(unique.size(), kMessages) << "not all reliable messages delivered";
-  EXPECT_EQ(total, kMessages) << "a retransmit was delivered as a duplicate";
+#if ZNET_ENABLE_METRICS
+  ServerMetrics sm = server.metrics();
+#ifdef ZNET_TARGET_LINUX
+  EXPECT_EQ(sm.zdt.receive_sockets, 4u);
+#else
+  EXPECT_EQ(sm.zdt.receive_sockets, 1u);
+#endif
+  EXPECT_EQ(sm.connections_accepted, kClients);
+  EXPECT_EQ(sm.zdt.cookies_rejected, 0u);
+#endif  // ZNET_ENABLE_METRICS
+
+  for (auto& client : clients) {
+    client->Disconnect();
+  }
+  server.Stop();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
 }
 
-// unreliable + ordered (sequenced): out-of-order arrivals are dropped, delivered
-// stream is strictly increasing, no retransmit.
-TEST(ZDTChannels, UnreliableSequencedDeliversMonotonic) {
-  ASSERT_EQ(Init(), Result::Success);
-  auto server_socket = MakeBoundSocket();
-  auto client_socket = MakeBoundSocket();
-  ZDTOptions config = FastConfig();
-  ZDTConnection connection;
-  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
-                           false, nullptr, connection, QuietCommon());
-  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
-                           false, nullptr, connection, QuietCommon());
+namespace {
 
-  const uint32_t kMessages = 200;
-  SendOptions options = MakeSendOptions(false, true, 2);
-  for (uint32_t i = 0; i < kMessages; i++) {
-    auto payload = std::make_shared<Buffer>();
-    payload->WriteInt<uint32_t>(i);
-    client.Send(payload, options);
+// stands in for a NAT in front of one client: the client sends to the front
+// socket, and the server sees its datagrams come from the current back socket.
+// Rebind() swaps in a new back socket, so a new source port, as a NAT does
+// when a mapping expires. The old one is kept open but no longer read, so what
+// the server still sends there is lost without an ICMP error coming back.
+class NatRelay {
+ public:
+  explicit NatRelay(std::shared_ptr<InetAddress> server)
+      : server_(std::move(server)), front_(OpenBoundSocket()),
+        back_(OpenBoundSocket()) {
+    thread_ = std::thread([this]() { Run(); });
   }
-  client.Update();  // flush once; unreliable, no retransmit
-
-  auto datagrams = CollectDatagrams(*server_socket, 1);
-  std::mt19937 rng(99);
-  std::shuffle(datagrams.begin(), datagrams.end(), rng);  // force reordering
-  for (auto& datagram : datagrams) {
-    server.OnDatagram(datagram.data(), datagram.size());
+  ~NatRelay() {
+    running_ = false;
+    thread_.join();
   }
-  server.Update();
 
-  std::vector<uint32_t> received;
-  while (auto buffer = server.Receive()) {
-    received.push_back(buffer->ReadInt<uint32_t>());
+  PortNumber port() const { return front_->local_address()->port(); }
+
+  void Rebind() {
+    auto fresh = OpenBoundSocket();
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.push_back(std::move(back_));
+    back_ = std::move(fresh);
   }
-  ASSERT_FALSE(received.empty());
-  for (size_t i = 1; i < received.size(); i++) {
-    EXPECT_LT(received[i - 1], received[i]) << "sequenced delivery not monotonic";
+
+ private:
+  void Run() {
+    std::vector<uint8_t> buf(ZNET_MAX_BUFFER_SIZE);
+    std::shared_ptr<InetAddress> client;
+    while (running_) {
+      std::shared_ptr<UDPSocket> back;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        back = back_;
+      }
+      bool idle = true;
+      size_t len = 0;
+      std::shared_ptr<InetAddress> from;
+      if (front_->RecvFrom(buf.data(), buf.size(), len, from) ==
+          RecvResult::Received) {
+        client = from;
+        back->SendTo(*server_, buf.data(), len);
+        idle = false;
+      }
+      if (back->RecvFrom(buf.data(), buf.size(), len, from) ==
+              RecvResult::Received &&
+          client) {
+        front_->SendTo(*client, buf.data(), len);
+        idle = false;
+      }
+      if (idle) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
   }
-  EXPECT_EQ(received.back(), kMessages - 1) << "highest sequence must arrive";
-}
 
-// unreliable + unordered: with no loss, every message is delivered exactly once.
-TEST(ZDTChannels, UnreliableUnorderedDeliversAllWithoutLoss) {
-  ASSERT_EQ(Init(), Result::Success);
-  auto server_socket = MakeBoundSocket();
+  std::shared_ptr<InetAddress> server_;
+  std::shared_ptr<UDPSocket> front_;
+  std::mutex mutex_;
+  std::shared_ptr<UDPSocket> back_;
+  std::vector<std::shared_ptr<UDPSocket>> retired_;
+  std::atomic_bool running_{true};
+  std::thread thread_;
+};
+
+}  // namespace
+
+// the client's NAT rebinds mid-connection: its datagrams keep their
+// connection id but arrive from a new port. The server must go on delivering
+// them and, once the new port answers a path challenge, send there instead,
+// without a new handshake.
+TEST(ZDTIntegration, ConnectionSurvivesNatRebinding) {
+  ASSERT_EQ(Init(), Result::Success);
+  PortNumber port = FreeUdpPort();
+  RoundTripState state;
+
+  ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  // several sockets, so the new port may well land on another shard
+  server_config.options.receive_sockets = 4;
+  Server server{server_config};
+  server.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<IncomingClientConnectedEvent>(
+        [&](IncomingClientConnectedEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ServerEchoHandler>(ev.session()));
+          return false;
+        });
+  });
+  ASSERT_EQ(server.Bind(), Result::Success);
+  ASSERT_EQ(server.Listen(), Result::Success);
+
+  NatRelay nat(InetAddress::from("127.0.0.1", port));
+  ClientConfig client_config{"127.0.0.1", nat.port(), std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  Client client{client_config};
+  client.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<ClientConnectedToServerEvent>(
+        [&](ClientConnectedToServerEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ClientReplyHandler>(&state));
+          auto packet = std::make_shared<DemoPacket>();
+          packet->text = "before";
+          ev.session()->SendPacket(packet);
+          return false;
+        });
+  });
+  ASSERT_EQ(client.Bind(), Result::Success);
+  ASSERT_EQ(client.Connect(), Result::Success);
+
+  auto wait_for_reply = [&]() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!state.got_reply && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return state.got_reply.load();
+  };
+  ASSERT_TRUE(wait_for_reply()) << "no echo before the rebinding";
+  EXPECT_EQ(state.reply_text, "reply:before");
+
+  nat.Rebind();
+  state.got_reply = false;
+  auto packet = std::make_shared<DemoPacket>();
+  packet->text = "after";
+  ASSERT_TRUE(client.client_session());
+  client.client_session()->SendPacket(packet);
+  ASSERT_TRUE(wait_for_reply()) << "no echo after the rebinding";
+  EXPECT_EQ(state.reply_text, "reply:after");
+
+#if ZNET_ENABLE_METRICS
+  ServerMetrics sm = server.metrics();
+  EXPECT_EQ(sm.zdt.paths_migrated, 1u);
+  EXPECT_EQ(sm.connections_accepted, 1u);  // the same connection, moved
+  EXPECT_EQ(sm.connections_active, 1u);
+#endif  // ZNET_ENABLE_METRICS
+
+  client.Disconnect();
+  server.Stop();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// --- Full application round-trip over ZDT (the "usable TCP-equivalent" proof)
+
+TEST(ZDTIntegration, AppPacketRoundTripOverUdp) {
+  ASSERT_EQ(Init(), Result::Success);
+  PortNumber port = FreeUdpPort();
+  RoundTripState state;
+
+  ServerConfig server_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  Server server{server_config};
+  server.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<IncomingClientConnectedEvent>(
+        [&](IncomingClientConnectedEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ServerEchoHandler>(ev.session()));
+          return false;
+        });
+  });
+  ASSERT_EQ(server.Bind(), Result::Success);
+  ASSERT_EQ(server.Listen(), Result::Success);
+
+  ClientConfig client_config{"127.0.0.1", port, std::chrono::seconds(5),
+                             ConnectionType::ZDT};
+  Client client{client_config};
+  client.SetEventCallback([&](Event& event) {
+    EventDispatcher dispatcher{event};
+    dispatcher.Dispatch<ClientConnectedToServerEvent>(
+        [&](ClientConnectedToServerEvent& ev) {
+          auto codec = std::make_shared<Codec>();
+          codec->Add(kPacketDemo, std::make_unique<DemoSerializer>());
+          ev.session()->SetCodec(codec);
+          ev.session()->SetHandler(
+              std::make_shared<ClientReplyHandler>(&state));
+          auto packet = std::make_shared<DemoPacket>();
+          packet->text = "hello";
+          ev.session()->SendPacket(packet);
+          return false;
+        });
+  });
+  ASSERT_EQ(client.Bind(), Result::Success);
+  ASSERT_EQ(client.Connect(), Result::Success);
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!state.got_reply && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  EXPECT_TRUE(state.got_reply.load()) << "client never received the echo";
+  EXPECT_EQ(state.reply_text, "reply:hello");
+
+  client.Disconnect();
+  server.Stop();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// --- Full channel matrix (M4) -------------------------------------------------
+
+// reliable + unordered: every message arrives exactly once (dedup on retransmit),
+// order not guaranteed.
+TEST(ZDTChannels, ReliableUnorderedDeliversAllExactlyOnce) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = MakeBoundSocket();
+  auto client_socket = MakeBoundSocket();
+  ZDTOptions config = FastConfig();
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const uint32_t kMessages = 200;
+  SendOptions options = MakeSendOptions(true, false, 1);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(i);
+    client.Send(payload, options);
+  }
+
+  std::mt19937 rng(7);
+  auto drop = [&]() { return (rng() % 100) < 30; };
+  auto pump = [&](UDPSocket& from, ZDTTransportLayer& to) { Pump(from, to, drop); };
+
+  std::set<uint32_t> unique;
+  size_t total = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while (unique.size() < kMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    client.Update();
+    pump(*server_socket, server);
+    server.Update();
+    pump(*client_socket, client);
+    while (auto buffer = server.Receive()) {
+      unique.insert(buffer->ReadInt<uint32_t>());
+      total++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_EQ(unique.size(), kMessages) << "not all reliable messages delivered";
+  EXPECT_EQ(total, kMessages) << "a retransmit was delivered as a duplicate";
+}
+
+// unreliable + ordered (sequenced): out-of-order arrivals are dropped, delivered
+// stream is strictly increasing, no retransmit.
+TEST(ZDTChannels, UnreliableSequencedDeliversMonotonic) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = MakeBoundSocket();
+  auto client_socket = MakeBoundSocket();
+  ZDTOptions config = FastConfig();
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const uint32_t kMessages = 200;
+  SendOptions options = MakeSendOptions(false, true, 2);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(i);
+    client.Send(payload, options);
+  }
+  client.Update();  // flush once; unreliable, no retransmit
+
+  auto datagrams = CollectDatagrams(*server_socket, 1);
+  std::mt19937 rng(99);
+  std::shuffle(datagrams.begin(), datagrams.end(), rng);  // force reordering
+  for (auto& datagram : datagrams) {
+    server.OnDatagram(datagram.data(), datagram.size());
+  }
+  server.Update();
+
+  std::vector<uint32_t> received;
+  while (auto buffer = server.Receive()) {
+    received.push_back(buffer->ReadInt<uint32_t>());
+  }
+  ASSERT_FALSE(received.empty());
+  for (size_t i = 1; i < received.size(); i++) {
+    EXPECT_LT(received[i - 1], received[i]) << "sequenced delivery not monotonic";
+  }
+  EXPECT_EQ(received.back(), kMessages - 1) << "highest sequence must arrive";
+}
+
+// unreliable + unordered: with no loss, every message is delivered exactly once.
+TEST(ZDTChannels, UnreliableUnorderedDeliversAllWithoutLoss) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = MakeBoundSocket();
   auto client_socket = MakeBoundSocket();
   ZDTOptions config = FastConfig();
   ZDTConnection connection;
@@ -1945,6 +2625,466 @@ TEST(ZDTCongestion, WindowBoundsBurstThenDrains) {
   }
 }
 
+// The model-based controller paces rather than bursting, and holds staged
+// messages on its clock instead of the window. Under loss it has to deliver the
+// same stream the default controller does.
+TEST(ZDTCongestion, ModelBasedControllerDeliversInOrderUnderLoss) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config = FastConfig();
+  config.congestion_algorithm = ZDTCongestionAlgorithm::Bbr;
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const uint32_t kMessages = 400;
+  const std::vector<uint8_t> filler(1024, 0x5a);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(i);
+    payload->Write(filler.data(), filler.size());
+    ASSERT_TRUE(client.Send(payload));
+  }
+
+  std::mt19937 rng(13);
+  auto drop = [&]() { return (rng() % 100) < 10; };
+
+  std::vector<uint32_t> received;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while (received.size() < kMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    client.Update();
+    Pump(*server_socket, server, drop);
+    server.Update();
+    Pump(*client_socket, client, drop);
+    while (auto buffer = server.Receive()) {
+      received.push_back(buffer->ReadInt<uint32_t>());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_EQ(received.size(), kMessages);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    EXPECT_EQ(received[i], i) << "out-of-order delivery at index " << i;
+  }
+#if ZNET_ENABLE_METRICS
+  SessionMetrics metrics;
+  client.FillMetrics(metrics);
+  EXPECT_GT(metrics.zdt.pacing_rate, 0u) << "a measured path should be paced";
+#endif
+}
+
+// Pacing under the delay controller, in both places it can happen: the worker
+// holding datagrams back, and the kernel holding them for their launch time
+// (which falls back to the worker where the socket cannot).
+namespace {
+
+void ExpectPacedDelivery(ZDTPacing pacing) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config = FastConfig();
+  config.pacing = pacing;
+  if (pacing == ZDTPacing::Kernel) {
+    client_socket->EnableTxTime();
+  }
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const uint32_t kMessages = 200;
+  const std::vector<uint8_t> filler(1024, 0x3c);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(i);
+    payload->Write(filler.data(), filler.size());
+    ASSERT_TRUE(client.Send(payload));
+  }
+
+  std::mt19937 rng(21);
+  auto drop = [&]() { return (rng() % 100) < 5; };
+
+  std::vector<uint32_t> received;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while (received.size() < kMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    client.Update();
+    Pump(*server_socket, server, drop);
+    server.Update();
+    Pump(*client_socket, client, drop);
+    while (auto buffer = server.Receive()) {
+      received.push_back(buffer->ReadInt<uint32_t>());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_EQ(received.size(), kMessages);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    EXPECT_EQ(received[i], i) << "out-of-order delivery at index " << i;
+  }
+#if ZNET_ENABLE_METRICS
+  SessionMetrics metrics;
+  client.FillMetrics(metrics);
+  EXPECT_GT(metrics.zdt.pacing_rate, 0u) << "pacing was asked for";
+#endif
+}
+
+}  // namespace
+
+TEST(ZDTCongestion, WorkerPacingDeliversInOrderUnderLoss) {
+  ExpectPacedDelivery(ZDTPacing::Worker);
+}
+
+TEST(ZDTCongestion, KernelPacingDeliversInOrderUnderLoss) {
+  ExpectPacedDelivery(ZDTPacing::Kernel);
+}
+
+// --- Forward error correction -------------------------------------------------
+
+namespace {
+
+// the u32 each FEC test message starts with, from a raw datagram's records on
+// `channel`; parity records are skipped
+std::vector<uint32_t> MessagesIn(const std::vector<uint8_t>& datagram,
+                                 uint8_t channel) {
+  std::vector<uint32_t> out;
+  Buffer buffer(Endianness::BigEndian);
+  buffer.Write(reinterpret_cast<const char*>(datagram.data()), datagram.size());
+  ZDTHeader header;
+  if (!ReadZDTHeader(buffer, header)) {
+    return out;
+  }
+  ZDTRecord record;
+  while (buffer.readable_bytes() > 0 && ReadZDTRecord(buffer, record)) {
+    if (record.channel == channel && !(record.flags & kRecParity) &&
+        record.length >= 4) {
+      Buffer payload;
+      payload.Write(buffer.read_cursor_data(), 4);
+      out.push_back(payload.ReadInt<uint32_t>());
+    }
+    buffer.SkipRead(record.length);
+  }
+  return out;
+}
+
+}  // namespace
+
+// Unreliable messages have no retransmit to fall back on, so on a protected
+// channel a lost one can only come back through parity. One loss per group,
+// past the first, which goes out before the receiver has seen any parity and
+// so starts remembering the channel.
+TEST(ZDTFec, RebuildsOneLossPerGroupWithoutARetransmit) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config = FastConfig();
+  config.fec_channels = {2};
+  config.fec_group_size = 4;
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const SendOptions input = SendOptions().Reliable(false).Ordered(false).Channel(2);
+  const uint32_t kMessages = 40;
+  std::set<uint32_t> dropped;
+  std::set<uint32_t> received;
+  for (uint32_t i = 0; i < kMessages; i++) {
+    auto payload = std::make_shared<Buffer>();
+    payload->WriteInt<uint32_t>(i);
+    payload->Write("input", 5);
+    ASSERT_TRUE(client.Send(payload, input));
+    client.Update();  // one message per datagram, as a tick's input would go
+    for (auto& datagram : CollectDatagrams(*server_socket, 1)) {
+      const auto carried = MessagesIn(datagram, 2);
+      if (carried.size() == 1 && carried[0] >= 4 && carried[0] % 4 == 1) {
+        dropped.insert(carried[0]);
+        continue;
+      }
+      server.OnDatagram(datagram.data(), datagram.size());
+    }
+    server.Update();
+    Pump(*client_socket, client);
+    while (auto buffer = server.Receive()) {
+      received.insert(buffer->ReadInt<uint32_t>());
+    }
+  }
+
+  EXPECT_EQ(dropped.size(), 9u);
+  EXPECT_EQ(received.size(), kMessages) << "every loss should be rebuilt";
+#if ZNET_ENABLE_METRICS
+  SessionMetrics sent;
+  client.FillMetrics(sent);
+  EXPECT_EQ(sent.zdt.fec_parity_sent, kMessages / 4);
+  EXPECT_EQ(sent.zdt.retransmits, 0u);
+  SessionMetrics got;
+  server.FillMetrics(got);
+  EXPECT_EQ(got.zdt.fec_recovered, 9u);
+#endif
+}
+
+// A burst sent in one tick would pack into a single datagram, and losing that
+// would lose the whole group. Each member has to travel on its own.
+TEST(ZDTFec, BurstInOneTickSurvivesLosingADatagram) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config = FastConfig();
+  config.fec_channels = {2};
+  config.fec_group_size = 4;
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  const SendOptions input = SendOptions().Reliable(false).Ordered(false).Channel(2);
+  std::set<uint32_t> received;
+  auto burst = [&](uint32_t first, bool drop_one) {
+    for (uint32_t i = first; i < first + 4; i++) {
+      auto payload = std::make_shared<Buffer>();
+      payload->WriteInt<uint32_t>(i);
+      payload->Write("input", 5);
+      ASSERT_TRUE(client.Send(payload, input));
+    }
+    client.Update();
+    bool dropped = false;
+    for (auto& datagram : CollectDatagrams(*server_socket, 5)) {
+      const auto carried = MessagesIn(datagram, 2);
+      EXPECT_LE(carried.size(), 1u) << "two of one group in a datagram";
+      if (drop_one && !dropped && !carried.empty()) {
+        dropped = true;
+        continue;
+      }
+      server.OnDatagram(datagram.data(), datagram.size());
+    }
+    EXPECT_EQ(dropped, drop_one);
+    server.Update();
+    Pump(*client_socket, client);
+    while (auto buffer = server.Receive()) {
+      received.insert(buffer->ReadInt<uint32_t>());
+    }
+  };
+  // the first group only teaches the receiver that the channel has parity
+  burst(0, /*drop_one=*/false);
+  burst(4, /*drop_one=*/true);
+
+  EXPECT_EQ(received, (std::set<uint32_t>{0, 1, 2, 3, 4, 5, 6, 7}));
+#if ZNET_ENABLE_METRICS
+  SessionMetrics got;
+  server.FillMetrics(got);
+  EXPECT_EQ(got.zdt.fec_recovered, 1u);
+#endif
+}
+
+// A reliable message rebuilt from parity is still resent, since its datagram
+// was never acked. Delivery has to stay in order and exactly once all the same.
+TEST(ZDTFec, ReliableChannelDeliversOnceAndInOrderUnderLoss) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTOptions config = FastConfig();
+  config.fec_channels = {0};
+  ZDTConnection connection;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(), config,
+                           false, nullptr, connection, QuietCommon());
+
+  std::mt19937 rng(5);
+  auto drop = [&]() { return (rng() % 100) < 10; };
+  const uint32_t kMessages = 300;
+  uint32_t queued = 0;
+  std::vector<uint32_t> received;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while (received.size() < kMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    // a few per tick, so groups span datagrams the way a stream's do
+    for (int i = 0; i < 3 && queued < kMessages; i++, queued++) {
+      auto payload = std::make_shared<Buffer>();
+      payload->WriteInt<uint32_t>(queued);
+      ASSERT_TRUE(client.Send(payload));
+      client.Update();
+    }
+    client.Update();
+    Pump(*server_socket, server, drop);
+    server.Update();
+    Pump(*client_socket, client, drop);
+    while (auto buffer = server.Receive()) {
+      received.push_back(buffer->ReadInt<uint32_t>());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_EQ(received.size(), kMessages);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    EXPECT_EQ(received[i], i) << "out-of-order delivery at index " << i;
+  }
+#if ZNET_ENABLE_METRICS
+  SessionMetrics got;
+  server.FillMetrics(got);
+  EXPECT_GT(got.zdt.fec_recovered, 0u);
+#endif
+}
+
+// --- Datagram sealing ---------------------------------------------------------
+
+namespace {
+
+// what the session would derive for a client and the server it reached: one
+// side's tx is the other's rx
+void InstallMirroredKeys(ZDTTransportLayer& client, ZDTTransportLayer& server) {
+  DatagramKeys keys;
+  for (size_t i = 0; i < sizeof(keys.tx_key); i++) {
+    keys.tx_key[i] = static_cast<unsigned char>(i * 7);
+    keys.rx_key[i] = static_cast<unsigned char>(0xA0 ^ i);
+  }
+  std::memcpy(keys.tx_salt, "c2s_", 4);
+  std::memcpy(keys.rx_salt, "s2c_", 4);
+  ASSERT_TRUE(client.InstallDatagramKeys(keys));
+  DatagramKeys mirrored;
+  std::memcpy(mirrored.tx_key, keys.rx_key, sizeof(keys.rx_key));
+  std::memcpy(mirrored.tx_salt, keys.rx_salt, sizeof(keys.rx_salt));
+  std::memcpy(mirrored.rx_key, keys.tx_key, sizeof(keys.tx_key));
+  std::memcpy(mirrored.rx_salt, keys.tx_salt, sizeof(keys.tx_salt));
+  ASSERT_TRUE(server.InstallDatagramKeys(mirrored));
+}
+
+bool Contains(const std::vector<uint8_t>& haystack, const std::string& needle) {
+  return std::search(haystack.begin(), haystack.end(), needle.begin(),
+                     needle.end()) != haystack.end();
+}
+
+}  // namespace
+
+// Keys only take on a connection whose handshake agreed to seal, so a session
+// that offers them to a peer that declined keeps its per-message encryption.
+TEST(ZDTSealing, KeysNeedANegotiatedConnection) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto socket = OpenBoundSocket();
+  ZDTConnection connection;
+  ZDTTransportLayer transport(socket, socket->local_address(), FastConfig(),
+                              false, nullptr, connection, QuietCommon());
+  EXPECT_FALSE(transport.InstallDatagramKeys(DatagramKeys{}));
+}
+
+// Every datagram on a sealed link carries the flag and none of its payload in
+// the clear, retransmits included, and delivery under loss stays reliable and
+// in order.
+TEST(ZDTSealing, SealedLinkDeliversInOrderUnderLoss) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTConnection connection;
+  connection.sealed = true;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(),
+                           FastConfig(), false, nullptr, connection,
+                           QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(),
+                           FastConfig(), false, nullptr, connection,
+                           QuietCommon());
+  InstallMirroredKeys(client, server);
+  client.StartSealing();
+  server.StartSealing();
+
+  std::mt19937 rng(16);
+  const std::string marker = "plaintext-marker";
+  const uint32_t kMessages = 200;
+  uint32_t queued = 0;
+  size_t datagrams = 0;
+  size_t leaked = 0;
+  std::vector<uint32_t> received;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while (received.size() < kMessages &&
+         std::chrono::steady_clock::now() < deadline) {
+    for (int i = 0; i < 4 && queued < kMessages; i++, queued++) {
+      auto payload = std::make_shared<Buffer>();
+      payload->WriteInt<uint32_t>(queued);
+      payload->Write(marker.data(), marker.size());
+      ASSERT_TRUE(client.Send(payload));
+    }
+    client.Update();
+    for (auto& datagram : CollectDatagrams(*server_socket)) {
+      datagrams++;
+      if (datagram.empty() || !(datagram[0] & kFlagSealed) ||
+          Contains(datagram, marker)) {
+        leaked++;
+      }
+      if (rng() % 100 >= 10) {
+        server.OnDatagram(datagram.data(), datagram.size());
+      }
+    }
+    server.Update();
+    Pump(*client_socket, client, [&]() { return (rng() % 100) < 10; });
+    while (auto buffer = server.Receive()) {
+      EXPECT_TRUE(server.LastReceiveSealed());
+      received.push_back(buffer->ReadInt<uint32_t>());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  EXPECT_GT(datagrams, 0u);
+  EXPECT_EQ(leaked, 0u) << "every datagram should go out sealed";
+  ASSERT_EQ(received.size(), kMessages);
+  for (uint32_t i = 0; i < kMessages; i++) {
+    EXPECT_EQ(received[i], i) << "out-of-order delivery at index " << i;
+  }
+}
+
+// Until the peer seals, its datagrams still ack and keep the link alive, but
+// once keys are in, a message that arrived unsealed is left unacked rather
+// than delivered: it comes back sealed, and only then counts.
+TEST(ZDTSealing, UnsealedMessagesWaitForTheSealedRetransmit) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = OpenBoundSocket();
+  auto client_socket = OpenBoundSocket();
+  ZDTConnection connection;
+  connection.sealed = true;
+  ZDTTransportLayer client(client_socket, server_socket->local_address(),
+                           FastConfig(), false, nullptr, connection,
+                           QuietCommon());
+  ZDTTransportLayer server(server_socket, client_socket->local_address(),
+                           FastConfig(), false, nullptr, connection,
+                           QuietCommon());
+  InstallMirroredKeys(client, server);
+  server.StartSealing();
+
+  auto payload = std::make_shared<Buffer>();
+  payload->WriteInt<uint32_t>(42);
+  ASSERT_TRUE(client.Send(payload));
+  client.Update();
+  auto unsealed = CollectDatagrams(*server_socket, 1);
+  ASSERT_FALSE(unsealed.empty());
+  EXPECT_FALSE(unsealed[0][0] & kFlagSealed);
+  for (auto& datagram : unsealed) {
+    server.OnDatagram(datagram.data(), datagram.size());
+  }
+  server.Update();
+  EXPECT_FALSE(server.Receive()) << "an unsealed message must not be delivered";
+
+  client.StartSealing();
+  std::shared_ptr<Buffer> delivered;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!delivered && std::chrono::steady_clock::now() < deadline) {
+    client.Update();
+    Pump(*server_socket, server);
+    server.Update();
+    Pump(*client_socket, client);
+    delivered = server.Receive();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_TRUE(delivered);
+  EXPECT_TRUE(server.LastReceiveSealed());
+  EXPECT_EQ(delivered->ReadInt<uint32_t>(), 42u);
+  EXPECT_FALSE(server.Receive()) << "delivered exactly once";
+}
+
 // Ack blocks are variable length, so a full datagram has to leave room for
 // them. Heavy two-way loss is what makes the encoder emit many: the history
 // alternates, and each run costs another block.
@@ -2016,6 +3156,43 @@ TEST(ZDTCongestion, DatagramsStayWithinTheMtu) {
   EXPECT_LE(largest, mtu) << "a datagram overran the negotiated MTU";
 }
 
+// Everything one Flush() builds goes to the socket together, and send_batch
+// bounds how much that is.
+TEST(ZDTCongestion, FlushHandsItsDatagramsToOneSend) {
+  ASSERT_EQ(Init(), Result::Success);
+  auto server_socket = MakeBoundSocket();
+  auto client_socket = MakeBoundSocket();
+  ZDTConnection connection;
+  const size_t widest = connection.mtu - kZDTHeaderReserve - kZDTRecordHeaderSize;
+  for (size_t send_batch : {size_t{32}, size_t{1}}) {
+    SCOPED_TRACE(send_batch);
+    ZDTOptions config = FastConfig();
+    config.send_batch = send_batch;
+    ZDTTransportLayer client(client_socket, server_socket->local_address(),
+                             config, false, nullptr, connection, QuietCommon());
+    // full-width messages, so each takes a datagram of its own; fewer than
+    // the opening congestion window, so none is held back
+    const size_t kMessages = 6;
+    for (size_t i = 0; i < kMessages; i++) {
+      auto payload = std::make_shared<Buffer>();
+      for (size_t b = 0; b < widest; b++) {
+        payload->WriteInt<uint8_t>(static_cast<uint8_t>(i));
+      }
+      ASSERT_TRUE(client.Send(payload));
+    }
+    client.Flush();
+    EXPECT_EQ(CollectDatagrams(*server_socket, kMessages).size(), kMessages);
+#if ZNET_ENABLE_METRICS
+    SessionMetrics m;
+    client.FillMetrics(m);
+    EXPECT_EQ(m.zdt.datagrams_sent, kMessages);
+    EXPECT_EQ(m.zdt.send_calls, send_batch == 1 ? kMessages : 1u);
+#endif
+    client.Close();
+    CollectDatagrams(*server_socket, 1);  // the FIN
+  }
+}
+
 // a reported gap has to be resent straight away. the retransmit scan is skipped
 // until the soonest RTO deadline, so a nak that does not pull that deadline in
 // is silently worth nothing.
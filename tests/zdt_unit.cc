@@ -9,19 +9,38 @@
 //
 
 //
-// Unit tests for ZDT's protocol components in isolation: no sockets, no
-// threads, no timers, so they run in milliseconds and a failure names one
-// component rather than "the connection misbehaved". The socket-level and
-// end-to-end tests live in zdt.cc.
+// Unit tests for ZDT's protocol components in isolation: no sockets but a
+// loopback one for a transport to write its acks to, no timers, and threads
+// only where the hand-off between two is what is under test, so they run in milliseconds and a failure names one component rather
+// than "the connection misbehaved". The socket-level and end-to-end tests live
+// in zdt.cc.
 //
 
 #include "znet/backends/zdt/zdt_ack_history.h"
 #include "znet/backends/zdt/zdt_congestion.h"
+#include "znet/backends/zdt/zdt_fec.h"
+#include "znet/backends/zdt/zdt_net.h"
+#include "znet/backends/zdt/zdt_peer_table.h"
+#include "znet/backends/zdt/zdt_retransmit_schedule.h"
+#include "znet/backends/zdt/zdt_seal.h"
+#include "znet/backends/zdt/zdt_seq_window.h"
+#include "znet/backends/zdt/zdt_transport.h"
 #include "znet/backends/zdt/zdt_wire.h"
 #include "znet/encryption.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 using namespace znet;
@@ -338,20 +357,20 @@ constexpr int kCap = 512;
 }  // namespace
 
 TEST(ZDTCongestionTest, StartsAtInitialWindowTen) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   EXPECT_DOUBLE_EQ(cc.cwnd(), 10.0);
   EXPECT_EQ(cc.Window(kCap), 10);
 }
 
 TEST(ZDTCongestionTest, SlowStartGrowsOnePerAckedDatagram) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QuietRtt();
   cc.OnAcked(3, rtt, /*next_seq=*/1, kCap);
   EXPECT_DOUBLE_EQ(cc.cwnd(), 13.0);
 }
 
 TEST(ZDTCongestionTest, WindowIsClampedToCap) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QuietRtt();
   for (int i = 0; i < 200; i++) {
     cc.OnAcked(50, rtt, /*next_seq=*/1, kCap);
@@ -362,7 +381,7 @@ TEST(ZDTCongestionTest, WindowIsClampedToCap) {
 }
 
 TEST(ZDTCongestionTest, WindowNeverStallsBelowTwo) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QueueingRtt();
   for (int i = 0; i < 200; i++) {
     cc.OnAcked(1, rtt, /*next_seq=*/1, kCap);
@@ -372,7 +391,7 @@ TEST(ZDTCongestionTest, WindowNeverStallsBelowTwo) {
 }
 
 TEST(ZDTCongestionTest, ZeroAckedIsANoOp) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QuietRtt();
   cc.OnAcked(0, rtt, 1, kCap);
   EXPECT_DOUBLE_EQ(cc.cwnd(), 10.0);
@@ -380,7 +399,7 @@ TEST(ZDTCongestionTest, ZeroAckedIsANoOp) {
 
 // One loss event should cost one reduction, not one per datagram in it.
 TEST(ZDTCongestionTest, QueueingBacksOffOncePerEpoch) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QueueingRtt();
   const double before = cc.cwnd();
 
@@ -394,7 +413,7 @@ TEST(ZDTCongestionTest, QueueingBacksOffOncePerEpoch) {
 }
 
 TEST(ZDTCongestionTest, RecoveryEndsOnceTheEpochSequenceIsAcked) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QueueingRtt();
   cc.OnAcked(1, rtt, /*next_seq=*/100, kCap);
   ASSERT_TRUE(cc.in_loss_recovery());
@@ -406,7 +425,7 @@ TEST(ZDTCongestionTest, RecoveryEndsOnceTheEpochSequenceIsAcked) {
 }
 
 TEST(ZDTCongestionTest, QueueingTimeoutCollapsesToTwoOncePerEpoch) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QueueingRtt();
   cc.OnRetransmitTimeout(rtt, /*next_seq=*/50);
   EXPECT_DOUBLE_EQ(cc.cwnd(), 2.0);
@@ -421,7 +440,7 @@ TEST(ZDTCongestionTest, QueueingTimeoutCollapsesToTwoOncePerEpoch) {
 // inside one round trip, which walks the window down to its floor and keeps it
 // there. This asserts what the code does today; see the refactor plan.
 TEST(ZDTCongestionTest, RepeatedTimeoutsWithoutQueueingWalkDownToTheFloor) {
-  ZDTCongestionController cc;
+  ZDTDelayController cc;
   const ZDTRttEstimator rtt = QuietRtt();
   ASSERT_FALSE(rtt.IsQueueing());
 
@@ -441,11 +460,11 @@ TEST(ZDTCongestionTest, RepeatedTimeoutsWithoutQueueingWalkDownToTheFloor) {
 // The two timeout paths floor at different values, which is worth pinning
 // because it is surprising rather than obviously intended.
 TEST(ZDTCongestionTest, TheTwoTimeoutFloorsDisagree) {
-  ZDTCongestionController queueing;
+  ZDTDelayController queueing;
   queueing.OnRetransmitTimeout(QueueingRtt(), 1);
   EXPECT_DOUBLE_EQ(queueing.cwnd(), 2.0);
 
-  ZDTCongestionController lossy;
+  ZDTDelayController lossy;
   const ZDTRttEstimator quiet = QuietRtt();
   for (int i = 0; i < 50; i++) {
     lossy.OnRetransmitTimeout(quiet, static_cast<WireSeq>(i));
@@ -453,6 +472,230 @@ TEST(ZDTCongestionTest, TheTwoTimeoutFloorsDisagree) {
   EXPECT_DOUBLE_EQ(lossy.cwnd(), 8.0);
 }
 
+// --- model-based controller ---------------------------------------------------
+
+namespace {
+
+// one bottleneck serving a datagram every `service`, behind a fixed
+// propagation delay, stepped 100 us at a time. Enough of a path for the model
+// to measure, with none of a real socket's scheduling noise.
+struct BottleneckLink {
+  std::chrono::microseconds service{1000};  // 1000 datagrams/s
+  Ms propagation{10};
+  TP now{};
+  TP link_free{};
+  WireSeq next_seq = 1;
+  // sends per step the application has; negative for a sender that always has
+  // more than the controller lets out
+  int offered = -1;
+  ZDTRttEstimator rtt;
+  ZDTPacer pacer;
+
+  struct Sent {
+    WireSeq seq;
+    TP sent;
+    TP acked_at;
+  };
+  std::deque<Sent> flight;
+
+  void Step(ZDTCongestionController& cc) {
+    now += std::chrono::microseconds{100};
+    while (!flight.empty() && flight.front().acked_at <= now) {
+      const Sent sent = flight.front();
+      flight.pop_front();
+      rtt.OnSample(now - sent.sent, now, Ms{1}, Ms{2000});
+      ZDTAckEvent ack;
+      ack.peer_ack = sent.seq;
+      ack.acked_datagrams = 1;
+      ack.in_flight = static_cast<int>(flight.size());
+      ack.next_seq = next_seq;
+      ack.cap = kCap;
+      ack.now = now;
+      cc.OnAck(ack, rtt);
+      pacer.SetRate(cc.pacing_rate());
+    }
+    int count = 0;
+    while (static_cast<int>(flight.size()) < cc.Window(kCap) &&
+           pacer.NextSendTime() <= now && (offered < 0 || count < offered)) {
+      link_free = std::max(now, link_free) + service;
+      flight.push_back(Sent{next_seq++, now, link_free + propagation});
+      pacer.OnSent(now);
+      count++;
+    }
+    if (offered >= 0 && static_cast<int>(flight.size()) < cc.Window(kCap)) {
+      cc.OnAppLimited();
+    }
+  }
+
+  void Run(ZDTCongestionController& cc, Ms duration) {
+    const TP end = now + duration;
+    while (now < end) {
+      Step(cc);
+    }
+  }
+
+  // what the link queues beyond its own service time
+  Ms QueueDelay() const {
+    return std::chrono::duration_cast<Ms>(std::max(link_free - now, TP::duration{}));
+  }
+};
+
+}  // namespace
+
+TEST(ZDTPacerTest, UnpacedUntilGivenARate) {
+  ZDTPacer pacer;
+  pacer.OnSent(At(5));
+  EXPECT_EQ(pacer.NextSendTime(), TP{});
+
+  pacer.SetRate(1000.0);
+  pacer.OnSent(At(5));
+  pacer.SetRate(0.0);
+  EXPECT_EQ(pacer.NextSendTime(), TP{}) << "a zero rate lets everything go";
+}
+
+// back to back sends first spend the idle quantum, then fall one interval
+// apart each
+TEST(ZDTPacerTest, SpendsTheQuantumThenSpacesSends) {
+  ZDTPacer pacer;
+  pacer.SetRate(10000.0);  // 100 us apart: the 1 ms quantum, then this slot
+  const TP now = At(1000);
+  int free_sends = 0;
+  while (pacer.NextSendTime() <= now && free_sends < 100) {
+    pacer.OnSent(now);
+    free_sends++;
+  }
+  EXPECT_EQ(free_sends, 11);
+
+  const TP previous = pacer.NextSendTime();
+  pacer.OnSent(now);
+  EXPECT_EQ(pacer.NextSendTime() - previous, std::chrono::microseconds{100});
+}
+
+TEST(ZDTPacerTest, IdlingBanksNoMoreThanTheQuantum) {
+  ZDTPacer pacer;
+  pacer.SetRate(10000.0);
+  pacer.OnSent(At(0));
+  // a second of silence is 10000 skipped slots; only the quantum comes back
+  const TP later = At(1000);
+  int free_sends = 0;
+  while (pacer.NextSendTime() <= later && free_sends < 100) {
+    pacer.OnSent(later);
+    free_sends++;
+  }
+  EXPECT_EQ(free_sends, 11);
+}
+
+// the delay controller's rate is its window over the round trip, with room
+// to grow on top so pacing does not become the limit
+TEST(ZDTPacerTest, DelayControllerPacesTheWindowOverTheRoundTrip) {
+  ZDTDelayController cc;
+  EXPECT_DOUBLE_EQ(cc.pacing_rate(), 0.0) << "no round trip yet";
+  ZDTAckEvent ack;
+  ack.peer_ack = 1;
+  ack.next_seq = 2;
+  ack.cap = kCap;
+  cc.OnAck(ack, QuietRtt());  // 100 ms, nothing acked
+  // slow start: 2x of 10 datagrams per 100 ms
+  EXPECT_DOUBLE_EQ(cc.pacing_rate(), 200.0);
+}
+
+TEST(ZDTBbrTest, FactoryKeepsTheDelayControllerAsTheDefault) {
+  ZDTOptions options;
+  auto cc = MakeZDTCongestionController(options.congestion_algorithm);
+  ASSERT_NE(dynamic_cast<ZDTDelayController*>(cc.get()), nullptr);
+
+  auto bbr = MakeZDTCongestionController(ZDTCongestionAlgorithm::Bbr);
+  EXPECT_NE(dynamic_cast<ZDTBbrController*>(bbr.get()), nullptr);
+}
+
+TEST(ZDTBbrTest, StartsAtTheInitialWindowWithoutPacing) {
+  ZDTBbrController cc;
+  EXPECT_EQ(cc.mode(), ZDTBbrController::Mode::Startup);
+  EXPECT_EQ(cc.Window(kCap), 10);
+  EXPECT_DOUBLE_EQ(cc.pacing_rate(), 0.0)
+      << "no round trip yet, so no rate to pace";
+}
+
+// the model should find the link's rate, leave Startup, and settle on a window
+// near twice the bandwidth-delay product rather than filling the queue
+TEST(ZDTBbrTest, FindsTheBottleneckAndSettlesNearTheBdp) {
+  ZDTBbrController cc;
+  BottleneckLink link;
+  link.Run(cc, Ms{3000});
+
+  EXPECT_EQ(cc.mode(), ZDTBbrController::Mode::ProbeBandwidth);
+  EXPECT_NEAR(cc.bottleneck_rate(), 1000.0, 150.0);
+  EXPECT_NEAR(cc.min_rtt_ms(), 11.0, 0.5);
+  // bdp = 1000/s * 11 ms = 11 datagrams, and the window is twice that
+  EXPECT_GE(cc.Window(kCap), 16);
+  EXPECT_LE(cc.Window(kCap), 30);
+  EXPECT_LE(link.QueueDelay(), Ms{15}) << "the pacer must not let a queue build";
+}
+
+TEST(ZDTBbrTest, PacesNearTheEstimatedRate) {
+  ZDTBbrController cc;
+  BottleneckLink link;
+  link.Run(cc, Ms{3000});
+  EXPECT_NEAR(cc.pacing_rate(), cc.bottleneck_rate(), cc.bottleneck_rate() * 0.3)
+      << "outside Startup the gain stays within a quarter of the estimate";
+}
+
+TEST(ZDTBbrTest, AnIdleApplicationDoesNotLowerTheEstimate) {
+  ZDTBbrController cc;
+  BottleneckLink link;
+  link.Run(cc, Ms{3000});
+  const double measured = cc.bottleneck_rate();
+
+  // one datagram every other step: a tenth of what the link carries, for far
+  // more round trips than the estimate's window
+  for (int i = 0; i < 20000; i++) {
+    link.offered = i % 2 == 0 ? 1 : 0;
+    link.Step(cc);
+  }
+  EXPECT_GE(cc.bottleneck_rate(), measured * 0.9);
+}
+
+TEST(ZDTBbrTest, ReprobesTheMinimumRoundTripOnceItGoesStale) {
+  ZDTBbrController cc;
+  BottleneckLink link;
+  bool probed = false;
+  int probe_window = kCap;
+  const TP end = link.now + Ms{kZDTRttMinWindowMs + 2000};
+  while (link.now < end) {
+    link.Step(cc);
+    if (cc.mode() == ZDTBbrController::Mode::ProbeRtt) {
+      probed = true;
+      probe_window = std::min(probe_window, cc.Window(kCap));
+    }
+  }
+  EXPECT_TRUE(probed);
+  EXPECT_EQ(probe_window, kZDTBbrMinWindow);
+  EXPECT_EQ(cc.mode(), ZDTBbrController::Mode::ProbeBandwidth)
+      << "the probe is a moment, not a new state";
+}
+
+TEST(ZDTBbrTest, TimeoutDropsToTheFloorForOneEpoch) {
+  ZDTBbrController cc;
+  BottleneckLink link;
+  link.Run(cc, Ms{3000});
+  const int window = cc.Window(kCap);
+  ASSERT_GT(window, kZDTBbrMinWindow);
+
+  cc.OnRetransmitTimeout(link.rtt, /*next_seq=*/500);
+  EXPECT_EQ(cc.Window(kCap), kZDTBbrMinWindow);
+  cc.OnRetransmitTimeout(link.rtt, /*next_seq=*/600);  // same epoch
+
+  ZDTAckEvent ack;
+  ack.peer_ack = 500;
+  ack.in_flight = 0;
+  ack.next_seq = 601;
+  ack.cap = kCap;
+  ack.now = link.now;
+  cc.OnAck(ack, link.rtt);
+  EXPECT_GE(cc.Window(kCap), window)
+      << "acking the epoch restores the window, once";
+}
+
 // ---------------------------------------------------------------------------
 // ReplayWindow
 //
@@ -570,3 +813,875 @@ TEST(ReplayWindowTest, AcceptsEveryCounterOfAShuffledBurstExactlyOnce) {
     EXPECT_FALSE(window.Accept(counter)) << "counter " << counter;
   }
 }
+
+// --- PeerKey / PeerTable ----------------------------------------------------
+
+namespace {
+
+PeerKey KeyFor(const std::string& host, PortNumber port) {
+  return PeerKey::From(*InetAddress::from(host, port));
+}
+
+}  // namespace
+
+TEST(PeerKeyTest, DistinguishesPortsAndFamilies) {
+  const PeerKey a = KeyFor("127.0.0.1", 4000);
+  EXPECT_TRUE(a.valid());
+  EXPECT_EQ(a, KeyFor("127.0.0.1", 4000));
+  EXPECT_NE(a, KeyFor("127.0.0.1", 4001));
+  EXPECT_NE(a, KeyFor("127.0.0.2", 4000));
+  EXPECT_NE(a, KeyFor("::ffff:127.0.0.1", 4000));
+  EXPECT_FALSE(PeerKey().valid());
+}
+
+TEST(PeerKeyTest, ConvertsBackToTheSameAddress) {
+  for (const char* host : {"10.1.2.3", "2001:db8::7"}) {
+    const PeerKey key = KeyFor(host, 5123);
+    auto address = key.ToInetAddress();
+    ASSERT_TRUE(address) << host;
+    EXPECT_EQ(address->readable(), InetAddress::from(host, 5123)->readable());
+    EXPECT_EQ(PeerKey::From(*address), key);
+  }
+  EXPECT_EQ(PeerKey().ToInetAddress(), nullptr);
+}
+
+TEST(PeerTableTest, InsertFindReplaceErase) {
+  PeerTable<int> table;
+  const PeerKey a = KeyFor("127.0.0.1", 1);
+  const PeerKey b = KeyFor("127.0.0.1", 2);
+  EXPECT_EQ(table.Find(a), nullptr);
+  table.Insert(a, 10);
+  table.Insert(b, 20);
+  ASSERT_NE(table.Find(a), nullptr);
+  EXPECT_EQ(*table.Find(a), 10);
+  table.Insert(a, 11);
+  EXPECT_EQ(*table.Find(a), 11);
+  EXPECT_EQ(table.size(), 2u);
+  EXPECT_TRUE(table.Erase(a));
+  EXPECT_FALSE(table.Erase(a));
+  EXPECT_EQ(table.Find(a), nullptr);
+  EXPECT_EQ(*table.Find(b), 20);
+  EXPECT_EQ(table.size(), 1u);
+}
+
+// enough entries to grow several times and to form long probe runs; every
+// erase has to leave the rest reachable
+TEST(PeerTableTest, EraseKeepsEveryOtherEntryReachable) {
+  PeerTable<int> table;
+  constexpr int kPeers = 2000;
+  for (int i = 0; i < kPeers; i++) {
+    table.Insert(KeyFor("10.0.0.1", static_cast<PortNumber>(1000 + i)), i);
+  }
+  ASSERT_EQ(table.size(), static_cast<size_t>(kPeers));
+  for (int i = 0; i < kPeers; i += 3) {
+    EXPECT_TRUE(
+        table.Erase(KeyFor("10.0.0.1", static_cast<PortNumber>(1000 + i))));
+  }
+  const size_t odd = table.EraseIf([](int value) { return value % 2 == 1; });
+  for (int i = 0; i < kPeers; i++) {
+    const int* found =
+        table.Find(KeyFor("10.0.0.1", static_cast<PortNumber>(1000 + i)));
+    const bool kept = i % 3 != 0 && i % 2 == 0;
+    ASSERT_EQ(found != nullptr, kept) << "peer " << i;
+    if (kept) {
+      EXPECT_EQ(*found, i);
+    }
+  }
+  EXPECT_EQ(table.size() + odd + (kPeers + 2) / 3, static_cast<size_t>(kPeers));
+}
+
+// --- Receive buffer pool -------------------------------------------------------
+
+TEST(ZDTDatagramPoolTest, RecycledBuffersAreReusedUpToTheCap) {
+  ZDTDatagramPool pool(/*max_pooled=*/2);
+  const char payload[] = "datagram";
+  bool hit = true;
+  std::vector<Buffer> drained;
+  for (int i = 0; i < 3; i++) {
+    drained.push_back(pool.Copy(payload, sizeof(payload), hit));
+    EXPECT_FALSE(hit) << "nothing has been recycled yet";
+  }
+  const char* storage = drained.front().data();
+  pool.Recycle(drained);
+  EXPECT_TRUE(drained.empty());
+
+  // two came back; the third was over the cap and freed
+  Buffer first = pool.Copy(payload, 4, hit);
+  EXPECT_TRUE(hit);
+  Buffer second = pool.Copy(payload, 4, hit);
+  EXPECT_TRUE(hit);
+  EXPECT_TRUE(first.data() == storage || second.data() == storage);
+  Buffer third = pool.Copy(payload, 4, hit);
+  EXPECT_FALSE(hit);
+
+  // a reused buffer holds only the new copy
+  EXPECT_EQ(first.size(), 4u);
+  EXPECT_EQ(std::string(first.data(), first.size()), "data");
+  EXPECT_EQ(first.endianness(), Endianness::BigEndian);
+}
+
+TEST(ZDTInboxTest, CountsPoolHitsAndMisses) {
+  auto pool = std::make_shared<ZDTDatagramPool>(16);
+  ZDTInbox inbox(/*limit=*/8, pool);
+  const char payload[] = "x";
+  std::vector<Buffer> drained;
+  for (int round = 0; round < 4; round++) {
+    inbox.Recycle(drained);  // what the last round's consumer finished
+    for (int i = 0; i < 3; i++) {
+      ASSERT_TRUE(inbox.Push(payload, sizeof(payload)));
+    }
+    inbox.Drain(drained);
+    EXPECT_EQ(drained.size(), 3u);
+  }
+  // only the first round allocated; every later one reused its buffers
+  EXPECT_EQ(inbox.pool_misses(), 3u);
+  EXPECT_EQ(inbox.pool_hits(), 9u);
+
+  // a refused datagram goes back to the pool rather than being counted
+  inbox.Recycle(drained);
+  for (int i = 0; i < 9; i++) {
+    inbox.Push(payload, sizeof(payload));
+  }
+  EXPECT_EQ(inbox.dropped(), 1u);
+  EXPECT_EQ(inbox.pool_hits() + inbox.pool_misses(), 20u);
+}
+
+// each receive thread keeps a free list of its own; a consumer's buffers go
+// back to the producer that filled them, never through a shared list
+TEST(ZDTInboxTest, HandsBuffersBackToTheProducerThatSentThem) {
+  auto pool = std::make_shared<ZDTDatagramPool>(/*max_pooled=*/8,
+                                                /*producers=*/2);
+  EXPECT_EQ(pool->per_producer(), 4u);
+  ZDTInbox inbox(/*limit=*/8, pool, /*producers=*/2);
+  const char payload[] = "x";
+  std::vector<Buffer> drained;
+  for (int round = 0; round < 3; round++) {
+    inbox.Recycle(drained);
+    for (int i = 0; i < 3; i++) {
+      ASSERT_TRUE(inbox.Push(payload, sizeof(payload), /*producer=*/0));
+    }
+    ASSERT_TRUE(inbox.Push(payload, sizeof(payload), /*producer=*/1));
+    inbox.Drain(drained);
+    ASSERT_EQ(drained.size(), 4u);
+  }
+  EXPECT_EQ(inbox.pool_misses(), 4u) << "only the first round allocates";
+  EXPECT_EQ(inbox.pool_hits(), 8u);
+
+  // producer 1 sent one a round, so it has one to reuse and no more
+  inbox.Recycle(drained);
+  ASSERT_TRUE(inbox.Push(payload, sizeof(payload), /*producer=*/1));
+  ASSERT_TRUE(inbox.Push(payload, sizeof(payload), /*producer=*/1));
+  EXPECT_EQ(inbox.pool_hits(), 9u);
+  EXPECT_EQ(inbox.pool_misses(), 5u);
+}
+
+TEST(ZDTInboxTest, BoundsEachProducerAndDrainsThemAll) {
+  ZDTInbox inbox(/*limit=*/4, /*pool=*/nullptr, /*producers=*/2);
+  const char first[] = "a";
+  const char second[] = "b";
+  for (int i = 0; i < 6; i++) {
+    inbox.Push(first, 1, /*producer=*/0);
+  }
+  EXPECT_EQ(inbox.dropped(), 2u) << "producer 0 is held to its own limit";
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(inbox.Push(second, 1, /*producer=*/1))
+        << "and producer 1 has a limit of its own";
+  }
+  std::vector<Buffer> drained;
+  inbox.Drain(drained);
+  ASSERT_EQ(drained.size(), 7u);
+  for (size_t i = 0; i < drained.size(); i++) {
+    EXPECT_EQ(drained[i].data()[0], i < 4 ? 'a' : 'b')
+        << "each producer's datagrams stay in their order";
+  }
+  inbox.Recycle(drained);
+  EXPECT_TRUE(drained.empty());
+  EXPECT_TRUE(inbox.Push(first, 1, /*producer=*/0)) << "room again once drained";
+}
+
+// the receive thread and the worker run at once; the worker sees every
+// datagram the receive thread queued, in order, and nothing it dropped
+TEST(ZDTInboxTest, ConcurrentDrainSeesEveryQueuedDatagram) {
+  constexpr uint32_t kCount = 20000;
+  ZDTInbox inbox(/*limit=*/128, std::make_shared<ZDTDatagramPool>(256));
+  std::atomic<uint32_t> queued{0};
+  std::thread receive([&] {
+    for (uint32_t i = 0; i < kCount; i++) {
+      char bytes[sizeof(uint32_t)];
+      std::memcpy(bytes, &i, sizeof(i));
+      if (inbox.Push(bytes, sizeof(bytes))) {
+        queued.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+  std::vector<Buffer> drained;
+  uint32_t seen = 0;
+  int64_t last = -1;
+  bool done = false;
+  while (!done) {
+    // read before the drain, so a finished producer's last push is in it
+    done = queued.load() + inbox.dropped() == kCount;
+    inbox.Drain(drained);
+    for (const Buffer& datagram : drained) {
+      uint32_t value = 0;
+      std::memcpy(&value, datagram.data(), sizeof(value));
+      EXPECT_GT(static_cast<int64_t>(value), last);
+      last = value;
+      seen++;
+    }
+    inbox.Recycle(drained);
+  }
+  receive.join();
+  EXPECT_EQ(seen, queued.load());
+  EXPECT_EQ(seen + inbox.dropped(), kCount);
+}
+
+// --- Retransmit schedule --------------------------------------------------------
+
+namespace {
+
+struct Scheduled {
+  int id = 0;
+  ZDTScheduleHook<Scheduled> schedule;
+};
+
+// takes everything due by `now`, in the order the transport would
+std::vector<int> TakeDue(ZDTRetransmitSchedule<Scheduled>& schedule, TP now) {
+  std::vector<int> taken;
+  while (Scheduled* entry = schedule.Due(now)) {
+    taken.push_back(entry->id);
+    schedule.Remove(entry);
+  }
+  return taken;
+}
+
+}  // namespace
+
+TEST(ZDTRetransmitScheduleTest, YieldsEntriesInDeadlineOrderAndOnlyOnceDue) {
+  // deliberately out of order, with a tie
+  const long long due_ms[] = {50, 10, 40, 30, 10, 70, 20, 60};
+  std::vector<Scheduled> entries(8);
+  ZDTRetransmitSchedule<Scheduled> schedule;
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].id = static_cast<int>(i);
+    schedule.OnSend(&entries[i], At(due_ms[i]));
+  }
+  EXPECT_EQ(schedule.next_due(), At(10));
+  EXPECT_EQ(schedule.Due(At(9)), nullptr) << "nothing falls due before 10";
+
+  schedule.Remove(&entries[2]);  // acked out of the middle of the heap
+  schedule.Reschedule(&entries[7], At(5));
+  schedule.Reschedule(&entries[1], At(65));
+
+  EXPECT_EQ(TakeDue(schedule, At(30)), (std::vector<int>{7, 4, 6, 3}));
+  EXPECT_EQ(TakeDue(schedule, At(1000)), (std::vector<int>{0, 1, 5}));
+  EXPECT_TRUE(schedule.empty());
+  EXPECT_EQ(schedule.next_due(), TP::max());
+}
+
+TEST(ZDTRetransmitScheduleTest, NewestFollowsSendsAndLossesGoToTheBack) {
+  std::vector<Scheduled> entries(3);
+  ZDTRetransmitSchedule<Scheduled> schedule;
+  EXPECT_EQ(schedule.newest(), nullptr);
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].id = static_cast<int>(i);
+    schedule.OnSend(&entries[i], At(100));
+  }
+  EXPECT_EQ(schedule.newest(), &entries[2]) << "the last one sent";
+
+  schedule.OnLost(&entries[2]);
+  EXPECT_EQ(schedule.newest(), &entries[1])
+      << "a reported loss is already being resent; the probe goes elsewhere";
+  EXPECT_EQ(schedule.Due(At(0)), &entries[2]) << "and it is due at once";
+
+  schedule.OnSend(&entries[0], At(200));  // a resend
+  EXPECT_EQ(schedule.newest(), &entries[0]);
+  schedule.Remove(&entries[0]);
+  EXPECT_EQ(schedule.newest(), &entries[1]);
+  schedule.Remove(&entries[1]);
+  schedule.Remove(&entries[2]);
+  EXPECT_EQ(schedule.newest(), nullptr);
+}
+
+// Shuffled sends, resends and acks against a sorted reference: the heap and
+// the send-order list both stay right through arbitrary interleavings.
+TEST(ZDTRetransmitScheduleTest, MatchesAReferenceThroughRandomChurn) {
+  constexpr int kEntries = 256;
+  std::vector<Scheduled> entries(kEntries);
+  std::vector<bool> live(kEntries, false);
+  std::vector<int> send_order;  // reference for newest()
+  ZDTRetransmitSchedule<Scheduled> schedule;
+  uint32_t rng = 12345;
+  auto next = [&rng]() {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+  };
+  for (int step = 0; step < 20000; step++) {
+    const int i = static_cast<int>(next() % kEntries);
+    entries[i].id = i;
+    const TP due = At(static_cast<long long>(next() % 1000));
+    send_order.erase(std::remove(send_order.begin(), send_order.end(), i),
+                     send_order.end());
+    if (live[i] && next() % 2 == 0) {
+      schedule.Remove(&entries[i]);
+      live[i] = false;
+    } else {
+      schedule.OnSend(&entries[i], due);
+      live[i] = true;
+      send_order.push_back(i);
+    }
+    ASSERT_EQ(schedule.newest(),
+              send_order.empty() ? nullptr : &entries[send_order.back()]);
+    TP earliest = TP::max();
+    for (int k = 0; k < kEntries; k++) {
+      if (live[k]) {
+        earliest = std::min(earliest, entries[k].schedule.due);
+      }
+    }
+    ASSERT_EQ(schedule.next_due(), earliest) << "step " << step;
+  }
+}
+
+// The scan's cost per tick is what this replaced a walk over every unacked
+// message with. A tick with nothing due, plus an ack and a send of steady
+// churn, is timed at a small window and at the default max_messages_in_flight;
+// the walk made the large one 64 times dearer, the heap about twice (log n).
+// The bound is loose so a noisy machine cannot fail it, and still far below
+// what a linear scan would cost.
+TEST(ZDTRetransmitScheduleTest, BenchmarkTickCostBarelyGrowsWithInFlight) {
+  auto ns_per_tick = [](size_t in_flight) {
+    constexpr int kTicks = 200000;
+    std::vector<Scheduled> entries(in_flight);
+    ZDTRetransmitSchedule<Scheduled> schedule;
+    const TP now = At(0);
+    long long next_due_ms = 1000;
+    for (Scheduled& entry : entries) {
+      schedule.OnSend(&entry, At(next_due_ms++));
+    }
+    double best = 0.0;
+    for (int rep = 0; rep < 3; rep++) {
+      size_t oldest = 0;
+      size_t work = 0;
+      const auto start = std::chrono::steady_clock::now();
+      for (int tick = 0; tick < kTicks; tick++) {
+        work += schedule.Due(now) == nullptr;
+        work += schedule.newest() != nullptr;
+        // the oldest send is acked and its slot carries the next message
+        Scheduled* acked = &entries[oldest];
+        schedule.Remove(acked);
+        schedule.OnSend(acked, At(next_due_ms++));
+        oldest = (oldest + 1) % in_flight;
+      }
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      EXPECT_EQ(work, static_cast<size_t>(kTicks) * 2);
+      const double ns =
+          std::chrono::duration<double, std::nano>(elapsed).count() / kTicks;
+      best = rep == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+  };
+  const double small = ns_per_tick(64);
+  const double large = ns_per_tick(4096);
+  std::printf("[ BENCH    ] retransmit tick: %.1f ns at 64 in flight, "
+              "%.1f ns at 4096\n",
+              small, large);
+  EXPECT_LT(large, small * 8.0);
+}
+
+// --- Sequence window ------------------------------------------------------------
+
+TEST(ZDTSeqWindowTest, HoldsWhatArrivedAheadUntilTaken) {
+  ZDTSeqWindow<int> window;
+  EXPECT_EQ(window.capacity(), 0u);  // nothing until something is out of order
+  EXPECT_TRUE(window.Put(10, 12, 12));
+  EXPECT_TRUE(window.Put(10, 11, 11));
+  EXPECT_TRUE(window.Has(10, 12));
+  EXPECT_FALSE(window.Has(10, 10));
+  EXPECT_FALSE(window.Has(10, 13));
+  EXPECT_EQ(window.Take(10), 0);
+  EXPECT_EQ(window.Take(11), 11);
+  EXPECT_EQ(window.Take(12), 12);
+  EXPECT_FALSE(window.Has(13, 12));
+  EXPECT_EQ(window.Take(13), 0);
+}
+
+TEST(ZDTSeqWindowTest, RefusesBelowTheBaseAndPastTheSpan) {
+  ZDTSeqWindow<int> window(100);
+  EXPECT_FALSE(window.Put(50, 49, 1));
+  EXPECT_FALSE(window.Put(50, 150, 1));
+  EXPECT_FALSE(window.Has(50, 150));
+  EXPECT_TRUE(window.Put(50, 149, 1));
+  EXPECT_EQ(window.capacity(), 128u);  // the span, rounded up, and no more
+}
+
+// Growing relays the values from wherever the ring's lap stood, so a resize
+// with the window straddling the wrap keeps each at its sequence.
+TEST(ZDTSeqWindowTest, GrowingKeepsEveryValueAtItsSequence) {
+  ZDTSeqWindow<int> window;
+  const SequenceId base = 1000 + 13;  // mid-lap for every ring size
+  for (SequenceId seq = base + 1; seq < base + 16; seq++) {
+    ASSERT_TRUE(window.Put(base, seq, static_cast<int>(seq)));
+  }
+  ASSERT_TRUE(window.Put(base, base + 100, static_cast<int>(base + 100)));
+  EXPECT_EQ(window.capacity(), 128u);
+  for (SequenceId seq = base + 1; seq < base + 16; seq++) {
+    EXPECT_EQ(window.Take(seq), static_cast<int>(seq)) << seq;
+  }
+  EXPECT_EQ(window.Take(base + 100), static_cast<int>(base + 100));
+}
+
+// Arrivals scattered ahead of a base that advances the way the receiver's does,
+// against a map doing the same: nothing is lost, duplicated or misplaced.
+TEST(ZDTSeqWindowTest, MatchesAReferenceThroughRandomChurn) {
+  constexpr size_t kSpan = 300;
+  ZDTSeqWindow<int> window(kSpan);
+  std::map<SequenceId, int> reference;
+  SequenceId base = 0;
+  uint32_t rng = 12345;
+  auto next = [&rng]() {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+  };
+  for (int step = 0; step < 20000; step++) {
+    if (next() % 3 != 0) {
+      const SequenceId seq = base + 1 + next() % (kSpan + 20);
+      const bool fits = seq - base < kSpan;
+      ASSERT_EQ(window.Put(base, seq, step + 1), fits) << "step " << step;
+      if (fits) {
+        reference[seq] = step + 1;
+      }
+    } else {
+      // the expected message arrives: it and the run behind it are taken
+      base++;
+      for (;;) {
+        auto it = reference.find(base);
+        const int taken = window.Take(base);
+        ASSERT_EQ(taken, it == reference.end() ? 0 : it->second)
+            << "step " << step;
+        if (it == reference.end()) {
+          break;
+        }
+        reference.erase(it);
+        base++;
+      }
+    }
+    const SequenceId probe = base + next() % kSpan;
+    ASSERT_EQ(window.Has(base, probe), reference.count(probe) != 0)
+        << "step " << step;
+  }
+  EXPECT_LE(window.capacity(), 512u);
+}
+
+// --- Forward error correction ----------------------------------------------------
+
+namespace {
+
+struct FecMessage {
+  ZDTRecord record;
+  std::vector<uint8_t> payload;
+};
+
+// `count` unreliable unordered messages of varying length, so the parity has
+// to pad the shorter ones
+std::vector<FecMessage> FecGroup(size_t count, WireSeq first_seq = 40) {
+  std::vector<FecMessage> group;
+  for (size_t i = 0; i < count; i++) {
+    FecMessage message;
+    message.payload.assign(10 + i * 7, static_cast<uint8_t>(0x11 * (i + 1)));
+    message.payload[0] = static_cast<uint8_t>(i);
+    message.record.channel = 3;
+    message.record.message_seq = static_cast<WireSeq>(first_seq + i);
+    message.record.length = static_cast<uint16_t>(message.payload.size());
+    group.push_back(message);
+  }
+  return group;
+}
+
+std::vector<uint8_t> FecParity(ZDTFecEncoder& encoder,
+                               const std::vector<FecMessage>& group) {
+  for (const FecMessage& message : group) {
+    encoder.Add(message.record, message.payload.data(), message.payload.size());
+  }
+  Buffer out(Endianness::BigEndian);
+  encoder.Finish(out);
+  return std::vector<uint8_t>(out.data(), out.data() + out.size());
+}
+
+}  // namespace
+
+TEST(ZDTFecTest, RebuildsTheOneMessageThatDidNotArrive) {
+  const auto group = FecGroup(4);
+  ZDTFecEncoder encoder(4);
+  const auto parity = FecParity(encoder, group);
+  EXPECT_EQ(parity.size(), ZDTFecEncoder::ParitySize(4, group[3].payload.size()));
+
+  for (size_t lost = 0; lost < group.size(); lost++) {
+    ZDTFecDecoder decoder;
+    for (size_t i = 0; i < group.size(); i++) {
+      if (i != lost) {
+        EXPECT_TRUE(decoder.OnRecord(group[i].record, group[i].payload.data(),
+                                     group[i].payload.size()));
+      }
+    }
+    ZDTRecord rebuilt;
+    const uint8_t* data = nullptr;
+    ASSERT_TRUE(decoder.Recover(parity.data(), parity.size(), rebuilt, data))
+        << "lost " << lost;
+    EXPECT_EQ(rebuilt.message_seq, group[lost].record.message_seq);
+    EXPECT_EQ(rebuilt.flags, group[lost].record.flags);
+    ASSERT_EQ(rebuilt.length, group[lost].payload.size());
+    EXPECT_EQ(std::vector<uint8_t>(data, data + rebuilt.length),
+              group[lost].payload);
+
+    // the original turning up late is the duplicate now
+    EXPECT_FALSE(decoder.OnRecord(group[lost].record,
+                                  group[lost].payload.data(),
+                                  group[lost].payload.size()));
+  }
+}
+
+TEST(ZDTFecTest, RebuildsNothingWhenNoneOrTwoAreMissing) {
+  const auto group = FecGroup(4);
+  ZDTFecEncoder encoder(4);
+  const auto parity = FecParity(encoder, group);
+  ZDTRecord rebuilt;
+  const uint8_t* data = nullptr;
+
+  ZDTFecDecoder complete;
+  for (const FecMessage& message : group) {
+    complete.OnRecord(message.record, message.payload.data(),
+                      message.payload.size());
+  }
+  EXPECT_FALSE(complete.Recover(parity.data(), parity.size(), rebuilt, data));
+
+  ZDTFecDecoder two_lost;
+  two_lost.OnRecord(group[0].record, group[0].payload.data(),
+                    group[0].payload.size());
+  two_lost.OnRecord(group[2].record, group[2].payload.data(),
+                    group[2].payload.size());
+  EXPECT_FALSE(two_lost.Recover(parity.data(), parity.size(), rebuilt, data));
+}
+
+// reliable and unreliable messages number themselves separately, so the same
+// message_seq on each is two different messages
+TEST(ZDTFecTest, TellsTheSequenceSpacesApart) {
+  auto group = FecGroup(2);
+  group[1].record.message_seq = group[0].record.message_seq;
+  group[1].record.flags = kRecReliable | kRecOrdered;
+  ZDTFecEncoder encoder(2);
+  const auto parity = FecParity(encoder, group);
+
+  ZDTFecDecoder decoder;
+  decoder.OnRecord(group[0].record, group[0].payload.data(),
+                   group[0].payload.size());
+  ZDTRecord rebuilt;
+  const uint8_t* data = nullptr;
+  ASSERT_TRUE(decoder.Recover(parity.data(), parity.size(), rebuilt, data));
+  EXPECT_EQ(rebuilt.flags, kRecReliable | kRecOrdered);
+  EXPECT_EQ(std::vector<uint8_t>(data, data + rebuilt.length),
+            group[1].payload);
+}
+
+TEST(ZDTFecTest, GroupsCloseAtTheirSizeAndStartClean) {
+  ZDTFecEncoder encoder(3);
+  const auto first = FecGroup(3, 0);
+  for (size_t i = 0; i < first.size(); i++) {
+    EXPECT_FALSE(encoder.full());
+    encoder.Add(first[i].record, first[i].payload.data(),
+                first[i].payload.size());
+  }
+  EXPECT_TRUE(encoder.full());
+  Buffer discard(Endianness::BigEndian);
+  encoder.Finish(discard);
+  EXPECT_EQ(encoder.count(), 0u);
+
+  // nothing of the first group's longer payloads may leak into the second's
+  auto second = FecGroup(3, 3);
+  for (FecMessage& message : second) {
+    message.payload.resize(4);
+    message.record.length = 4;
+  }
+  const auto parity = FecParity(encoder, second);
+  EXPECT_EQ(parity.size(), ZDTFecEncoder::ParitySize(3, 4));
+  ZDTFecDecoder decoder;
+  decoder.OnRecord(second[0].record, second[0].payload.data(), 4);
+  decoder.OnRecord(second[2].record, second[2].payload.data(), 4);
+  ZDTRecord rebuilt;
+  const uint8_t* data = nullptr;
+  ASSERT_TRUE(decoder.Recover(parity.data(), parity.size(), rebuilt, data));
+  EXPECT_EQ(std::vector<uint8_t>(data, data + rebuilt.length),
+            second[1].payload);
+}
+
+TEST(ZDTFecTest, FitsOnlyWhileTheParityStillFitsADatagram) {
+  ZDTFecEncoder encoder(8);
+  const size_t capacity = 100;
+  EXPECT_TRUE(encoder.Fits(capacity - ZDTFecEncoder::ParitySize(1, 0),
+                           capacity));
+  EXPECT_FALSE(encoder.Fits(capacity, capacity))
+      << "too large for any group";
+  std::vector<uint8_t> payload(50, 1);
+  ZDTRecord record;
+  record.length = 50;
+  encoder.Add(record, payload.data(), payload.size());
+  EXPECT_TRUE(encoder.Fits(50, capacity));
+  EXPECT_FALSE(encoder.Fits(capacity - ZDTFecEncoder::ParitySize(1, 0), capacity))
+      << "would fit alone, but not beside a member";
+}
+
+TEST(ZDTFecTest, RefusesMalformedParity) {
+  ZDTFecDecoder decoder;
+  ZDTRecord rebuilt;
+  const uint8_t* data = nullptr;
+  const std::vector<uint8_t> empty_group = {0};
+  EXPECT_FALSE(decoder.Recover(empty_group.data(), empty_group.size(), rebuilt,
+                               data));
+  // claims two members but carries one
+  const std::vector<uint8_t> truncated = {2, 0, 0, 1, 0, 0};
+  EXPECT_FALSE(decoder.Recover(truncated.data(), truncated.size(), rebuilt,
+                               data));
+  // a member longer than the xor covering it
+  const std::vector<uint8_t> overlong = {1, 0, 0, 1, 0, 9, 0xaa};
+  EXPECT_FALSE(decoder.Recover(overlong.data(), overlong.size(), rebuilt, data));
+}
+
+// --- Reassembly ------------------------------------------------------------------
+
+namespace {
+
+// one datagram carrying one fragment of message `seq`, `length` bytes long
+std::vector<uint8_t> FragmentDatagram(uint16_t packet_seq, uint16_t seq,
+                                      uint8_t index, uint8_t count,
+                                      uint16_t length) {
+  Buffer buffer(Endianness::BigEndian);
+  ZDTHeader header;
+  header.packet_seq = packet_seq;
+  WriteZDTHeader(buffer, header);
+  ZDTRecord record;
+  record.flags = kRecFragment;  // unreliable: a refusal is final
+  record.message_seq = seq;
+  record.frag_index = index;
+  record.frag_count = count;
+  record.length = length;
+  WriteZDTRecord(buffer, record);
+  const std::vector<char> body(length, static_cast<char>(seq));
+  buffer.Write(body.data(), body.size());
+  return std::vector<uint8_t>(buffer.data(), buffer.data() + buffer.size());
+}
+
+}  // namespace
+
+// the first fragment of a message allocates all of it, so one fragment that
+// claims 255 of them must be held to the ceiling by what it allocates, not by
+// what it carries
+TEST(ZDTReassemblyTest, OneFragmentCannotReservePastTheCeiling) {
+  auto socket = std::make_shared<UDPSocket>();
+  ASSERT_EQ(socket->Open(InetProtocolVersion::IPv4), Result::Success);
+  socket->SetBlocking(false);
+  ASSERT_EQ(socket->Bind(*InetAddress::from("127.0.0.1", 0)), Result::Success);
+  ZDTOptions config;
+  config.max_reassembly_bytes = 64 * 1024;
+  CommonOptions common;
+  common.keepalive_interval = std::chrono::hours(1);
+  common.idle_timeout = std::chrono::hours(1);
+  ZDTTransportLayer transport(socket, socket->local_address(), config,
+                              /*drains_own_socket=*/false, nullptr,
+                              ZDTConnection(), common);
+
+  // 254 body fragments of 1000 bytes would be 254000 bytes, far past 64 KiB
+  auto greedy = FragmentDatagram(1, 0, 0, 255, 1000);
+  transport.OnDatagram(greedy.data(), greedy.size());
+  transport.Update();
+  // a message that fits is still taken whole
+  for (uint8_t i = 0; i < 2; i++) {
+    auto datagram = FragmentDatagram(static_cast<uint16_t>(2 + i), 1, i, 2, 1000);
+    transport.OnDatagram(datagram.data(), datagram.size());
+  }
+  transport.Update();
+
+  auto message = transport.Receive();
+  ASSERT_NE(message, nullptr);
+  EXPECT_EQ(message->readable_bytes(), 2000u);
+  EXPECT_EQ(message->read_cursor_data()[0], 1);
+  EXPECT_EQ(transport.Receive(), nullptr);
+#if ZNET_ENABLE_METRICS
+  SessionMetrics metrics;
+  transport.FillMetrics(metrics);
+  EXPECT_EQ(metrics.zdt.reassemblies_dropped, 1u);
+  EXPECT_LT(metrics.zdt.state_bytes, config.max_reassembly_bytes);
+#endif
+}
+
+// --- Datagram sealing ------------------------------------------------------------
+
+namespace {
+
+// the two ends of one connection: each one's tx is the other's rx
+void MakeSealerPair(ZDTDatagramSealer& a, ZDTDatagramSealer& b,
+                    CipherSuite suite = CipherSuite::Aes256Gcm) {
+  DatagramKeys keys;
+  keys.suite = suite;
+  for (size_t i = 0; i < sizeof(keys.tx_key); i++) {
+    keys.tx_key[i] = static_cast<unsigned char>(i);
+    keys.rx_key[i] = static_cast<unsigned char>(0x80 + i);
+  }
+  std::memcpy(keys.tx_salt, "txsl", 4);
+  std::memcpy(keys.rx_salt, "rxsl", 4);
+  a.Install(keys);
+  DatagramKeys mirrored;
+  mirrored.suite = suite;
+  std::memcpy(mirrored.tx_key, keys.rx_key, sizeof(keys.rx_key));
+  std::memcpy(mirrored.tx_salt, keys.rx_salt, sizeof(keys.rx_salt));
+  std::memcpy(mirrored.rx_key, keys.tx_key, sizeof(keys.tx_key));
+  std::memcpy(mirrored.rx_salt, keys.tx_salt, sizeof(keys.tx_salt));
+  b.Install(mirrored);
+}
+
+// header || body || room for the tag, sealed under `packet_seq`
+std::vector<uint8_t> SealedDatagram(ZDTDatagramSealer& sealer,
+                                    WireSeq packet_seq,
+                                    const std::vector<uint8_t>& header,
+                                    const std::vector<uint8_t>& body) {
+  std::vector<uint8_t> datagram(header);
+  datagram.insert(datagram.end(), body.begin(), body.end());
+  datagram.resize(datagram.size() + kZDTSealTagSize);
+  EXPECT_TRUE(sealer.Seal(packet_seq, datagram.data(), header.size(),
+                          datagram.data() + header.size(), body.size()));
+  return datagram;
+}
+
+bool OpenDatagram(ZDTDatagramSealer& sealer, WireSeq packet_seq,
+                  std::vector<uint8_t>& datagram, size_t header_len) {
+  return sealer.Open(packet_seq, datagram.data(), header_len,
+                     datagram.data() + header_len,
+                     datagram.size() - header_len);
+}
+
+}  // namespace
+
+TEST(ZDTDatagramSealerTest, OpensWhatThePeerSealedAndNothingElse) {
+  ZDTDatagramSealer client;
+  ZDTDatagramSealer server;
+  MakeSealerPair(client, server);
+  const std::vector<uint8_t> header = {kFlagOnline | kFlagSealed, 0, 7, 0, 0, 0};
+  const std::vector<uint8_t> body = {'h', 'e', 'l', 'l', 'o'};
+
+  std::vector<uint8_t> datagram = SealedDatagram(client, 7, header, body);
+  EXPECT_TRUE(std::equal(header.begin(), header.end(), datagram.begin()));
+  EXPECT_FALSE(std::equal(body.begin(), body.end(),
+                          datagram.begin() + header.size()));
+  EXPECT_FALSE(server.peer_sealing());
+  ASSERT_TRUE(OpenDatagram(server, 7, datagram, header.size()));
+  EXPECT_TRUE(std::equal(body.begin(), body.end(),
+                         datagram.begin() + header.size()));
+  EXPECT_TRUE(server.peer_sealing());
+
+  // its own direction's key is not the peer's
+  std::vector<uint8_t> own = SealedDatagram(client, 8, header, body);
+  EXPECT_FALSE(OpenDatagram(client, 8, own, header.size()));
+  // nor is a sealer without keys any use
+  ZDTDatagramSealer bare;
+  EXPECT_FALSE(OpenDatagram(bare, 8, own, header.size()));
+}
+
+// Sealing follows the session's suite: the same keys give a different datagram
+// under each, and only a peer on the same suite opens it.
+TEST(ZDTDatagramSealerTest, SealsUnderTheNegotiatedSuite) {
+  const std::vector<uint8_t> header = {kFlagOnline | kFlagSealed, 0, 3, 0, 0, 0};
+  const std::vector<uint8_t> body(24, 0x42);
+  std::vector<std::vector<uint8_t>> sealed;
+  for (CipherSuite suite : {CipherSuite::Aes256Gcm, CipherSuite::Aes128Gcm,
+                            CipherSuite::ChaCha20Poly1305}) {
+    if (!IsCipherSuiteAvailable(suite)) {
+      continue;
+    }
+    SCOPED_TRACE(GetCipherSuiteString(suite));
+    ZDTDatagramSealer client;
+    ZDTDatagramSealer server;
+    MakeSealerPair(client, server, suite);
+    std::vector<uint8_t> datagram = SealedDatagram(client, 3, header, body);
+    sealed.push_back(datagram);
+    ASSERT_TRUE(OpenDatagram(server, 3, datagram, header.size()));
+    EXPECT_TRUE(std::equal(body.begin(), body.end(),
+                           datagram.begin() + header.size()));
+  }
+  for (size_t i = 1; i < sealed.size(); i++) {
+    EXPECT_NE(sealed[i], sealed[0]);
+  }
+
+  ZDTDatagramSealer aes256;
+  ZDTDatagramSealer aes128;
+  ZDTDatagramSealer unused;
+  MakeSealerPair(aes256, unused);
+  MakeSealerPair(unused, aes128, CipherSuite::Aes128Gcm);
+  std::vector<uint8_t> datagram = SealedDatagram(aes256, 4, header, body);
+  EXPECT_FALSE(OpenDatagram(aes128, 4, datagram, header.size()));
+}
+
+TEST(ZDTDatagramSealerTest, RefusesAnAlteredHeaderBodyOrSequence) {
+  ZDTDatagramSealer client;
+  ZDTDatagramSealer server;
+  MakeSealerPair(client, server);
+  const std::vector<uint8_t> header = {kFlagOnline | kFlagSealed, 0, 1, 0, 3, 0};
+  const std::vector<uint8_t> body(40, 0x5a);
+
+  const std::vector<uint8_t> sealed = SealedDatagram(client, 1, header, body);
+  // the header is read in the clear but authenticated: a rewritten ack is
+  // caught like a rewritten record
+  std::vector<uint8_t> ack = sealed;
+  ack[4] ^= 1;
+  EXPECT_FALSE(OpenDatagram(server, 1, ack, header.size()));
+  std::vector<uint8_t> record = sealed;
+  record[header.size() + 10] ^= 1;
+  EXPECT_FALSE(OpenDatagram(server, 1, record, header.size()));
+  std::vector<uint8_t> tag = sealed;
+  tag.back() ^= 1;
+  EXPECT_FALSE(OpenDatagram(server, 1, tag, header.size()));
+  // the nonce is the packet_seq, so a datagram moved to another one fails
+  std::vector<uint8_t> moved = sealed;
+  EXPECT_FALSE(OpenDatagram(server, 2, moved, header.size()));
+  // and none of that cost the real one its place
+  std::vector<uint8_t> intact = sealed;
+  EXPECT_TRUE(OpenDatagram(server, 1, intact, header.size()));
+}
+
+TEST(ZDTDatagramSealerTest, RefusesReplaysButTakesReordering) {
+  ZDTDatagramSealer client;
+  ZDTDatagramSealer server;
+  MakeSealerPair(client, server);
+  const std::vector<uint8_t> header = {kFlagOnline | kFlagSealed};
+  const std::vector<uint8_t> body = {1, 2, 3};
+
+  std::vector<std::vector<uint8_t>> sent;
+  for (WireSeq seq = 1; seq <= 4; seq++) {
+    sent.push_back(SealedDatagram(client, seq, header, body));
+  }
+  std::vector<uint8_t> copy = sent[3];
+  ASSERT_TRUE(OpenDatagram(server, 4, sent[3], header.size()));
+  ASSERT_TRUE(OpenDatagram(server, 2, sent[1], header.size()));
+  EXPECT_FALSE(OpenDatagram(server, 4, copy, header.size()));
+  ASSERT_TRUE(OpenDatagram(server, 1, sent[0], header.size()));
+  ASSERT_TRUE(OpenDatagram(server, 3, sent[2], header.size()));
+}
+
+TEST(ZDTDatagramSealerTest, FollowsPacketSeqAcrossTheWrap) {
+  ZDTDatagramSealer client;
+  ZDTDatagramSealer server;
+  MakeSealerPair(client, server);
+  const std::vector<uint8_t> header = {kFlagOnline | kFlagSealed};
+  const std::vector<uint8_t> body = {9};
+
+  // the transport's packet_seq, which skips the reserved 0 when it wraps.
+  // Each full sequence is a fresh nonce; were the wrap to restart it, the
+  // second lap would reuse the first's and the peer would refuse it as a
+  // replay
+  WireSeq seq = 1;
+  for (int i = 0; i < 3 * 65536; i++) {
+    std::vector<uint8_t> datagram = SealedDatagram(client, seq, header, body);
+    ASSERT_TRUE(OpenDatagram(server, seq, datagram, header.size())) << i;
+    seq++;
+    if (seq == 0) {
+      seq = 1;
+    }
+  }
+}
@@ -101,23 +101,26 @@ class ServerBackend {
   virtual ServerMetrics metrics() const { return {}; }
 
   /**
-   * @brief Installs a callback fired when inbound data arrives.
+   * @brief Installs a callback fired with the session inbound data arrived
+   *        for.
    *
-   * Called from whichever thread noticed the data, to cut short a session
-   * worker that would otherwise sleep out the rest of its tick. Must be cheap
-   * and must not call back into the backend. Backends that read on the
-   * caller's thread ignore it.
+   * Called from whichever thread noticed the data, so the session's worker
+   * can process that one session now rather than sweep all of its own at the
+   * next tick. Must be cheap and must not call back into the backend. Sessions
+   * still handshaking are reported too. Backends that read on the caller's
+   * thread ignore it.
    *
-   * @param on_data Invoked on arrival; pass nothing to leave the default no-op.
+   * @param on_ready Invoked on arrival; pass nothing to leave the default
+   *        no-op.
    */
-  virtual void SetWakeCallback(std::function<void()> on_data) {
-    (void)on_data;
+  virtual void SetReadyCallback(std::function<void(PeerSession&)> on_ready) {
+    (void)on_ready;
   }
 
   /**
    * @brief Joins any receive thread the backend runs, leaving the socket open.
    *
-   * Call before destroying anything the wake callback touches. The socket
+   * Call before destroying anything the ready callback touches. The socket
    * stays usable so sessions can still send their goodbyes; Close() releases
    * it. Idempotent, and a no-op for backends without their own thread.
    */
@@ -0,0 +1,93 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//
+// Readiness notification for a set of stream sockets: which of them have
+// something for a reader to pick up. epoll on Linux, poll() everywhere else,
+// behind one interface so the TCP server does not care which it got.
+//
+
+#ifndef ZNET_BACKENDS_READINESS_POLLER_H_
+#define ZNET_BACKENDS_READINESS_POLLER_H_
+
+#include "znet/compat.h"
+#include "znet/types.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace znet {
+namespace backends {
+
+/**
+ * @brief Reports which registered sockets turned readable.
+ *
+ * A socket is registered once, with a token of the caller's choosing, and is
+ * reported by that token. Reports are edge-like on every implementation: a
+ * socket is reported when it becomes readable and then not again until its
+ * reader has drained it to would-block and called Rearm(). That is what lets a
+ * single watcher thread sit in Wait() without re-firing on bytes a worker has
+ * not got round to yet.
+ *
+ * Add, Remove and Rearm may be called from any thread; Wait from one only.
+ */
+class ReadinessPoller {
+ public:
+  enum class Kind {
+    Default,   // epoll where there is one, else poll
+    Portable,  // poll, on every platform; mostly so tests can reach it
+  };
+
+  /**
+   * @brief Creates a poller. Never null: a platform poller that fails to
+   *        initialize falls back to the portable one.
+   */
+  static std::shared_ptr<ReadinessPoller> Create(Kind kind = Kind::Default);
+
+  virtual ~ReadinessPoller() = default;
+
+  /** @brief Starts watching @p socket; reports carry @p token. */
+  virtual bool Add(SocketHandle socket, uint64_t token) = 0;
+
+  /**
+   * @brief Stops watching @p socket.
+   *
+   * Must come before the descriptor is closed. Once closed, the number is free
+   * for the process to reuse, and a late Remove would unregister whichever
+   * socket got it next.
+   */
+  virtual void Remove(SocketHandle socket) = 0;
+
+  /**
+   * @brief Tells the poller the socket was read to would-block, so it may be
+   *        reported again once more data arrives.
+   */
+  virtual void Rearm(SocketHandle socket) = 0;
+
+  /**
+   * @brief Blocks until something is ready or @p timeout passes, appending the
+   *        tokens of every ready socket to @p ready.
+   *
+   * A hangup or an error counts as ready: the reader is who notices a close.
+   *
+   * @return how many tokens were appended.
+   */
+  virtual size_t Wait(std::vector<uint64_t>& ready,
+                      std::chrono::milliseconds timeout) = 0;
+
+  /** @brief Sockets currently registered. */
+  ZNET_NODISCARD virtual size_t size() const = 0;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_READINESS_POLLER_H_
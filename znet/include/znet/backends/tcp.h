@@ -13,6 +13,7 @@
 
 #include "znet/admission.h"
 #include "znet/backends/backend.h"
+#include "znet/backends/readiness_poller.h"
 #include "znet/buffer.h"
 #include "znet/compat.h"
 #include "znet/options.h"
@@ -20,17 +21,23 @@
 
 #include <deque>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace znet {
 namespace backends {
 
 class TCPTransportLayer : public TransportLayer {
  public:
-  // `common` carries the keepalive knobs; the default matches CommonOptions
-  // so call sites without a SessionOptions in hand behave like a default
-  // session
+  // `common` carries the keepalive knobs and `tcp` the write batching; the
+  // defaults match SessionOptions so call sites without one in hand behave
+  // like a default session. `poller` is the readiness poller the socket is
+  // registered with, if any: the transport rearms it on would-block and
+  // unregisters before the descriptor is released.
   TCPTransportLayer(SocketHandle socket,
-                    CommonOptions common = CommonOptions());
+                    CommonOptions common = CommonOptions(),
+                    TCPOptions tcp = TCPOptions(),
+                    std::shared_ptr<ReadinessPoller> poller = nullptr);
   ~TCPTransportLayer() override;
 
   std::shared_ptr<Buffer> Receive() override;
@@ -42,8 +49,20 @@ class TCPTransportLayer : public TransportLayer {
 
   void Update() override;
 
+  /** @brief Writes every staged frame. */
   void Flush() override;
 
+  /** @brief Same as Flush(); safe from the thread that drained. */
+  void EndSendBatch() override;
+
+  /** @brief The largest message Send() takes, when TCPOptions::bundle_messages
+   *         is on. */
+  size_t BundleBudget() const override;
+  size_t MaxMessageSize() const override;
+
+  /** @brief The keepalive ping or the idle timeout, whichever is sooner. */
+  std::chrono::steady_clock::time_point NextDeadline() const override;
+
   void FillMetrics(SessionMetrics& out) const override;
 
  private:
@@ -63,8 +82,22 @@ class TCPTransportLayer : public TransportLayer {
   /** @brief Writes a whole framed message, looping over partial sends. */
   bool WriteAll(Buffer& buffer);
 
+  /**
+   * @brief Writes out what Send() staged, in as few vectored writes as the
+   *        batch budget allows. Closes the connection if a write fails.
+   *
+   * @param wait whether to wait out a full socket. Close() does not: a peer
+   *        that stopped reading would hold it forever.
+   */
+  void FlushStaged(bool wait);
+
+  /** @brief The loop under FlushStaged(). Call with write_mutex_ held. */
+  bool WriteFrames(const std::vector<std::shared_ptr<Buffer>>& frames,
+                   bool wait);
+
   Buffer recv_buffer_{Endianness::BigEndian};
   SocketHandle socket_;
+  std::shared_ptr<ReadinessPoller> poller_;
   // read by IsClosed() from whichever thread owns the application, written by
   // Close() from the same, so it cannot be a plain bool
   std::atomic_bool is_closed_{false};
@@ -76,8 +109,21 @@ class TCPTransportLayer : public TransportLayer {
   // claim while pings and pongs come from the worker, and interleaved send()s
   // would splice two frames together. last_send_ is guarded by it too, since
   // both paths stamp it.
-  std::mutex write_mutex_;
+  mutable std::mutex write_mutex_;
   std::chrono::steady_clock::time_point last_send_;
+  // frames framed by Send() and not yet written, oldest first. Send() runs on
+  // whichever thread holds the session's encode claim and the flush on
+  // another, so the hand-off is locked; by its own mutex, so staging never
+  // waits behind a write stalled on a full socket. Lock order is
+  // write_mutex_, then stage_mutex_.
+  std::mutex stage_mutex_;
+  std::vector<std::shared_ptr<Buffer>> staged_;
+  size_t staged_bytes_ = 0;
+  // the batch being written, swapped out of staged_ so staging can go on.
+  // Guarded by write_mutex_, and kept to reuse its capacity.
+  std::vector<std::shared_ptr<Buffer>> flushing_;
+  size_t max_write_batch_;
+  bool bundle_messages_;
 #if ZNET_ENABLE_METRICS
   SessionMetrics metrics_;
 #endif
@@ -146,8 +192,8 @@ class TCPServerBackend : public ServerBackend {
 
   bool IsAlive() override;
 
-  void SetWakeCallback(std::function<void()> on_data) override {
-    on_data_ = std::move(on_data);
+  void SetReadyCallback(std::function<void(PeerSession&)> on_ready) override {
+    on_ready_ = std::move(on_ready);
   }
 
   void StopReceiving() override;
@@ -158,14 +204,16 @@ class TCPServerBackend : public ServerBackend {
 
  private:
   /**
-   * @brief Watches every accepted socket and fires the wake callback when
-   *        one turns readable.
+   * @brief Waits on the readiness poller and reports the session behind each
+   *        accepted socket that turns readable.
    *
    * Without it, inbound TCP data sat until a worker's next tick: an 8 ms
    * round-trip floor at the default 120 tps, three orders of magnitude above
    * the socket's own latency.
    */
   void PollLoop();
+  /** @brief Drops watched_ entries whose session is gone. Poll thread. */
+  void SweepWatched();
   // serializes Close() against Accept(): the server's loop accepts on
   // server_socket_ while the application may close it from its own thread, and
   // accept() on a descriptor that has been closed and reused would hand back a
@@ -180,12 +228,19 @@ class TCPServerBackend : public ServerBackend {
   std::atomic_bool is_bind_{false};
   std::atomic_bool is_listening_{false};
   SocketHandle server_socket_ = kSocketInvalid;
-  std::function<void()> on_data_;
+  std::function<void(PeerSession&)> on_ready_;
   Task poll_task_;
-  // accepted sockets under watch; the poll thread prunes entries whose
-  // descriptors have been closed by their transports
-  std::mutex poll_mutex_;
-  std::vector<SocketHandle> polled_;
+  // every accepted socket is registered here once, by Accept(), and removed
+  // by its transport before the descriptor is closed. Shared with those
+  // transports, which can outlive the backend.
+  std::shared_ptr<ReadinessPoller> poller_;
+  // poller token -> the session behind it. The token is the session id, which
+  // is never reused, so a report that races a close finds an expired entry,
+  // never some other session. Entries are dropped once their session is gone
+  // (SweepWatched), not when the socket closes: the transport that closes it
+  // does not know its token.
+  std::mutex watched_mutex_;
+  std::unordered_map<uint64_t, std::weak_ptr<PeerSession>> watched_;
 };
 
 }  // namespace backends
@@ -40,6 +40,7 @@
 #include <unordered_map>
 #include <vector>
 #include "znet/backends/zdt/zdt_domain.h"
+#include "znet/backends/zdt/zdt_peer_table.h"
 #include "znet/backends/zdt/zdt_transport.h"
 
 namespace znet {
@@ -88,11 +89,15 @@ class ZDTClientBackend : public ClientBackend {
   // the client loop's next tick. started only after the handshake, which reads
   // the socket directly and would otherwise race it.
   void ReceiveLoop();
+  // answers the server's PathChallenge, from whatever address the NAT now
+  // gives this socket. Receive thread only.
+  void AnswerPathChallenge(Buffer& challenge);
 
   std::shared_ptr<InetAddress> server_address_;
   std::shared_ptr<InetAddress> local_address_;
   std::shared_ptr<UDPSocket> socket_;
   std::shared_ptr<ZDTInbox> inbox_;
+  std::shared_ptr<ZDTDatagramPool> datagram_pool_;  // null when disabled
   std::thread receive_thread_;
   std::mutex receive_thread_mutex_;
   std::atomic_bool receiving_{false};
@@ -101,6 +106,9 @@ class ZDTClientBackend : public ClientBackend {
   ZDTOptions config_;
   SessionOptions session_options_;  // passed to the PeerSession it creates
   uint64_t guid_ = 0;
+  // what the server routes this connection by; set before the receive
+  // thread starts
+  ZDTConnectionId connection_id_ = 0;
   bool is_bind_ = false;
 };
 
@@ -122,8 +130,8 @@ class ZDTServerBackend : public ServerBackend {
   bool IsAlive() override;
 
 
-  void SetWakeCallback(std::function<void()> on_data) override {
-    on_data_ = std::move(on_data);
+  void SetReadyCallback(std::function<void(PeerSession&)> on_ready) override {
+    on_ready_ = std::move(on_ready);
   }
 
   void StopReceiving() override;
@@ -132,87 +140,144 @@ class ZDTServerBackend : public ServerBackend {
     return bind_address_;
   }
 
-  ServerMetrics metrics() const override {
-    // the receive thread writes these counters, so sample under the lock
-    std::lock_guard<std::mutex> lock(state_mutex_);
-    ServerMetrics out = metrics_;
-    out.connection_type = ConnectionType::ZDT;
-    return out;
-  }
+  ServerMetrics metrics() const override;
 
  private:
   struct Route {
     std::weak_ptr<PeerSession> session;
     std::shared_ptr<ZDTInbox> inbox;
     std::shared_ptr<InetAddress> peer;
+    PeerKey path;  // `peer`, as datagrams from it arrive
+    ZDTConnectionId id = 0;
     uint64_t remote_guid = 0;
+    // the address a PathChallenge is out to, and what it must echo; a
+    // datagram carrying this route's id came from there
+    PeerKey probe_path;
+    uint64_t probe_token = 0;
+    std::chrono::steady_clock::time_point probe_sent;
   };
 
-  // body of the receive thread: blocks in recvfrom and routes each datagram as
-  // it lands. Online -> the matching peer's inbox; offline -> the stateless
-  // handshake path (which may create a session and push it onto
-  // pending_accept_). Returns when is_listening_ goes false.
-  void ReceiveLoop();
-  void RouteDatagram(Buffer& datagram,
-                     const std::shared_ptr<InetAddress>& from);
-  void HandleOffline(Buffer& buffer, const std::shared_ptr<InetAddress>& from,
+  struct SourceRate {
+    int count = 0;
+    std::chrono::steady_clock::time_point window_start;
+  };
+
+  // one socket on the server's port, its receive thread, and everything that
+  // thread touches. The kernel picks the socket by the peer's address and
+  // port, so a peer whose NAT rebinds may turn up on another shard; that one
+  // adopts its route from registry_. The session keeps answering through
+  // the socket that accepted it, which shares the port.
+  struct Shard {
+    size_t index = 0;  // in shards_, and the producer it is to every inbox
+    std::shared_ptr<UDPSocket> socket;
+    std::thread receive_thread;
+
+    // pending_accept and published are handed from the receive thread to the
+    // Server's tick, so they need a lock. Deliberately not mutex_: the Server
+    // holds that across a whole tick, and stalling the receive thread that
+    // long is what overflows the socket.
+    mutable std::mutex state_mutex;
+    std::deque<std::shared_ptr<PeerSession>> pending_accept;
+    ServerMetrics published;  // a copy of metrics, refreshed once per batch
+
+    // everything below belongs to the receive thread alone, and it reads and
+    // writes them without a lock. routes above all: it is probed for every
+    // datagram, and only ever from here.
+    PeerTable<Route, ZDTConnectionId> routes;
+    std::unordered_map<std::string, SourceRate> source_rate;
+    // cookie signing secrets. Per shard: a Request2 comes from the same
+    // address as its Request1, so it lands on the shard that signed the
+    // cookie.
+    std::array<uint8_t, 32> secret_current{};
+    std::array<uint8_t, 32> secret_previous{};
+    uint32_t epoch = 0;
+    bool has_previous_secret = false;
+    std::chrono::steady_clock::time_point last_rotation;
+    ServerMetrics metrics;
+#ifndef NDEBUG
+    // RouteDatagram and everything it reaches (HandleOffline, the cookie
+    // secrets, the rate limiter) belong to the shard's receive thread.
+    ThreadDomain receive_domain;
+#endif
+  };
+
+  // opens, configures and binds one shard's socket to bind_address_
+  Result OpenShard(Shard& shard, bool reuse_port);
+  // body of a shard's receive thread: blocks for datagrams, takes as many as
+  // are queued (up to receive_batch) and routes each. Online -> the matching
+  // peer's inbox; offline -> the stateless handshake path (which may create a
+  // session and push it onto pending_accept). Returns when receiving_ goes
+  // false.
+  void ReceiveLoop(Shard& shard);
+  // receive thread only. Returns the session an online datagram was queued
+  // for, so the caller can report it; null for anything else. `segment_size`
+  // is the receive's DatagramSlot::segment_size: nonzero when `datagram` holds
+  // several, coalesced by receive offload. A known peer's datagrams are routed
+  // on their connection id alone; an InetAddress is built only for the
+  // handshake path and for a path challenge.
+  std::shared_ptr<PeerSession> RouteDatagram(Shard& shard, Buffer& datagram,
+                                             size_t segment_size,
+                                             const PeerKey& from);
+  void HandleOffline(Shard& shard, Buffer& buffer, const PeerKey& peer,
+                     const std::shared_ptr<InetAddress>& from,
                      size_t datagram_size);
-  void MaybeRotateSecret();
-  ZDTCookie CookieFor(const std::string& peer_readable, uint32_t epoch) const;
+  // the shard's route for `id`, adopted from registry_ when the peer last
+  // arrived on another shard; null when there is none. Receive thread only.
+  Route* FindRoute(Shard& shard, ZDTConnectionId id);
+  // a datagram for `route` came from `from`, not its path: asks `from` to
+  // prove it is the peer, at most once per kPathChallengeInterval
+  void ChallengePath(Shard& shard, Route& route, const PeerKey& from);
+  // a PathResponse from `peer`: moves the route there if it echoes the
+  // challenge sent to it
+  void OnPathResponse(Shard& shard, Buffer& buffer, const PeerKey& peer,
+                      const std::shared_ptr<InetAddress>& from);
+  // drops the routes whose sessions are gone, from the shard and from
+  // registry_. Receive thread only.
+  void ReapRoutes(Shard& shard);
+  void MaybeRotateSecret(Shard& shard);
+  ZDTCookie CookieFor(const Shard& shard, const std::string& peer_readable,
+                      uint32_t epoch) const;
   // per-source handshake rate limit (bounded, self-pruning). returns false when
   // the source has exceeded per_source_handshake_rate this second.
-  bool AllowHandshake(const std::string& peer_readable);
+  bool AllowHandshake(Shard& shard, const std::string& peer_readable);
 
   // makes Close() a single winner, so two threads stopping the server together
-  // do not both tear the tables and the socket down. Guards nothing else; the
-  // receive thread and the server's tick share state_mutex_ instead.
+  // do not both tear the tables and the sockets down. Guards nothing else; the
+  // receive threads and the server's tick share each shard's state_mutex.
   std::mutex mutex_;
   std::shared_ptr<InetAddress> bind_address_;
-  std::shared_ptr<UDPSocket> socket_;
   ZDTOptions config_;
   SessionOptions child_session_options_;  // passed to each accepted PeerSession
-  // touched only from the offline-datagram path, like source_rate_
+  size_t receive_sockets_;
+  // shared by every shard and session, made by Bind(); null when disabled
+  std::shared_ptr<ZDTDatagramPool> datagram_pool_;
+  // reached from every shard's offline path, and not synchronized itself
+  std::mutex admission_mutex_;
   AdmissionControl admission_;
   std::atomic_bool is_bind_{false};
   std::atomic_bool is_listening_{false};
-
-  struct SourceRate {
-    int count = 0;
-    std::chrono::steady_clock::time_point window_start;
-  };
-
-  // routes_, pending_accept_, source_rate_, the cookie secrets and metrics_ are
-  // written by the receive thread and read by the Server's tick, so they need a
-  // lock. Deliberately not mutex_: the Server holds that across a whole tick,
-  // and stalling the receive thread that long is what overflows the socket.
-  mutable std::mutex state_mutex_;
-  // set once before the receive thread starts and never reassigned, so the
-  // thread can read it without synchronizing.
-  std::function<void()> on_data_;
+  // set once before the receive threads start and never reassigned, so they
+  // can read it without synchronizing.
+  std::function<void(PeerSession&)> on_ready_;
   // StopReceiving() is reachable both from the shutdown path and from Close()
   // on another thread. Joining the same thread twice is undefined, so entry is
   // serialized here.
-#ifndef NDEBUG
-  // RouteDatagram and everything it reaches (HandleOffline, the cookie secrets,
-  // the rate limiter) belong to the receive thread.
-  ThreadDomain receive_domain_;
-#endif
   std::mutex receive_thread_mutex_;
-  std::thread receive_thread_;
   std::atomic_bool receiving_{false};
 
-  std::unordered_map<std::string, Route> routes_;
-  std::deque<std::shared_ptr<PeerSession>> pending_accept_;
-  std::unordered_map<std::string, SourceRate> source_rate_;
-
-  // cookie signing secrets (touched only on the receive thread).
-  std::array<uint8_t, 32> secret_current_{};
-  std::array<uint8_t, 32> secret_previous_{};
-  uint32_t epoch_ = 0;
-  bool has_previous_secret_ = false;
-  std::chrono::steady_clock::time_point last_rotation_;
+  // fixed between Bind() and Close(); each shard locks its own state.
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // every connection on the server, by id and by current path: what a shard
+  // adopts a migrated peer's route from, what max_connections counts, and
+  // what a duplicate Request2 is checked against. Touched on handshakes,
+  // migrations and reaps, never per datagram.
+  mutable std::mutex registry_mutex_;
+  PeerTable<Route, ZDTConnectionId> registry_;
+  PeerTable<ZDTConnectionId> registry_paths_;
+  // Accept() takes from the shards in turn, so a busy one cannot starve the
+  // rest. The server's tick only.
+  size_t next_accept_ = 0;
   uint64_t server_guid_ = 0;
-  ServerMetrics metrics_;
 };
 
 }  // namespace backends
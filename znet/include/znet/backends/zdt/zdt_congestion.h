@@ -9,8 +9,8 @@
 //
 
 //
-// ZDT's round-trip estimator and congestion window, as two plain state
-// machines. Neither owns a socket, a clock or a connection: time arrives as a
+// ZDT's round-trip estimator and congestion controllers, as plain state
+// machines. None owns a socket, a clock or a connection: time arrives as a
 // parameter and everything they need about the rest of the transport is passed
 // in. That is what makes them testable, which matters here more than usual,
 // because congestion control only misbehaves on links that are awkward to
@@ -22,10 +22,11 @@
 
 #include "znet/backends/zdt/zdt_wire.h"
 #include "znet/compat.h"
-#include "znet/compat.h"
 #include "znet/options.h"
 
+#include <array>
 #include <chrono>
+#include <memory>
 
 namespace znet {
 namespace backends {
@@ -67,11 +68,14 @@ class ZDTRttEstimator {
   ZNET_NODISCARD bool has_rtt() const { return has_rtt_; }
   ZNET_NODISCARD double srtt_ms() const { return srtt_ms_; }
   ZNET_NODISCARD double rtt_min_ms() const { return rtt_min_ms_; }
+  /** @brief The most recent sample, unsmoothed. */
+  ZNET_NODISCARD double latest_ms() const { return latest_ms_; }
   ZNET_NODISCARD std::chrono::milliseconds rto() const { return rto_; }
 
  private:
   double srtt_ms_ = 0.0;
   double rttvar_ms_ = 0.0;
+  double latest_ms_ = 0.0;
   // a windowed minimum, not a lifetime one. the whole controller is measured
   // against this, so a stale floor left by a route change would read the new
   // baseline as permanent queueing and pin the window at its lower bound.
@@ -81,8 +85,99 @@ class ZDTRttEstimator {
   std::chrono::milliseconds rto_{200};
 };
 
+/** @brief What one incoming ack told the sender, after it was applied. */
+struct ZDTAckEvent {
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  WireSeq peer_ack = 0;  /**< Highest packet_seq the peer has seen. */
+  int acked_datagrams = 0;  /**< Datagrams this ack newly retired. */
+  int in_flight = 0;  /**< Reliable datagrams still unacked after it. */
+  /** @brief The sender's next packet sequence, which bounds any epoch the
+   *         ack opens. */
+  WireSeq next_seq = 0;
+  int cap = 0;  /**< Ceiling on the window. */
+  TimePoint now;
+};
+
+/**
+ * @brief How much a connection may have in flight, and how fast it may send
+ *        it.
+ *
+ * The transport owns one per connection, picked by
+ * ZDTOptions::congestion_algorithm, and reports every ack and timeout. The
+ * window counts datagrams, as max_datagrams_in_flight does. Window() is asked
+ * per message in the flush loop, so implementations keep it to a few loads.
+ * How fast the window may be sent is pacing_rate(), which the transport's
+ * ZDTPacer turns into send times.
+ */
+class ZDTCongestionController {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  virtual ~ZDTCongestionController() = default;
+
+  /** @brief An ack arrived, whether or not it retired anything. */
+  virtual void OnAck(const ZDTAckEvent& ack, const ZDTRttEstimator& rtt) = 0;
+
+  /** @brief A retransmit scan found something timed out. */
+  virtual void OnRetransmitTimeout(const ZDTRttEstimator& rtt,
+                                   WireSeq next_seq) = 0;
+
+  /** @brief The sender ran out of data with room left in the window, so what
+   *         the acks say about the path's rate is an underestimate. */
+  virtual void OnAppLimited() {}
+
+  /**
+   * @brief Datagrams allowed in flight, clamped to `cap` and to a floor that
+   *        always permits forward progress.
+   */
+  ZNET_NODISCARD virtual int Window(int cap) const = 0;
+
+  ZNET_NODISCARD virtual double cwnd() const = 0;
+  /** @brief Datagrams per second to pace the window at; 0 until there is a
+   *         round trip to base it on. */
+  ZNET_NODISCARD virtual double pacing_rate() const = 0;
+};
+
 /**
- * @brief The congestion window, in datagrams.
+ * @brief Spaces datagrams at a rate: each send moves the next send time one
+ *        interval on.
+ *
+ * A sender that went idle may send a quantum back to back (a millisecond of
+ * sends, at least two), since the slots it skipped are not banked beyond
+ * that. Anything finer than the quantum is below what a worker's wake-ups
+ * can honour anyway.
+ */
+class ZDTPacer {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  /** @brief Datagrams per second; 0 stops pacing. */
+  void SetRate(double datagrams_per_second);
+
+  /** @brief A paced datagram went out at `now`. */
+  void OnSent(TimePoint now);
+
+  /** @brief Earliest time the next datagram may leave; the epoch when
+   *         unpaced. */
+  ZNET_NODISCARD TimePoint NextSendTime() const { return next_send_; }
+  ZNET_NODISCARD double rate() const { return rate_; }
+
+ private:
+  double rate_ = 0.0;
+  std::chrono::steady_clock::duration interval_{};
+  TimePoint next_send_;
+};
+
+/**
+ * @brief Builds the controller `algorithm` names.
+ */
+std::unique_ptr<ZDTCongestionController> MakeZDTCongestionController(
+    ZDTCongestionAlgorithm algorithm);
+
+/**
+ * @brief The default controller: a window in datagrams, driven by queueing
+ *        delay.
  *
  * The congestion signal is queueing delay rather than loss. Reno-style halving
  * on every drop settles at a window of ~1.2/sqrt(loss), six datagrams at 5%,
@@ -92,9 +187,15 @@ class ZDTRttEstimator {
  * Loss events are grouped into epochs so that one burst costs one reduction
  * rather than one per datagram in it. The epoch is defined against the sender's
  * packet sequence, which is why the send-path counter is passed in.
+ *
+ * Its pacing rate is the window over the smoothed round trip, with Linux TCP's
+ * headroom on top (2x in slow start, 1.2x after) so pacing never becomes what
+ * limits it. Only used when ZDTOptions::pacing asks for it.
  */
-class ZDTCongestionController {
+class ZDTDelayController : public ZDTCongestionController {
  public:
+  void OnAck(const ZDTAckEvent& ack, const ZDTRttEstimator& rtt) override;
+
   /** @brief Ends the current loss epoch once the peer acknowledges something
    *  sent after it opened. */
   void OnAckArrived(WireSeq peer_ack);
@@ -119,15 +220,10 @@ class ZDTCongestionController {
    * lossy path gets a gentler reduction, since a timeout there is usually still
    * just loss.
    */
-  void OnRetransmitTimeout(const ZDTRttEstimator& rtt, WireSeq next_seq);
+  void OnRetransmitTimeout(const ZDTRttEstimator& rtt,
+                           WireSeq next_seq) override;
 
-  /**
-   * @brief Datagrams allowed in flight, clamped to `cap` and to a floor that
-   *        always permits forward progress.
-   *
-   * Inline: evaluated per iteration of the flush loop.
-   */
-  ZNET_NODISCARD int Window(int cap) const {
+  ZNET_NODISCARD int Window(int cap) const override {
     int w = static_cast<int>(cwnd_);
     if (w < 2) {
       w = 2;  // always allow enough in flight to make forward progress
@@ -135,11 +231,13 @@ class ZDTCongestionController {
     return w > cap ? cap : w;
   }
 
-  ZNET_NODISCARD double cwnd() const { return cwnd_; }
+  ZNET_NODISCARD double cwnd() const override { return cwnd_; }
+  ZNET_NODISCARD double pacing_rate() const override;
   ZNET_NODISCARD bool in_loss_recovery() const { return in_loss_recovery_; }
 
  private:
   double cwnd_ = 10.0;     // initial window, TCP's IW10
+  double srtt_ms_ = 0.0;   // as of the last ack, for the pacing rate
   double ssthresh_ = 1e9;  // no threshold until the first loss teaches one
   // suppresses repeated reduction inside one round trip: one loss event should
   // cost one reduction, not one per lost datagram in the same window.
@@ -147,6 +245,104 @@ class ZDTCongestionController {
   bool in_loss_recovery_ = false;
 };
 
+/**
+ * @brief A model-based controller after BBR: it estimates the path's
+ *        bottleneck rate and its minimum round trip, and sends at that rate
+ *        rather than in window-sized bursts. Always paced, whatever
+ *        ZDTOptions::pacing says.
+ *
+ * Neither the loss rate nor the delay ratio the default controller reads
+ * drives it, so it keeps its window on the microsecond round trips where
+ * kZDTQueueingRttRatio is a margin smaller than jitter, and on lossy links.
+ * The rate is the most datagrams acked in any of the last
+ * kZDTBbrRateWindowRounds round trips, a round trip being the time until an
+ * ack covers a datagram sent after the previous one ended; the window is
+ * twice rate times minimum round trip, which keeps the pipe full while the
+ * pacer spreads it out.
+ *
+ * The phases are BBR's: Startup doubles the rate every round trip until it
+ * stops growing, Drain sends below it until the queue Startup built is gone,
+ * ProbeBandwidth cycles a round trip above the estimate, one below, and six
+ * at it, and ProbeRtt drops the window to its floor for a moment whenever the
+ * minimum round trip has gone kZDTRttMinWindowMs unconfirmed, since a
+ * connection that always keeps a queue would never see the floor again.
+ */
+class ZDTBbrController : public ZDTCongestionController {
+ public:
+  enum class Mode { Startup, Drain, ProbeBandwidth, ProbeRtt };
+
+  void OnAck(const ZDTAckEvent& ack, const ZDTRttEstimator& rtt) override;
+  /** @brief Loss is not the model's signal, but a timeout means what is in
+   *         flight is gone: the window drops to the floor until the epoch it
+   *         opens is acked, and then returns to where it was. */
+  void OnRetransmitTimeout(const ZDTRttEstimator& rtt,
+                           WireSeq next_seq) override;
+  void OnAppLimited() override { round_app_limited_ = true; }
+
+  ZNET_NODISCARD int Window(int cap) const override {
+    int w = static_cast<int>(cwnd_);
+    if (mode_ == Mode::ProbeRtt && w > kZDTBbrMinWindow) {
+      w = kZDTBbrMinWindow;
+    }
+    if (w < kZDTBbrMinWindow) {
+      w = kZDTBbrMinWindow;
+    }
+    return w > cap ? cap : w;
+  }
+  ZNET_NODISCARD double cwnd() const override { return cwnd_; }
+  ZNET_NODISCARD double pacing_rate() const override { return pacing_rate_; }
+
+  ZNET_NODISCARD Mode mode() const { return mode_; }
+  /** @brief The bottleneck estimate, datagrams per second; 0 before the
+   *         first round trip completes. */
+  ZNET_NODISCARD double bottleneck_rate() const;
+  /** @brief The minimum round trip the model uses, in milliseconds. */
+  ZNET_NODISCARD double min_rtt_ms() const { return min_rtt_ms_; }
+
+ private:
+  void EndRound(const ZDTAckEvent& ack);
+  void UpdateMinRtt(const ZDTAckEvent& ack, const ZDTRttEstimator& rtt);
+  void UpdateMode(const ZDTAckEvent& ack);
+  void EnterProbeBandwidth(TimePoint now);
+  void UpdatePacingRate(const ZDTRttEstimator& rtt);
+  ZNET_NODISCARD double PacingGain() const;
+  ZNET_NODISCARD double Bdp() const;
+
+  Mode mode_ = Mode::Startup;
+  double cwnd_ = 10.0;  // the same IW10 the default controller starts from
+  double pacing_rate_ = 0.0;
+
+  // the round trip being measured: acks counted since it began, and the
+  // packet_seq whose ack ends it
+  bool round_open_ = false;
+  WireSeq round_end_ = 0;
+  TimePoint round_start_;
+  int round_acked_ = 0;
+  bool round_app_limited_ = false;
+  // the last kZDTBbrRateWindowRounds measured rates; the estimate is their
+  // maximum
+  std::array<double, kZDTBbrRateWindowRounds> rates_{};
+  size_t rate_slot_ = 0;
+
+  // Startup ends after three rounds that failed to grow the rate by a quarter
+  double full_rate_ = 0.0;
+  int full_rate_rounds_ = 0;
+  bool filled_pipe_ = false;
+
+  int cycle_index_ = 0;
+  TimePoint cycle_start_;
+
+  double min_rtt_ms_ = 0.0;
+  TimePoint min_rtt_stamp_;
+  TimePoint probe_rtt_done_;
+  WireSeq probe_rtt_round_end_ = 0;
+
+  // a timeout's collapse lasts one epoch, as the default controller's does
+  bool in_loss_recovery_ = false;
+  WireSeq loss_recovery_until_ = 0;
+  double prior_cwnd_ = 0.0;
+};
+
 }  // namespace backends
 }  // namespace znet
 
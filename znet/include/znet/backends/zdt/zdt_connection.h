@@ -22,6 +22,13 @@ struct ZDTConnection {
   uint16_t mtu = 1200;
   uint64_t local_guid = 0;
   uint64_t remote_guid = 0;
+  // the id the peer routes this connection's datagrams by, stamped on every
+  // one sent to it. 0 when the peer routes by source address: the server end
+  // of a connection, and P2P links.
+  uint32_t peer_connection_id = 0;
+  // both ends agreed to seal datagrams (ZDTOptions::datagram_encryption), so
+  // the transport takes the session's datagram keys once they exist
+  bool sealed = false;
 };
 
 }  // namespace backends
@@ -0,0 +1,159 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Forward error correction for a ZDT channel. After every group of messages
+// the sender adds one parity record, the XOR of their payloads, and a receiver
+// missing exactly one of the group rebuilds it from the parity and the rest
+// instead of waiting a round trip for the retransmit. Bookkeeping and the
+// parity's wire layout only: the transport decides which channels use it and
+// which datagram each parity rides in.
+//
+// A parity record's payload:
+//
+//   count(1)  count x [rec_flags(1) message_seq(2) length(2)]  xor(longest)
+//
+// Members are named rather than counted on, so the receiver matches them to
+// what it holds whatever order they arrived in and whatever was lost. The xor
+// is as long as the longest member; shorter ones count as zero-padded.
+//
+
+#ifndef ZNET_BACKENDS_ZDT_ZDT_FEC_H_
+#define ZNET_BACKENDS_ZDT_ZDT_FEC_H_
+
+#include "znet/backends/zdt/zdt_wire.h"
+#include "znet/buffer.h"
+#include "znet/compat.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace znet {
+namespace backends {
+
+/**
+ * @brief Builds the parity for one channel's messages as they are sent.
+ *
+ * Only a message's first transmission joins a group: a retransmit is already
+ * covered by the group it was first sent in, or by nothing.
+ */
+class ZDTFecEncoder {
+ public:
+  /** @param group_size messages per parity, clamped to 2..kZDTFecMaxGroup. */
+  explicit ZDTFecEncoder(size_t group_size);
+
+  /** @brief Bytes of parity payload for `members` messages, the longest
+   *         `longest` bytes. */
+  static size_t ParitySize(size_t members, size_t longest) {
+    return 1 + members * kZDTFecMemberSize + longest;
+  }
+
+  /**
+   * @brief Whether a message of `len` bytes can join the open group with its
+   *        parity still fitting in `capacity` bytes of payload.
+   *
+   * A message too long to fit even an empty group goes out unprotected; one
+   * that only overflows this group should close it first.
+   */
+  ZNET_NODISCARD bool Fits(size_t len, size_t capacity) const {
+    return ParitySize(count_ + 1, len > longest_ ? len : longest_) <= capacity;
+  }
+
+  /** @brief Folds one message record and its payload into the open group. */
+  void Add(const ZDTRecord& record, const uint8_t* data, size_t len);
+
+  /** @brief Whether the open group has reached its size. */
+  ZNET_NODISCARD bool full() const { return count_ >= group_size_; }
+  /** @brief Messages in the open group. */
+  ZNET_NODISCARD size_t count() const { return count_; }
+
+  /** @brief Appends the open group's parity payload to `out` and starts the
+   *         next group. */
+  void Finish(Buffer& out);
+
+  /** @brief What this holds at its current capacity. */
+  ZNET_NODISCARD size_t StateBytes() const {
+    return sizeof(*this) + xor_.capacity();
+  }
+
+ private:
+  struct Member {
+    uint8_t flags = 0;
+    WireSeq seq = 0;
+    uint16_t length = 0;
+  };
+
+  size_t group_size_;
+  size_t count_ = 0;
+  size_t longest_ = 0;
+  std::array<Member, kZDTFecMaxGroup> members_{};
+  // zero past longest_, so a longer member XORs into clean bytes
+  std::vector<uint8_t> xor_;
+};
+
+/**
+ * @brief Remembers one channel's recent messages so a parity can rebuild the
+ *        one that went missing.
+ *
+ * Holds the last kZDTFecHistory message records by their identity on the
+ * channel (reliability, ordering and message_seq). Fragments are never
+ * protected, so they are never held either.
+ */
+class ZDTFecDecoder {
+ public:
+  /**
+   * @brief Holds a message record that arrived on the channel.
+   *
+   * @return false when Recover() already rebuilt this one. The caller drops it
+   *         as a duplicate: an unreliable unordered channel has nothing else
+   *         that would.
+   */
+  bool OnRecord(const ZDTRecord& record, const uint8_t* data, size_t len);
+
+  /**
+   * @brief Reads a parity payload and, when exactly one message it covers is
+   *        missing, rebuilds it.
+   *
+   * @param out_record receives the rebuilt message's header, all but the
+   *                   channel, which the caller knows.
+   * @param out_data   points at its payload, valid until the next call.
+   * @return false when nothing was missing, more than one was, or the parity
+   *         is malformed.
+   */
+  bool Recover(const uint8_t* parity, size_t len, ZDTRecord& out_record,
+               const uint8_t*& out_data);
+
+  /** @brief What this holds at its current capacity. */
+  ZNET_NODISCARD size_t StateBytes() const;
+
+ private:
+  struct Entry {
+    uint8_t flags = 0;  // kRecReliable | kRecOrdered only
+    WireSeq seq = 0;
+    bool live = false;
+    bool recovered = false;  // rebuilt here rather than received
+    std::vector<uint8_t> bytes;
+  };
+
+  Entry* Find(uint8_t flags, WireSeq seq);
+  // the oldest entry, emptied for reuse; its buffer keeps its capacity
+  Entry& Claim(uint8_t flags, WireSeq seq);
+
+  std::array<Entry, kZDTFecHistory> entries_;
+  size_t next_ = 0;
+  std::vector<uint8_t> rebuilt_;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_ZDT_ZDT_FEC_H_
@@ -24,7 +24,9 @@
 #include "znet/options.h"
 #include "znet/peer_session.h"
 #include "znet/compat.h"
+#include "znet/spsc_queue.h"
 #include "znet/transport.h"
+#include "znet/types.h"
 
 #include <array>
 #include <atomic>
@@ -32,6 +34,7 @@
 #include <cstdint>
 #include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
@@ -45,6 +48,50 @@ namespace backends {
 
 enum class RecvResult { Received, WouldBlock, Error };
 
+/**
+ * @brief A datagram's source in a fixed, comparable form: family, port, IPv6
+ *        scope and address bytes, zero-padded.
+ *
+ * Built straight from the sockaddr the kernel filled, so a receive loop can
+ * recognise a peer without the allocation and formatting an InetAddress
+ * costs. ToInetAddress() is for when one is needed after all.
+ */
+struct PeerKey {
+  uint16_t family = 0;  // 0 for nothing, else 4 or 6
+  uint16_t port = 0;    // network order, as the sockaddr holds it
+  uint32_t scope = 0;   // IPv6 only
+  std::array<uint8_t, 16> address{};  // IPv4 uses the first 4
+
+  static PeerKey From(const sockaddr* addr);
+  static PeerKey From(const InetAddress& addr) {
+    return From(addr.handle_ptr());
+  }
+
+  ZNET_NODISCARD bool valid() const { return family != 0; }
+  ZNET_NODISCARD size_t Hash() const;
+  /** @brief Null for a key that is not valid(). Drops the scope, as
+   *         InetAddress::from() does. */
+  ZNET_NODISCARD std::shared_ptr<InetAddress> ToInetAddress() const;
+
+  bool operator==(const PeerKey& other) const {
+    return family == other.family && port == other.port &&
+           scope == other.scope && address == other.address;
+  }
+  bool operator!=(const PeerKey& other) const { return !(*this == other); }
+};
+
+// one datagram of a UDPSocket::RecvBatch(): storage the caller owns, and what
+// landed in it
+struct DatagramSlot {
+  void* data = nullptr;
+  size_t cap = 0;
+  size_t len = 0;  // filled in
+  PeerKey from;    // filled in
+  // filled in: nonzero when receive offload coalesced several datagrams into
+  // `len`, each this long but the last, which may be shorter
+  size_t segment_size = 0;
+};
+
 // thin owner of a UDP socket. shared by a server's per-peer transports: concurrent
 // sendto() on one socket is safe.
 class UDPSocket {
@@ -57,10 +104,91 @@ class UDPSocket {
   Result Open(InetProtocolVersion ipv);
   Result Bind(const InetAddress& addr);
 
+  // most datagrams one batched call moves; larger batches are clamped
+  static constexpr size_t kMaxBatch = 64;
+  // what one coalesced receive can hold; a RecvBatch() slot on a socket with
+  // receive offload needs this much room or the excess is cut off
+  static constexpr size_t kMaxOffloadBytes = 65535;
+
   bool SendTo(const InetAddress& addr, const void* data, size_t len);
   RecvResult RecvFrom(void* data, size_t cap, size_t& out_len,
                       std::shared_ptr<InetAddress>& out_from);
 
+  /**
+   * @brief Sends each of @p datagrams to @p addr, in order.
+   *
+   * One sendmmsg() on Linux, a SendTo() each elsewhere. A datagram the kernel
+   * refuses is skipped rather than ending the batch, as separate sends would.
+   *
+   * @param launch when not null, the time each datagram should leave, for a
+   *        socket with EnableTxTime(); ignored otherwise. An epoch entry
+   *        leaves at once.
+   * @return how many were sent.
+   */
+  size_t SendBatchTo(const InetAddress& addr, const SocketSlice* datagrams,
+                     size_t count,
+                     const std::chrono::steady_clock::time_point* launch =
+                         nullptr);
+
+  /**
+   * @brief Receives up to @p count datagrams into @p slots.
+   *
+   * Waits for the first the way RecvFrom() would, then takes only what is
+   * already queued: a blocking socket never waits for a full batch. One
+   * recvmmsg() on Linux; a loop elsewhere, and one datagram a call on Windows.
+   *
+   * @param out_count slots filled; only meaningful on Received.
+   */
+  RecvResult RecvBatch(DatagramSlot* slots, size_t count, size_t& out_count);
+
+  /**
+   * @brief Lets SendBatchTo() hand a run of equal-sized datagrams to the
+   *        kernel as one buffer it splits (UDP_SEGMENT).
+   *
+   * Linux only; false where the kernel lacks it, leaving the socket as it was.
+   * A send the kernel refuses later turns it back off and goes out
+   * datagram by datagram instead, so a route without the offload costs one
+   * failed call.
+   */
+  bool EnableSendOffload();
+
+  /**
+   * @brief Lets the kernel coalesce arrivals from one peer into a single
+   *        receive (UDP_GRO), reported through DatagramSlot::segment_size.
+   *
+   * Linux only; false where the kernel lacks it. Only for a socket read
+   * through RecvBatch() with kMaxOffloadBytes slots: RecvFrom() cannot tell a
+   * coalesced receive from one datagram.
+   */
+  bool EnableReceiveOffload();
+
+  /**
+   * @brief Lets other sockets bind the same address and port, the kernel
+   *        spreading arrivals across them by source (SO_REUSEPORT). Call
+   *        before Bind(), on every socket in the group.
+   *
+   * Linux only: elsewhere the option is missing or hands every datagram to
+   * the last socket bound, which spreads nothing, so this returns false.
+   */
+  bool EnableReusePort();
+
+  /**
+   * @brief Lets SendBatchTo() give each datagram a launch time the kernel
+   *        holds it until (SO_TXTIME against the monotonic clock that
+   *        steady_clock reads).
+   *
+   * Linux only; false where the kernel lacks it. The fq or etf queueing
+   * discipline is what honours the times: under any other the kernel accepts
+   * them and sends at once.
+   */
+  bool EnableTxTime();
+
+  ZNET_NODISCARD bool send_offload() const {
+    return send_offload_.load(std::memory_order_relaxed);
+  }
+  ZNET_NODISCARD bool receive_offload() const { return receive_offload_; }
+  ZNET_NODISCARD bool tx_time() const { return tx_time_; }
+
   bool SetBlocking(bool blocking);
   bool SetReceiveTimeout(std::chrono::milliseconds timeout);
   // headroom for bursts that arrive between drains. Best-effort: the kernel
@@ -100,6 +228,11 @@ class UDPSocket {
 
  private:
   std::atomic<SocketHandle> socket_{kSocketInvalid};
+  // cleared by whichever sender first sees the kernel refuse a segmented send;
+  // the socket is shared, so that can be any transport's worker
+  std::atomic_bool send_offload_{false};
+  bool receive_offload_ = false;  // set before the socket is read
+  bool tx_time_ = false;  // set before the socket is written
 };
 
 // Applies both buffer sizes (0 = leave the OS default) and logs the granted
@@ -108,22 +241,111 @@ class UDPSocket {
 // carries ZDT traffic goes through this: both backends and the P2P punch.
 void ApplySocketBufferSizes(UDPSocket& socket, int recv_bytes, int send_bytes);
 
-// thread-safe datagram queue, shared by a producer and a consumer running on
-// different threads (see ZDTTransportLayer for the threading rule).
+// recycles the buffers datagrams ride in from a receive thread to the session
+// that parses them, so a steady flow allocates none. One per backend, with a
+// free list for each of its receive threads that only that thread touches,
+// so nothing here is locked. Workers never reach it: a worker hands its
+// parsed datagrams back through the inbox they came in, and the receive
+// thread takes them from there when its own list runs dry. See ZDTInbox.
+class ZDTDatagramPool {
+ public:
+  // `max_pooled` bounds what sits idle in the free lists, split evenly
+  // between the `producers`: a burst that needed more frees the surplus as it
+  // is handed back
+  explicit ZDTDatagramPool(size_t max_pooled, size_t producers = 1);
+
+  // a big-endian buffer holding a copy of `data`, from `producer`'s free
+  // list. `out_hit` says whether it was a pooled one or had to be allocated.
+  // This and the rest are for that producer's thread only.
+  Buffer Copy(const char* data, size_t len, bool& out_hit, size_t producer = 0);
+  void Recycle(Buffer&& datagram, size_t producer = 0);
+  // hands back every buffer in `datagrams`, leaving it empty
+  void Recycle(std::vector<Buffer>& datagrams, size_t producer = 0);
+  // once `producer`'s free list is empty, refills it from what a consumer
+  // handed back through `returned`
+  void Refill(SpscQueue<Buffer>& returned, size_t producer);
+
+  // the most one producer keeps idle
+  ZNET_NODISCARD size_t per_producer() const { return per_producer_; }
+
+ private:
+  // a line apart, as SpscQueue's cursors: neighbouring lists belong to
+  // different threads
+  struct FreeList {
+    char padding[64];
+    std::vector<Buffer> buffers;
+  };
+
+  const size_t producers_;
+  const size_t per_producer_;
+  std::unique_ptr<FreeList[]> free_;
+};
+
+// datagram queue from the receive side to a session's worker. Lock-free, so
+// a receive thread serving many sessions never waits on one of them: each
+// producer gets its own SpscQueue, created on its first push, and the
+// consumer drains them all. A server's receive shards are its producers,
+// since a route adopted by another shard after a NAT rebinding leaves the old
+// shard able to push too. See ZDTTransportLayer for the threading rule.
 class ZDTInbox {
  public:
-  // moves one ready-to-parse datagram in; the caller builds it outside the
-  // lock, so the critical section is a deque push. drops and returns false
-  // once `limit` datagrams are pending, so a flooding peer cannot grow this
-  // queue without bound (the refused buffer is simply destroyed).
-  bool Push(Buffer&& datagram, size_t limit);
-  void Drain(std::deque<Buffer>& out);
+  // at most `limit` datagrams pending per producer, numbered below
+  // `producers`. datagrams are copied into buffers from `pool` when there is
+  // one, and Recycle() sends them back to the producer they came from, which
+  // returns them to the pool.
+  explicit ZDTInbox(size_t limit,
+                    std::shared_ptr<ZDTDatagramPool> pool = nullptr,
+                    size_t producers = 1);
+  ~ZDTInbox();
+  ZDTInbox(const ZDTInbox&) = delete;
+  ZDTInbox& operator=(const ZDTInbox&) = delete;
+
+  // copies one datagram in for `producer`, which only that thread may use.
+  // drops and returns false once `limit` of its datagrams are pending, so a
+  // flooding peer cannot grow this queue without bound.
+  bool Push(const char* data, size_t len, size_t producer = 0);
+  // appends what every producer has queued to `out`. consumer only.
+  void Drain(std::vector<Buffer>& out);
+  // the consumer is done with what Drain() gave it; empties `drained`. Each
+  // producer gets back as many buffers as it sent, up to its pool share; the
+  // rest are freed here.
+  void Recycle(std::vector<Buffer>& drained);
   size_t dropped() const;
+  // how many pushed datagrams found a pooled buffer, and how many did not
+  size_t pool_hits() const;
+  size_t pool_misses() const;
+
+  // a new address for the consumer to send to, handed over once the producer
+  // has verified the peer moved there. TakePeer() returns null when there is
+  // none, without touching the lock, which nothing else takes.
+  void SetPeer(std::shared_ptr<InetAddress> peer);
+  std::shared_ptr<InetAddress> TakePeer();
 
  private:
-  mutable std::mutex mutex_;
-  std::deque<Buffer> queue_;
-  size_t dropped_ = 0;
+  // what one producer and the consumer share: datagrams one way, their
+  // emptied buffers the other
+  struct Lane {
+    Lane(size_t limit, size_t returns) : datagrams(limit), returned(returns) {}
+    SpscQueue<Buffer> datagrams;
+    SpscQueue<Buffer> returned;
+  };
+
+  const std::shared_ptr<ZDTDatagramPool> pool_;
+  const size_t limit_;
+  const size_t producers_;
+  // one per producer, null until its first push. written by that producer,
+  // read by the consumer
+  std::unique_ptr<std::atomic<Lane*>[]> lanes_;
+  // how many of what Drain() handed out came from each producer, so Recycle()
+  // can send them back. consumer only
+  std::unique_ptr<size_t[]> drained_;
+  // relaxed counters: only ever sampled for metrics
+  std::atomic<size_t> dropped_{0};
+  std::atomic<size_t> pool_hits_{0};
+  std::atomic<size_t> pool_misses_{0};
+  std::mutex peer_mutex_;
+  std::shared_ptr<InetAddress> peer_;
+  std::atomic_bool has_peer_{false};
 };
 
 }  // namespace backends
@@ -0,0 +1,190 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// The maps a ZDT server routes datagrams through: source address, or the
+// connection id a client stamps on its datagrams, to whatever the server keeps
+// for that peer. Probed once per received datagram, so they are keyed by raw
+// bytes rather than a formatted string and laid out flat, with no node to
+// chase and nothing allocated on a lookup.
+//
+
+#ifndef ZNET_BACKENDS_ZDT_ZDT_PEER_TABLE_H_
+#define ZNET_BACKENDS_ZDT_ZDT_PEER_TABLE_H_
+
+#include "znet/backends/zdt/zdt_net.h"
+#include "znet/compat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace znet {
+namespace backends {
+
+// the hashes PeerTable spreads its keys by, one overload per key type
+inline size_t PeerTableHash(const PeerKey& key) { return key.Hash(); }
+inline size_t PeerTableHash(uint32_t id) {
+  // fibonacci hashing, folded so the low bits the mask keeps depend on all
+  // of the id and not only its own low bits
+  const uint64_t x = static_cast<uint64_t>(id) * 0x9e3779b97f4a7c15ULL;
+  return static_cast<size_t>(x ^ (x >> 32));
+}
+
+/**
+ * @brief An open-addressed map from Key (a PeerKey, or a connection id) to T.
+ *
+ * Linear probing over a power-of-two array kept at most half full, so a
+ * lookup is a hash and, almost always, one or two adjacent slots. Erasing
+ * shifts the entries behind it back instead of leaving tombstones, so a table
+ * that sees peers come and go never slows down.
+ *
+ * Not synchronized. The server gives each one a single owning thread, which
+ * is what lets that thread read it without a lock.
+ */
+template <typename T, typename Key = PeerKey>
+class PeerTable {
+ public:
+  /** @brief The value stored for `key`, or null. */
+  T* Find(const Key& key) {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    for (size_t i = IndexOf(key);; i = (i + 1) & mask_) {
+      Slot& slot = slots_[i];
+      if (!slot.used) {
+        return nullptr;
+      }
+      if (slot.key == key) {
+        return &slot.value;
+      }
+    }
+  }
+
+  /** @brief Stores `value` for `key`, replacing any value already there. */
+  T& Insert(const Key& key, T value) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+      Grow();
+    }
+    for (size_t i = IndexOf(key);; i = (i + 1) & mask_) {
+      Slot& slot = slots_[i];
+      if (!slot.used) {
+        slot.used = true;
+        slot.key = key;
+        slot.value = std::move(value);
+        size_++;
+        return slot.value;
+      }
+      if (slot.key == key) {
+        slot.value = std::move(value);
+        return slot.value;
+      }
+    }
+  }
+
+  /** @brief Removes `key`. Returns whether it was there. */
+  bool Erase(const Key& key) {
+    if (size_ == 0) {
+      return false;
+    }
+    for (size_t i = IndexOf(key);; i = (i + 1) & mask_) {
+      Slot& slot = slots_[i];
+      if (!slot.used) {
+        return false;
+      }
+      if (slot.key == key) {
+        EraseAt(i);
+        return true;
+      }
+    }
+  }
+
+  /** @brief Removes every entry `predicate(value)` holds for. Returns how
+   *         many went. */
+  template <typename Predicate>
+  size_t EraseIf(Predicate predicate) {
+    size_t erased = 0;
+    for (size_t i = 0; i < slots_.size();) {
+      if (slots_[i].used && predicate(slots_[i].value)) {
+        // the shift may have moved an unvisited entry into this slot, so it
+        // is looked at again rather than stepped past
+        EraseAt(i);
+        erased++;
+      } else {
+        i++;
+      }
+    }
+    return erased;
+  }
+
+  void Clear() {
+    slots_.clear();
+    mask_ = 0;
+    size_ = 0;
+  }
+
+  ZNET_NODISCARD size_t size() const { return size_; }
+  ZNET_NODISCARD bool empty() const { return size_ == 0; }
+
+ private:
+  struct Slot {
+    Key key{};
+    T value{};
+    bool used = false;
+  };
+
+  size_t IndexOf(const Key& key) const { return PeerTableHash(key) & mask_; }
+
+  void Grow() {
+    std::vector<Slot> old = std::move(slots_);
+    const size_t capacity = old.empty() ? 16 : old.size() * 2;
+    slots_ = std::vector<Slot>(capacity);
+    mask_ = capacity - 1;
+    size_ = 0;
+    for (Slot& slot : old) {
+      if (slot.used) {
+        Insert(slot.key, std::move(slot.value));
+      }
+    }
+  }
+
+  // backward-shift deletion: walks the cluster after `hole` and pulls back
+  // each entry whose home slot the hole now sits between, so every probe
+  // still reaches its key without crossing an empty slot
+  void EraseAt(size_t hole) {
+    for (size_t i = (hole + 1) & mask_;; i = (i + 1) & mask_) {
+      Slot& slot = slots_[i];
+      if (!slot.used) {
+        break;
+      }
+      const size_t home = IndexOf(slot.key);
+      // distance from home to here versus from home to the hole, both
+      // measured forward around the ring
+      if (((i - home) & mask_) >= ((i - hole) & mask_)) {
+        slots_[hole].key = slot.key;
+        slots_[hole].value = std::move(slot.value);
+        hole = i;
+      }
+    }
+    slots_[hole].used = false;
+    slots_[hole].value = T{};
+    size_--;
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_ = 0;
+  size_t size_ = 0;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_ZDT_ZDT_PEER_TABLE_H_
@@ -0,0 +1,235 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// When each unacked reliable message falls due for a resend, and which was
+// sent last. A transport with thousands of messages in flight asks both every
+// tick, and almost never finds anything due, so the answers must not cost a
+// walk over everything in flight.
+//
+
+#ifndef ZNET_BACKENDS_ZDT_ZDT_RETRANSMIT_SCHEDULE_H_
+#define ZNET_BACKENDS_ZDT_ZDT_RETRANSMIT_SCHEDULE_H_
+
+#include "znet/compat.h"
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace znet {
+namespace backends {
+
+/**
+ * @brief What ZDTRetransmitSchedule links an entry by. Each scheduled type
+ *        embeds one as a member named `schedule`.
+ */
+template <typename T>
+struct ZDTScheduleHook {
+  static constexpr size_t kUnscheduled = (std::numeric_limits<size_t>::max)();
+
+  std::chrono::steady_clock::time_point due;
+  size_t heap_index = kUnscheduled;  // kUnscheduled while not in a schedule
+  T* newer = nullptr;  // the entry sent next after this one
+  T* older = nullptr;  // the entry sent last before this one
+};
+
+#if !ZNET_HAS_CXX17
+template <typename T>
+constexpr size_t ZDTScheduleHook<T>::kUnscheduled;
+#endif
+
+/**
+ * @brief A deadline heap and a send-order list over the same entries.
+ *
+ * The heap answers "what is due": a tick that finds nothing due reads its
+ * root and stops, and one that finds something pays O(log n) for each entry
+ * it takes. The list answers "what went out last", for the tail probe, in
+ * O(1). Both are intrusive: the links live in the entries (see
+ * ZDTScheduleHook), so scheduling allocates nothing once the heap has grown to
+ * the window, and removing an acked entry needs no search.
+ *
+ * Entries must stay put while scheduled, as std::map values do. Not
+ * synchronized; the transport's worker owns it.
+ *
+ * @tparam T has a `ZDTScheduleHook<T> schedule` member.
+ */
+template <typename T>
+class ZDTRetransmitSchedule {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  /**
+   * @brief `entry` went out just now and falls due at `due`.
+   *
+   * Adds it when it is not scheduled yet. Either way it becomes the newest.
+   */
+  void OnSend(T* entry, TimePoint due) {
+    if (entry->schedule.heap_index == ZDTScheduleHook<T>::kUnscheduled) {
+      entry->schedule.due = due;
+      entry->schedule.heap_index = heap_.size();
+      heap_.push_back(entry);
+      SiftUp(entry->schedule.heap_index);
+    } else {
+      Unlink(entry);
+      Reschedule(entry, due);
+    }
+    LinkNewest(entry);
+  }
+
+  /** @brief Moves `entry`'s deadline, leaving its place in the send order. */
+  void Reschedule(T* entry, TimePoint due) {
+    const TimePoint before = entry->schedule.due;
+    entry->schedule.due = due;
+    if (due < before) {
+      SiftUp(entry->schedule.heap_index);
+    } else {
+      SiftDown(entry->schedule.heap_index);
+    }
+  }
+
+  /**
+   * @brief `entry` is known lost: due at once, and the last a tail probe
+   *        would pick, since its resend is already on the way.
+   */
+  void OnLost(T* entry) {
+    Reschedule(entry, TimePoint{});
+    Unlink(entry);
+    LinkOldest(entry);
+  }
+
+  /** @brief Takes `entry` out; it may be destroyed afterwards. */
+  void Remove(T* entry) {
+    const size_t index = entry->schedule.heap_index;
+    const size_t last = heap_.size() - 1;
+    if (index != last) {
+      T* moved = heap_[last];
+      Place(moved, index);
+      heap_.pop_back();
+      // the last entry may belong above or below the hole it filled
+      SiftUp(index);
+      SiftDown(moved->schedule.heap_index);
+    } else {
+      heap_.pop_back();
+    }
+    Unlink(entry);
+    entry->schedule.heap_index = ZDTScheduleHook<T>::kUnscheduled;
+  }
+
+  /** @brief The entry falling due soonest if that is at or before `now`. */
+  ZNET_NODISCARD T* Due(TimePoint now) const {
+    if (heap_.empty() || heap_.front()->schedule.due > now) {
+      return nullptr;
+    }
+    return heap_.front();
+  }
+
+  /** @brief When the soonest entry falls due; TimePoint::max() when empty. */
+  ZNET_NODISCARD TimePoint next_due() const {
+    return heap_.empty() ? TimePoint::max() : heap_.front()->schedule.due;
+  }
+
+  /** @brief The entry sent most recently, or null. */
+  ZNET_NODISCARD T* newest() const { return newest_; }
+
+  /** @brief Forgets every entry, without touching them. */
+  void Clear() {
+    heap_.clear();
+    newest_ = nullptr;
+    oldest_ = nullptr;
+  }
+
+  ZNET_NODISCARD size_t size() const { return heap_.size(); }
+  ZNET_NODISCARD bool empty() const { return heap_.empty(); }
+  /** @brief Entries the heap has room for without growing. */
+  ZNET_NODISCARD size_t capacity() const { return heap_.capacity(); }
+
+ private:
+  void Place(T* entry, size_t index) {
+    heap_[index] = entry;
+    entry->schedule.heap_index = index;
+  }
+
+  void SiftUp(size_t index) {
+    T* entry = heap_[index];
+    while (index > 0) {
+      const size_t parent = (index - 1) / 2;
+      if (!(entry->schedule.due < heap_[parent]->schedule.due)) {
+        break;
+      }
+      Place(heap_[parent], index);
+      index = parent;
+    }
+    Place(entry, index);
+  }
+
+  void SiftDown(size_t index) {
+    T* entry = heap_[index];
+    const size_t count = heap_.size();
+    for (;;) {
+      size_t child = index * 2 + 1;
+      if (child >= count) {
+        break;
+      }
+      if (child + 1 < count &&
+          heap_[child + 1]->schedule.due < heap_[child]->schedule.due) {
+        child++;
+      }
+      if (!(heap_[child]->schedule.due < entry->schedule.due)) {
+        break;
+      }
+      Place(heap_[child], index);
+      index = child;
+    }
+    Place(entry, index);
+  }
+
+  void LinkNewest(T* entry) {
+    entry->schedule.older = newest_;
+    entry->schedule.newer = nullptr;
+    if (newest_) {
+      newest_->schedule.newer = entry;
+    } else {
+      oldest_ = entry;
+    }
+    newest_ = entry;
+  }
+
+  void LinkOldest(T* entry) {
+    entry->schedule.newer = oldest_;
+    entry->schedule.older = nullptr;
+    if (oldest_) {
+      oldest_->schedule.older = entry;
+    } else {
+      newest_ = entry;
+    }
+    oldest_ = entry;
+  }
+
+  void Unlink(T* entry) {
+    T* newer = entry->schedule.newer;
+    T* older = entry->schedule.older;
+    (newer ? newer->schedule.older : newest_) = older;
+    (older ? older->schedule.newer : oldest_) = newer;
+    entry->schedule.newer = nullptr;
+    entry->schedule.older = nullptr;
+  }
+
+  std::vector<T*> heap_;  // a binary min-heap on schedule.due
+  T* newest_ = nullptr;
+  T* oldest_ = nullptr;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_ZDT_ZDT_RETRANSMIT_SCHEDULE_H_
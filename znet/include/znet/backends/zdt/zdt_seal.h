@@ -0,0 +1,101 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Datagram sealing for ZDT: the session's AEAD over a whole datagram rather
+// than over each message in it. A sealed datagram, flagged kFlagSealed:
+//
+//   header  records(encrypted)  tag(16)
+//
+// The header, ack blocks and all, is authenticated but left readable. The
+// nonce is salt || packet_seq, the full 64-bit sequence both ends rebuild
+// from the 16 bits on the wire, so a datagram's nonce costs nothing to carry
+// and never repeats under one key: every datagram, a retransmit included,
+// goes out under a fresh packet_seq.
+//
+
+#ifndef ZNET_BACKENDS_ZDT_ZDT_SEAL_H_
+#define ZNET_BACKENDS_ZDT_ZDT_SEAL_H_
+
+#include "znet/backends/zdt/zdt_wire.h"
+#include "znet/compat.h"
+#include "znet/encryption.h"
+#include "znet/transport.h"
+
+#include <openssl/evp.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace znet {
+namespace backends {
+
+/**
+ * @brief One connection's datagram keys, cipher state and replay window.
+ *
+ * Worker thread only, like the rest of the transport's protocol state.
+ */
+class ZDTDatagramSealer {
+ public:
+  ZDTDatagramSealer() = default;
+  ~ZDTDatagramSealer();
+
+  ZDTDatagramSealer(const ZDTDatagramSealer&) = delete;
+  ZDTDatagramSealer& operator=(const ZDTDatagramSealer&) = delete;
+
+  /** @brief Takes the session's keys. Open() works from here on. */
+  void Install(const DatagramKeys& keys);
+  ZNET_NODISCARD bool installed() const { return installed_; }
+
+  /** @brief Whether a datagram from the peer has opened, which says it seals
+   *         too: from then on an unsealed one is stale or forged. */
+  ZNET_NODISCARD bool peer_sealing() const { return peer_sealing_; }
+
+  /**
+   * @brief Encrypts `body` in place and writes the tag just after it.
+   *
+   * @param packet_seq the datagram's, as in its header. Each call must pass a
+   *                   newer one than the last.
+   * @param header     the datagram's header, authenticated as it stands.
+   * @param body       the records, with kZDTSealTagSize writable bytes past
+   *                   `body_len` for the tag.
+   */
+  bool Seal(WireSeq packet_seq, const uint8_t* header, size_t header_len,
+            uint8_t* body, size_t body_len);
+
+  /**
+   * @brief Authenticates a sealed datagram and decrypts its records in place.
+   *
+   * @param body what follows the header, the tag included.
+   * @return false when the tag fails, or when this packet_seq opened before
+   *         or is too old to tell. Nothing in `body` may be trusted then.
+   */
+  bool Open(WireSeq packet_seq, const uint8_t* header, size_t header_len,
+            uint8_t* body, size_t len);
+
+ private:
+  DatagramKeys keys_;
+  EVP_CIPHER_CTX* seal_ctx_ = nullptr;
+  EVP_CIPHER_CTX* open_ctx_ = nullptr;
+  bool seal_keyed_ = false;
+  bool open_keyed_ = false;
+  bool installed_ = false;
+  bool peer_sealing_ = false;
+  // the full packet sequences: the last sealed, and the highest that opened,
+  // which is what the next wire value is rebuilt against
+  SequenceId sent_ = 0;
+  SequenceId opened_ = 0;
+  ReplayWindow replay_;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_ZDT_ZDT_SEAL_H_
@@ -0,0 +1,129 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// The receive side of a ZDT channel keeps what arrived ahead of the next
+// message it is waiting for. The sender never runs more than kZDTMaxSeqGap
+// messages ahead of its oldest unacked one, so that is a bounded window of
+// sequence numbers, and a ring indexed by sequence holds it without a node or
+// a hash per message.
+//
+
+#ifndef ZNET_BACKENDS_ZDT_ZDT_SEQ_WINDOW_H_
+#define ZNET_BACKENDS_ZDT_ZDT_SEQ_WINDOW_H_
+
+#include "znet/backends/zdt/zdt_wire.h"
+#include "znet/compat.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace znet {
+namespace backends {
+
+/**
+ * @brief Values for the sequence numbers from a moving `base` up to
+ *        `base + max_span`, in a ring indexed by sequence.
+ *
+ * The caller owns `base` (the next sequence it expects) and passes it in
+ * wherever the window needs it. A slot is empty when it holds T{}, and every
+ * non-empty slot lies inside the window: values are put at or above `base`,
+ * and the caller takes each one before moving `base` past it.
+ *
+ * Starts with no storage, so a channel that never sees a message out of order
+ * costs nothing, and doubles as a put needs more, up to `max_span` rounded up
+ * to a power of two. It never shrinks: a channel that reordered that far once
+ * will again, and regrowing is what would touch the allocator.
+ *
+ * @tparam T default-constructible and movable; T{} means empty.
+ */
+template <typename T>
+class ZDTSeqWindow {
+ public:
+  explicit ZDTSeqWindow(size_t max_span = static_cast<size_t>(kZDTMaxSeqGap))
+      : max_span_(max_span) {}
+
+  /**
+   * @brief Stores `value` for `seq`.
+   *
+   * @return false, storing nothing, when `seq` is below `base` or `max_span`
+   *         or more past it.
+   */
+  bool Put(SequenceId base, SequenceId seq, T value) {
+    if (seq < base || seq - base >= max_span_) {
+      return false;
+    }
+    const size_t span = static_cast<size_t>(seq - base) + 1;
+    if (span > slots_.size()) {
+      Grow(base, span);
+    }
+    slots_[Index(seq)] = std::move(value);
+    return true;
+  }
+
+  /** @brief Whether `seq` holds a value. */
+  ZNET_NODISCARD bool Has(SequenceId base, SequenceId seq) const {
+    if (seq < base || seq - base >= slots_.size()) {
+      return false;
+    }
+    return !(slots_[Index(seq)] == T{});
+  }
+
+  /**
+   * @brief Moves out the value for `seq`, which must be inside the window,
+   *        leaving its slot empty. T{} when there was none.
+   */
+  T Take(SequenceId seq) {
+    if (slots_.empty()) {
+      return T{};
+    }
+    T& slot = slots_[Index(seq)];
+    T value = std::move(slot);
+    slot = T{};
+    return value;
+  }
+
+  /** @brief Slots allocated so far; never more than max_span rounded up. */
+  ZNET_NODISCARD size_t capacity() const { return slots_.size(); }
+
+ private:
+  size_t Index(SequenceId seq) const {
+    return static_cast<size_t>(seq) & (slots_.size() - 1);
+  }
+
+  // relays every value at its place in a ring big enough for `span`. the
+  // values sit in [base, base + old capacity), which is how each slot's
+  // sequence is recovered from its index.
+  void Grow(SequenceId base, size_t span) {
+    size_t capacity = slots_.empty() ? 16 : slots_.size();
+    while (capacity < span) {
+      capacity <<= 1;
+    }
+    std::vector<T> grown(capacity);
+    const size_t old_mask = slots_.size() - 1;
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (slots_[i] == T{}) {
+        continue;
+      }
+      const SequenceId seq = base + ((i - static_cast<size_t>(base)) & old_mask);
+      grown[static_cast<size_t>(seq) & (capacity - 1)] = std::move(slots_[i]);
+    }
+    slots_ = std::move(grown);
+  }
+
+  std::vector<T> slots_;
+  size_t max_span_;
+};
+
+}  // namespace backends
+}  // namespace znet
+
+#endif  // ZNET_BACKENDS_ZDT_ZDT_SEQ_WINDOW_H_
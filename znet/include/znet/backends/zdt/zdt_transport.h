@@ -27,20 +27,24 @@
 
 #include <array>
 #include <atomic>
+#include <bitset>
 #include <chrono>
 #include <cstdint>
 #include <deque>
-#include <map>
-#include <set>
+#include <memory>
+#include <mutex>
 #include <thread>
-#include <tuple>
 #include <unordered_map>
 #include <vector>
 #include "znet/backends/zdt/zdt_ack_history.h"
 #include "znet/backends/zdt/zdt_congestion.h"
 #include "znet/backends/zdt/zdt_connection.h"
 #include "znet/backends/zdt/zdt_domain.h"
+#include "znet/backends/zdt/zdt_fec.h"
 #include "znet/backends/zdt/zdt_net.h"
+#include "znet/backends/zdt/zdt_retransmit_schedule.h"
+#include "znet/backends/zdt/zdt_seal.h"
+#include "znet/backends/zdt/zdt_seq_window.h"
 #include "znet/backends/zdt/zdt_wire.h"
 
 namespace znet {
@@ -48,8 +52,9 @@ namespace backends {
 
 
 // per-peer transport. all protocol state is touched only on the owning session's
-// worker thread (Update/Receive/Send). OnDatagram may be called from any thread;
-// it just appends raw bytes to the inbox which Update() drains.
+// worker thread (Update/Receive/Send). OnDatagram may be called from any one
+// thread at a time, as the inbox's producer 0; it just appends raw bytes to the
+// inbox which Update() drains.
 class ZDTTransportLayer : public TransportLayer {
  public:
   // `common` carries the transport-agnostic keepalive knobs; the defaults
@@ -69,32 +74,46 @@ class ZDTTransportLayer : public TransportLayer {
   uint8_t OrderingDomain(const SendOptions& options) const override {
     return options.GetOr<ChannelKey>(0);
   }
+  /** @brief Takes them when the handshake agreed to seal datagrams. */
+  bool InstallDatagramKeys(const DatagramKeys& keys) override;
+  void StartSealing() override { sealing_ = true; }
+  bool LastReceiveSealed() const override { return last_receive_sealed_; }
   Result Close(CloseOptions options = {}) override;
   bool IsClosed() const override { return is_closed_; }
   void Update() override;
   void Flush() override;
+  std::chrono::steady_clock::time_point NextDeadline() const override;
+  // the largest message that goes out as one unfragmented record, when
+  // ZDTOptions::bundle_messages is on
+  size_t BundleBudget() const override;
 
   // feeds one raw ZDT datagram (UDP payload) to this transport. Thread-safe.
   void OnDatagram(const uint8_t* data, size_t len);
 
   void FillMetrics(SessionMetrics& out) const override;
 
-  std::shared_ptr<InetAddress> peer() const { return peer_; }
+  // thread-safe: the worker replaces the address when the peer migrates
+  std::shared_ptr<InetAddress> peer() const {
+    std::lock_guard<std::mutex> lock(peer_mutex_);
+    return peer_;
+  }
   std::shared_ptr<ZDTInbox> inbox() const { return inbox_; }
 
  private:
   using TimePoint = std::chrono::steady_clock::time_point;
 
-  // identifies one reliable datagram / reassembly buffer.
-  struct MsgKey {
-    uint8_t channel = 0;
-    bool reliable = false;
-    uint8_t frag_index = 0;
-    SequenceId message_seq = 0;
-    bool operator<(const MsgKey& other) const {
-      return std::tie(channel, reliable, message_seq, frag_index) <
-             std::tie(other.channel, other.reliable, other.message_seq,
-                      other.frag_index);
+  // marks the end of an intrusive slot list
+  static constexpr uint32_t kNoSlot = 0xffffffffu;
+
+  // a message on its way to the session, and whether everything it arrived in
+  // was sealed. Empty is the null payload, as ZDTSeqWindow expects.
+  struct Inbound {
+    std::shared_ptr<Buffer> payload;
+    bool sealed = false;
+
+    explicit operator bool() const { return payload != nullptr; }
+    bool operator==(const Inbound& other) const {
+      return payload == other.payload && sealed == other.sealed;
     }
   };
 
@@ -104,6 +123,12 @@ class ZDTTransportLayer : public TransportLayer {
   size_t StageOutbound(); // move ring entries into their channel lanes
   void SendControl(uint8_t flags);
   void CheckTimers();
+  // the UDP payload a datagram may fill, less the tag when sealing was agreed
+  ZNET_NODISCARD size_t DatagramBudget() const;
+  // authenticates and decrypts the sealed datagram in `buffer`, whose header
+  // starts at `header_begin` and has been read, and trims the tag off its end
+  bool OpenDatagram(Buffer& buffer, size_t header_begin,
+                    const ZDTHeader& header);
 
   // one message queued for the datagram being packed. `owner` keeps the source
   // buffer alive until the batch goes out, since `payload` points into it.
@@ -113,7 +138,8 @@ class ZDTTransportLayer : public TransportLayer {
     const char* payload = nullptr;
     size_t payload_len = 0;
     bool reliable = false;
-    MsgKey key;
+    SequenceId message_seq = 0;  // the full one; the record carries it truncated
+    uint32_t slot = kNoSlot;  // its unacked_ slot, when reliable
   };
 
   // assigns a fresh packet_seq, piggybacks the current ack and writes every
@@ -122,18 +148,48 @@ class ZDTTransportLayer : public TransportLayer {
   WireSeq SendBatch(uint8_t extra_flags, const PendingRecord* batch,
                     size_t count);
 
+  // while one is alive, SendBatch() holds the datagrams it builds instead of
+  // sending each, and the outermost hands them all to one batched send when
+  // it ends. Nests, so Update() and the Flush() inside it share one batch.
+  class SendScope {
+   public:
+    explicit SendScope(ZDTTransportLayer& transport) : transport_(transport) {
+      transport_.send_scope_depth_++;
+    }
+    ~SendScope() {
+      if (--transport_.send_scope_depth_ == 0) {
+        transport_.SendHeld();
+      }
+    }
+    SendScope(const SendScope&) = delete;
+    SendScope& operator=(const SendScope&) = delete;
+
+   private:
+    ZDTTransportLayer& transport_;
+  };
+  // sends what SendBatch() is holding, in one call where the platform allows
+  void SendHeld();
+
   // encodes the arrival history into at most max_blocks blocks, so the caller
   // can hold the datagram inside the MTU.
-  // congestion control: grows while acks arrive, backs off on queueing delay.
+  // congestion control: what congestion_ allows, under the configured cap.
   /** @brief Whether the round trip says a real queue is building. */
   ZNET_NODISCARD int SendWindow() const;
   ZNET_NODISCARD int SendWindowCap() const;
+  // when the pacer next lets a reliable datagram be built: its slot under
+  // Worker pacing, up to a round trip ahead of it under Kernel
+  ZNET_NODISCARD TimePoint PacedUntil() const;
   // marks a reported gap for immediate retransmit and stops tracking it, so one
   // loss costs one resend however often the peer keeps reporting it.
   void OnNak(WireSeq packet_seq);
   void ProcessAcks(const ZDTHeader& header);  // consume the peer's ack blocks
   bool AckPacket(WireSeq packet_seq);  // true if this ack was new
+  // resends what retransmits_ says is due; a tick with nothing due reads
+  // one deadline and returns
   void RetransmitUnacked();
+  // how long after its send_count'th transmission a message falls due: the
+  // RTO, doubled per resend up to six times, capped at rto_max
+  std::chrono::milliseconds RetransmitDelay(int send_count) const;
   // resends the newest unacked message when acks go silent, so a lost burst
   // tail does not wait out the RTO floor. Even when the probed message was not
   // the one lost, its fresh packet_seq advances the peer's ack horizon and the
@@ -149,8 +205,20 @@ class ZDTTransportLayer : public TransportLayer {
   // rather than taking responsibility for data it dropped.
   bool OnRecord(const ZDTRecord& record, const uint8_t* data, size_t len);
   bool OnDataFragment(const ZDTRecord& record, const uint8_t* data, size_t len);
+  // a parity record: rebuilds and delivers the one message of its group that
+  // did not arrive, when exactly one did not
+  void OnParity(const ZDTRecord& record, const uint8_t* data, size_t len);
   void PruneReassembly();
-  void DeliverMessage(const ZDTRecord& record, std::shared_ptr<Buffer> payload);
+  // ends the reassembly at `index`, keeping it as a spare
+  void FinishReassembly(size_t index);
+  // what the structures above hold at their current capacity, for FillMetrics
+  size_t StateBytes() const;
+  // `sealed` when every datagram the message came in was
+  void DeliverMessage(const ZDTRecord& record, std::shared_ptr<Buffer> payload,
+                      bool sealed);
+  // a buffer holding a copy of one record's payload, reused from
+  // message_pool_ when the one handed out longest ago has come back
+  std::shared_ptr<Buffer> MessageBuffer(const uint8_t* data, size_t len);
 
   // ring of the most recent packet_seqs a reliable datagram was sent under.
   // fixed capacity, stored inline, so tracking retransmissions never allocates
@@ -171,7 +239,6 @@ class ZDTTransportLayer : public TransportLayer {
     const WireSeq* begin() const { return items.data(); }
     const WireSeq* end() const { return items.data() + count; }
   };
-  static TransmissionLog MakeLog(WireSeq seq);
 
   // describes one message, or one fragment of one, for the send path. `offset`
   // is into `owner`, which stays alive until the batch goes out.
@@ -180,31 +247,41 @@ class ZDTTransportLayer : public TransportLayer {
                                   uint8_t channel, SequenceId message_seq,
                                   uint8_t frag_index, uint8_t frag_count,
                                   bool reliable);
-  // files a reliable record under its key so it retransmits until acked. `log`
-  // carries the packet_seq when known; the batching path fills it in later.
-  void TrackReliable(const PendingRecord& pending, size_t offset, TimePoint now,
-                     TransmissionLog log);
+  // files a reliable record in an unacked_ slot so it retransmits until
+  // acked, and returns the slot. Done before the send, which logs each
+  // packet_seq against the slot as it goes out.
+  uint32_t TrackReliable(const PendingRecord& pending, size_t offset,
+                         TimePoint now);
 
   struct QueuedOut {
     std::shared_ptr<Buffer> payload;
     SendOptions options;
   };
+  // names an unacked_ slot as it was when a datagram carried it. Slots are
+  // reused once their message is acked, and the generation tells the
+  // occupants apart, so a late ack cannot retire a newer message.
+  struct UnackedRef {
+    uint32_t slot = kNoSlot;
+    uint32_t generation = 0;
+  };
   // a datagram can carry several reliable messages, so acking it retires all of
   // them. fixed capacity and inline, like TransmissionLog: batching must not add
   // an allocation per datagram.
   struct SentInfo {
     static constexpr size_t kMaxKeys = 64;
     TimePoint send_time;
-    std::array<MsgKey, kMaxKeys> keys{};
+    std::array<UnackedRef, kMaxKeys> keys{};
+    WireSeq seq = 0;     // the packet_seq holding this ring slot
+    bool live = false;   // false once retired
     uint8_t key_count = 0;  // reliable messages in this datagram
 
-    void Add(const MsgKey& key) {
+    void Add(UnackedRef ref) {
       if (key_count < kMaxKeys) {
-        keys[key_count++] = key;
+        keys[key_count++] = ref;
       }
     }
-    const MsgKey* begin() const { return keys.data(); }
-    const MsgKey* end() const { return keys.data() + key_count; }
+    const UnackedRef* begin() const { return keys.data(); }
+    const UnackedRef* end() const { return keys.data() + key_count; }
   };
   // one outstanding reliable datagram (a whole small message, or one fragment of
   // a large one). Fragments of a message share the underlying `message` buffer.
@@ -213,7 +290,7 @@ class ZDTTransportLayer : public TransportLayer {
     size_t offset = 0;
     size_t length = 0;
     uint8_t channel = 0;
-    uint16_t message_seq = 0;
+    SequenceId message_seq = 0;  // the full one, not the wire's
     uint8_t frag_index = 0;
     uint8_t frag_count = 1;
     uint8_t data_flags = 0;  // includes kFlagData and, if fragmented, kFlagFragment
@@ -224,11 +301,31 @@ class ZDTTransportLayer : public TransportLayer {
     // sent_packets_ record. fixed-size, so retries cannot grow it; the oldest
     // fall off and age out of sent_packets_ on their own.
     TransmissionLog packets;
+    ZDTScheduleHook<OutReliable> schedule;  // its place in retransmits_
+    bool live = false;
+    uint32_t slot = kNoSlot;  // its own index, for the records that resend it
+    uint32_t generation = 0;  // bumped each time the slot is released
+    // neighbours in its channel's send order, which is message_seq order
+    uint32_t channel_older = kNoSlot;
+    uint32_t channel_newer = kNoSlot;
   };
+  // one message being put back together. Every fragment but the last has the
+  // same length, so fragment i lands at i * fragment_len in `bytes` whatever
+  // order they arrive in, and completing the message is one copy out. The last
+  // goes to `tail`, as it may arrive before that length is known.
   struct Reassembly {
+    uint8_t channel = 0;
+    bool reliable = false;
+    SequenceId seq = 0;
     uint8_t frag_count = 0;
-    std::map<uint8_t, std::vector<uint8_t>> fragments;  // frag_index -> bytes
+    uint16_t received = 0;     // distinct fragments so far
+    size_t fragment_len = 0;   // zero until a fragment other than the last
+    size_t held = 0;           // what this adds to reassembly_bytes_
+    std::bitset<256> have;     // by frag_index
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> tail;
     TimePoint first_seen;
+    bool sealed = true;  // until a fragment arrives in a datagram that is not
   };
   // per-channel state. reliable and unreliable keep separate sequence spaces,
   // so one channel carries both without interference. which members are live
@@ -242,16 +339,26 @@ class ZDTTransportLayer : public TransportLayer {
     // send
     SequenceId rel_send = 0;
     SequenceId unrel_send = 0;
-    // receive
+    // this channel's unacked_ slots, oldest first
+    uint32_t unacked_oldest = kNoSlot;
+    uint32_t unacked_newest = kNoSlot;
+    // receive. both windows start at rel_expected
     SequenceId rel_expected = 0;
-    std::map<SequenceId, std::shared_ptr<Buffer>> rel_reorder;
-    std::set<SequenceId> rel_delivered_ahead;
+    ZDTSeqWindow<Inbound> rel_reorder;
+    ZDTSeqWindow<uint8_t> rel_delivered_ahead;  // nonzero once delivered
     SequenceId unrel_last = 0;
     bool unrel_started = false;
+    // forward error correction: the group being sent, on a channel in
+    // config_.fec_channels, and what arrived, once the peer sent parity
+    std::unique_ptr<ZDTFecEncoder> fec_send;
+    std::unique_ptr<ZDTFecDecoder> fec_receive;
   };
 
   std::shared_ptr<UDPSocket> socket_;
+  // replaced only by the worker, which reads it without the lock; Close()
+  // and peer() take it since they may run on other threads
   std::shared_ptr<InetAddress> peer_;
+  mutable std::mutex peer_mutex_;
   ZDTOptions config_;
   bool drains_own_socket_;
   std::shared_ptr<ZDTInbox> inbox_;
@@ -263,7 +370,11 @@ class ZDTTransportLayer : public TransportLayer {
   // on a simultaneous open (both P2P punch peers, or a busy client/server).
   WireSeq next_packet_seq_ = 1;
 
-  std::deque<std::shared_ptr<Buffer>> ready_;
+  std::deque<Inbound> ready_;
+  bool last_receive_sealed_ = false;  // of what Receive() last returned
+  // every message buffer recently handed out, oldest first; one is free again
+  // when this is its only reference. Worker only.
+  std::deque<std::shared_ptr<Buffer>> message_pool_;
   // Send() runs on whichever thread is encoding the session, FlushOutbound()
   // on the owning worker, so the hand-off is lock-free.
   MpscQueue<QueuedOut> outbound_;
@@ -278,24 +389,47 @@ class ZDTTransportLayer : public TransportLayer {
   std::vector<StagedLane> staged_;
   size_t staged_count_ = 0;   // total queued across lanes; bounds the drain
   size_t staged_cursor_ = 0;  // rotates so no lane is always served first
-  // reused across ProcessInbound() calls. a default-constructed std::deque
-  // allocates its map and first node immediately, so declaring this local meant
-  // two mallocs on every tick whether or not a datagram had arrived. swapping
-  // into a member keeps those nodes alive between calls. session worker only.
-  std::deque<Buffer> inbound_scratch_;
+  // reused across ProcessInbound() calls: Drain() appends into it and
+  // Recycle() clears it, so it keeps the capacity of the largest batch and a
+  // tick allocates nothing for it. session worker only.
+  std::vector<Buffer> inbound_scratch_;
   // where DrainSocket() lands each recvfrom before the right-sized copy goes
   // into the inbox. reserved once; worker only.
   Buffer recv_scratch_{Endianness::BigEndian};
   // reused across SendBatch() calls, so a datagram costs no allocation once
-  // warm. worker only: Close() writes its FIN from the application's thread
-  // and builds its own buffer for exactly that reason.
+  // warm. Held datagrams sit in it back to back, each at an offset in held_.
+  // worker only: Close() writes its FIN from the application's thread and
+  // builds its own buffer for exactly that reason.
   Buffer send_scratch_{Endianness::BigEndian};
+  struct HeldDatagram {
+    size_t offset;
+    size_t length;
+    TimePoint launch;  // ZDTPacing::Kernel's slot for it; the epoch for now
+  };
+  std::vector<HeldDatagram> held_;
+  int send_scope_depth_ = 0;
+  size_t send_batch_;  // config_.send_batch, clamped to what one call takes
   // reused across FlushOutbound() calls; holds up to SentInfo::kMaxKeys
   // records, which as a local was a ~5 KB malloc and free every tick.
   std::vector<PendingRecord> batch_scratch_;
+  // config_.fec_channels, by channel
+  std::bitset<256> fec_channels_;
+  // the session's datagram keys, once connection_.sealed and the key exchange
+  // has settled. Sends are sealed from sealing_ on; the datagram being read
+  // was sealed when inbound_sealed_.
+  ZDTDatagramSealer sealer_;
+  bool sealing_ = false;
+  bool inbound_sealed_ = false;
+  // where a group's parity is written before it goes out. One is enough: the
+  // datagram holding the last parity is always sent before the next is built.
+  std::shared_ptr<Buffer> fec_parity_;
   // read via IsAlive() from whichever thread owns the application, written by
   // Close() from the same, so it cannot be a plain bool
   std::atomic_bool is_closed_{false};
+  // BundleBudget(), refreshed by every FlushOutbound() as the path MTU moves.
+  // Atomic because it is read by whichever thread encodes; 0 until the first
+  // flush, which only means the handshake's messages go out unbundled.
+  std::atomic<size_t> bundle_budget_{0};
 #ifndef NDEBUG
   // Update/Flush/Receive belong to whichever thread is driving this session.
   // Send, OnDatagram and Close are deliberately outside it: they are the three
@@ -314,24 +448,47 @@ class ZDTTransportLayer : public TransportLayer {
   ZDTRttEstimator rtt_;
 
   // reliability, sender: in-flight datagrams and unacked reliable datagrams.
-  std::unordered_map<uint16_t, SentInfo> sent_packets_;
+  // sent_packets_ is a ring indexed by packet_seq. It grows by doubling
+  // rather than drop a datagram still awaiting its ack, up to
+  // kZDTAckHistoryBits: a packet_seq that far behind the newest can no longer
+  // be described by any ack, so losing its slot loses nothing.
+  std::vector<SentInfo> sent_packets_;
+  WireSeq sent_oldest_ = 1;  // where PruneSentPackets() resumes its walk
+  size_t sent_live_ = 0;     // entries not yet retired
   // datagrams awaiting an acknowledgment, which is what the congestion window
-  // bounds. not sent_packets_.size(): that also holds datagrams carrying no
+  // bounds. not sent_live_: that also holds datagrams carrying no
   // reliable record, which the peer never acks individually, so they linger
   // until they age out and would otherwise hold window the whole time. On a
   // path whose window sits near the floor, a couple of keepalives were enough
   // to stall every reliable send until the next one happened to be acked.
   size_t in_flight_datagrams_ = 0;
 
-  // Erases a sent_packets_ entry, keeping in_flight_datagrams_ true.
-  void RetireSentPacket(std::unordered_map<uint16_t, SentInfo>::iterator it);
+  // the live entry for packet_seq, or null
+  SentInfo* FindSent(WireSeq packet_seq);
+  // the slot packet_seq is about to go out under, emptied for it
+  SentInfo& ClaimSent(WireSeq packet_seq);
+  // Retires a live sent_packets_ entry, keeping in_flight_datagrams_ true.
+  void RetireSentPacket(SentInfo& info);
   // Same as above, by sequence; does nothing when the entry is already gone.
-  void RetireSentPacket(uint16_t packet_seq);
-
-  std::map<MsgKey, OutReliable> unacked_;
-  // soonest moment any unacked message can fall due; before it, the retransmit
-  // scan has nothing to find and is skipped entirely
-  TimePoint next_retransmit_scan_ = TimePoint::min();
+  void RetireSentPacket(WireSeq packet_seq);
+
+  // unacked reliable datagrams, in blocks of kUnackedBlock that never move,
+  // so retransmits_ and the channel lists can hold on to them. Released slots
+  // are reused newest first, so the working set stays at the front.
+  static constexpr uint32_t kUnackedBlock = 64;
+  std::vector<std::unique_ptr<OutReliable[]>> unacked_blocks_;
+  std::vector<uint32_t> unacked_free_;
+  size_t unacked_count_ = 0;
+  OutReliable& Unacked(uint32_t slot) {
+    return unacked_blocks_[slot / kUnackedBlock][slot % kUnackedBlock];
+  }
+  // the message `ref` named, or null once it has been acked
+  OutReliable* FindUnacked(UnackedRef ref);
+  // a live slot, linked in as the newest on `channel`
+  uint32_t AllocateUnacked(uint8_t channel);
+  void ReleaseUnacked(uint32_t slot);
+  // every live unacked_ slot, by when it falls due and in send order
+  ZDTRetransmitSchedule<OutReliable> retransmits_;
   // when the next tail-loss probe fires. Armed while reliable data is
   // outstanding; sends and ack progress push it back, each fire doubles it.
   TimePoint tail_probe_at_ = TimePoint::max();
@@ -340,16 +497,23 @@ class ZDTTransportLayer : public TransportLayer {
   // reliability, receiver: ack state and per-channel ordered delivery.
   // what arrived from the peer, and the ack blocks built from it
   ZDTAckHistory ack_history_;
-  // the send window and its loss-epoch bookkeeping
-  ZDTCongestionController congestion_;
+  // the send window and pacing clock, whichever ZDTOptions picked
+  std::unique_ptr<ZDTCongestionController> congestion_;
+  // config_.pacing as it resolved for this socket and controller
+  ZDTPacing pacing_ = ZDTPacing::Off;
+  ZDTPacer pacer_;
   bool needs_ack_ = false;
   std::unordered_map<uint8_t, ChannelState> channels_;  // allocated on first use
 #if ZNET_ENABLE_METRICS
   SessionMetrics metrics_;
 #endif
-  std::map<MsgKey, Reassembly> reassembly_;  // frag_index unused in this key
-  // bytes currently held in reassembly_. tracked so the caps can act as
-  // backpressure (refuse to start new messages) instead of discarding data.
+  // the first reassembly_active_ entries are messages in progress. A few
+  // finished ones are kept past them for their buffers, so a steady stream of
+  // large messages reassembles without allocating.
+  std::vector<Reassembly> reassembly_;
+  size_t reassembly_active_ = 0;
+  // bytes currently held in partial reassemblies. tracked so the caps can act
+  // as backpressure (refuse to start new messages) instead of discarding data.
   size_t reassembly_bytes_ = 0;
 };
 
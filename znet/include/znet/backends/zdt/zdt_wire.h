@@ -38,7 +38,7 @@ namespace znet {
 namespace backends {
 
 /** @brief Protocol version, checked for strict equality during the handshake. */
-ZNET_INLINE_CONSTEXPR uint8_t kZDTProtocolVersion = 4;
+ZNET_INLINE_CONSTEXPR uint8_t kZDTProtocolVersion = 7;
 
 /**
  * @brief Prefix on offline (pre-connection) messages.
@@ -54,12 +54,16 @@ ZNET_INLINE_CONSTEXPR std::array<uint8_t, 8> kZDTMagic = {'Z', 'N', 'E', 'T',
 ZNET_INLINE_CONSTEXPR uint8_t kFlagFin = 1u << 0;     // graceful close
 ZNET_INLINE_CONSTEXPR uint8_t kFlagPing = 1u << 1;    // keepalive probe
 ZNET_INLINE_CONSTEXPR uint8_t kFlagPong = 1u << 2;    // keepalive reply
+ZNET_INLINE_CONSTEXPR uint8_t kFlagConnectionId = 1u << 3;  // id follows flags
+// records encrypted, tag after them; see ZDTDatagramSealer
+ZNET_INLINE_CONSTEXPR uint8_t kFlagSealed = 1u << 4;
 ZNET_INLINE_CONSTEXPR uint8_t kFlagOnline = 1u << 7;  // online-datagram marker
 
 // per-record flags (byte 0 of each message record).
 ZNET_INLINE_CONSTEXPR uint8_t kRecReliable = 1u << 0;  // retransmit until acked
 ZNET_INLINE_CONSTEXPR uint8_t kRecOrdered = 1u << 1;   // ordering applies on channel
 ZNET_INLINE_CONSTEXPR uint8_t kRecFragment = 1u << 2;  // frag_index/frag_count present
+ZNET_INLINE_CONSTEXPR uint8_t kRecParity = 1u << 3;  // FEC parity, not a message
 
 /** @brief Offline (handshake) message ids, all < 0x80 so they never set kFlagOnline. */
 enum class ZDTOfflineMsg : uint8_t {
@@ -72,13 +76,38 @@ enum class ZDTOfflineMsg : uint8_t {
   AlreadyConnected = 0x07,
   ConnectionBanned = 0x08,
   Punch = 0x09,  // P2P NAT hole-punch keepalive (not part of the client/server flow)
+  // server -> client at an address a known connection id arrived from, and
+  // the client's echo from that address; only then does the server move the
+  // connection there
+  PathChallenge = 0x0A,
+  PathResponse = 0x0B,
 };
 
+// what a server routes a client's online datagrams by, assigned in Reply2.
+// Unlike the source address it survives a NAT rebinding the client's port.
+// 0 is never assigned, and means none was: the datagram goes out without
+// kFlagConnectionId. Only an end with a single path sends those, a server to
+// its client or one P2P host to the other. A server does not fall back to the
+// address for one it receives: an online datagram without an id is dropped as
+// unroutable.
+using ZDTConnectionId = uint32_t;
+ZNET_INLINE_CONSTEXPR size_t kZDTConnectionIdSize = 4;
+
+// the features byte closing OpenConnectionRequest2, what the client offers, and
+// OpenConnectionReply2, what the server took up. Unknown bits are ignored, so
+// an end that offers nothing reads the same as an older one.
+ZNET_INLINE_CONSTEXPR uint8_t kZDTFeatureSealing = 1u << 0;
+
+// what sealing adds to a datagram: the AEAD tag after its records. The
+// nonce is rebuilt from packet_seq, so it costs no bytes.
+ZNET_INLINE_CONSTEXPR size_t kZDTSealTagSize = 16;
+
 // a datagram is one header followed by zero or more message records, so small
 // messages share one instead of each paying for its own. zero records is a valid
 // control datagram (bare ack, ping, pong or fin).
 // flags(1) + packet_seq(2) + ack(2) + block_count(1), then 2 bytes per block.
-// this is the fixed part; ReadZDTHeader checks the blocks separately.
+// this is the fixed part; ReadZDTHeader checks the blocks separately, and the
+// connection id that kFlagConnectionId puts between flags and packet_seq.
 ZNET_INLINE_CONSTEXPR size_t kZDTHeaderSize = 6;
 // rec_flags, channel, message_seq, length
 ZNET_INLINE_CONSTEXPR size_t kZDTRecordHeaderSize = 6;
@@ -104,6 +133,12 @@ inline SequenceId ReconstructSeq(WireSeq truncated, SequenceId expected) {
   return candidate;
 }
 
+// how far a sender may run ahead of its oldest unacked message on one channel:
+// half a wire period, so a late retransmit can never reconstruct onto a live
+// message. It also bounds how far past the next expected message a receiver
+// ever has to hold anything.
+ZNET_INLINE_CONSTEXPR SequenceId kZDTMaxSeqGap = (SequenceId{1} << 16) / 2;
+
 // how far back the receiver remembers which packet_seqs arrived. the encoder
 // walks this to build ack blocks, so it bounds what one acknowledgment can
 // describe and therefore how large the send window may usefully grow.
@@ -122,8 +157,11 @@ ZNET_INLINE_CONSTEXPR size_t kZDTAckBlockSize = 2;
 // encoder is capped at whatever is actually left. without the reserve a full
 // datagram would carry no ack at all.
 ZNET_INLINE_CONSTEXPR size_t kZDTAckBlocksReserved = 4;
+// the connection id is reserved whether or not this end sends one, so both
+// ends of a connection pack records against the same budget.
 ZNET_INLINE_CONSTEXPR size_t kZDTHeaderReserve =
-    kZDTHeaderSize + kZDTAckBlocksReserved * kZDTAckBlockSize;
+    kZDTHeaderSize + kZDTConnectionIdSize +
+    kZDTAckBlocksReserved * kZDTAckBlockSize;
 
 // how long a base round trip measurement stays authoritative. the minimum is
 // the queue-free path, so it has to be re-probed: a route change or a handover
@@ -136,6 +174,22 @@ ZNET_INLINE_CONSTEXPR int kZDTRttMinWindowMs = 10000;
 ZNET_INLINE_CONSTEXPR double kZDTQueueingRttRatio = 1.25;
 ZNET_INLINE_CONSTEXPR double kZDTQueueingBackoff = 0.85;
 
+// ZDTBbrController's model: the rate estimate is the best of this many round
+// trips, long enough to ride out a few slow ones. The window never drops
+// below the floor, and a min-RTT probe holds it there this long.
+ZNET_INLINE_CONSTEXPR size_t kZDTBbrRateWindowRounds = 10;
+ZNET_INLINE_CONSTEXPR int kZDTBbrMinWindow = 4;
+ZNET_INLINE_CONSTEXPR int kZDTBbrProbeRttMs = 200;
+
+// forward error correction: messages per parity group at most, and the
+// receiver's memory of recent messages on a protected channel, which has to
+// reach back over a whole group and what was resent into it.
+ZNET_INLINE_CONSTEXPR size_t kZDTFecMaxGroup = 16;
+ZNET_INLINE_CONSTEXPR size_t kZDTFecHistory = 2 * kZDTFecMaxGroup;
+// each message a parity record covers: rec_flags(1) + message_seq(2) +
+// length(2), after a count(1) for the group
+ZNET_INLINE_CONSTEXPR size_t kZDTFecMemberSize = 5;
+
 // tail-loss probe: how long the ack stream may stay silent with reliable data
 // outstanding before the newest unacked message is resent once. A lost burst
 // tail is invisible to the NAK path (nothing later arrives to expose the gap),
@@ -155,6 +209,7 @@ struct ZDTAckBlock {
 
 struct ZDTHeader {
   uint8_t flags = kFlagOnline;
+  ZDTConnectionId connection_id = 0;  // on the wire only with kFlagConnectionId
   uint16_t packet_seq = 0;  // connection-level, ++ per datagram (drives ack/RTT)
   uint16_t ack = 0;         // highest packet_seq seen from peer
   // run-length encoded picture of what arrived, walking back from `ack`. the
@@ -180,6 +235,9 @@ void WriteZDTHeader(Buffer& buffer, const ZDTHeader& header);
 // is too short or does not carry the online marker. leaves the read cursor at the
 // first record on success.
 bool ReadZDTHeader(Buffer& buffer, ZDTHeader& out_header);
+// the connection id of the online datagram at `data`, without parsing the rest
+// of the header; false when it carries none.
+bool PeekZDTConnectionId(const char* data, size_t len, ZDTConnectionId& out_id);
 
 // record header only; the payload follows and is not copied.
 void WriteZDTRecord(Buffer& buffer, const ZDTRecord& record);
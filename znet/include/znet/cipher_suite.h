@@ -0,0 +1,88 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// The AEADs a session may encrypt with. Both ends advertise the ones they
+// allow during the handshake and the server picks one; the key schedule is the
+// same for all of them, only the cipher behind it changes.
+//
+
+#ifndef ZNET_CIPHER_SUITE_H_
+#define ZNET_CIPHER_SUITE_H_
+
+#include "znet/compat.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace znet {
+
+using CipherSuiteRaw = uint8_t;
+
+/** @brief Wire values; a suite keeps its value for as long as it exists. */
+enum class CipherSuite : CipherSuiteRaw {
+  /** @brief An unencrypted session, or one whose handshake has not settled. */
+  None = 0,
+  /** @brief What every session used before suites were negotiated. */
+  Aes256Gcm = 1,
+  Aes128Gcm = 2,
+  /** @brief The fast one on a CPU without AES instructions. */
+  ChaCha20Poly1305 = 3,
+};
+
+std::string GetCipherSuiteString(CipherSuite suite);
+
+/**
+ * @brief Whether this CPU has AES instructions (AES-NI, or the ARMv8 crypto
+ *        extension), detected once and cached.
+ *
+ * Without them OpenSSL falls back to table-driven AES, which is several times
+ * slower than ChaCha20-Poly1305 in plain integer code.
+ */
+bool HasHardwareAes();
+
+/**
+ * @brief Whether the OpenSSL this was built against provides `suite`.
+ *
+ * ChaCha20-Poly1305 can be compiled out of OpenSSL; the AES suites cannot.
+ */
+bool IsCipherSuiteAvailable(CipherSuite suite);
+
+/**
+ * @brief The order a session advertises when CommonOptions::cipher_suites is
+ *        left empty.
+ *
+ * AES-256-GCM first on a CPU with AES instructions, which keeps such a pair
+ * on what it has always used. ChaCha20-Poly1305 first without them.
+ */
+std::vector<CipherSuite> DefaultCipherSuites();
+
+/**
+ * @brief The server's choice between its own list and the client's offer.
+ *
+ * Every message is encrypted on one end and decrypted on the other, so the
+ * slower end sets the pace for both. A side lacking AES instructions says so
+ * by putting ChaCha20-Poly1305 first, and when either side does and both
+ * allow it, it wins. Otherwise the first suite on the server's list that the
+ * client also offers does.
+ *
+ * @param server the server's list, in preference order.
+ * @param client the client's offer, in preference order.
+ * @param out    set only on success.
+ * @return false when the two have nothing in common.
+ */
+bool SelectCipherSuite(const std::vector<CipherSuite>& server,
+                       const std::vector<CipherSuite>& client,
+                       CipherSuite& out);
+
+}  // namespace znet
+
+#endif  // ZNET_CIPHER_SUITE_H_
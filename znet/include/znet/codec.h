@@ -79,6 +79,20 @@ class Codec {
   std::shared_ptr<Buffer> Serialize(std::shared_ptr<Packet> packet,
                                     size_t headroom = 0);
 
+  /**
+   * @brief Serializes a packet as one more frame at the end of `buffer`.
+   *
+   * Deserialize() reads frames until the buffer runs out, so a buffer built
+   * up this way carries several packets in one message.
+   *
+   * @param packet A shared pointer to the packet to be serialized.
+   * @param buffer Where the frame goes, after whatever it already holds.
+   * @return false if no serializer is found or it failed, in which case
+   *         `buffer` is left as it was.
+   */
+  bool SerializeInto(const std::shared_ptr<Packet>& packet,
+                     const std::shared_ptr<Buffer>& buffer);
+
   /**
    * @brief Registers a packet serializer for a specific packet type.
    *
@@ -91,6 +105,15 @@ class Codec {
   std::unordered_map<PacketId, std::unique_ptr<PacketSerializerBase>> serializers_;
 };
 
+template <typename Derived, typename... Routes>
+void DensePacketHandler<Derived, Routes...>::RegisterSerializers(Codec& codec) {
+  using expander = int[];
+  (void)expander{0, (codec.Add(Routes::kId,
+                               std::unique_ptr<PacketSerializerBase>(
+                                   new typename Routes::SerializerType())),
+                     0)...};
+}
+
 }
 
 
@@ -14,6 +14,17 @@
 #include "znet/buffer.h"
 #include "znet/compat.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
+// zstd's own names for its contexts and digested dictionaries, so this header
+// does not have to include zstd.h
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
 namespace znet {
 
 using CompressionTypeRaw = uint8_t;
@@ -21,6 +32,26 @@ using CompressionTypeRaw = uint8_t;
 enum class CompressionType {
   None,
   Zstandard,
+  /**
+   * @brief Zstandard with the dictionary both ends agreed on at handshake.
+   *
+   * Only a message's type byte says this; configure Zstandard and set
+   * CommonOptions::compression_dictionary instead.
+   */
+  ZstandardDictionary,
+  /**
+   * @brief Zstandard over one stream per direction that lasts as long as the
+   *        connection, so every message is compressed against the ones before
+   *        it and structure repeated across messages costs next to nothing.
+   *
+   * Needs every message delivered once and in order, which only a TCP session
+   * promises; on any other it is negotiated down to Zstandard. Each direction
+   * keeps a 128 KiB window plus the coder's tables for the session's life,
+   * roughly half a megabyte per session. A message that fails to decompress
+   * leaves the stream unusable, so it closes the session, and so does one
+   * that was compressed but could not be sent.
+   */
+  ZstandardStream,
   /**
    * @brief Resolved at session start to whatever the build supports.
    *
@@ -52,11 +83,157 @@ constexpr CompressionType ResolveCompressionType(CompressionType type) {
 CompressionTypeRaw GetCompressionTypeRaw(CompressionType type);
 std::string GetCompressionTypeString(CompressionType type);
 
+/**
+ * @brief A zstd dictionary, trained on the traffic it is going to compress.
+ *
+ * A 100-byte game message has too little in it for zstd to find repeats, so on
+ * its own it does not compress at all. Primed with the field names, magic
+ * values and common layouts of a few hundred earlier messages, the same
+ * message typically shrinks 2-3x. Both ends need the same dictionary, so it is
+ * identified by the ID the trainer stamps in it and offered at handshake.
+ *
+ * Immutable once made; one instance is shared by every session that uses it,
+ * on any thread. Both factories return null, having logged why, when the
+ * input is unusable or the build has no zstd.
+ */
+class CompressionDictionary {
+ public:
+  /**
+   * @brief Trains a dictionary from sample messages.
+   *
+   * Samples are serialized payloads as the codec writes them, ideally a few
+   * hundred or more captured from real sessions. zstd refuses a set that is
+   * too small or too uniform to learn from.
+   *
+   * @param max_size upper bound on the dictionary, in bytes. A few KiB is
+   *        plenty for small messages, and every session's compressor keeps
+   *        its own digested copy.
+   */
+  static std::shared_ptr<CompressionDictionary> Train(
+      const std::vector<std::string>& samples, size_t max_size = 16 * 1024);
+
+  /**
+   * @brief Loads a dictionary saved from bytes() earlier, or made by the
+   *        `zstd --train` command line tool.
+   *
+   * Refuses a raw-content dictionary: without the ID a trained one carries,
+   * two ends could not tell whether they hold the same one.
+   */
+  static std::shared_ptr<CompressionDictionary> FromBytes(const void* data,
+                                                          size_t size);
+
+  ~CompressionDictionary();
+
+  CompressionDictionary(const CompressionDictionary&) = delete;
+  CompressionDictionary& operator=(const CompressionDictionary&) = delete;
+
+  /** @brief What the handshake compares; never 0. */
+  ZNET_NODISCARD uint32_t id() const { return id_; }
+
+  /** @brief The dictionary itself, to store and hand to FromBytes() later. */
+  ZNET_NODISCARD const std::string& bytes() const { return bytes_; }
+
+  ZNET_NODISCARD const ZSTD_CDict_s* compression_dict() const { return cdict_; }
+  ZNET_NODISCARD const ZSTD_DDict_s* decompression_dict() const {
+    return ddict_;
+  }
+
+ private:
+  CompressionDictionary() = default;
+
+  std::string bytes_;
+  uint32_t id_ = 0;
+  ZSTD_CDict_s* cdict_ = nullptr;
+  ZSTD_DDict_s* ddict_ = nullptr;
+};
+
 namespace compr {
 
-std::shared_ptr<Buffer> HandleOutWithType(CompressionType type, std::shared_ptr<Buffer> buffer);
-std::shared_ptr<Buffer> HandleInWithType(CompressionType type, std::shared_ptr<Buffer> buffer);
-std::shared_ptr<Buffer> HandleInDynamic(std::shared_ptr<Buffer> buffer);
+/**
+ * @brief The sending half of CompressionType::ZstandardStream.
+ *
+ * Not synchronized; one per session, owned by whoever holds its encode claim.
+ */
+class StreamCompressor {
+ public:
+  /** @param dictionary primes the stream's start; may be null. */
+  explicit StreamCompressor(const CompressionDictionary* dictionary);
+  ~StreamCompressor();
+
+  StreamCompressor(const StreamCompressor&) = delete;
+  StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+  /**
+   * @brief Compresses `buffer`'s readable bytes as the stream's next message,
+   *        flushed so the peer can decode it without waiting for the next.
+   *
+   * The result is typed ZstandardStream, then carries the message's place in
+   * the stream as one wrapping byte, and has front room for the stages after
+   * it. Null on failure, after which the stream is out of step with the
+   * peer's and the session cannot continue. So is it once a result is lost
+   * before reaching the peer.
+   */
+  std::shared_ptr<Buffer> Compress(const Buffer& buffer);
+
+ private:
+  ZSTD_CCtx_s* stream_ = nullptr;
+  uint8_t sequence_ = 0;
+};
+
+/**
+ * @brief The receiving half of CompressionType::ZstandardStream.
+ *
+ * Not synchronized; one per session, on the thread that decodes for it.
+ */
+class StreamDecompressor {
+ public:
+  explicit StreamDecompressor(const CompressionDictionary* dictionary);
+  ~StreamDecompressor();
+
+  StreamDecompressor(const StreamDecompressor&) = delete;
+  StreamDecompressor& operator=(const StreamDecompressor&) = delete;
+
+  /**
+   * @brief The inverse of StreamCompressor::Compress(), after the type byte.
+   *
+   * @param scratch as for HandleInWithType().
+   * @return null when the message does not decode, or is not the one that
+   *         comes next, which leaves the stream unusable.
+   */
+  std::shared_ptr<Buffer> Decompress(const Buffer& buffer,
+                                     std::shared_ptr<Buffer>* scratch);
+
+ private:
+  ZSTD_DCtx_s* stream_ = nullptr;
+  uint8_t sequence_ = 0;
+};
+
+/**
+ * @param dictionary the session's negotiated dictionary, used when `type` is
+ *        Zstandard, which then goes out as ZstandardDictionary. Null for none.
+ */
+std::shared_ptr<Buffer> HandleOutWithType(
+    CompressionType type, std::shared_ptr<Buffer> buffer,
+    const CompressionDictionary* dictionary = nullptr);
+
+/**
+ * @param scratch optionally, a buffer to decompress into instead of a new one
+ *        per message. Reused while the caller holds the only reference to it,
+ *        and swapped for a new one when something else still does. A
+ *        message that was not compressed comes back as `buffer` and leaves
+ *        it alone.
+ * @param dictionary the session's negotiated dictionary. A message claiming
+ *        one on a session without is dropped.
+ */
+std::shared_ptr<Buffer> HandleInWithType(
+    CompressionType type, std::shared_ptr<Buffer> buffer,
+    std::shared_ptr<Buffer>* scratch = nullptr,
+    const CompressionDictionary* dictionary = nullptr);
+
+/** @brief HandleInWithType for the type named by the message's first byte. */
+std::shared_ptr<Buffer> HandleInDynamic(
+    std::shared_ptr<Buffer> buffer, std::shared_ptr<Buffer>* scratch = nullptr,
+    const CompressionDictionary* dictionary = nullptr);
 
 }
 
@@ -30,6 +30,7 @@
 #ifndef ZNET_TARGET_WIN
 #include <cerrno>
 #include <poll.h>
+#include <sys/uio.h>
 #endif
 
 namespace znet {
@@ -129,6 +130,51 @@ inline ssize_t SocketSend(SocketHandle socket, const void* data, size_t len) {
 #endif
 }
 
+/** @brief Most slices one SocketSendv() call takes; the rest are ignored. */
+constexpr size_t kMaxSocketSlices = 64;
+
+/**
+ * @brief Sends `count` slices over a connected socket in one call, as if they
+ *        were one contiguous buffer.
+ *
+ * @return bytes sent, or -1 on error. Like SocketSend() the send may be short,
+ *         and it may stop partway through any slice.
+ */
+inline ssize_t SocketSendv(SocketHandle socket, const SocketSlice* slices,
+                           size_t count) {
+  if (count > kMaxSocketSlices) {
+    count = kMaxSocketSlices;
+  }
+#ifdef ZNET_TARGET_WIN
+  WSABUF buffers[kMaxSocketSlices];
+  for (size_t i = 0; i < count; i++) {
+    buffers[i].buf = const_cast<char*>(static_cast<const char*>(slices[i].data));
+    buffers[i].len = static_cast<ULONG>(detail::SocketIoLength(slices[i].len));
+  }
+  DWORD sent = 0;
+  if (WSASend(socket, buffers, static_cast<DWORD>(count), &sent, 0, nullptr,
+              nullptr) != 0) {
+    return -1;
+  }
+  return static_cast<ssize_t>(sent);
+#else
+  iovec vectors[kMaxSocketSlices];
+  for (size_t i = 0; i < count; i++) {
+    vectors[i].iov_base = const_cast<void*>(slices[i].data);
+    vectors[i].iov_len = slices[i].len;
+  }
+  msghdr message{};
+  message.msg_iov = vectors;
+  // size_t on Linux, int on the BSDs; count is capped far below either
+  message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(count);
+#if defined(MSG_NOSIGNAL)
+  return sendmsg(socket, &message, MSG_NOSIGNAL);  // see SocketSend()
+#else
+  return sendmsg(socket, &message, 0);
+#endif
+#endif
+}
+
 /**
  * @brief Receives from a connected socket. @return bytes read, 0 on an orderly
  *        shutdown by the peer, or -1 on error.
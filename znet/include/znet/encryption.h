@@ -15,10 +15,12 @@
 #ifndef ZNET_ENCRYPTION_H_
 #define ZNET_ENCRYPTION_H_
 
+#include "znet/cipher_suite.h"
 #include "znet/compat.h"
 #include "znet/compression.h"
 #include "znet/packet.h"
 #include "znet/packet_handler.h"
+#include "znet/transport.h"
 
 // DH and ENGINE are deprecated in OpenSSL 3, and this is the header that
 // includes them, so the suppression belongs here rather than in a build flag a
@@ -28,11 +30,13 @@
 #endif
 #include <openssl/dh.h>
 #include <openssl/engine.h>
+#include <openssl/evp.h>
 
 #include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace znet {
 
@@ -49,6 +53,31 @@ UniquePKey DeserializePublicKey(const unsigned char* der, uint32_t len);
 
 UniquePKey CloneKey(const UniquePKey& k);
 
+/** @brief The OpenSSL cipher behind `suite`, or nullptr when there is none. */
+const EVP_CIPHER* GetCipherSuiteEvp(CipherSuite suite);
+
+/**
+ * @brief One message's AEAD, as EncryptionLayer runs it. Declared here for the
+ *        cipher benchmark, which times exactly this per suite.
+ *
+ * `ctx` is reused across calls and keyed only when `set_key` is true, which
+ * is when `cipher` and `key` are read. The nonce is 12 bytes, the tag 16.
+ *
+ * @return the ciphertext length, or -1 on failure.
+ */
+int EncryptData(EVP_CIPHER_CTX* ctx, const EVP_CIPHER* cipher, bool set_key,
+                const unsigned char* key, const unsigned char* nonce,
+                const unsigned char* aad, int aad_len,
+                const unsigned char* plaintext, int plaintext_len,
+                unsigned char* ciphertext, unsigned char* tag);
+
+/** @brief The inverse of EncryptData(). -1 when the tag does not verify. */
+int DecryptData(EVP_CIPHER_CTX* ctx, const EVP_CIPHER* cipher, bool set_key,
+                const unsigned char* key, const unsigned char* nonce,
+                const unsigned char* aad, int aad_len,
+                const unsigned char* ciphertext, int ciphertext_len,
+                const unsigned char* tag, unsigned char* plaintext);
+
 class HandshakePacket : public Packet {
  public:
   HandshakePacket() : Packet(GetPacketId()) { }
@@ -61,6 +90,13 @@ class HandshakePacket : public Packet {
   // server sends; the initiator's copy carries defaults and is ignored.
   bool encryption_ = true;
   CompressionTypeRaw compression_ = 0;
+  // the initiator's offer, most preferred first; on the server's packet, the
+  // one suite it selected. Absent from a peer that predates suites, which
+  // reads as AES-256-GCM alone.
+  std::vector<CipherSuiteRaw> cipher_suites_;
+  // the initiator's compression dictionary, 0 for none; on the server's
+  // packet, that same ID when it agreed to use it. Absent from older peers.
+  uint32_t dictionary_id_ = 0;
 };
 
 class HandshakePacketSerializerV1 : public PacketSerializer<HandshakePacket> {
@@ -80,6 +116,12 @@ class HandshakePacketSerializerV1 : public PacketSerializer<HandshakePacket> {
       buffer->Write(data, len);
       OPENSSL_free(data);
     }
+    // last, so an older peer that stops reading after the key still parses
+    buffer->WriteInt<uint8_t>(static_cast<uint8_t>(packet->cipher_suites_.size()));
+    for (CipherSuiteRaw suite : packet->cipher_suites_) {
+      buffer->WriteInt<CipherSuiteRaw>(suite);
+    }
+    buffer->WriteInt<uint32_t>(packet->dictionary_id_);
     return buffer;
   }
 
@@ -92,6 +134,15 @@ class HandshakePacketSerializerV1 : public PacketSerializer<HandshakePacket> {
       buffer->Read(tmp.data(), len);
       packet->pub_key_ = DeserializePublicKey(tmp.data(), len);
     }
+    if (buffer->readable_bytes() > 0) {
+      const uint8_t count = buffer->ReadInt<uint8_t>();
+      for (uint8_t i = 0; i < count && buffer->readable_bytes() > 0; i++) {
+        packet->cipher_suites_.push_back(buffer->ReadInt<CipherSuiteRaw>());
+      }
+    }
+    if (buffer->readable_bytes() >= sizeof(uint32_t)) {
+      packet->dictionary_id_ = buffer->ReadInt<uint32_t>();
+    }
     return packet;
   }
 };
@@ -188,6 +239,9 @@ class EncryptionLayer {
   static constexpr size_t kMaxExportLength = 255 * 32;
   /** @brief Longest application label an export may carry. */
   static constexpr size_t kMaxExportLabelLength = 255;
+  /** @brief Most bytes HandleOut() adds to a message: the mode, the stream
+   *         and counter, and the tag. */
+  static constexpr size_t kMaxMessageOverhead = 1 + 8 + 16;
 
   EncryptionLayer(PeerSession& session);
   ~EncryptionLayer();
@@ -198,10 +252,22 @@ class EncryptionLayer {
    * `want_encryption` is the server's policy and is only read on the accepting
    * side. The initiator always offers a key and then follows whatever the
    * server selects, so a client needs no matching configuration.
+   *
+   * `cipher_suites` is read on both sides, as CommonOptions::cipher_suites:
+   * the initiator offers it and the acceptor selects from it.
    */
-  void Initialize(bool send, bool want_encryption = true);
+  void Initialize(bool send, bool want_encryption = true,
+                  const std::vector<CipherSuite>& cipher_suites = {});
 
-  std::shared_ptr<Buffer> HandleIn(std::shared_ptr<Buffer> buffer);
+  /**
+   * @brief Decrypts one incoming message.
+   *
+   * @param sealed  whether the transport authenticated the datagrams it came
+   *                in, from TransportLayer::LastReceiveSealed(). A message
+   *                relying on that is refused without it.
+   */
+  std::shared_ptr<Buffer> HandleIn(std::shared_ptr<Buffer> buffer,
+                                   bool sealed = false);
   /**
    * @brief Encrypts one outgoing message.
    *
@@ -214,9 +280,23 @@ class EncryptionLayer {
   std::shared_ptr<Buffer> HandleOut(std::shared_ptr<Buffer> buffer,
                                     uint8_t stream);
 
+  /**
+   * @brief HandleOut() for a message other sessions are sending too: the
+   *        result is always a new buffer, and `buffer` is only read.
+   *
+   * Costs nothing extra when this session encrypts, since the ciphertext goes
+   * into a new buffer anyway; otherwise the mode byte costs a copy.
+   */
+  std::shared_ptr<Buffer> HandleOut(const Buffer& buffer, uint8_t stream);
+
   void OnHandshakePacket(std::shared_ptr<HandshakePacket> packet);
   void OnAcknowledgePacket(std::shared_ptr<ConnectionReadyPacket> packet);
 
+  /** @brief The negotiated AEAD, None until an encrypted session is ready. */
+  ZNET_NODISCARD CipherSuite cipher_suite() const {
+    return enable_encryption_ ? suite_ : CipherSuite::None;
+  }
+
   /** @brief Bytes unique to this session and this label. See PeerSession. */
   Result ExportKeyingMaterial(const std::string& label, unsigned char* out,
                             size_t out_len) const;
@@ -231,15 +311,23 @@ class EncryptionLayer {
   bool enable_encryption_ = false;
   bool want_encryption_ = true;  // server policy, unread on the initiator
   bool negotiated_ = false;      // mode settled; ready may now be exchanged
+  // this side's allowed suites, resolved from the options, and the one the
+  // handshake settled on
+  std::vector<CipherSuite> cipher_suites_;
+  CipherSuite suite_ = CipherSuite::None;
   unsigned char* shared_secret_ = nullptr;
   size_t shared_secret_len_ = 0;
   bool key_filled_ = false;
-
-  // AES-256-GCM, one key per direction. The two directions must never share a
-  // key: the nonce is a counter, so a shared key would repeat a (key, nonce)
-  // pair as soon as both sides sent, and repeating one under GCM leaks the
-  // authentication subkey rather than just a block of plaintext. Which label
-  // maps to tx and which to rx is decided by is_initiator().
+  // the transport took datagram keys, so once encryption is on the messages
+  // go out in sealed datagrams instead of each under its own tag
+  bool datagram_sealed_ = false;
+
+  // One key per direction, for whichever suite was negotiated; AES-128-GCM
+  // keys from the first half. The two directions must never share a key: the
+  // nonce is a counter, so a shared key would repeat a (key, nonce) pair as
+  // soon as both sides sent, and repeating one under either AEAD leaks its
+  // authenticator key rather than just a block of plaintext. Which label maps
+  // to tx and which to rx is decided by is_initiator().
   unsigned char tx_key_[32] = {};
   unsigned char rx_key_[32] = {};
   // Nonce is salt || counter. The salt half is derived, never sent, and only
@@ -268,8 +356,10 @@ class EncryptionLayer {
   std::mutex enc_mutex_;
 
  private:
-  std::shared_ptr<Buffer> HandleDecrypt(std::shared_ptr<Buffer> buffer);
+  std::shared_ptr<Buffer> HandleDecrypt(std::shared_ptr<Buffer> buffer,
+                                        bool sealed);
   bool DeriveDirectionalKeys();
+  bool DeriveDatagramKeys(DatagramKeys& out);
   bool DeriveExporterSecret();
   /** @brief Send counter for `stream`. Call with enc_mutex_ held. */
   uint64_t& TxCounter(uint8_t stream);
@@ -26,6 +26,7 @@
 #include "znet/compat.h"
 #include "znet/compression.h"
 #include "znet/packet_handler.h"
+#include "znet/shared_message.h"
 #include "znet/types.h"
 
 #include <memory>
@@ -75,14 +76,82 @@ class MessagePipeline {
                                  uint8_t stream,
                                  size_t* out_payload_bytes = nullptr);
 
+  /**
+   * @brief Packet to payload: Encode()'s first stage on its own, leaving the
+   *        headroom the others need.
+   *
+   * More packets can follow it in with Append(), and Seal() then turns the
+   * payload into one message carrying all of them.
+   *
+   * @return null if the packet could not be serialized, having logged why.
+   */
+  std::shared_ptr<Buffer> Serialize(const std::shared_ptr<Packet>& packet);
+
+  /**
+   * @brief Serializes one more packet onto the end of `payload`.
+   *
+   * @return false if it could not be, having logged why. `payload` is then
+   *         as it was.
+   */
+  bool Append(const std::shared_ptr<Buffer>& payload,
+              const std::shared_ptr<Packet>& packet);
+
+  /**
+   * @brief Moves the bytes of `payload` from `offset` on into a payload of
+   *        their own, with the same headroom Serialize() leaves.
+   *
+   * For the packet that took a payload past its budget: it is already
+   * serialized, and copying its frame out is cheaper than serializing it
+   * again.
+   */
+  std::shared_ptr<Buffer> SplitOff(Buffer& payload, size_t offset);
+
+  /**
+   * @brief Payload to wire bytes: compress, encrypt. What Encode() does after
+   *        serializing.
+   *
+   * @return null if either stage fails, having logged why.
+   */
+  std::shared_ptr<Buffer> Seal(std::shared_ptr<Buffer> payload, uint8_t stream);
+
+  /**
+   * @brief Encode() for a message other sessions are sending too: serialized
+   *        and compressed once for every session that would produce the same
+   *        bytes, and only encrypted here.
+   *
+   * Under ZstandardStream, or without a codec, it is Encode() of the packet.
+   */
+  std::shared_ptr<Buffer> EncodeShared(SharedMessage& message, uint8_t stream,
+                                       size_t* out_payload_bytes = nullptr);
+
+  /**
+   * @brief How large a payload may grow while its sealed message stays within
+   *        `message_budget` bytes; 0 when even an empty one would not.
+   *
+   * Assumes the worst of both stages: incompressible bytes, which the
+   * compressors grow slightly, and a full AEAD header and tag.
+   */
+  static size_t PayloadBudget(size_t message_budget);
+
   /**
    * @brief Wire bytes to payload: decrypt, then decompress.
    *
    * The exact inverse of Encode's middle two stages, in the reverse order.
+   * Decryption works inside `buffer`, and decompression into a scratch this
+   * keeps across messages, so neither allocates once the session is warm.
+   * A payload something still holds on to is never reused; the scratch is
+   * replaced instead.
+   *
+   * Stream-compressed messages have to arrive in the order they were encoded,
+   * and one that fails leaves inbound_stream_broken() set.
+   *
+   * @param sealed  whether the transport authenticated the datagrams the
+   *                message came in; see TransportLayer::LastReceiveSealed().
    *
    * @return null if either stage fails, having logged why.
    */
-  std::shared_ptr<Buffer> Decode(std::shared_ptr<Buffer> buffer);
+  std::shared_ptr<Buffer> Decode(std::shared_ptr<Buffer> buffer,
+                                 bool sealed = false);
 
   /**
    * @brief Reads packets out of a decoded payload and hands them to `handler`.
@@ -95,6 +164,22 @@ class MessagePipeline {
 
   ZNET_NODISCARD bool has_codec() const { return codec_ != nullptr; }
 
+  /**
+   * @brief Whether a stream-compressed message failed to decode, after which
+   *        no later one can; see CompressionType::ZstandardStream.
+   */
+  ZNET_NODISCARD bool inbound_stream_broken() const { return stream_broken_; }
+
+  /**
+   * @brief Whether the last Seal() ran its payload through the outgoing
+   *        compression stream, whether or not it went on to succeed.
+   *
+   * The stream now holds that message, so it has to reach the peer: a seal
+   * that failed after this point, or a send that failed after the seal, leaves
+   * the two streams out of step for good.
+   */
+  ZNET_NODISCARD bool sealed_into_stream() const { return sealed_into_stream_; }
+
   void SetCodec(std::shared_ptr<Codec> codec) { codec_ = std::move(codec); }
 
   ZNET_NODISCARD CompressionType out_compression() const {
@@ -102,8 +187,35 @@ class MessagePipeline {
   }
   void SetOutCompression(CompressionType type) { out_compression_ = type; }
 
-  /** @brief Messages below this many bytes skip compression entirely. */
-  void SetCompressionThreshold(size_t bytes) { compression_threshold_ = bytes; }
+  /**
+   * @brief The largest message the transport sends, 0 for no limit; see
+   *        TransportLayer::MaxMessageSize().
+   *
+   * Only the stream checks it. Any other message the transport refuses is
+   * lost alone.
+   */
+  void SetMessageLimit(size_t bytes) { message_limit_ = bytes; }
+
+  /**
+   * @brief Messages below this many bytes skip compression entirely;
+   *        `with_context` replaces `bytes` when the compressor starts from
+   *        more than the message, a dictionary or a stream's history.
+   */
+  void SetCompressionThreshold(size_t bytes, size_t with_context) {
+    compression_threshold_ = bytes;
+    context_threshold_ = with_context;
+  }
+
+  /**
+   * @brief The dictionary both ends agreed on, null for none.
+   *
+   * Takes effect for decoding at once and for encoding whenever the outgoing
+   * compression is Zstandard or ZstandardStream.
+   */
+  void SetCompressionDictionary(
+      std::shared_ptr<const CompressionDictionary> dictionary) {
+    dictionary_ = std::move(dictionary);
+  }
 
   /** @brief Log a hex dump when a frame in a payload fails to decode. */
   void SetDumpOnDecodeFailure(bool enabled) {
@@ -120,11 +232,26 @@ class MessagePipeline {
   static constexpr size_t kSendHeadroom = 4;
 
  private:
+  // the compression half of Seal()
+  std::shared_ptr<Buffer> Compress(std::shared_ptr<Buffer> buffer);
+
   EncryptionLayer& encryption_;
   SessionId id_;
   std::shared_ptr<Codec> codec_;
+  // what compressed messages decompress into; see compr::HandleInDynamic
+  std::shared_ptr<Buffer> decompress_scratch_;
   CompressionType out_compression_ = CompressionType::None;
   size_t compression_threshold_ = 128;
+  size_t context_threshold_ = 32;
+  std::shared_ptr<const CompressionDictionary> dictionary_;
+  // CompressionType::ZstandardStream, one per direction and made on first use:
+  // the encoder's by whoever holds the encode claim, the decoder's by the
+  // worker, so neither is ever touched by two threads
+  std::unique_ptr<compr::StreamCompressor> stream_out_;
+  std::unique_ptr<compr::StreamDecompressor> stream_in_;
+  bool stream_broken_ = false;
+  bool sealed_into_stream_ = false;
+  size_t message_limit_ = 0;
   bool dump_on_decode_failure_ = false;
 };
 
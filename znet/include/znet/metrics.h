@@ -48,6 +48,9 @@ namespace znet {
 /** @brief Counters meaningful on every transport. */
 struct CommonMetrics {
   uint64_t messages_sent = 0;
+  /** @brief Packets those messages carried. Above messages_sent when the
+   *         transport bundles; see TransportLayer::BundleBudget(). */
+  uint64_t packets_sent = 0;
   uint64_t messages_received = 0;
   /** @brief On the wire: after compression and encryption, before transport
    *         framing. Pairs with the peer's message_bytes_received. */
@@ -75,13 +78,23 @@ struct CommonMetrics {
 
 /** @brief Counters only a TCP session reports. */
 struct TCPSessionMetrics {
-  uint64_t writes = 0;  /**< Send() calls that succeeded. */
+  uint64_t writes = 0;  /**< Socket writes that sent data. */
   uint64_t reads = 0;  /**< Recv() calls that returned data. */
+  /**
+   * @brief Batches of staged frames written out. writes / flushes is the
+   *        writes each one took, 1 when the batch budget holds it.
+   */
+  uint64_t flushes = 0;
+  /** @brief Data frames written. frames_sent / writes is the coalescing. */
+  uint64_t frames_sent = 0;
 };
 
 /** @brief Counters only a ZDT session reports. */
 struct ZDTSessionMetrics {
   uint64_t datagrams_sent = 0;
+  /** @brief Socket calls that sent datagrams. datagrams_sent / send_calls is
+   *         the batching. */
+  uint64_t send_calls = 0;
   uint64_t datagrams_received = 0;
   uint64_t retransmits = 0;
   /** @brief Resends fired because acks went silent, not by NAK or timeout. */
@@ -91,6 +104,15 @@ struct ZDTSessionMetrics {
   uint64_t duplicates_dropped = 0;  /**< Deduped by the receiver. */
   uint64_t inbound_dropped = 0;  /**< Inbox full. */
   uint64_t reassemblies_dropped = 0;  /**< Incomplete, timed out or over cap. */
+  /** @brief Parity datagrams sent for ZDTOptions::fec_channels. */
+  uint64_t fec_parity_sent = 0;
+  /** @brief Messages rebuilt from parity rather than waited for. */
+  uint64_t fec_recovered = 0;
+  /** @brief Received datagrams and messages that reused a pooled buffer. */
+  uint64_t pool_hits = 0;
+  /** @brief Received datagrams and messages that had to allocate one. After
+   *         warm-up this should stop growing. */
+  uint64_t pool_misses = 0;
   /** @brief Smoothed round-trip estimate. Sampled, not accumulated. */
   uint32_t srtt_us = 0;
   /**
@@ -112,9 +134,30 @@ struct ZDTSessionMetrics {
    * there, not that the application ran out of things to send.
    */
   uint32_t cwnd = 0;
+  /**
+   * @brief Reliable datagrams per second the pacer releases. Sampled, not
+   *        accumulated.
+   *
+   * 0 when ZDTOptions::pacing is Off under the Delay controller. Under Delay
+   * it is the window over the round trip with some headroom; under Bbr, the
+   * bottleneck estimate times the current phase's gain.
+   */
+  uint32_t pacing_rate = 0;
   uint32_t in_flight = 0;  /**< Unacked reliable datagrams. */
   /** @brief MTU the handshake settled on. Sampled, not accumulated. */
   uint32_t mtu = 0;
+  /**
+   * @brief Bytes the connection's send and receive state holds. Sampled, not
+   *        accumulated.
+   *
+   * Covers the sent-datagram ring, the unacked message slots, the per-channel
+   * reorder windows and the reassembly buffers. Each grows to its high-water
+   * mark and keeps it, so at steady state this stops moving, and the options
+   * cap it: kZDTAckHistoryBits datagrams, about max_messages_in_flight
+   * messages, the peer's messages in flight per channel, and
+   * max_reassembly_bytes.
+   */
+  uint64_t state_bytes = 0;
 };
 
 /**
@@ -142,6 +185,15 @@ struct ZDTServerMetrics {
   uint64_t datagrams_unroutable = 0;  /**< Online datagram from an unknown peer. */
   /** @brief Dropped by the allow/deny lists or the attempt throttle. */
   uint64_t admission_rejected = 0;
+  uint64_t datagrams_received = 0;  /**< Everything the socket delivered. */
+  /** @brief Socket calls that returned datagrams. datagrams_received /
+   *         receive_calls is the batching. */
+  uint64_t receive_calls = 0;
+  /** @brief Sockets, and receive threads, reading the port. */
+  uint64_t receive_sockets = 0;
+  /** @brief Connections moved to a new client address, after it answered a
+   *         path challenge. */
+  uint64_t paths_migrated = 0;
 };
 
 /** @brief Listener-scope counters, across every session it accepted. */
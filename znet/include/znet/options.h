@@ -25,6 +25,7 @@
 #ifndef ZNET_OPTIONS_H_
 #define ZNET_OPTIONS_H_
 
+#include "znet/cipher_suite.h"
 #include "znet/compat.h"
 #include "znet/compression.h"
 #include "znet/inet_addr.h"
@@ -72,12 +73,27 @@ struct CommonOptions {
    */
   bool encryption = true;
 
+  /**
+   * @brief The AEADs this end allows, most preferred first. Empty means
+   *        DefaultCipherSuites(), ordered by whether this CPU has AES
+   *        instructions.
+   *
+   * Unlike `encryption`, read on both ends: the client offers its list and
+   * the server picks from the overlap, by the rule in SelectCipherSuite().
+   * A session whose two lists share nothing is closed during the handshake.
+   * Suites this OpenSSL lacks are skipped, and the key schedule is the same
+   * for all of them.
+   */
+  std::vector<CipherSuite> cipher_suites;
+
   /**
    * @brief Compression applied to outgoing messages once the session is ready.
    *
    * Server-side like `encryption`, and negotiated the same way, so both ends
    * agree. Runs before encryption and therefore compresses the plaintext,
    * which works on encrypted and unencrypted sessions alike.
+   * ZstandardStream compresses across messages on TCP and is plain Zstandard
+   * on anything else.
    */
   CompressionType compression = CompressionType::Default;
 
@@ -95,6 +111,28 @@ struct CommonOptions {
    */
   size_t compression_threshold = 128;
 
+  /**
+   * @brief A trained dictionary to compress small messages with.
+   *
+   * Read on both ends: the client offers its dictionary's ID at handshake,
+   * and the server uses its own when the IDs match and `compression` resolves
+   * to Zstandard or ZstandardStream. Otherwise the session compresses without
+   * one, so a mismatch costs ratio rather than the connection. Train one with
+   * CompressionDictionary::Train() on payloads captured from real sessions.
+   */
+  std::shared_ptr<const CompressionDictionary> compression_dictionary;
+
+  /**
+   * @brief compression_threshold for a session that has a dictionary, or
+   *        that compresses with ZstandardStream.
+   *
+   * With the redundancy already in the dictionary, even a message a few dozen
+   * bytes long comes out smaller; what is left to pay for is zstd's 9 bytes
+   * of frame. A stream finds it in the messages before, and pays only a
+   * 3-byte block header.
+   */
+  size_t dictionary_compression_threshold = 32;
+
   /**
    * @brief Packets a session will hold for its worker to encode.
    *
@@ -104,7 +142,7 @@ struct CommonOptions {
    * total a session can hold.
    *
    * The queue is a ring allocated whole when the session is constructed,
-   * roughly 32 bytes a slot rounded up to a power of two, and nothing is
+   * roughly 48 bytes a slot rounded up to a power of two, and nothing is
    * allocated per message afterwards. A refusal loses nothing, since the
    * caller still holds the packet, so this only has to cover the largest burst
    * worth absorbing between two of the worker's ticks.
@@ -135,6 +173,32 @@ struct CommonOptions {
   uint32_t max_invalid_frames = 16;
 };
 
+/** @brief TCP tunables. */
+struct TCPOptions {
+  /**
+   * @brief Most bytes one vectored write hands the kernel.
+   *
+   * Send() only frames and stages; the frames go out together when the
+   * session finishes a drain or flushes, as few writes as this allows. It
+   * also bounds what staging holds: reaching it writes the batch at once
+   * instead of waiting for the flush. A single frame larger than this still
+   * goes out whole. Zero writes every frame on its own, from Send().
+   */
+  size_t max_write_batch = 64 * 1024;
+  /**
+   * @brief Send consecutive queued packets with the same SendOptions as one
+   *        message, up to the largest frame the transport takes.
+   *
+   * Each message otherwise pays its own compression header, encryption nonce
+   * and tag and frame length, which on small packets can be most of what goes
+   * on the wire. The peer reads the packets back out one by one either way,
+   * so this needs nothing from it. No packet waits longer for it: a bundle
+   * goes out when the drain that built it ends, which is when the staged
+   * frames were written anyway.
+   */
+  bool bundle_messages = true;
+};
+
 /**
  * @brief Candidate MTUs for the handshake to probe, largest first.
  *
@@ -164,6 +228,48 @@ struct MTULadder {
   constexpr bool empty() const { return count == 0; }
 };
 
+/** @brief The congestion controller a ZDT connection runs. */
+enum class ZDTCongestionAlgorithm {
+  /**
+   * @brief A window that grows until the round trip rises above its floor.
+   *
+   * Keeps queues short on long links, but on a round trip of microseconds
+   * the rise it reacts to is noise, and the window sits near its floor.
+   * Sends what the window allows in bursts.
+   */
+  Delay,
+  /**
+   * @brief Models the path's bottleneck rate and minimum round trip, after
+   *        BBR, and paces sends at that rate.
+   *
+   * Neither loss nor a noisy round trip shrinks its window, so it suits fast
+   * local links and lossy ones. Every eight round trips it sends a quarter
+   * above the estimate for one, to find out whether the path got faster.
+   */
+  Bbr,
+};
+
+/** @brief How a ZDT connection spaces out the datagrams the window allows. */
+enum class ZDTPacing {
+  /** @brief Each flush sends what the window allows at once. */
+  Off,
+  /**
+   * @brief The session worker holds datagrams back and sends each at its
+   *        slot, waking early for the next one.
+   */
+  Worker,
+  /**
+   * @brief Stamps each datagram with its slot and hands the whole flush to
+   *        the kernel (SO_TXTIME), which sends them on time from the fq
+   *        queueing discipline.
+   *
+   * Linux only, and only as good as the interface's qdisc: without fq (or
+   * etf) the stamps are ignored and datagrams leave at once. Where the socket
+   * option is missing this falls back to Worker.
+   */
+  Kernel,
+};
+
 /** @brief ZDT tunables. */
 struct ZDTOptions {
   /** @brief Candidate MTUs, probed largest first during the handshake. */
@@ -188,6 +294,74 @@ struct ZDTOptions {
    * the MTU per round trip, which is what governs throughput on a long link.
    */
   int max_datagrams_in_flight = 512;
+  /**
+   * @brief What sizes the window under max_datagrams_in_flight.
+   *
+   * Each side picks its own; it governs only what that side sends.
+   */
+  ZDTCongestionAlgorithm congestion_algorithm = ZDTCongestionAlgorithm::Delay;
+  /**
+   * @brief Whether to spread each flight over the round trip at the
+   *        controller's rate instead of sending it in one burst.
+   *
+   * A burst of a whole window is what overflows a shallow router buffer on a
+   * long fat path, and the losses it causes come in runs. Pacing costs a
+   * little latency per datagram while a window is outstanding. Bbr paces
+   * whatever this says, so under it Off means Worker.
+   */
+  ZDTPacing pacing = ZDTPacing::Off;
+  /**
+   * @brief Channels whose messages are sent with forward error correction.
+   *
+   * After every fec_group_size messages on one of these channels a parity
+   * datagram follows, the XOR of their payloads, and a receiver missing any
+   * one of the group rebuilds it without waiting a round trip for the
+   * retransmit. Meant for small latency-critical traffic such as input or
+   * voice under random loss: it costs one datagram per group whether or not
+   * anything is lost, it cannot recover two losses in one group, and a
+   * message too large to share a datagram with its parity's bookkeeping, any
+   * fragmented one included, goes out unprotected.
+   *
+   * Messages of one group never share a datagram, so a burst of them costs a
+   * datagram each where it would otherwise be packed into one. Reliable
+   * messages are still retransmitted; FEC only delivers them sooner. A group
+   * that never fills, such as the last few messages before the channel goes
+   * quiet, is not protected. Each side picks its own; the receiver needs no
+   * setting.
+   */
+  std::vector<uint8_t> fec_channels;
+  /** @brief Messages per parity on fec_channels, 2 to 16. Smaller recovers
+   *         more and sooner at more overhead: 4 costs a quarter again. */
+  size_t fec_group_size = 4;
+  /**
+   * @brief Encrypt and authenticate whole datagrams instead of each message.
+   *
+   * The session's AEAD otherwise runs once per message, so a datagram
+   * coalescing 40 small messages carries 40 nonces and 40 tags, 24 bytes
+   * each, and pays for 40 cipher passes. With this the transport seals the
+   * datagram once, after coalescing: its header is authenticated, its records
+   * encrypted, and the nonce comes from packet_seq, so the overhead is one
+   * 16-byte tag per datagram. Messages still carry the session's one-byte
+   * mode marker.
+   *
+   * Only takes effect when CommonOptions::encryption settles on an encrypted
+   * session, since the keys come from the session's key exchange. Offered by
+   * the client and taken up when the server also sets it; otherwise both ends
+   * fall back to per-message encryption. P2P links do not negotiate it yet.
+   */
+  bool datagram_encryption = false;
+  /**
+   * @brief Send consecutive queued packets with the same SendOptions as one
+   *        message, up to what fits one datagram unfragmented. Off by default.
+   *
+   * Coalescing already packs small messages into a datagram, but each still
+   * carries its own record header, compression header and, without
+   * datagram_encryption, its own nonce and tag; a bundle pays those once. The
+   * cost is on lossy channels: a bundle is one message, so an unreliable one
+   * lost takes every packet in it, and a reliable one holds all of them back
+   * until it is resent. See TCPOptions::bundle_messages.
+   */
+  bool bundle_messages = false;
   /**
    * @brief Reliable messages allowed in flight. A memory bound, not congestion
    * control; the congestion window is max_datagrams_in_flight.
@@ -195,6 +369,10 @@ struct ZDTOptions {
    * Coalescing puts many messages in one datagram, so holding this near
    * max_datagrams_in_flight would throttle small messages well below what the
    * window actually allows.
+   *
+   * Each message in flight holds a slot of about 160 bytes. Slots are
+   * allocated as the window first reaches them and reused after, so this is
+   * also the ceiling on that part of ZDTSessionMetrics::state_bytes.
    */
   int max_messages_in_flight = 4096;
   /** @brief How long to wait for a handshake reply before resending. */
@@ -217,7 +395,9 @@ struct ZDTOptions {
    * @brief Ceiling on bytes held in partial reassemblies.
    *
    * Reaching it refuses to start new messages rather than discarding data
-   * already accepted, so a peer stalls instead of losing anything.
+   * already accepted, so a peer stalls instead of losing anything. A message
+   * is charged its whole size as soon as its first full-size fragment
+   * arrives, since that is when the room for it is allocated.
    */
   size_t max_reassembly_bytes = 16u * 1024u * 1024u;
 
@@ -234,11 +414,63 @@ struct ZDTOptions {
   int socket_recv_buffer = 4 * 1024 * 1024;
   /** @brief SO_SNDBUF, on the same terms as socket_recv_buffer. */
   int socket_send_buffer = 4 * 1024 * 1024;
+  /**
+   * @brief Datagrams a server's receive thread takes per call (recvmmsg on
+   *        Linux). Capped at 64.
+   *
+   * Each is a ZNET_MAX_BUFFER_SIZE slot reserved for the server's lifetime.
+   * The call never waits to fill the batch, so a quiet server pays nothing
+   * for a large one. 1 receives a datagram at a time.
+   */
+  size_t receive_batch = 32;
+  /**
+   * @brief Idle receive buffers a client or server keeps for reuse.
+   *
+   * A received datagram is copied into one of these for the session that
+   * parses it, and the buffer comes back once it has been. Each is a
+   * ZNET_MAX_BUFFER_SIZE allocation; this bounds only how many sit idle
+   * after a burst, not how many can be in use. A server splits it between
+   * its receive threads, and a session may hold up to one thread's share
+   * more for each thread that serves it, handed back but not yet reused.
+   * 0 allocates one per datagram.
+   */
+  size_t datagram_pool_size = 1024;
+  /**
+   * @brief Datagrams a connection holds back to send in one call (sendmmsg on
+   *        Linux). Capped at 64.
+   *
+   * What one Flush() or Update() produces leaves together, in as many calls
+   * as this requires. The held datagrams share one buffer that keeps its
+   * high-water size, about this times the MTU for a busy connection. 1 sends
+   * each datagram as it is built.
+   */
+  size_t send_batch = 32;
+  /**
+   * @brief Lets the kernel split and coalesce datagrams (UDP GSO/GRO). Linux
+   *        only; off by default.
+   *
+   * Sending, a batch of full datagrams goes down as one buffer the kernel
+   * cuts up late, ideally in the NIC. A server also takes coalesced arrivals
+   * and splits them back up itself, which makes each receive slot
+   * kMaxOffloadBytes (64 KiB) instead of ZNET_MAX_BUFFER_SIZE. Worth it for
+   * bulk transfers, where flushes are runs of full-MTU datagrams; small
+   * messages rarely form runs to offload.
+   *
+   * A kernel or route that refuses either is detected and the socket falls
+   * back to plain datagrams, so turning this on is always safe.
+   */
+  bool segmentation_offload = false;
 
   // the three below bound a flooding peer and an application that outruns the
   // link; each is a hard cap after which traffic is dropped or refused
 
-  /** @brief Raw datagrams queued per connection before arrivals are dropped. */
+  /**
+   * @brief Raw datagrams queued per connection before arrivals are dropped.
+   *
+   * Counted per receive thread feeding the connection, which is one unless
+   * a migrated peer is heard on two of a server's receive sockets at once.
+   * The queue grows towards this in small blocks as bursts need it.
+   */
   size_t max_inbox_datagrams = 4096;
   /**
    * @brief Encoded messages the transport will hold before Send() fails.
@@ -266,6 +498,7 @@ struct ZDTOptions {
  */
 struct SessionOptions {
   CommonOptions common;
+  TCPOptions tcp;
   ZDTOptions zdt;
 };
 
@@ -277,6 +510,18 @@ struct ServerOptions {
   int max_connections = 0;
   /** @brief Allow rebinding a port still in TIME_WAIT (SO_REUSEADDR). */
   bool reuse_address = true;
+  /**
+   * @brief Sockets a ZDT server reads its port through, each with a receive
+   *        thread of its own. Zero opens one per hardware thread. ZDT only.
+   *
+   * One thread routing every datagram caps a server's packet rate whatever
+   * its core count. Beyond one, the sockets share the port (SO_REUSEPORT)
+   * and the kernel hashes each peer's address and port to one of them, so a
+   * peer is always read by the same thread and the threads share no routing
+   * state. Each keeps its own handshake secrets and rate table for the same
+   * reason. Linux only; elsewhere the server opens one.
+   */
+  size_t receive_sockets = 1;
 
   /**
    * @brief Sources allowed to connect. Empty admits everyone the denylist
@@ -23,6 +23,7 @@
 #include "znet/mpsc_queue.h"
 #include "znet/packet.h"
 #include "znet/send_options.h"
+#include "znet/shared_message.h"
 
 #include <atomic>
 #include <functional>
@@ -41,9 +42,11 @@ namespace znet {
  */
 class OutboundQueue {
  public:
+  /** @brief A packet, or a message shared with other sessions; one is null. */
   struct Item {
     std::shared_ptr<Packet> packet;
     SendOptions options;
+    std::shared_ptr<SharedMessage> shared;
   };
 
   explicit OutboundQueue(size_t capacity) : queue_(capacity) {}
@@ -61,14 +64,12 @@ class OutboundQueue {
    *         caller still owns the packet and may retry.
    */
   bool Push(std::shared_ptr<Packet> packet, SendOptions options) {
-    size_t queued = 0;
-    if (!queue_.Push(Item{std::move(packet), options}, &queued)) {
-      return false;
-    }
-    if (queued == 0 && wake_) {
-      wake_();
-    }
-    return true;
+    return PushItem(Item{std::move(packet), options, nullptr});
+  }
+
+  /** @brief Queues a message other sessions are sending too. Any thread. */
+  bool Push(std::shared_ptr<SharedMessage> message, SendOptions options) {
+    return PushItem(Item{nullptr, options, std::move(message)});
   }
 
   /**
@@ -83,6 +84,20 @@ class OutboundQueue {
    */
   template <typename EncodeFn>
   bool Drain(EncodeFn&& encode) {
+    return Drain(std::forward<EncodeFn>(encode), [] {});
+  }
+
+  /**
+   * @brief Drain() with a last step, run once the queue is empty and while
+   *        the claim is still held.
+   *
+   * For an `encode` that holds on to what it was given rather than finishing
+   * each item, such as one bundling packets into a message: `finish` sends the
+   * rest before another thread can take the claim and encode ahead of it.
+   * Runs only if this thread won the claim.
+   */
+  template <typename EncodeFn, typename FinishFn>
+  bool Drain(EncodeFn&& encode, FinishFn&& finish) {
     // whoever takes the claim encodes; whoever does not returns rather than
     // waiting, so no thread blocks here.
     if (encoding_.exchange(true, std::memory_order_acquire)) {
@@ -99,6 +114,7 @@ class OutboundQueue {
         encoded = true;
       }
     }
+    finish();
     encoding_.store(false, std::memory_order_release);
     // a packet pushed between the last Pop() and the release raised no wake of
     // its own, its producer having seen a non-zero count, so nudge here rather
@@ -144,6 +160,17 @@ class OutboundQueue {
   ZNET_NODISCARD size_t capacity() const { return queue_.capacity(); }
 
  private:
+  bool PushItem(Item item) {
+    size_t queued = 0;
+    if (!queue_.Push(std::move(item), &queued)) {
+      return false;
+    }
+    if (queued == 0 && wake_) {
+      wake_();
+    }
+    return true;
+  }
+
   // queue depth up to which the worker encodes even when a dedicated encoder
   // exists. One message is the latency case, and handing it to another thread
   // costs a wake to save nothing.
@@ -15,6 +15,7 @@
 #include "znet/packet.h"
 #include "znet/packet_serializer.h"
 
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <type_traits>
@@ -53,6 +54,56 @@ struct HasOnPacketSharedT<
 template <typename T>
 struct IsDerivedFromPacket : std::is_base_of<Packet, T> {};
 
+template <typename S, typename P, typename = void>
+struct HasDeserializeIntoT : std::false_type {};
+template <typename S, typename P>
+struct HasDeserializeIntoT<
+    S, P,
+    compat::VoidT<decltype(std::declval<S&>().DeserializeInto(
+        std::declval<Buffer&>(), std::declval<P&>()))>>
+    : std::is_same<decltype(std::declval<S&>().DeserializeInto(
+                       std::declval<Buffer&>(), std::declval<P&>())),
+                   bool> {};
+
+// tag dispatch rather than `if constexpr`, which is C++17. both compile to the
+// same thing: the false_type overloads have empty bodies and inline away.
+template <typename Derived, typename P>
+void CallConst(Derived* self, const std::shared_ptr<P>& p, std::true_type) {
+  self->OnPacket(static_cast<const P&>(*p));
+}
+template <typename Derived, typename P>
+void CallConst(Derived*, const std::shared_ptr<P>&, std::false_type) {}
+
+template <typename Derived, typename P>
+void CallShared(Derived* self, const std::shared_ptr<P>& p, std::true_type) {
+  self->OnPacket(p);
+}
+template <typename Derived, typename P>
+void CallShared(Derived*, const std::shared_ptr<P>&, std::false_type) {}
+
+// every OnPacket overload `Derived` has for P, const reference first
+template <typename Derived, typename P>
+void DispatchPacket(Derived* self, const std::shared_ptr<P>& p) {
+  CallConst(self, p, HasOnPacketConstT<Derived, P>{});
+  CallShared(self, p, HasOnPacketSharedT<Derived, P>{});
+}
+
+/** @brief What became of one frame once its serializer had run. */
+enum class FrameVerdict {
+  Decoded,  // a packet, and the cursor on the next frame
+  Refused,  // the serializer returned null; skipped to the next frame
+  Overrun,  // read past the frame, so nothing after it can be located
+};
+
+/**
+ * @brief Codec's checks on a frame after its serializer ran: rewinds and
+ *        skips a frame read short or refused, and lifts the read limit.
+ *
+ * One copy of the rules for both the serializer map and a dense table.
+ */
+FrameVerdict FinishFrame(Buffer& buffer, PacketId id, bool decoded,
+                         size_t body_start, size_t size);
+
 }  // namespace detail
 
 // aliases over the traits above, so each constraint is defined exactly once.
@@ -71,10 +122,40 @@ concept DerivedFromPacket = detail::IsDerivedFromPacket<T>::value;
   ZNET_TPL_CONSTRAINED(::znet::DerivedFromPacket,             \
                        ::znet::detail::IsDerivedFromPacket, T)
 
+class Codec;
+struct PacketHandlerBase;
+
+/**
+ * @brief One slot of a DensePacketHandler's table: decodes the frame the
+ *        buffer's read cursor is on and dispatches it to the handler.
+ */
+using DenseDecodeFn = detail::FrameVerdict (*)(
+    PacketHandlerBase& handler, const std::shared_ptr<Buffer>& buffer,
+    PacketId id, size_t body_start, size_t size);
+
 /** @brief What a session dispatches every decoded packet into. */
 struct PacketHandlerBase {
   virtual ~PacketHandlerBase() = default;
   virtual void Handle(std::shared_ptr<Packet> p) = 0;
+
+  /**
+   * @brief The table Codec::Deserialize decodes through before its own
+   *        serializers, indexed by packet id; null for handlers without one.
+   */
+  ZNET_NODISCARD const DenseDecodeFn* dense_table() const {
+    return dense_table_;
+  }
+  ZNET_NODISCARD size_t dense_table_size() const { return dense_table_size_; }
+
+ protected:
+  void SetDenseTable(const DenseDecodeFn* table, size_t size) {
+    dense_table_ = table;
+    dense_table_size_ = size;
+  }
+
+ private:
+  const DenseDecodeFn* dense_table_ = nullptr;
+  size_t dense_table_size_ = 0;
 };
 
 /**
@@ -112,33 +193,225 @@ class PacketHandler : public PacketHandlerBase {
     return tbl;
   }
 
-  // tag dispatch rather than `if constexpr`, which is C++17. both compile to
-  // the same thing: the false_type overloads have empty bodies and inline away.
+  // main dispatcher
   template<typename P>
-  static void CallConst(Derived* self, const std::shared_ptr<P>& p,
-                        std::true_type) {
-    self->OnPacket(static_cast<const P&>(*p));
+  static void call(Derived* self, std::shared_ptr<Packet> p_base) {
+    detail::DispatchPacket(self, std::static_pointer_cast<P>(p_base));
   }
-  template<typename P>
-  static void CallConst(Derived*, const std::shared_ptr<P>&, std::false_type) {}
 
-  template<typename P>
-  static void CallShared(Derived* self, const std::shared_ptr<P>& p,
-                         std::true_type) {
-    self->OnPacket(p);
+};
+
+/**
+ * @brief One entry of a DensePacketHandler: packet type `P` travels as `Id`
+ *        and is read and written by `Serializer`.
+ *
+ * `Serializer` is a PacketSerializer<P> that is default-constructible and
+ * keeps no state between calls; the handler makes one per frame on the stack.
+ *
+ * A serializer that also defines `bool DeserializeInto(Buffer&, P&)` makes
+ * the route heap-free: frames decode into a packet the worker thread keeps
+ * and reuses, and handlers see it by reference. The packet it is handed was
+ * decoded before, so it must set every field, and return false to refuse the
+ * frame. A handler taking `std::shared_ptr<P>` may keep the packet. The pool
+ * only reuses a packet nobody else holds, so a kept one is left alone, and the
+ * next frame of that type allocates as it would have without the pool.
+ */
+template <PacketId Id, typename P, typename Serializer>
+struct PacketRoute {
+  static_assert(std::is_base_of<Packet, P>::value, "P must derive from Packet");
+  static_assert(std::is_base_of<PacketSerializer<P>, Serializer>::value,
+                "Serializer must be a PacketSerializer<P>");
+  static constexpr PacketId kId = Id;
+  using PacketType = P;
+  using SerializerType = Serializer;
+};
+
+namespace detail {
+
+// ids past this belong in a PacketHandler: the table has a slot for every id
+// up to the largest, used or not
+constexpr PacketId kMaxDensePacketId = 4095;
+
+constexpr PacketId MaxPacketId(const PacketId* ids, size_t count) {
+  PacketId max = 0;
+  for (size_t i = 0; i < count; i++) {
+    max = ids[i] > max ? ids[i] : max;
   }
-  template<typename P>
-  static void CallShared(Derived*, const std::shared_ptr<P>&, std::false_type) {}
+  return max;
+}
+
+constexpr bool DistinctPacketIds(const PacketId* ids, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = i + 1; j < count; j++) {
+      if (ids[i] == ids[j]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <typename... Routes>
+struct DenseRouteIds {
+  static constexpr size_t kCount = sizeof...(Routes);
+  // a leading zero keeps the array legal for an empty list
+  static constexpr PacketId kIds[] = {0, Routes::kId...};
+  static constexpr PacketId kMax = MaxPacketId(kIds + 1, kCount);
+};
 
-  // main dispatcher
-  template<typename P>
-  static void call(Derived* self, std::shared_ptr<Packet> p_base) {
-    auto p = std::static_pointer_cast<P>(p_base);
+// the packet of type P this thread decodes into next, for routes whose
+// serializer can decode in place. one deep: dispatch is synchronous, so the
+// packet is back before the next frame unless a handler kept it.
+template <typename P>
+std::shared_ptr<P>& PooledPacket() {
+  static thread_local std::shared_ptr<P> packet;
+  return packet;
+}
+
+template <typename Derived, typename P, typename S>
+FrameVerdict DenseDecodeWith(PacketHandlerBase& handler,
+                             const std::shared_ptr<Buffer>& buffer,
+                             PacketId id, size_t body_start, size_t size,
+                             std::false_type /*in_place*/) {
+  S serializer;
+  // qualified, so the call binds statically instead of through the vtable
+  std::shared_ptr<P> packet = serializer.S::DeserializeTyped(buffer);
+  FrameVerdict verdict =
+      FinishFrame(*buffer, id, packet != nullptr, body_start, size);
+  if (verdict == FrameVerdict::Decoded) {
+    DispatchPacket(static_cast<Derived*>(&handler), packet);
+  }
+  return verdict;
+}
+
+template <typename Derived, typename P, typename S>
+FrameVerdict DenseDecodeWith(PacketHandlerBase& handler,
+                             const std::shared_ptr<Buffer>& buffer,
+                             PacketId id, size_t body_start, size_t size,
+                             std::true_type /*in_place*/) {
+  std::shared_ptr<P>& pooled = PooledPacket<P>();
+  // out of the pool while it is in use, so a handler decoding another frame
+  // of the same type finds the pool empty instead of this packet
+  std::shared_ptr<P> packet = std::move(pooled);
+  if (!packet) {
+    packet = std::make_shared<P>();
+  }
+  S serializer;
+  const bool decoded = serializer.S::DeserializeInto(*buffer, *packet);
+  FrameVerdict verdict = FinishFrame(*buffer, id, decoded, body_start, size);
+  if (verdict == FrameVerdict::Decoded) {
+    DispatchPacket(static_cast<Derived*>(&handler), packet);
+  }
+  // a packet a handler kept is the handler's now
+  if (packet.use_count() == 1) {
+    pooled = std::move(packet);
+  }
+  return verdict;
+}
+
+template <typename Derived, typename Route>
+FrameVerdict DenseDecode(PacketHandlerBase& handler,
+                         const std::shared_ptr<Buffer>& buffer, PacketId id,
+                         size_t body_start, size_t size) {
+  using P = typename Route::PacketType;
+  using S = typename Route::SerializerType;
+  return DenseDecodeWith<Derived, P, S>(handler, buffer, id, body_start, size,
+                                        HasDeserializeIntoT<S, P>{});
+}
+
+template <typename Derived, typename Route>
+void DenseHandleOne(PacketHandlerBase& handler,
+                    const std::shared_ptr<Packet>& packet) {
+  using P = typename Route::PacketType;
+  // the id alone does not prove the type outside the codec
+  if (typeid(*packet) == typeid(P)) {
+    DispatchPacket(static_cast<Derived*>(&handler),
+                   std::static_pointer_cast<P>(packet));
+  }
+}
 
-    CallConst<P>(self, p, detail::HasOnPacketConstT<Derived, P>{});
-    CallShared<P>(self, p, detail::HasOnPacketSharedT<Derived, P>{});
+using DenseHandleFn = void (*)(PacketHandlerBase&,
+                               const std::shared_ptr<Packet>&);
+
+template <size_t N>
+struct DenseTables {
+  DenseDecodeFn decode[N];
+  DenseHandleFn handle[N];
+};
+
+// filled by a constant expression, so the tables are data in the binary
+// rather than something built on first use
+template <typename Derived, typename... Routes>
+constexpr DenseTables<DenseRouteIds<Routes...>::kMax + 1> BuildDenseTables() {
+  DenseTables<DenseRouteIds<Routes...>::kMax + 1> tables{};
+  using expander = int[];
+  (void)expander{0, (tables.decode[Routes::kId] = &DenseDecode<Derived, Routes>,
+                     tables.handle[Routes::kId] =
+                         &DenseHandleOne<Derived, Routes>,
+                     0)...};
+  return tables;
+}
+
+template <typename Derived, typename... Routes>
+struct DenseTableHolder {
+  static constexpr DenseTables<DenseRouteIds<Routes...>::kMax + 1> kTables =
+      BuildDenseTables<Derived, Routes...>();
+};
+
+template <typename... Routes>
+constexpr PacketId DenseRouteIds<Routes...>::kIds[];
+
+template <typename Derived, typename... Routes>
+constexpr DenseTables<DenseRouteIds<Routes...>::kMax + 1>
+    DenseTableHolder<Derived, Routes...>::kTables;
+
+}  // namespace detail
+
+/**
+ * @brief PacketHandler for a protocol whose ids are small integers: a table
+ *        indexed by packet id, built at compile time, both decodes and
+ *        dispatches each frame.
+ *
+ * Derive as
+ * `class Mine : public DensePacketHandler<Mine, PacketRoute<1, ChatPacket,
+ * ChatSerializer>, PacketRoute<2, MovePacket, MoveSerializer>>` and define
+ * OnPacket overloads exactly as for PacketHandler. Codec::Deserialize hands a
+ * frame whose id has a route straight to its slot, which reads the packet
+ * with that route's serializer and calls OnPacket, without looking the id up
+ * in the codec or the packet's type up here: one bounds check and one indirect
+ * call per packet, against a hash lookup and a virtual call for each with
+ * PacketHandler. With serializers that decode in place (see PacketRoute) it
+ * allocates nothing per packet either.
+ *
+ * Ids without a route still go through the codec's own serializers, and from
+ * there to Handle(), which drops them the way PacketHandler drops an unlisted
+ * type. The codec still needs every route's serializer to send with; add them
+ * with RegisterSerializers().
+ */
+template <typename Derived, typename... Routes>
+class DensePacketHandler : public PacketHandlerBase {
+  using Ids = detail::DenseRouteIds<Routes...>;
+  static_assert(sizeof...(Routes) > 0, "a DensePacketHandler needs routes");
+  static_assert(Ids::kMax <= detail::kMaxDensePacketId,
+                "packet ids too large for a dense table; use PacketHandler");
+  static_assert(detail::DistinctPacketIds(Ids::kIds + 1, Ids::kCount),
+                "two routes share a packet id");
+  using Holder = detail::DenseTableHolder<Derived, Routes...>;
+
+ public:
+  static constexpr size_t kTableSize = Ids::kMax + 1;
+
+  DensePacketHandler() { SetDenseTable(Holder::kTables.decode, kTableSize); }
+
+  void Handle(std::shared_ptr<Packet> p) override {
+    const PacketId id = p->id();
+    if (id < kTableSize && Holder::kTables.handle[id] != nullptr) {
+      Holder::kTables.handle[id](*this, p);
+    }
   }
 
+  /** @brief Adds every route's serializer to `codec`, for sending. */
+  static void RegisterSerializers(Codec& codec);
 };
 
 /**
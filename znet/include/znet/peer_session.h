@@ -20,9 +20,12 @@
 #include "znet/outbound_queue.h"
 #include "znet/packet_handler.h"
 #include "znet/send_options.h"
+#include "znet/shared_message.h"
 #include "znet/task.h"
 #include "znet/transport.h"
 
+#include <atomic>
+#include <limits>
 #include <vector>
 
 namespace znet {
@@ -125,12 +128,29 @@ class PeerSession {
    */
   Result SendPacket(std::shared_ptr<Packet> packet, SendOptions options = {});
 
+  /**
+   * @brief SendPacket() for a message other sessions are sending too, which
+   *        is serialized and compressed once between them. Any thread.
+   *
+   * What Server::Broadcast() queues to each recipient; for an application
+   * keeping its own list of sessions to send to. Ordered with this session's
+   * SendPacket()s like any other send.
+   *
+   * @return as SendPacket(), and InvalidArgument for a message without a
+   *         packet.
+   */
+  Result SendShared(std::shared_ptr<SharedMessage> message,
+                    SendOptions options = {});
+
   /**
    * @brief Encodes and sends whatever SendPacket() has queued.
    *
    * Any thread may call this. Exactly one encodes a session at a time, so
    * ordering holds whichever one drains.
    *
+   * Consecutive packets with the same SendOptions go out bundled into one
+   * message, as far as TransportLayer::BundleBudget() allows.
+   *
    * @return whether anything was encoded, so a caller can skip waking the
    *         thread that flushes when there was nothing to flush.
    */
@@ -185,15 +205,68 @@ class PeerSession {
   void ReleaseHandler() { handler_.reset(); }
 
   /**
-   * @brief Registers a callback fired when an idle session is sent to, so the
-   *        owning worker encodes without waiting out its tick.
+   * @brief Registers the callback Wake() fires, so the owner processes this
+   *        session without waiting out its tick.
    *
-   * Set by the server before it hands the session to the application, and never
-   * replaced, so SendPacket() can read it without synchronizing. A session
-   * driven directly, as a client's is, needs none.
+   * Set once and never replaced. The backend already knows the session by
+   * then and may be waking it from its own thread, so the callback is
+   * published atomically rather than assigned under that thread's feet. A
+   * session driven directly, as a client's is, needs none.
    */
-  void SetWakeCallback(std::function<void()> wake) {
-    outbound_.SetWakeCallback(std::move(wake));
+  void SetWakeCallback(std::function<void()> wake);
+
+  /**
+   * @brief Tells the owner this session has work. Any thread.
+   *
+   * Backends call it when data arrives for the session, SendPacket() when an
+   * idle session is sent to, and Close() so the owner notices the death.
+   * Does nothing until SetWakeCallback() has been called.
+   */
+  void Wake();
+
+  /**
+   * @brief When this session next needs a Process() with nothing arriving.
+   *        Internal; from the thread that drives Process(), after it.
+   *
+   * The transport's timers, or now when the last pass left work behind: the
+   * receive cap cut it short, or packets are still queued. See
+   * TransportLayer::NextDeadline().
+   */
+  ZNET_NODISCARD std::chrono::steady_clock::time_point NextDeadline() const;
+
+  /**
+   * @brief Claims this session's place on its owner's ready list. Internal.
+   *
+   * True for exactly one caller until the owner takes the session off again
+   * with ClearQueued(), so a session is listed once however often it wakes.
+   */
+  bool TryQueue() {
+    return !queued_.exchange(true, std::memory_order_acq_rel);
+  }
+  void ClearQueued() { queued_.store(false, std::memory_order_release); }
+
+  /**
+   * @brief The deadline the owner last filed this session's timer under, or
+   *        the far future when none is pending. Internal, owner thread only:
+   *        any other timer entry for the session is stale.
+   */
+  ZNET_NODISCARD std::chrono::steady_clock::time_point scheduled_deadline() const {
+    return scheduled_deadline_;
+  }
+  void set_scheduled_deadline(std::chrono::steady_clock::time_point deadline) {
+    scheduled_deadline_ = deadline;
+  }
+
+  /**
+   * @brief Which of its owner's workers drives this session, or an index past
+   *        the last one before it is handed to any. Internal; set once by the
+   *        owner before the application sees the session.
+   */
+  ZNET_NODISCARD size_t worker_index() const {
+    return worker_index_.load(std::memory_order_relaxed);
+  }
+  void set_worker_index(size_t index) {
+    worker_index_.store(index, std::memory_order_relaxed);
   }
 
   /**
@@ -251,6 +324,22 @@ class PeerSession {
    */
   ZNET_NODISCARD uint64_t invalid_frames() const { return invalid_frames_; }
 
+  /**
+   * @brief The AEAD the handshake settled on. CipherSuite::None on an
+   *        unencrypted session, or before the session is ready.
+   */
+  ZNET_NODISCARD CipherSuite cipher_suite() const {
+    return encryption_layer_.cipher_suite();
+  }
+
+  /**
+   * @brief The ID of the compression dictionary the handshake settled on, 0
+   *        when the session compresses without one.
+   */
+  ZNET_NODISCARD uint32_t compression_dictionary_id() const {
+    return dictionary_id_;
+  }
+
   /**
    * @brief Derives bytes unique to this session, for binding an application
    *        credential to it.
@@ -340,6 +429,15 @@ class PeerSession {
     negotiated_compression_ = type;
   }
 
+  // the dictionary ID this end offers at handshake, 0 without a dictionary
+  ZNET_NODISCARD uint32_t offered_dictionary_id() const;
+  // settles on the dictionary `id` names, 0 for none. False when it is not
+  // this end's own, which only a misbehaving peer would name.
+  bool SetNegotiatedDictionary(uint32_t id);
+
+  // where the handshake hands datagram keys, when the transport seals its own
+  TransportLayer& transport() { return *transport_layer_; }
+
   // how many messages one Process() call will deliver before yielding, so a
   // session under load cannot monopolize the worker it shares with others.
   static constexpr uint32_t kMaxReceivesPerProcess = 256;
@@ -355,6 +453,37 @@ class PeerSession {
    */
   bool EncodeAndSend(const std::shared_ptr<Packet>& packet, SendOptions options);
 
+  /**
+   * @brief Adds a packet to the message being bundled, first sending that
+   *        message if the packet cannot join it. Under the encode claim.
+   *
+   * @param budget the largest payload a bundle may grow to, from
+   *        MessagePipeline::PayloadBudget(); one packet larger than that still
+   *        goes out, on its own.
+   */
+  void Bundle(const std::shared_ptr<Packet>& packet, SendOptions options,
+              size_t budget);
+
+  /** @brief Seals and sends the message being bundled, if there is one. */
+  void SendBundle();
+
+  /** @brief Seals a serialized payload and hands it to the transport. */
+  bool SealAndSend(std::shared_ptr<Buffer> payload, SendOptions options,
+                   uint32_t packets);
+
+  /** @brief EncodeAndSend() for a SharedMessage. Under the encode claim. */
+  bool EncodeSharedAndSend(SharedMessage& message, SendOptions options);
+
+  /** @brief Hands an encoded message to the transport, and counts it. */
+  bool Transmit(std::shared_ptr<Buffer> message, SendOptions options,
+                size_t payload_bytes, uint32_t packets);
+
+  /**
+   * @brief After a message failed to seal or send: closes the session if the
+   *        outgoing compression stream had already taken it in.
+   */
+  void AbandonMessage();
+
  protected:
   SessionId id_;
   std::shared_ptr<InetAddress> local_address_;
@@ -372,6 +501,7 @@ class PeerSession {
   EncryptionLayer encryption_layer_;
   SessionOptions options_;
   CompressionType negotiated_compression_ = CompressionType::None;
+  uint32_t dictionary_id_ = 0;
   bool is_initiator_;
   // published with release once the handshake settles, so a sender that reads
   // it sees the codec and keys the worker wrote beforehand. See IsReady().
@@ -386,6 +516,24 @@ class PeerSession {
   // the thread boundary on the send path: the queue, the encode claim and the
   // rule for who takes it
   OutboundQueue outbound_;
+  // the message DrainOutbound() is bundling packets into, and what they were
+  // sent with. Under the encode claim; empty whenever it is not held.
+  std::shared_ptr<Buffer> bundle_;
+  SendOptions bundle_options_;
+  uint32_t bundle_packets_ = 0;
+  // the owner's wake callback. wake_storage_ is written once, before wake_
+  // publishes it; Wake() only ever reads through wake_.
+  std::unique_ptr<std::function<void()>> wake_storage_;
+  std::atomic<const std::function<void()>*> wake_{nullptr};
+  // owner bookkeeping for a loop driving many sessions; see TryQueue(),
+  // scheduled_deadline() and worker_index()
+  std::atomic_bool queued_{false};
+  std::chrono::steady_clock::time_point scheduled_deadline_ =
+      std::chrono::steady_clock::time_point::max();
+  std::atomic<size_t> worker_index_{std::numeric_limits<size_t>::max()};
+  // the last Process() stopped at kMaxReceivesPerProcess with input possibly
+  // left, which no readiness edge will report again. thread driving Process()
+  bool backlogged_ = false;
 #if ZNET_ENABLE_METRICS
   // touched only by the thread that drives this session
   SessionMetrics metrics_;
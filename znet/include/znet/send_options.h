@@ -198,6 +198,22 @@ class SendOptions {
     return (bitmask_ & (1u << Key::id)) != 0;
   }
 
+  /**
+   * @brief The same options set, to the same values.
+   *
+   * An option left unset is not equal to the same option set to its default:
+   * the transport is free to pick that default per message.
+   */
+  constexpr bool operator==(const SendOptions& other) const {
+    return bitmask_ == other.bitmask_ &&
+           data_.reliable == other.data_.reliable &&
+           data_.ordered == other.data_.ordered &&
+           data_.channel == other.data_.channel;
+  }
+  constexpr bool operator!=(const SendOptions& other) const {
+    return !(*this == other);
+  }
+
  private:
   struct Data {
     bool reliable = true;
@@ -17,9 +17,17 @@
 #include "znet/options.h"
 #include "znet/peer_session.h"
 #include "znet/scheduler.h"
+#include "znet/session_groups.h"
 #include "znet/task.h"
 #include "znet/worker_signal.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
 namespace znet {
 
 namespace backends {
@@ -120,6 +128,89 @@ class Server : public Interface {
    */
   void SetTicksPerSecond(uint16_t tps);
 
+  /**
+   * @brief Sends `packet` to every ready session `filter` accepts, serializing
+   *        and compressing it once rather than once per session. This
+   *        function is thread-safe, and may be called from a packet handler.
+   *
+   * Only hands the packet to each worker, which fans it out to its own
+   * sessions at the start of its next pass; each recipient then encrypts and
+   * sends it with its own keys. See SharedMessage for what every recipient
+   * has to have in common. The packet must not change after this call.
+   *
+   * A session whose send queue is full misses it, as SendPacket() would have
+   * refused it. There is deliberately no count of the sessions it reached:
+   * that is only known once every worker has run, and waiting for them here
+   * is what made a broadcast from a handler able to deadlock.
+   *
+   * @param filter called on each worker for each of its sessions, so it must
+   *        be safe to call from several threads at once. Null sends to every
+   *        session.
+   * @return Result::Success once every worker has it
+   * @return Result::InvalidArgument if `packet` is null
+   */
+  Result Broadcast(std::shared_ptr<Packet> packet,
+                   std::function<bool(PeerSession&)> filter = nullptr,
+                   SendOptions options = {});
+
+  /**
+   * @brief Creates an empty session group. This function is thread-safe.
+   *
+   * A group is a set of sessions that SendToGroup() reaches with one
+   * serialized, compressed message, the way Broadcast() reaches all of them:
+   * a room, or everyone in range of something. Membership is kept by the
+   * worker that owns each session, so a send fans out on the workers without
+   * any of them locking another's sessions. A session may be in any number
+   * of groups, and leaves all of them when it disconnects.
+   *
+   * @return the new group's id. Ids are never reused, and none is zero.
+   */
+  GroupId CreateGroup();
+
+  /**
+   * @brief Empties `group` for good. Sends and adds already made still run
+   *        first. This function is thread-safe.
+   */
+  void DestroyGroup(GroupId group);
+
+  /**
+   * @brief Adds `session` to `group`. This function is thread-safe.
+   *
+   * Takes effect on the session's worker in order with the group's sends: a
+   * send made after this returns reaches the session. Adding a session twice
+   * is the same as adding it once.
+   *
+   * @return false if `session` is not one of this server's ready sessions,
+   *         or has already disconnected
+   */
+  bool AddToGroup(GroupId group, const std::shared_ptr<PeerSession>& session);
+
+  /**
+   * @brief Takes `session` out of `group`; a send made after this returns no
+   *        longer reaches it. This function is thread-safe.
+   *
+   * @return false if `session` is not one of this server's ready sessions
+   */
+  bool RemoveFromGroup(GroupId group,
+                       const std::shared_ptr<PeerSession>& session);
+
+  /**
+   * @brief Sends `packet` to every member of `group`, serializing and
+   *        compressing it once. This function is thread-safe, and may be
+   *        called from a packet handler.
+   *
+   * Group sends keep their order among themselves and after the membership
+   * changes made before them, but are not ordered with a member's own
+   * SendPacket() calls: the group's packet is queued to the member when its
+   * worker next runs, not now. A member whose send queue is full misses it.
+   * The packet must not change after this call.
+   *
+   * @return Result::Success once every worker has it, members or not
+   * @return Result::InvalidArgument if `packet` is null
+   */
+  Result SendToGroup(GroupId group, std::shared_ptr<Packet> packet,
+                     SendOptions options = {});
+
   /**
    * @brief Whether Stop() (or a fatal error) has fully torn the server down.
    *
@@ -152,12 +243,11 @@ class Server : public Interface {
   /**
    * @brief One worker's sessions, plus the size it publishes for the acceptor.
    *
-   * The published count is what lets the receive thread's wake callback skip
-   * idle workers, and SelectNextTask() pick the emptiest, without taking the
-   * lock. A stale read costs at most a spurious wake or a slightly worse
-   * placement, where locking per datagram would put the receive thread behind
-   * whichever worker is mid-tick. Every mutation goes through With(), which
-   * republishes it, so the two cannot drift.
+   * The published count is what lets SelectNextTask() pick the emptiest
+   * worker, and an empty one sleep, without taking the lock. A stale read
+   * costs at most a slightly worse placement, where locking would put the
+   * acceptor behind whichever worker is mid-tick. Every mutation goes through
+   * With(), which republishes it, so the two cannot drift.
    */
   class SessionSet {
    public:
@@ -178,6 +268,20 @@ class Server : public Interface {
     std::atomic<size_t> count_{0};
   };
 
+  /**
+   * @brief A session's next NextDeadline(), filed on its worker's heap.
+   *
+   * Stale once the session is filed again under another deadline; see
+   * PeerSession::scheduled_deadline(). Weak, so an entry for a session the
+   * worker dropped does not hold it alive until it comes due.
+   */
+  struct Timer {
+    std::chrono::steady_clock::time_point due;
+    std::weak_ptr<PeerSession> session;
+
+    bool operator>(const Timer& other) const { return due > other.due; }
+  };
+
   // Not movable or copyable: it owns a thread, a mutex and a condition
   // variable. Held by unique_ptr in tasks_ so the vector never needs to be.
   struct TaskData {
@@ -185,6 +289,14 @@ class Server : public Interface {
     SessionSet sessions_;
     std::unique_ptr<Task> task_;
     Scheduler scheduler_{120};
+    size_t index_ = 0;  // its place in tasks_, and its sessions' worker_index()
+    // worker only. The ready list is swapped in here to be walked outside the
+    // signal's mutex, keeping its capacity between ticks; the heap holds one
+    // live entry per session, soonest first.
+    std::vector<std::weak_ptr<PeerSession>> ready_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    // this worker's share of every group, and the broadcasts posted to it
+    SessionGroups groups_;
 
     TaskData() = default;
     ~TaskData() {
@@ -213,9 +325,26 @@ class Server : public Interface {
   void ProcessSessions();
   /** @brief Drops dead sessions from `sessions`, then ticks the survivors. */
   void CleanupAndProcessSessions(SessionMap& sessions);
+  /**
+   * @brief One worker tick: the sessions woken since the last one, then those
+   *        whose deadline has come. Everything else is left alone.
+   */
+  void ProcessReadySessions(TaskData& data, SessionMap& sessions);
+  /** @brief Processes one of the worker's sessions and files its next
+      deadline, or drops it if it is dead. */
+  void TickSession(TaskData& data, SessionMap& sessions,
+                   const std::shared_ptr<PeerSession>& session,
+                   std::chrono::steady_clock::time_point now);
+  /** @brief Reports a dead session's end and lets go of it. */
+  void DropSession(SessionMap& sessions, SessionMap::iterator it);
   void DisconnectPending();
   void PromoteReady(std::shared_ptr<PeerSession> session);
   void SubmitSession(TaskData& data, std::shared_ptr<PeerSession> session);
+  /**
+   * @brief The worker driving `session`, or null if it is none of ours.
+   *        Caller holds tasks_mutex_.
+   */
+  TaskData* OwnerOf(const PeerSession& session);
   TaskData* SelectNextTask();
   /** @brief Handshaking plus promoted sessions. Worker counts may lag a
       tick, which only makes the max_connections check slightly lenient. */
@@ -231,6 +360,11 @@ class Server : public Interface {
   Task task_;
 
   std::vector<std::unique_ptr<TaskData>> tasks_;
+  // held by the broadcast and group functions while they post to tasks_, and
+  // by MainProcessor() to take it on shutdown; nothing else touches tasks_
+  // off the main thread
+  std::mutex tasks_mutex_;
+  std::atomic<GroupId> next_group_{1};
   SessionMap pending_sessions_;
 };
 }  // namespace znet
@@ -0,0 +1,125 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// Internal: a private member of Server's workers, public only because that
+// member needs the complete type. Use Server's group functions instead.
+//
+// One worker's share of every session group: which of its own sessions are in
+// which group. A group send, or a broadcast, reaches each worker as one posted
+// operation and is fanned out there, over lists no other thread reads or
+// writes, so the fan-out itself takes no lock. Only handing the operation over
+// does, for as long as a push_back.
+//
+
+#ifndef ZNET_SESSION_GROUPS_H_
+#define ZNET_SESSION_GROUPS_H_
+
+#include "znet/compat.h"
+#include "znet/inet_addr.h"
+#include "znet/peer_session.h"
+#include "znet/send_options.h"
+#include "znet/shared_message.h"
+#include "znet/types.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace znet {
+
+/**
+ * @brief Group membership for the sessions one worker drives.
+ *
+ * The Post functions may be called from any thread; each queues an operation
+ * for Apply(), which the worker runs at the start of its pass. Operations run
+ * in the order they were posted, so a session added and then sent to gets the
+ * send. Everything else is the worker's alone.
+ */
+class SessionGroups {
+ public:
+  // the worker's own sessions, as Server keeps them
+  using SessionMap = std::unordered_map<std::shared_ptr<InetAddress>,
+                                        std::shared_ptr<PeerSession>>;
+
+  SessionGroups() = default;
+  SessionGroups(const SessionGroups&) = delete;
+  SessionGroups& operator=(const SessionGroups&) = delete;
+
+  /**
+   * @return true when nothing was queued before it, so the worker may be
+   *         asleep and needs waking; the same for every Post function.
+   */
+  bool PostAdd(GroupId group, std::shared_ptr<PeerSession> session);
+  bool PostRemove(GroupId group, std::shared_ptr<PeerSession> session);
+  bool PostDestroy(GroupId group);
+  bool PostSend(GroupId group, std::shared_ptr<SharedMessage> message,
+                SendOptions options);
+  /** @brief Sends to every one of the worker's sessions `filter` keeps. */
+  bool PostBroadcast(std::shared_ptr<SharedMessage> message,
+                     std::function<bool(PeerSession&)> filter,
+                     SendOptions options);
+
+  /**
+   * @brief Runs every posted operation. Worker only, with `sessions` the
+   *        worker's own, which a broadcast walks.
+   */
+  void Apply(const SessionMap& sessions);
+
+  /** @brief Takes a dropped session out of its groups. Worker only. */
+  void Forget(PeerSession& session);
+
+  /** @brief This worker's members of `group`. Worker only. */
+  ZNET_NODISCARD size_t members(GroupId group) const;
+
+ private:
+  enum class OpType { Add, Remove, Destroy, Send, Broadcast };
+
+  struct Op {
+    OpType type;
+    GroupId group;
+    std::shared_ptr<PeerSession> session;
+    std::shared_ptr<SharedMessage> message;
+    SendOptions options;
+    std::function<bool(PeerSession&)> filter;
+  };
+
+  // a vector to walk and an index to find a member in it, so neither a send
+  // nor a removal has to search
+  struct Group {
+    std::vector<std::shared_ptr<PeerSession>> members;
+    std::unordered_map<PeerSession*, size_t> index;
+  };
+
+  bool Post(Op op);
+  void Add(GroupId group, std::shared_ptr<PeerSession> session);
+  void Remove(GroupId group, PeerSession& session);
+  void Destroy(GroupId group);
+  void Send(GroupId group, const std::shared_ptr<SharedMessage>& message,
+            SendOptions options);
+  // drops `session` from group `id` and `id` from the session's own list
+  void Erase(GroupId id, Group& group, PeerSession& session);
+
+  std::mutex mutex_;
+  std::vector<Op> posted_;  // guarded by mutex_
+  // worker only. posted_ is swapped in here to be run outside the mutex,
+  // keeping both vectors' capacity between passes
+  std::vector<Op> applying_;
+  std::unordered_map<GroupId, Group> groups_;
+  // the groups each member is in, so a dropped session leaves all of them
+  // without a walk over every group
+  std::unordered_map<PeerSession*, std::vector<GroupId>> memberships_;
+};
+
+}  // namespace znet
+
+#endif  // ZNET_SESSION_GROUPS_H_
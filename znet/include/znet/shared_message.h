@@ -0,0 +1,97 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+//
+// One packet on its way to many sessions. Serializing and compressing it is the
+// same work for each of them, so it is done once and the bytes are kept here;
+// only the encryption, whose keys and counters are per session, is repeated.
+//
+
+#ifndef ZNET_SHARED_MESSAGE_H_
+#define ZNET_SHARED_MESSAGE_H_
+
+#include "znet/buffer.h"
+#include "znet/compat.h"
+#include "znet/compression.h"
+#include "znet/packet.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace znet {
+
+class MessagePipeline;
+
+/**
+ * @brief A packet queued to many sessions, encoded once for all of them that
+ *        compress alike. See Server::Broadcast() and PeerSession::SendShared().
+ *
+ * Nothing is encoded when it is built. Whichever recipient reaches it first
+ * serializes and compresses it, on the thread draining that session, and
+ * leaves the payload here for the rest; each then only encrypts and sends. So
+ * the work lands on the workers that own the sessions, not on the thread that
+ * broadcast.
+ *
+ * Every recipient is assumed to frame the packet the same way, as sessions
+ * speaking one protocol do: it is serialized with the codec of whichever
+ * session gets to it first. A session compressing with
+ * CompressionType::ZstandardStream shares nothing, since what it produces
+ * depends on every message before, and encodes the packet for itself.
+ *
+ * @par Threading
+ * Thread-safe. The packet must not change once this is built.
+ */
+class SharedMessage {
+ public:
+  explicit SharedMessage(std::shared_ptr<Packet> packet)
+      : packet_(std::move(packet)) {}
+
+  SharedMessage(const SharedMessage&) = delete;
+  SharedMessage& operator=(const SharedMessage&) = delete;
+
+  ZNET_NODISCARD const std::shared_ptr<Packet>& packet() const {
+    return packet_;
+  }
+
+ private:
+  friend class MessagePipeline;
+
+  // everything besides the packet that decides the compressed bytes
+  struct Key {
+    CompressionType compression;
+    const CompressionDictionary* dictionary;
+    size_t threshold;
+
+    bool operator==(const Key& other) const {
+      return compression == other.compression &&
+             dictionary == other.dictionary && threshold == other.threshold;
+    }
+  };
+
+  struct Encoding {
+    Key key;
+    // serialized and compressed, never written to again
+    std::shared_ptr<const Buffer> payload;
+    size_t payload_bytes;  // serialized, before compression; for the metrics
+  };
+
+  std::shared_ptr<Packet> packet_;
+  // held while an encoding is made, so a second session after the same one
+  // waits for it rather than repeating it
+  std::mutex mutex_;
+  // one per Key among the recipients, which for one server is nearly always
+  // one
+  std::vector<Encoding> encodings_;
+};
+
+}  // namespace znet
+
+#endif  // ZNET_SHARED_MESSAGE_H_
@@ -0,0 +1,201 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#ifndef ZNET_SPSC_QUEUE_H_
+#define ZNET_SPSC_QUEUE_H_
+
+#include "znet/compat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace znet {
+
+/**
+ * @brief One-producer, one-consumer queue, bounded by a count.
+ *
+ * Neither side ever waits for the other: each owns one cursor, publishes it
+ * with a release store and reads the other's with an acquire load. Nothing is
+ * locked and nothing is retried.
+ *
+ * Storage is a circle of fixed-size blocks rather than one ring. A ring sized
+ * for the limit would commit all of it up front, which for a per-connection
+ * queue with a generous limit is most of the memory a connection uses. Here a
+ * burst adds a block when the producer finds the next one still unread, and
+ * the blocks stay in the circle afterwards, so a queue grows to its high-water
+ * mark once and then stops allocating.
+ *
+ * Only one thread may produce and one consume. Nothing checks that.
+ *
+ * @tparam T must be default-constructible and move-assignable. Popping moves
+ *         out of the slot, so a T owning a resource releases it there rather
+ *         than holding it until the slot is written a lap later.
+ */
+template <typename T>
+class SpscQueue {
+ public:
+  /**
+   * @brief An empty queue holding at most `limit` items, allocated
+   *        `block_size` slots at a time.
+   *
+   * @param block_size rounded up to a power of two, minimum two.
+   */
+  explicit SpscQueue(size_t limit, size_t block_size = 32)
+      : limit_(limit), block_size_(RoundUpPowerOfTwo(block_size)) {
+    Block* first = new Block(block_size_);
+    first->next = first;
+    tail_block_ = first;
+    head_block_ = first;
+    tail_.value.store(0, std::memory_order_relaxed);
+    head_.value.store(0, std::memory_order_relaxed);
+  }
+
+  ~SpscQueue() {
+    Block* block = tail_block_->next;
+    while (block != tail_block_) {
+      Block* next = block->next;
+      delete block;
+      block = next;
+    }
+    delete tail_block_;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /**
+   * @brief Appends one value. Producer only.
+   *
+   * @param value moved into the queue on success, left alone on failure.
+   * @return false when `limit` items are already queued.
+   */
+  bool Push(T&& value) {
+    const size_t pos = tail_.value.load(std::memory_order_relaxed);
+    if (pos - head_.value.load(std::memory_order_acquire) >= limit_) {
+      return false;
+    }
+    const size_t mask = block_size_ - 1;
+    if ((pos & mask) == 0 && pos != 0) {
+      EnterNextBlock(pos);
+    }
+    tail_block_->slots[pos & mask] = std::move(value);
+    // release: the consumer must see the slot, and any block linked in for
+    // it, before it sees the position
+    tail_.value.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @brief Takes the oldest value. Consumer only. False when empty. */
+  bool Pop(T& out) {
+    const size_t pos = head_.value.load(std::memory_order_relaxed);
+    if (pos == tail_.value.load(std::memory_order_acquire)) {
+      return false;
+    }
+    const size_t mask = block_size_ - 1;
+    if ((pos & mask) == 0 && pos != 0) {
+      // the producer linked this in before publishing the position
+      head_block_ = head_block_->next;
+    }
+    out = std::move(head_block_->slots[pos & mask]);
+    // release: the producer must not reuse the slot before the move out of it
+    // has finished
+    head_.value.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Appends everything queued to `out`, oldest first. Consumer only.
+   *
+   * @tparam Container anything with push_back(T&&).
+   * @return how many were taken.
+   */
+  template <typename Container>
+  size_t DrainTo(Container& out) {
+    size_t taken = 0;
+    T value;
+    while (Pop(value)) {
+      out.push_back(std::move(value));
+      taken++;
+    }
+    return taken;
+  }
+
+  /** @brief A sample of the depth; exact only when neither side is moving. */
+  ZNET_NODISCARD size_t size() const {
+    const size_t head = head_.value.load(std::memory_order_acquire);
+    return tail_.value.load(std::memory_order_acquire) - head;
+  }
+
+  ZNET_NODISCARD bool Empty() const { return size() == 0; }
+
+  ZNET_NODISCARD size_t limit() const { return limit_; }
+
+ private:
+  static size_t RoundUpPowerOfTwo(size_t value) {
+    size_t slots = 2;
+    while (slots < value) {
+      slots <<= 1;
+    }
+    return slots;
+  }
+
+  struct Block {
+    explicit Block(size_t size) : slots(new T[size]) {}
+    std::unique_ptr<T[]> slots;
+    // the position slots[0] held on the producer's last pass through here.
+    // producer only
+    size_t base = 0;
+    // written by the producer only, before it publishes the first position
+    // past this block; the consumer follows it after acquiring that position
+    Block* next = nullptr;
+  };
+
+  // as MpscQueue's: a line each, the padding leading so the sizes both
+  // sides read sit apart from either cursor
+  static constexpr size_t kCacheLine = 64;
+  struct Cursor {
+    char padding[kCacheLine];
+    std::atomic<size_t> value;
+  };
+
+  // the producer has filled tail_block_ and `pos` starts the next one. Reuses
+  // the block after it when the consumer has left that block behind, and
+  // otherwise links in a fresh one between the two.
+  void EnterNextBlock(size_t pos) {
+    Block* next = tail_block_->next;
+    // free once the consumer has taken an item past it: its last slot being
+    // read is not enough, since the consumer reads `next` only when it moves
+    // on. The circle's only block is never free, as the consumer is in it.
+    if (next == tail_block_ ||
+        head_.value.load(std::memory_order_acquire) <= next->base + block_size_) {
+      Block* fresh = new Block(block_size_);
+      fresh->next = next;
+      tail_block_->next = fresh;
+      next = fresh;
+    }
+    next->base = pos;
+    tail_block_ = next;
+  }
+
+  const size_t limit_;
+  const size_t block_size_;
+  // each side's block pointer shares the line of the cursor it advances
+  Cursor tail_;        // the producer advances this
+  Block* tail_block_;  // producer only
+  Cursor head_;        // the consumer advances this
+  Block* head_block_;  // consumer only
+};
+
+}  // namespace znet
+
+
+#endif  // ZNET_SPSC_QUEUE_H_
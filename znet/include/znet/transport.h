@@ -13,13 +13,34 @@
 #define ZNET_TRANSPORT_H_
 
 #include "znet/buffer.h"
+#include "znet/cipher_suite.h"
 #include "znet/close_options.h"
 #include "znet/compat.h"
 #include "znet/metrics.h"
 #include "znet/send_options.h"
 
+#include <chrono>
+
 namespace znet {
 
+/**
+ * @brief Key and nonce salt per direction, for a transport that seals whole
+ *        datagrams. See TransportLayer::InstallDatagramKeys().
+ *
+ * Derived from the session's key exchange under labels of their own, so they
+ * share nothing with the keys the session encrypts single messages with: the
+ * two nonce spaces would otherwise overlap.
+ */
+struct DatagramKeys {
+  /** @brief The session's negotiated suite; AES-128-GCM keys use the first
+   *         16 bytes. */
+  CipherSuite suite = CipherSuite::Aes256Gcm;
+  unsigned char tx_key[32] = {};
+  unsigned char tx_salt[4] = {};
+  unsigned char rx_key[32] = {};
+  unsigned char rx_salt[4] = {};
+};
+
 /**
  * @brief Moves encoded bytes between a session and the wire.
  *
@@ -56,6 +77,41 @@ class TransportLayer {
     return 0;
   }
 
+  /**
+   * @brief Offers the transport the session's datagram keys, once the key
+   *        exchange has settled. Worker thread only.
+   *
+   * A transport that seals its own datagrams starts opening the peer's sealed
+   * ones straight away, and from then on drops the messages of any datagram
+   * that is not. It does not seal its own until StartSealing(): the peer may
+   * not hold the keys yet.
+   *
+   * @return Whether the transport took them. The default declines, and the
+   *         session goes on encrypting every message itself.
+   */
+  virtual bool InstallDatagramKeys(const DatagramKeys& keys) {
+    (void)keys;
+    return false;
+  }
+
+  /**
+   * @brief Seals every datagram built from here on with the keys above.
+   *        Worker thread only.
+   *
+   * The session calls it once the peer is known to hold its keys, before it
+   * sends the first message that relies on it.
+   */
+  virtual void StartSealing() {}
+
+  /**
+   * @brief Whether the message Receive() last returned arrived only in
+   *        datagrams this transport authenticated. Worker thread only.
+   *
+   * The session accepts a message it did not encrypt itself only when this
+   * holds, so an unsealed datagram cannot pass one off as sealed.
+   */
+  virtual bool LastReceiveSealed() const { return false; }
+
   /** @brief Shuts the transport down. Callable from any thread. */
   virtual Result Close(CloseOptions options = {}) = 0;
 
@@ -76,6 +132,55 @@ class TransportLayer {
    */
   virtual void Flush() = 0;
 
+  /**
+   * @brief Ends a run of Send()s made by one drain of the session's queue.
+   *
+   * Called by whichever thread drained, right after it finished, which need
+   * not be the worker: a client's encoder drains on its own thread. A
+   * transport that stages sends to write them together pushes them out here,
+   * so staging never waits on a loop that may be asleep, and must be
+   * thread-safe to do so. The default does nothing, for transports whose
+   * Flush() does the sending.
+   */
+  virtual void EndSendBatch() {}
+
+  /**
+   * @brief How large an encoded message the session may build by bundling
+   *        queued packets together, or 0 to send each packet as its own.
+   *
+   * Bundling pays for a message's compression header, encryption nonce and
+   * tag and transport framing once for a run of small packets. A bundle
+   * larger than what the transport carries in one piece, one TCP frame or
+   * one unfragmented ZDT datagram, gives that back and more, so only the
+   * transport can say where to stop. Called by whichever thread drains the
+   * session's queue, so it must be thread-safe. The default declines.
+   */
+  virtual size_t BundleBudget() const { return 0; }
+
+  /**
+   * @brief The largest message Send() accepts, or 0 for no fixed limit.
+   *
+   * A session compressing into a stream checks against this before it
+   * compresses: the stream keeps every message it takes in, so one that Send()
+   * then refused would leave it out of step with the peer's. Called by
+   * whichever thread drains the session's queue, so it must be thread-safe.
+   */
+  virtual size_t MaxMessageSize() const { return 0; }
+
+  /**
+   * @brief When Update() next has something to do with nothing arriving: a
+   *        keepalive, an idle timeout, a retransmit, an ack still owed.
+   *        Worker thread only, after Update()/Flush().
+   *
+   * An owner driving many sessions ticks each one only when it is woken or
+   * this comes due, so an answer too late silently delays a timer. The
+   * default, the distant past, is always due: a transport that does not say
+   * is ticked every time, as it would be by a plain loop.
+   */
+  virtual std::chrono::steady_clock::time_point NextDeadline() const {
+    return std::chrono::steady_clock::time_point::min();
+  }
+
   /**
    * @brief Copies this transport's counters into `out`.
    *
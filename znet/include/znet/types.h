@@ -14,6 +14,7 @@
 #include "znet/compat.h"
 #include "znet/detail/platform.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -26,6 +27,8 @@ namespace znet {
 
 // 64 bits might be an overkill here but meh
 using SessionId = uint64_t;
+// names a session group; see Server::CreateGroup()
+using GroupId = uint32_t;
 
 enum class Endianness { LittleEndian, BigEndian };
 
@@ -174,6 +177,12 @@ struct IPv6Address {
   uint8_t bytes[16];
 };
 
+/** @brief One piece of a vectored send, or one datagram of a batched one. */
+struct SocketSlice {
+  const void* data;
+  size_t len;
+};
+
 /** @brief Whether a socket call returned a usable handle. */
 inline bool IsValidSocketHandle(SocketHandle handle) {
 #ifdef ZNET_TARGET_WIN
@@ -23,11 +23,15 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace znet {
 
+class PeerSession;
+
 struct WorkerSignal {
   std::mutex mutex;
   std::condition_variable cv;
@@ -39,6 +43,11 @@ struct WorkerSignal {
   // and setting the flag would skip the rest of the tick and spin for as long
   // as the session had traffic.
   std::atomic<std::thread::id> owner{};
+  // for a loop driving many sessions: the ones that asked for a pass since it
+  // last looked, so it can skip the rest. guarded by `mutex`. weak, so a
+  // listed session never keeps itself, or the signal its callback holds,
+  // alive.
+  std::vector<std::weak_ptr<PeerSession>> ready;
 
   /**
    * @brief Ends the sleep unless called from the loop's own thread.
@@ -58,6 +67,27 @@ struct WorkerSignal {
     }
     cv.notify_one();
   }
+
+  /**
+   * @brief Lists `session` as ready, then ends the sleep as Raise() does.
+   *
+   * Listed even from the loop's own thread, where nothing is woken: work a
+   * session queues for itself mid-pass still needs the next pass.
+   */
+  void RaiseFor(std::weak_ptr<PeerSession> session) {
+    const bool own =
+        std::this_thread::get_id() == owner.load(std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ready.push_back(std::move(session));
+      if (!own) {
+        woken.store(true, std::memory_order_relaxed);
+      }
+    }
+    if (!own) {
+      cv.notify_one();
+    }
+  }
 };
 
 }  // namespace znet
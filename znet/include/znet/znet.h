@@ -33,6 +33,7 @@
 #include "znet/peer_session.h"
 #include "znet/server.h"
 #include "znet/server_events.h"
+#include "znet/shared_message.h"
 #include "znet/types.h"
 
 #endif  // ZNET_ZNET_H_
@@ -0,0 +1,277 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#include "znet/backends/readiness_poller.h"
+
+#include "znet/detail/socket_ops.h"
+#include "znet/error.h"
+#include "znet/logger.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef ZNET_TARGET_LINUX
+#include <sys/epoll.h>
+#endif
+
+namespace znet {
+namespace backends {
+
+namespace {
+
+#ifdef ZNET_TARGET_LINUX
+
+// Edge-triggered, so a socket is reported once per arrival rather than for as
+// long as it stays readable, and Rearm() has nothing to do. The kernel keeps
+// the set: registering and removing are one syscall each, and a wait costs the
+// number of ready sockets rather than the number watched.
+class EpollReadinessPoller : public ReadinessPoller {
+ public:
+  EpollReadinessPoller() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+
+  ~EpollReadinessPoller() override {
+    if (epoll_fd_ >= 0) {
+      close(epoll_fd_);
+    }
+  }
+
+  bool IsValid() const { return epoll_fd_ >= 0; }
+
+  bool Add(SocketHandle socket, uint64_t token) override {
+    epoll_event event{};
+    // RDHUP so a peer's shutdown wakes the reader even with nothing to read
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = token;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &event) != 0) {
+      ZNET_LOG_ERROR("Failed to watch socket {}: {}", socket,
+                     GetLastErrorInfo());
+      return false;
+    }
+    count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void Remove(SocketHandle socket) override {
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, nullptr) == 0) {
+      count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  void Rearm(SocketHandle socket) override {
+    (void)socket;  // edge-triggered: the next arrival reports by itself
+  }
+
+  size_t Wait(std::vector<uint64_t>& ready,
+              std::chrono::milliseconds timeout) override {
+    const int count = epoll_wait(epoll_fd_, events_.data(),
+                                 static_cast<int>(events_.size()),
+                                 static_cast<int>(timeout.count()));
+    if (count <= 0) {
+      return 0;  // a timeout, or EINTR; either way the caller loops
+    }
+    for (int i = 0; i < count; i++) {
+      ready.push_back(events_[static_cast<size_t>(i)].data.u64);
+    }
+    return static_cast<size_t>(count);
+  }
+
+  size_t size() const override {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const int epoll_fd_;
+  std::atomic<size_t> count_{0};
+  // Wait() thread only. More ready sockets than this are simply picked up by
+  // the next call, which returns at once.
+  std::array<epoll_event, 256> events_{};
+};
+
+#endif  // ZNET_TARGET_LINUX
+
+// how long the portable poller waits while any socket is out for a rearm
+constexpr std::chrono::milliseconds kPollRearmLatency{1};
+
+// poll() has no edge mode, so it is emulated: a reported socket leaves the
+// polled set until its reader rearms it. Otherwise a socket with unread bytes
+// would return poll() immediately, over and over, until a worker drained it.
+//
+// The pollfd array is rebuilt only when the set changed, not on every wait.
+// poll() itself is still linear in the sockets watched; that is the price of
+// the portable path.
+class PollReadinessPoller : public ReadinessPoller {
+ public:
+  bool Add(SocketHandle socket, uint64_t token) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(socket) != 0) {
+      return false;
+    }
+    index_[socket] = entries_.size();
+    entries_.push_back(Entry{socket, token, true});
+    dirty_ = true;
+    return true;
+  }
+
+  void Remove(SocketHandle socket) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EraseLocked(socket);
+  }
+
+  void Rearm(SocketHandle socket) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(socket);
+    if (it == index_.end()) {
+      return;
+    }
+    Entry& entry = entries_[it->second];
+    if (!entry.armed) {
+      entry.armed = true;
+      disarmed_--;
+      dirty_ = true;
+    }
+  }
+
+  size_t Wait(std::vector<uint64_t>& ready,
+              std::chrono::milliseconds timeout) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (dirty_) {
+        fds_.clear();
+        for (const Entry& entry : entries_) {
+          if (!entry.armed) {
+            continue;
+          }
+          pollfd fd{};
+          fd.fd = entry.socket;
+          fd.events = POLLIN;
+          fds_.push_back(fd);
+        }
+        dirty_ = false;
+      }
+      // a rearm cannot interrupt a poll() already in progress, so while
+      // anything is waiting on one the wait is kept short; this bounds how
+      // long freshly arrived data on a rearmed socket goes unnoticed
+      if (disarmed_ > 0) {
+        timeout = std::min(timeout, kPollRearmLatency);
+      }
+    }
+    if (fds_.empty()) {
+      // WSAPoll refuses an empty set rather than sleeping on it
+      std::this_thread::sleep_for(timeout);
+      return 0;
+    }
+#ifdef ZNET_TARGET_WIN
+    const int count = WSAPoll(fds_.data(), static_cast<ULONG>(fds_.size()),
+                              static_cast<INT>(timeout.count()));
+#else
+    const int count = poll(fds_.data(), static_cast<nfds_t>(fds_.size()),
+                           static_cast<int>(timeout.count()));
+#endif
+    if (count <= 0) {
+      return 0;
+    }
+    size_t reported = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const pollfd& fd : fds_) {
+      if (fd.revents == 0) {
+        continue;
+      }
+      if ((fd.revents & POLLNVAL) != 0) {
+        // closed without a Remove(); stop watching the number before
+        // something else in the process reuses it
+        EraseLocked(fd.fd);
+        continue;
+      }
+      if ((fd.revents & (POLLIN | POLLERR | POLLHUP)) == 0) {
+        continue;
+      }
+      // the set may have changed while poll() ran; a socket removed in the
+      // meantime has no entry left to report
+      auto it = index_.find(fd.fd);
+      if (it == index_.end()) {
+        continue;
+      }
+      Entry& entry = entries_[it->second];
+      if (!entry.armed) {
+        continue;
+      }
+      entry.armed = false;
+      disarmed_++;
+      dirty_ = true;
+      ready.push_back(entry.token);
+      reported++;
+    }
+    return reported;
+  }
+
+  size_t size() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    SocketHandle socket;
+    uint64_t token;
+    bool armed;
+  };
+
+  void EraseLocked(SocketHandle socket) {
+    auto it = index_.find(socket);
+    if (it == index_.end()) {
+      return;
+    }
+    const size_t slot = it->second;
+    if (!entries_[slot].armed) {
+      disarmed_--;
+    }
+    index_.erase(it);
+    // swap-and-pop keeps removal O(1); the moved entry gets its new slot
+    if (slot + 1 != entries_.size()) {
+      entries_[slot] = entries_.back();
+      index_[entries_[slot].socket] = slot;
+    }
+    entries_.pop_back();
+    dirty_ = true;
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::unordered_map<SocketHandle, size_t> index_;  // socket -> entries_ slot
+  size_t disarmed_ = 0;
+  bool dirty_ = false;
+  // Wait() thread only
+  std::vector<pollfd> fds_;
+};
+
+}  // namespace
+
+std::shared_ptr<ReadinessPoller> ReadinessPoller::Create(Kind kind) {
+#ifdef ZNET_TARGET_LINUX
+  if (kind == Kind::Default) {
+    auto epoll = std::make_shared<EpollReadinessPoller>();
+    if (epoll->IsValid()) {
+      return epoll;
+    }
+    ZNET_LOG_WARN("epoll is unavailable ({}), falling back to poll.",
+                  GetLastErrorInfo());
+  }
+#else
+  (void)kind;
+#endif
+  return std::make_shared<PollReadinessPoller>();
+}
+
+}  // namespace backends
+}  // namespace znet
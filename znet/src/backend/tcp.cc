@@ -18,6 +18,7 @@
 #include "znet/util.h"
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstring>
 #include <thread>
@@ -42,14 +43,33 @@ inline bool WouldBlockOnSend() {
 // the session was closed underneath it
 constexpr int kSendStallWaitMs = 50;
 
+// what a frame may take of ZNET_MAX_BUFFER_SIZE, which ReadBuffer()
+// reassembles a frame within. The slack is more than any header needs.
+constexpr size_t kFrameHeaderSlack = 48;
+constexpr size_t kFrameLimit = ZNET_MAX_BUFFER_SIZE - kFrameHeaderSlack;
+// the largest message Send() takes: two bytes of length go in front, so it
+// can say no more than 0xFFFF, and the framed size has to stay under
+// kFrameLimit. A ZNET_MAX_BUFFER_SIZE over 64 KiB is fine, it just buys
+// nothing here.
+constexpr size_t kMaxMessageSize = std::min<size_t>(kFrameLimit - 3, 0xFFFF);
+
+// how often the poll thread forgets sessions that have ended. Only memory
+// rides on it: an expired entry is never reported.
+constexpr std::chrono::seconds kWatchedSweepInterval{1};
+
 }  // namespace
 
-TCPTransportLayer::TCPTransportLayer(SocketHandle socket, CommonOptions common)
+TCPTransportLayer::TCPTransportLayer(SocketHandle socket, CommonOptions common,
+                                     TCPOptions tcp,
+                                     std::shared_ptr<ReadinessPoller> poller)
     : socket_(socket),
+      poller_(std::move(poller)),
       keepalive_interval_(common.keepalive_interval),
       idle_timeout_(common.idle_timeout),
       last_recv_(std::chrono::steady_clock::now()),
-      last_send_(std::chrono::steady_clock::now()) {
+      last_send_(std::chrono::steady_clock::now()),
+      max_write_batch_(tcp.max_write_batch),
+      bundle_messages_(tcp.bundle_messages) {
   // one reservation for the connection's lifetime; recv() is bounded by the
   // space left in it, so it never grows
   recv_buffer_.ReserveExact(ZNET_MAX_BUFFER_SIZE);
@@ -65,41 +85,52 @@ TCPTransportLayer::TCPTransportLayer(SocketHandle socket, CommonOptions common)
 TCPTransportLayer::~TCPTransportLayer() {
   // where the descriptor is released; see Close() for why not there. The
   // session owning this transport is gone by now, so no worker can be inside
-  // recv() on the socket.
+  // recv() on the socket. Unwatched first: once closed, the number is free for
+  // the next accept() to reuse, and removing it after would drop that one.
+  if (poller_) {
+    poller_->Remove(socket_);
+  }
   CloseSocket(socket_);
   socket_ = kSocketInvalid;
 }
 
 std::shared_ptr<Buffer> TCPTransportLayer::Receive() {
-  std::shared_ptr<Buffer> new_buffer;
-  if ((new_buffer = ReadBuffer())) {
-    return new_buffer;
-  }
+  // reads until there is a whole frame to hand up or the socket runs dry. A
+  // read that ends mid-frame goes straight back for the rest: returning there
+  // would leave bytes in the kernel that the readiness poller has already
+  // reported once, and an edge-triggered poller will not report them again.
+  for (;;) {
+    std::shared_ptr<Buffer> new_buffer;
+    if ((new_buffer = ReadBuffer())) {
+      return new_buffer;
+    }
+    if (IsClosed()) {
+      return nullptr;  // ReadBuffer() may have refused a frame and closed
+    }
 
-  // ReadBuffer() compacted, so everything past the write cursor is free to
-  // append into. A partial frame can never fill the reservation (see the
-  // oversize check), so there is always room to make progress.
-  ssize_t received = SocketRecv(socket_, recv_buffer_.write_cursor_data(),
-                                recv_buffer_.writable_bytes());
+    // ReadBuffer() compacted, so everything past the write cursor is free to
+    // append into. A partial frame can never fill the reservation (see the
+    // oversize check), so there is always room to make progress.
+    ssize_t received = SocketRecv(socket_, recv_buffer_.write_cursor_data(),
+                                  recv_buffer_.writable_bytes());
 
-  if (received == 0) {
-    Close();
-    return nullptr;
-  }
+    if (received == 0) {
+      Close();
+      return nullptr;
+    }
 
-  if (received > 0) {
-    last_recv_ = std::chrono::steady_clock::now();
-    ZNET_METRIC(metrics_.tcp.reads++);
-    ZNET_METRIC(metrics_.common.wire_bytes_received += static_cast<uint64_t>(received));
-    recv_buffer_.CommitWrite(static_cast<size_t>(received));
-    return ReadBuffer();
-  }
+    if (received > 0) {
+      last_recv_ = std::chrono::steady_clock::now();
+      ZNET_METRIC(metrics_.tcp.reads++);
+      ZNET_METRIC(metrics_.common.wire_bytes_received += static_cast<uint64_t>(received));
+      recv_buffer_.CommitWrite(static_cast<size_t>(received));
+      continue;
+    }
 
-  if (received == -1) {
 #ifdef ZNET_TARGET_WIN
     int err = WSAGetLastError();
     if (err == WSAEWOULDBLOCK) {
-      return nullptr; // no data received
+      break; // no data received
     }
     if (err == WSAECONNRESET) {
       ZNET_LOG_ERROR("Connection lost because peer has closed the connection.");
@@ -107,8 +138,11 @@ std::shared_ptr<Buffer> TCPTransportLayer::Receive() {
       return nullptr;
     }
 #else
+    if (errno == EINTR) {
+      continue;
+    }
     if (errno == EWOULDBLOCK || errno == EAGAIN) {
-      return nullptr; // no data received
+      break; // no data received
     }
     if (errno == ECONNRESET) {
       ZNET_LOG_ERROR("Closing connection because peer closed the connection.");
@@ -118,6 +152,11 @@ std::shared_ptr<Buffer> TCPTransportLayer::Receive() {
 #endif
     ZNET_LOG_ERROR("Closing connection due to an error: {}", GetLastErrorInfo());
     Close();
+    return nullptr;
+  }
+  // drained: only now may the poller report this socket again
+  if (poller_) {
+    poller_->Rearm(socket_);
   }
   return nullptr;
 }
@@ -223,6 +262,12 @@ bool TCPTransportLayer::WriteAll(Buffer& buffer) {
   return true;
 }
 
+size_t TCPTransportLayer::BundleBudget() const {
+  return bundle_messages_ ? kMaxMessageSize : 0;
+}
+
+size_t TCPTransportLayer::MaxMessageSize() const { return kMaxMessageSize; }
+
 bool TCPTransportLayer::Send(std::shared_ptr<Buffer> buffer, SendOptions options) {
   (void)options;  // TCP has one stream: no channels, no ordering to choose
   if (IsClosed()) {
@@ -230,8 +275,7 @@ bool TCPTransportLayer::Send(std::shared_ptr<Buffer> buffer, SendOptions options
     return false;
   }
 
-  const size_t header = 48; // usually smaller than this
-  const size_t limit = ZNET_MAX_BUFFER_SIZE - header;
+  const size_t limit = kFrameLimit;
   // the message starts at the read cursor: the send pipeline reserves headroom
   const size_t payload_size = buffer->readable_bytes();
   if (payload_size == 0) {
@@ -250,35 +294,136 @@ bool TCPTransportLayer::Send(std::shared_ptr<Buffer> buffer, SendOptions options
     return false;
   }
 
-  // straight to the socket: the session already queued on the caller's behalf,
-  // so there is nothing left to hand off. The frame goes in place when the
-  // pipeline left headroom; only a foreign buffer costs a copy.
+  // staged rather than written: the session drains its queue a message at a
+  // time, and a send() each would cost a syscall per message. The frame goes
+  // in place when the pipeline left headroom; only a foreign buffer costs a
+  // copy.
   const uint8_t high = static_cast<uint8_t>(payload_size >> 8);
   const uint8_t low = static_cast<uint8_t>(payload_size & 0xFF);
   if (buffer->read_cursor() >= 2) {
     buffer->PrependInt8(low);
     buffer->PrependInt8(high);
-    if (!WriteAll(*buffer)) {
-      ZNET_LOG_ERROR("TCPTransport::WriteAll failed, socket={}", socket_);
-      return false;
+  } else {
+    auto framed = std::make_shared<Buffer>();
+    framed->ReserveExact(new_size);
+    framed->WriteInt<uint8_t>(high);
+    framed->WriteInt<uint8_t>(low);
+    framed->Write(buffer->read_cursor_data(), payload_size);
+    buffer = std::move(framed);
+  }
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock(stage_mutex_);
+    staged_bytes_ += buffer->readable_bytes();
+    staged_.push_back(std::move(buffer));
+    full = staged_bytes_ >= max_write_batch_;
+  }
+  // a full batch goes now instead of growing without bound; a budget of zero
+  // makes that every frame
+  if (full) {
+    FlushStaged(true);
+  }
+  return true;
+}
+
+void TCPTransportLayer::FlushStaged(bool wait) {
+  bool ok;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    {
+      std::lock_guard<std::mutex> stage_lock(stage_mutex_);
+      if (staged_.empty()) {
+        return;
+      }
+      flushing_.swap(staged_);
+      staged_bytes_ = 0;
     }
-    return true;
+    ok = WriteFrames(flushing_, wait);
+    flushing_.clear();
+  }
+  if (!ok && !IsClosed()) {
+    // part of a frame may be on the wire already, and the peer would read
+    // whatever comes next as the rest of it: the stream is unusable
+    ZNET_LOG_ERROR("TCPTransport: flushing staged frames failed, socket={}",
+                   socket_);
+    Close();
   }
-  Buffer framed;
-  framed.ReserveExact(new_size);
-  framed.WriteInt<uint8_t>(high);
-  framed.WriteInt<uint8_t>(low);
-  framed.Write(buffer->read_cursor_data(), payload_size);
-  if (!WriteAll(framed)) {
-    ZNET_LOG_ERROR("TCPTransport::WriteAll failed, socket={}", socket_);
+}
+
+bool TCPTransportLayer::WriteFrames(
+    const std::vector<std::shared_ptr<Buffer>>& frames, bool wait) {
+  std::array<SocketSlice, kMaxSocketSlices> slices;
+  size_t index = 0;   // first frame not yet fully written
+  size_t offset = 0;  // bytes of it already written
+  size_t wire_bytes = 0;
+  ZNET_METRIC(metrics_.tcp.flushes++);
+  while (index < frames.size()) {
+    // same as WriteAll(): a close from the application's thread must stop a
+    // loop stalled on a peer that stopped reading
+    if (IsClosed()) {
+      return false;
+    }
+    // one write covers as many frames as the budget holds, but always at least
+    // the current one, so a budget smaller than a frame still makes progress
+    size_t count = 0;
+    size_t batch = 0;
+    for (size_t i = index; i < frames.size() && count < slices.size(); i++) {
+      const Buffer& frame = *frames[i];
+      const size_t skip = i == index ? offset : 0;
+      const size_t len = frame.readable_bytes() - skip;
+      if (count > 0 && batch + len > max_write_batch_) {
+        break;
+      }
+      slices[count++] = SocketSlice{frame.read_cursor_data() + skip, len};
+      batch += len;
+    }
+    ssize_t written = SocketSendv(socket_, slices.data(), count);
+    if (written > 0) {
+      ZNET_METRIC(metrics_.tcp.writes++);
+      size_t left = static_cast<size_t>(written);
+      wire_bytes += left;
+      // a short write stops anywhere, mid-frame included; the next one picks
+      // up exactly there
+      while (left > 0) {
+        const size_t rest = frames[index]->readable_bytes() - offset;
+        if (left < rest) {
+          offset += left;
+          break;
+        }
+        left -= rest;
+        offset = 0;
+        index++;
+        ZNET_METRIC(metrics_.tcp.frames_sent++);
+      }
+      continue;
+    }
+    if (written < 0 && WouldBlockOnSend()) {
+      if (!wait) {
+        return false;
+      }
+      if (!WaitUntilWritable(socket_, kSendStallWaitMs)) {
+        ZNET_LOG_ERROR("Waiting on a stalled socket failed: {}",
+                       GetLastErrorInfo());
+        return false;
+      }
+      continue;
+    }
+    ZNET_LOG_ERROR("Error sending packet to the server: {}", GetLastErrorInfo());
     return false;
   }
+  last_send_ = std::chrono::steady_clock::now();
+  ZNET_METRIC(metrics_.common.wire_bytes_sent += wire_bytes);
+  (void)wire_bytes;
   return true;
 }
 
-// nothing to do: Send() writes straight to the socket, and the kernel owns
-// retransmit and pacing.
-void TCPTransportLayer::Flush() {}
+void TCPTransportLayer::Flush() {
+  FlushStaged(true);
+}
+
+void TCPTransportLayer::EndSendBatch() {
+  FlushStaged(true);
+}
 
 void TCPTransportLayer::Update() {
   if (IsClosed()) {
@@ -302,6 +447,23 @@ void TCPTransportLayer::Update() {
   }
 }
 
+std::chrono::steady_clock::time_point TCPTransportLayer::NextDeadline() const {
+  using TimePoint = std::chrono::steady_clock::time_point;
+  if (IsClosed()) {
+    return TimePoint::max();
+  }
+  // nothing else here runs on a clock: inbound data is the poller's to report
+  TimePoint due = TimePoint::max();
+  if (idle_timeout_.count() > 0) {
+    due = last_recv_ + idle_timeout_;
+  }
+  if (keepalive_interval_.count() > 0) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    due = std::min(due, last_send_ + keepalive_interval_);
+  }
+  return due;
+}
+
 void TCPTransportLayer::FillMetrics(SessionMetrics& out) const {
 #if ZNET_ENABLE_METRICS
   out.tcp = metrics_.tcp;
@@ -313,10 +475,29 @@ void TCPTransportLayer::FillMetrics(SessionMetrics& out) const {
 }
 
 Result TCPTransportLayer::Close(CloseOptions options) {
+  const bool no_linger = options.GetOr<NoLingerKey>(false);
+  if (!no_linger && !IsClosed()) {
+    // what Send() accepted is owed to the peer, so it goes out ahead of the
+    // shutdown. Only if the socket takes it now: the application's thread
+    // must not wait on a peer that stopped reading, nor on a flush already
+    // in progress, which will finish or fail by itself.
+    std::unique_lock<std::mutex> lock(write_mutex_, std::try_to_lock);
+    if (lock.owns_lock()) {
+      {
+        std::lock_guard<std::mutex> stage_lock(stage_mutex_);
+        flushing_.swap(staged_);
+        staged_bytes_ = 0;
+      }
+      if (!flushing_.empty()) {
+        WriteFrames(flushing_, false);
+        flushing_.clear();
+      }
+    }
+  }
   if (is_closed_.exchange(true, std::memory_order_acq_rel)) {
     return Result::AlreadyDisconnected;
   }
-  if (options.GetOr<NoLingerKey>(false)) {
+  if (no_linger) {
     linger l; l.l_onoff = 1; l.l_linger = 0;
     setsockopt(socket_, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&l), sizeof(l));
   }
@@ -434,7 +615,7 @@ Result TCPClientBackend::Connect() {
   wait_socket_ = client_socket_;
   client_session_ =
       std::make_shared<PeerSession>(local_address_, server_address_,
-                                    std::make_unique<TCPTransportLayer>(client_socket_, options_.common), ConnectionType::TCP, true,
+                                    std::make_unique<TCPTransportLayer>(client_socket_, options_.common, options_.tcp), ConnectionType::TCP, true,
                                     /*self_managed=*/false, options_);
   // the transport owns the descriptor now, so dropping our copy keeps
   // CleanupSocket() from closing whatever later reused that number
@@ -489,7 +670,8 @@ TCPServerBackend::TCPServerBackend(std::shared_ptr<InetAddress> bind_address,
     : child_options_(child_options),
       server_options_(server_options),
       admission_(server_options),
-      bind_address_(bind_address) {}
+      bind_address_(bind_address),
+      poller_(ReadinessPoller::Create()) {}
 
 TCPServerBackend::~TCPServerBackend() {
   ZNET_LOG_DEBUG("Destructor of the TCP server backend is called.");
@@ -586,58 +768,50 @@ void TCPServerBackend::StopReceiving() {
 }
 
 void TCPServerBackend::PollLoop() {
+  std::vector<uint64_t> ready;
+  std::vector<std::shared_ptr<PeerSession>> sessions;
+  auto next_sweep = std::chrono::steady_clock::now() + kWatchedSweepInterval;
   while (!poll_task_.IsStopRequested()) {
-    std::vector<pollfd> fds;
-    {
-      std::lock_guard<std::mutex> lock(poll_mutex_);
-      fds.reserve(polled_.size());
-      for (SocketHandle handle : polled_) {
-        pollfd entry{};
-        entry.fd = handle;
-        entry.events = POLLIN;
-        fds.push_back(entry);
-      }
-    }
-    if (fds.empty()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      continue;
-    }
-#ifdef ZNET_TARGET_WIN
-    const int ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), 10);
-#else
-    const int ready = poll(fds.data(), static_cast<nfds_t>(fds.size()), 10);
-#endif
-    if (ready <= 0) {
-      continue;
-    }
-    bool wake = false;
-    std::vector<SocketHandle> dead;
-    for (const pollfd& entry : fds) {
-      if ((entry.revents & POLLNVAL) != 0) {
-        // the transport closed the descriptor; stop watching the number
-        // before something else in the process reuses it
-        dead.push_back(entry.fd);
-        continue;
+    ready.clear();
+    // the timeout only bounds how long a stop request goes unnoticed. No pause
+    // after a wake: a reported socket is not reported again until its worker
+    // has drained it, so there is no re-fire to hold back.
+    if (poller_->Wait(ready, std::chrono::milliseconds(10)) > 0) {
+      {
+        std::lock_guard<std::mutex> lock(watched_mutex_);
+        for (uint64_t token : ready) {
+          auto it = watched_.find(token);
+          if (it == watched_.end()) {
+            continue;
+          }
+          if (auto session = it->second.lock()) {
+            sessions.push_back(std::move(session));
+          }
+        }
       }
-      if ((entry.revents & (POLLIN | POLLERR | POLLHUP)) != 0) {
-        wake = true;  // data, or a close the worker has to notice
+      // outside the lock, which Accept() takes for every new connection
+      if (on_ready_) {
+        for (const auto& session : sessions) {
+          on_ready_(*session);
+        }
       }
+      sessions.clear();
     }
-    if (!dead.empty()) {
-      std::lock_guard<std::mutex> lock(poll_mutex_);
-      polled_.erase(std::remove_if(polled_.begin(), polled_.end(),
-                                   [&dead](SocketHandle handle) {
-                                     return std::find(dead.begin(), dead.end(),
-                                                      handle) != dead.end();
-                                   }),
-                    polled_.end());
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_sweep) {
+      SweepWatched();
+      next_sweep = now + kWatchedSweepInterval;
     }
-    if (wake && on_data_) {
-      on_data_();
-      // level-triggered: the bytes stay readable until a worker drains them,
-      // so pause rather than re-fire the wake in a tight loop. Short, because
-      // this pause is also the floor under back-to-back round trips.
-      std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+void TCPServerBackend::SweepWatched() {
+  std::lock_guard<std::mutex> lock(watched_mutex_);
+  for (auto it = watched_.begin(); it != watched_.end();) {
+    if (it->second.expired()) {
+      it = watched_.erase(it);
+    } else {
+      ++it;
     }
   }
 }
@@ -709,16 +883,30 @@ std::shared_ptr<PeerSession> TCPServerBackend::Accept() {
       CloseSocket(client_socket);
       continue;
     }
-    {
-      // watched from here on, so inbound data wakes a worker instead of
-      // waiting out its tick
-      std::lock_guard<std::mutex> lock(poll_mutex_);
-      polled_.push_back(client_socket);
-    }
-    return std::make_shared<PeerSession>(bind_address_, remote_address,
-                                      std::make_unique<TCPTransportLayer>(client_socket, child_options_.common), ConnectionType::TCP,
+    auto session = std::make_shared<PeerSession>(bind_address_, remote_address,
+                                      std::make_unique<TCPTransportLayer>(client_socket, child_options_.common, child_options_.tcp, poller_), ConnectionType::TCP,
                                       /*is_initiator=*/false,
                                       /*self_managed=*/false, child_options_);
+    // watched from here on, so inbound data reaches the session's worker. The
+    // entry goes in first, so a report arriving straight away finds it.
+    const uint64_t token = session->id();
+    {
+      std::lock_guard<std::mutex> lock(watched_mutex_);
+      watched_[token] = session;
+    }
+    if (!poller_->Add(client_socket, token)) {
+      // a worker only reads a session it is told about, so an unwatched one
+      // would sit on its data until a keepalive came due
+      {
+        std::lock_guard<std::mutex> lock(watched_mutex_);
+        watched_.erase(token);
+      }
+      CloseOptions options;
+      options.Set<NoLingerKey>(true);
+      session->Close(options);
+      continue;
+    }
+    return session;
   }
 }
 
@@ -28,6 +28,20 @@ namespace backends {
 
 using steady_clock = std::chrono::steady_clock;
 
+namespace {
+
+// how often a receive thread sweeps its routes for sessions that are gone. A
+// stale route only costs its memory, and a handshake that finds the server
+// full sweeps first anyway.
+constexpr std::chrono::seconds kRouteReapInterval{1};
+
+// how long a route's PathChallenge stands before a datagram from yet another
+// address may replace it. Bounds what a sender spraying a known id from
+// spoofed addresses can make the server send.
+constexpr std::chrono::milliseconds kPathChallengeInterval{250};
+
+}  // namespace
+
 // ---------------------------------------------------------------------------
 // ZDTClientBackend
 // ---------------------------------------------------------------------------
@@ -35,7 +49,12 @@ using steady_clock = std::chrono::steady_clock;
 ZDTClientBackend::ZDTClientBackend(std::shared_ptr<InetAddress> server_address,
                                    const SessionOptions& options)
     : server_address_(std::move(server_address)), config_(options.zdt),
-      session_options_(options) {}
+      session_options_(options) {
+  if (config_.datagram_pool_size != 0) {
+    datagram_pool_ =
+        std::make_shared<ZDTDatagramPool>(config_.datagram_pool_size);
+  }
+}
 
 ZDTClientBackend::~ZDTClientBackend() {
   ZNET_LOG_DEBUG("Destructor of the ZDT client backend is called.");
@@ -55,6 +74,15 @@ Result ZDTClientBackend::BindTo(const InetAddress& address) {
   socket_->SetDontFragment(true);  // make the handshake MTU probe meaningful
   ApplySocketBufferSizes(*socket_, config_.socket_recv_buffer,
                          config_.socket_send_buffer);
+  // sending only: the receive loop reads a datagram at a time, and a
+  // coalesced receive would look like one oversized datagram
+  if (config_.segmentation_offload && !socket_->EnableSendOffload()) {
+    ZNET_LOG_DEBUG("ZDT: segmentation offload unavailable, sending plain "
+                   "datagrams.");
+  }
+  if (config_.pacing == ZDTPacing::Kernel && !socket_->EnableTxTime()) {
+    ZNET_LOG_DEBUG("ZDT: SO_TXTIME unavailable, pacing from the worker.");
+  }
   result = socket_->Bind(address);
   if (result != Result::Success) {
     return result;
@@ -167,6 +195,8 @@ Result ZDTClientBackend::Handshake(ZDTConnection& out) {
     request.WriteInetAddress(*server_address_);
     request.WriteInt<uint16_t>(negotiated_mtu);
     request.WriteInt<uint64_t>(guid_);
+    request.WriteInt<uint8_t>(config_.datagram_encryption ? kZDTFeatureSealing
+                                                          : 0);
     socket_->SendTo(*server_address_, request.data(), request.size());
 
     auto deadline = steady_clock::now() + config_.handshake_retransmit;
@@ -199,6 +229,10 @@ Result ZDTClientBackend::Handshake(ZDTConnection& out) {
         out.mtu = mtu ? mtu : negotiated_mtu;
         out.local_guid = guid_;
         out.remote_guid = reply_server_guid ? reply_server_guid : server_guid;
+        out.peer_connection_id = reply.ReadInt<ZDTConnectionId>();
+        // the server only takes up what was offered, so this is the answer
+        out.sealed = config_.datagram_encryption &&
+                     (reply.ReadInt<uint8_t>() & kZDTFeatureSealing) != 0;
         return Result::Success;
       }
       if (id == ZDTOfflineMsg::IncompatibleProtocolVersion) {
@@ -234,9 +268,11 @@ Result ZDTClientBackend::Connect() {
   }
   ZNET_LOG_DEBUG("ZDT connected to {} (mtu={})", server_address_->readable(),
                  connection.mtu);
+  connection_id_ = connection.peer_connection_id;
   // the receive thread owns the socket from here, so the transport takes its
   // datagrams from the inbox instead of polling alongside it
-  inbox_ = std::make_shared<ZDTInbox>();
+  inbox_ = std::make_shared<ZDTInbox>(config_.max_inbox_datagrams,
+                                      datagram_pool_);
   auto transport = std::make_unique<ZDTTransportLayer>(
       socket_, server_address_, config_, /*drains_own_socket=*/false, inbox_,
       connection, session_options_.common);
@@ -278,14 +314,38 @@ void ZDTClientBackend::ReceiveLoop() {
       continue;
     }
     scratch.CommitWrite(len);
-    inbox_->Push(Buffer(scratch.data(), scratch.size(), Endianness::BigEndian),
-                 config_.max_inbox_datagrams);
+    if (!(static_cast<uint8_t>(scratch.data()[0]) & kFlagOnline)) {
+      // the one offline message a connected client answers; the transport
+      // ignores the rest
+      AnswerPathChallenge(scratch);
+      continue;
+    }
+    inbox_->Push(scratch.data(), scratch.size());
     if (on_data_) {
       on_data_();  // the session has work; do not make it wait out its tick
     }
   }
 }
 
+void ZDTClientBackend::AnswerPathChallenge(Buffer& challenge) {
+  ZDTOfflineMsg id;
+  if (!ReadOfflineHeader(challenge, id) ||
+      id != ZDTOfflineMsg::PathChallenge ||
+      challenge.readable_bytes() < kZDTConnectionIdSize + sizeof(uint64_t)) {
+    return;
+  }
+  if (challenge.ReadInt<ZDTConnectionId>() != connection_id_) {
+    return;
+  }
+  const uint64_t token = challenge.ReadInt<uint64_t>();
+  Buffer response(Endianness::BigEndian);
+  WriteOfflineHeader(response, ZDTOfflineMsg::PathResponse);
+  response.WriteInt<ZDTConnectionId>(connection_id_);
+  response.WriteInt<uint64_t>(token);
+  // concurrent sendto() with the session's worker is safe
+  socket_->SendTo(*server_address_, response.data(), response.size());
+}
+
 void ZDTClientBackend::StopReceiving() {
   std::lock_guard<std::mutex> lock(receive_thread_mutex_);
   receiving_ = false;
@@ -323,7 +383,9 @@ ZDTServerBackend::ZDTServerBackend(std::shared_ptr<InetAddress> bind_address,
                                    const SessionOptions& child_options,
                                    const ServerOptions& server_options)
     : bind_address_(std::move(bind_address)), config_(child_options.zdt),
-      child_session_options_(child_options), admission_(server_options) {}
+      child_session_options_(child_options),
+      receive_sockets_(server_options.receive_sockets),
+      admission_(server_options) {}
 
 ZDTServerBackend::~ZDTServerBackend() {
   ZNET_LOG_DEBUG("Destructor of the ZDT server backend is called.");
@@ -337,36 +399,91 @@ Result ZDTServerBackend::Bind() {
   if (!bind_address_ || !bind_address_->is_valid()) {
     return Result::InvalidAddress;
   }
-  socket_ = std::make_shared<UDPSocket>();
-  Result result = socket_->Open(bind_address_->ipv());
+  size_t count = receive_sockets_ != 0
+                     ? receive_sockets_
+                     : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+#ifndef ZNET_TARGET_LINUX
+  count = 1;  // no SO_REUSEPORT that spreads datagrams, see EnableReusePort()
+#endif
+  shards_.clear();
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    registry_.Clear();
+    registry_paths_.Clear();
+  }
+  next_accept_ = 0;
+  const auto now = steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    auto shard = std::make_unique<Shard>();
+    shard->index = i;
+    Result result = OpenShard(*shard, count > 1);
+    if (result != Result::Success) {
+      if (i == 0) {
+        return result;
+      }
+      // the port is ours already; serve it with the sockets that did bind
+      ZNET_LOG_WARN("ZDT: opened {} of {} receive sockets on {}.", i, count,
+                    bind_address_->readable());
+      break;
+    }
+    if (i == 0) {
+      // the rest join the port this one got, which matters when it was
+      // auto-assigned
+      auto local = shard->socket->local_address();
+      if (local) {
+        bind_address_ = local;
+      }
+    }
+    // cookie-signing secret. RAND_bytes needs znet::Init(), which
+    // Server::Bind() runs before invoking the backend.
+    RAND_bytes(shard->secret_current.data(),
+               static_cast<int>(shard->secret_current.size()));
+    shard->last_rotation = now;
+    ZNET_METRIC(shard->metrics.zdt.receive_sockets = 1);
+    ZNET_METRIC(shard->published = shard->metrics);
+    shards_.push_back(std::move(shard));
+  }
+  // a free list per receive thread, so only now that they are counted
+  if (config_.datagram_pool_size != 0) {
+    datagram_pool_ = std::make_shared<ZDTDatagramPool>(
+        config_.datagram_pool_size, shards_.size());
+  }
+  server_guid_ = GenerateGuid();
+  is_bind_ = true;
+  ZNET_LOG_DEBUG("ZDT bind to: {} ({} receive sockets)",
+                 bind_address_->readable(), shards_.size());
+  return Result::Success;
+}
+
+Result ZDTServerBackend::OpenShard(Shard& shard, bool reuse_port) {
+  shard.socket = std::make_shared<UDPSocket>();
+  UDPSocket& socket = *shard.socket;
+  Result result = socket.Open(bind_address_->ipv());
   if (result != Result::Success) {
     return result;
   }
   // the receive thread blocks in recvfrom so a datagram wakes it immediately
   // instead of waiting for the next poll. The timeout is only there to give the
   // loop a chance to notice shutdown.
-  socket_->SetBlocking(true);
-  socket_->SetReceiveTimeout(std::chrono::milliseconds(200));
-  ApplySocketBufferSizes(*socket_, config_.socket_recv_buffer,
+  socket.SetBlocking(true);
+  socket.SetReceiveTimeout(std::chrono::milliseconds(200));
+  ApplySocketBufferSizes(socket, config_.socket_recv_buffer,
                          config_.socket_send_buffer);
-  result = socket_->Bind(*bind_address_);
-  if (result != Result::Success) {
-    return result;
+  if (config_.segmentation_offload) {
+    const bool send = socket.EnableSendOffload();
+    const bool receive = socket.EnableReceiveOffload();
+    ZNET_LOG_DEBUG("ZDT: segmentation offload: send {}, receive {}",
+                   send ? "on" : "unavailable", receive ? "on" : "unavailable");
   }
-  auto local = socket_->local_address();
-  if (local) {
-    bind_address_ = local;
+  if (config_.pacing == ZDTPacing::Kernel && !socket.EnableTxTime()) {
+    ZNET_LOG_DEBUG("ZDT: SO_TXTIME unavailable, pacing from the worker.");
   }
-  // cookie-signing secret + server identity. RAND_bytes needs znet::Init(),
-  // which Server::Bind() runs before invoking the backend.
-  RAND_bytes(secret_current_.data(), static_cast<int>(secret_current_.size()));
-  has_previous_secret_ = false;
-  epoch_ = 0;
-  last_rotation_ = steady_clock::now();
-  server_guid_ = GenerateGuid();
-  is_bind_ = true;
-  ZNET_LOG_DEBUG("ZDT bind to: {}", bind_address_->readable());
-  return Result::Success;
+  if (reuse_port && !socket.EnableReusePort()) {
+    ZNET_LOG_ERROR("ZDT: cannot share {} between receive sockets: {}",
+                   bind_address_->readable(), GetLastErrorInfo());
+    return Result::CannotBind;
+  }
+  return socket.Bind(*bind_address_);
 }
 
 Result ZDTServerBackend::Listen() {
@@ -380,78 +497,257 @@ Result ZDTServerBackend::Listen() {
   }
   is_listening_ = true;
   receiving_ = true;
-  receive_thread_ = std::thread([this]() { ReceiveLoop(); });
+  for (auto& shard : shards_) {
+    Shard* target = shard.get();
+    target->receive_thread =
+        std::thread([this, target]() { ReceiveLoop(*target); });
+  }
   return Result::Success;
 }
 
-void ZDTServerBackend::ReceiveLoop() {
-  Buffer scratch(Endianness::BigEndian);
-  scratch.ReserveExact(ZNET_MAX_BUFFER_SIZE);
+void ZDTServerBackend::ReceiveLoop(Shard& shard) {
+  // one slot per datagram a call may return, reserved once; the kernel writes
+  // straight into them
+  const size_t batch =
+      std::min(std::max<size_t>(config_.receive_batch, 1), UDPSocket::kMaxBatch);
+  // a coalesced receive can be far larger than any one datagram, and whatever
+  // does not fit the slot is lost
+  const size_t slot_size = shard.socket->receive_offload()
+                               ? UDPSocket::kMaxOffloadBytes
+                               : ZNET_MAX_BUFFER_SIZE;
+  std::vector<Buffer> scratch;
+  std::vector<DatagramSlot> slots(batch);
+  scratch.reserve(batch);
+  for (size_t i = 0; i < batch; i++) {
+    scratch.emplace_back(Endianness::BigEndian);
+    scratch[i].ReserveExact(slot_size);
+    slots[i].data = scratch[i].write_cursor_data();
+    slots[i].cap = scratch[i].writable_bytes();
+  }
+  std::vector<std::shared_ptr<PeerSession>> ready;
+  auto next_reap = steady_clock::now() + kRouteReapInterval;
   while (receiving_.load(std::memory_order_relaxed)) {
-    scratch.Reset();
-    size_t len = 0;
-    std::shared_ptr<InetAddress> from;
-    RecvResult result = socket_->RecvFrom(scratch.write_cursor_data(),
-                                          scratch.writable_bytes(), len, from);
-    if (result == RecvResult::WouldBlock) {
-      continue;  // receive timeout expired, just re-check the stop flag
-    }
+    size_t count = 0;
+    RecvResult result =
+        shard.socket->RecvBatch(slots.data(), slots.size(), count);
     if (result == RecvResult::Error) {
       break;  // socket closed underneath us, shutdown is in progress
     }
-    if (len == 0 || !from) {
+    // a WouldBlock is the receive timeout expiring: nothing to route, but
+    // the upkeep below still runs
+    if (result == RecvResult::Received) {
+      ZNET_METRIC(shard.metrics.zdt.receive_calls++);
+      ZNET_METRIC(shard.metrics.zdt.datagrams_received += count);
+      MaybeRotateSecret(shard);
+      for (size_t i = 0; i < count; i++) {
+        if (slots[i].len == 0 || !slots[i].from.valid()) {
+          continue;
+        }
+        Buffer& datagram = scratch[i];
+        datagram.Reset();
+        datagram.CommitWrite(slots[i].len);
+        auto session = RouteDatagram(shard, datagram, slots[i].segment_size,
+                                     slots[i].from);
+        // a burst from one peer tends to arrive back to back; report it once
+        if (session && (ready.empty() || ready.back() != session)) {
+          ready.push_back(std::move(session));
+        }
+      }
+    }
+    const auto now = steady_clock::now();
+    if (now >= next_reap) {
+      ReapRoutes(shard);
+      next_reap = now + kRouteReapInterval;
+    }
+#if ZNET_ENABLE_METRICS
+    {
+      // the one lock a batch takes, and only to hand the counters over
+      std::lock_guard<std::mutex> lock(shard.state_mutex);
+      shard.published = shard.metrics;
+    }
+#endif
+    if (on_ready_) {
+      for (const auto& session : ready) {
+        on_ready_(*session);  // it has work; do not make it wait out its tick
+      }
+    }
+    ready.clear();
+  }
+}
+
+std::shared_ptr<PeerSession> ZDTServerBackend::RouteDatagram(
+    Shard& shard, Buffer& datagram, size_t segment_size, const PeerKey& from) {
+  ZNET_ZDT_ENTER_DOMAIN(shard.receive_domain);
+  // a coalesced receive is a run of datagrams from one peer, each routed as if
+  // it had arrived alone. The route is looked up once for all of them.
+  const size_t step = segment_size != 0 ? segment_size : datagram.size();
+  std::shared_ptr<PeerSession> session;
+  Route* route = nullptr;
+  std::shared_ptr<InetAddress> address;  // built on the handshake path only
+  for (size_t offset = 0; offset < datagram.size(); offset += step) {
+    const size_t len = std::min(step, datagram.size() - offset);
+    const char* data = datagram.data() + offset;
+    if (static_cast<uint8_t>(data[0]) & kFlagOnline) {
+      ZDTConnectionId id = 0;
+      if (!PeekZDTConnectionId(data, len, id)) {
+        // every client stamps the id Reply2 gave it, so this is noise
+        ZNET_METRIC(shard.metrics.zdt.datagrams_unroutable++);
+        continue;
+      }
+      if (!route || route->id != id) {
+        route = FindRoute(shard, id);
+      }
+      if (!route) {
+        // online datagram for a connection this server does not have -> drop.
+        ZNET_METRIC(shard.metrics.zdt.datagrams_unroutable++);
+        continue;
+      }
+      if (route->path != from) {
+        // the peer's NAT may have rebound it. The datagram is delivered all
+        // the same, but replies keep going to the old path until the new one
+        // answers a challenge: the id alone does not prove who sent it.
+        ChallengePath(shard, *route, from);
+      }
+      // copied into a pooled buffer; the scratch stays behind for the next
+      // receive. the shard's own queue in the inbox, so a peer that migrated
+      // never has two shards pushing to one.
+      route->inbox->Push(data, len, shard.index);
+      if (!session) {
+        session = route->session.lock();
+      }
       continue;
     }
-    scratch.CommitWrite(len);
-    RouteDatagram(scratch, from);
-    if (on_data_) {
-      on_data_();  // a session has work; do not make it wait out its tick
+    // offline datagrams are parsed straight out of the scratch; the reply
+    // buffers HandleOffline builds are its own. whatever they create is
+    // pending and ticked by the server's own loop, so there is no one to
+    // report.
+    if (!address) {
+      address = from.ToInetAddress();
+    }
+    if (len == datagram.size()) {
+      HandleOffline(shard, datagram, from, address, len);
+    } else {
+      Buffer single(data, len, Endianness::BigEndian);
+      HandleOffline(shard, single, from, address, len);
     }
+    // a completed handshake or migration may have moved the routes
+    route = nullptr;
   }
+  return session;
 }
 
-void ZDTServerBackend::RouteDatagram(Buffer& datagram,
-                                     const std::shared_ptr<InetAddress>& from) {
-  ZNET_ZDT_ENTER_DOMAIN(receive_domain_);
-  std::lock_guard<std::mutex> lock(state_mutex_);
-  MaybeRotateSecret();
-  if (static_cast<uint8_t>(datagram.data()[0]) & kFlagOnline) {
-    auto it = routes_.find(from->readable());
-    if (it != routes_.end()) {
-      // right-sized for the inbox; the scratch's reservation stays behind
-      it->second.inbox->Push(Buffer(datagram.data(), datagram.size(),
-                                    Endianness::BigEndian),
-                             config_.max_inbox_datagrams);
-      return;
+ZDTServerBackend::Route* ZDTServerBackend::FindRoute(Shard& shard,
+                                                     ZDTConnectionId id) {
+  Route* route = shard.routes.Find(id);
+  if (route) {
+    return route;
+  }
+  Route adopted;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    const Route* known = registry_.Find(id);
+    if (!known) {
+      return nullptr;
     }
-    // online datagram from an unknown address -> drop.
-    ZNET_METRIC(metrics_.zdt.datagrams_unroutable++);
+    adopted = *known;
+  }
+  adopted.probe_token = 0;  // a challenge another shard sent is its own
+  return &shard.routes.Insert(id, std::move(adopted));
+}
+
+void ZDTServerBackend::ChallengePath(Shard& shard, Route& route,
+                                     const PeerKey& from) {
+  const auto now = steady_clock::now();
+  if (route.probe_token != 0 && now - route.probe_sent < kPathChallengeInterval) {
+    return;
+  }
+  std::shared_ptr<InetAddress> address = from.ToInetAddress();
+  if (!address) {
     return;
   }
-  // offline datagrams are parsed straight out of the scratch; the reply
-  // buffers HandleOffline builds are its own
-  HandleOffline(datagram, from, datagram.size());
+  route.probe_path = from;
+  route.probe_sent = now;
+  do {
+    RAND_bytes(reinterpret_cast<unsigned char*>(&route.probe_token),
+               sizeof(route.probe_token));
+  } while (route.probe_token == 0);  // 0 means no challenge is out
+  Buffer out(Endianness::BigEndian);
+  WriteOfflineHeader(out, ZDTOfflineMsg::PathChallenge);
+  out.WriteInt<ZDTConnectionId>(route.id);
+  out.WriteInt<uint64_t>(route.probe_token);
+  shard.socket->SendTo(*address, out.data(), out.size());
 }
 
-void ZDTServerBackend::MaybeRotateSecret() {
+void ZDTServerBackend::OnPathResponse(Shard& shard, Buffer& buffer,
+                                      const PeerKey& peer,
+                                      const std::shared_ptr<InetAddress>& from) {
+  if (buffer.readable_bytes() < kZDTConnectionIdSize + sizeof(uint64_t)) {
+    return;
+  }
+  const ZDTConnectionId id = buffer.ReadInt<ZDTConnectionId>();
+  const uint64_t token = buffer.ReadInt<uint64_t>();
+  Route* route = shard.routes.Find(id);
+  if (!route || route->probe_token == 0 || route->probe_path != peer ||
+      route->probe_token != token) {
+    return;  // stale, or not an answer to anything this shard asked
+  }
+  const PeerKey old_path = route->path;
+  route->path = peer;
+  route->peer = from;
+  route->probe_token = 0;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    Route* known = registry_.Find(id);
+    if (known) {
+      known->path = peer;
+      known->peer = from;
+    }
+    const ZDTConnectionId* previous = registry_paths_.Find(old_path);
+    if (previous && *previous == id) {
+      registry_paths_.Erase(old_path);
+    }
+    registry_paths_.Insert(peer, id);
+  }
+  // the session's worker switches its sends over on its next tick
+  route->inbox->SetPeer(from);
+  ZNET_METRIC(shard.metrics.zdt.paths_migrated++);
+  ZNET_LOG_DEBUG("ZDT: connection {} migrated to {}", id, from->readable());
+}
+
+void ZDTServerBackend::ReapRoutes(Shard& shard) {
+  ZNET_ZDT_ENTER_DOMAIN(shard.receive_domain);
+  auto gone = [](const Route& route) { return route.session.expired(); };
+  shard.routes.EraseIf(gone);
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+  if (registry_.EraseIf(gone) != 0) {
+    registry_paths_.EraseIf([this](ZDTConnectionId id) {
+      return registry_.Find(id) == nullptr;
+    });
+  }
+}
+
+void ZDTServerBackend::MaybeRotateSecret(Shard& shard) {
   auto now = steady_clock::now();
-  if (now - last_rotation_ < config_.cookie_secret_rotation) {
+  if (now - shard.last_rotation < config_.cookie_secret_rotation) {
     return;
   }
-  secret_previous_ = secret_current_;
-  has_previous_secret_ = true;
-  RAND_bytes(secret_current_.data(), static_cast<int>(secret_current_.size()));
-  epoch_++;
-  last_rotation_ = now;
+  shard.secret_previous = shard.secret_current;
+  shard.has_previous_secret = true;
+  RAND_bytes(shard.secret_current.data(),
+             static_cast<int>(shard.secret_current.size()));
+  shard.epoch++;
+  shard.last_rotation = now;
 }
 
-ZDTCookie ZDTServerBackend::CookieFor(const std::string& peer_readable,
+ZDTCookie ZDTServerBackend::CookieFor(const Shard& shard,
+                                      const std::string& peer_readable,
                                       uint32_t epoch) const {
-  return ComputeCookie(secret_current_.data(), secret_current_.size(),
-                       peer_readable, epoch);
+  return ComputeCookie(shard.secret_current.data(),
+                       shard.secret_current.size(), peer_readable, epoch);
 }
 
-bool ZDTServerBackend::AllowHandshake(const std::string& peer_readable) {
+bool ZDTServerBackend::AllowHandshake(Shard& shard,
+                                      const std::string& peer_readable) {
   auto now = steady_clock::now();
   // keep the table bounded: when it grows large, drop entries whose 1s window
   // has elapsed. This is the only per-source state the server keeps, and it is
@@ -460,16 +756,16 @@ bool ZDTServerBackend::AllowHandshake(const std::string& peer_readable) {
       config_.max_connections > 0
           ? static_cast<size_t>(config_.max_connections) * 2
           : 8192;
-  if (source_rate_.size() > prune_at) {
-    for (auto it = source_rate_.begin(); it != source_rate_.end();) {
+  if (shard.source_rate.size() > prune_at) {
+    for (auto it = shard.source_rate.begin(); it != shard.source_rate.end();) {
       if (now - it->second.window_start > std::chrono::seconds(1)) {
-        it = source_rate_.erase(it);
+        it = shard.source_rate.erase(it);
       } else {
         ++it;
       }
     }
   }
-  SourceRate& entry = source_rate_[peer_readable];
+  SourceRate& entry = shard.source_rate[peer_readable];
   if (entry.count == 0 || now - entry.window_start > std::chrono::seconds(1)) {
     entry.window_start = now;
     entry.count = 0;
@@ -478,7 +774,8 @@ bool ZDTServerBackend::AllowHandshake(const std::string& peer_readable) {
   return entry.count <= config_.per_source_handshake_rate;
 }
 
-void ZDTServerBackend::HandleOffline(Buffer& buffer,
+void ZDTServerBackend::HandleOffline(Shard& shard, Buffer& buffer,
+                                     const PeerKey& peer,
                                      const std::shared_ptr<InetAddress>& from,
                                      size_t datagram_size) {
   ZDTOfflineMsg id;
@@ -487,32 +784,46 @@ void ZDTServerBackend::HandleOffline(Buffer& buffer,
   }
   // silent on every refusal: never reply to a source the rules exclude.
   // screened before the rate table too, so an excluded source cannot fill it.
-  if (admission_.Screen(*from) != AdmissionControl::Verdict::Allow) {
-    ZNET_METRIC(metrics_.zdt.admission_rejected++);
+  AdmissionControl::Verdict verdict;
+  {
+    std::lock_guard<std::mutex> lock(admission_mutex_);
+    verdict = admission_.Screen(*from);
+  }
+  if (verdict != AdmissionControl::Verdict::Allow) {
+    ZNET_METRIC(shard.metrics.zdt.admission_rejected++);
     return;
   }
   const std::string key = from->readable();
-  if (!AllowHandshake(key)) {
-    ZNET_METRIC(metrics_.zdt.rate_limited++);
+  if (!AllowHandshake(shard, key)) {
+    ZNET_METRIC(shard.metrics.zdt.rate_limited++);
     return;  // per-source handshake rate exceeded -> drop silently
   }
 
+  if (id == ZDTOfflineMsg::PathResponse) {
+    OnPathResponse(shard, buffer, peer, from);
+    return;
+  }
+
   if (id == ZDTOfflineMsg::OpenConnectionRequest1) {
-    if (admission_.Admit(*from) != AdmissionControl::Verdict::Allow) {
+    {
+      std::lock_guard<std::mutex> lock(admission_mutex_);
+      verdict = admission_.Admit(*from);
+    }
+    if (verdict != AdmissionControl::Verdict::Allow) {
       // the user-facing attempt throttle, distinct from the anti-flood rate
       // above; a Request1 is what starts a handshake, so it is the attempt
-      ZNET_METRIC(metrics_.zdt.admission_rejected++);
+      ZNET_METRIC(shard.metrics.zdt.admission_rejected++);
       return;
     }
-    ZNET_METRIC(metrics_.zdt.handshakes_started++);
+    ZNET_METRIC(shard.metrics.zdt.handshakes_started++);
     uint8_t version = buffer.ReadInt<uint8_t>();
     if (version != kZDTProtocolVersion) {
-      ZNET_METRIC(metrics_.zdt.handshakes_rejected++);
+      ZNET_METRIC(shard.metrics.zdt.handshakes_rejected++);
       Buffer out(Endianness::BigEndian);
       WriteOfflineHeader(out, ZDTOfflineMsg::IncompatibleProtocolVersion);
       out.WriteInt<uint8_t>(kZDTProtocolVersion);
       out.WriteInt<uint64_t>(server_guid_);
-      socket_->SendTo(*from, out.data(), out.size());
+      shard.socket->SendTo(*from, out.data(), out.size());
       return;
     }
     // allocate nothing here. The received size is the MTU the path carried,
@@ -520,15 +831,15 @@ void ZDTServerBackend::HandleOffline(Buffer& buffer,
     uint16_t mtu = static_cast<uint16_t>(std::min<size_t>(
         datagram_size,
         ZDTPayloadForLinkMTU(config_.mtu_ladder.front(), from->ipv())));
-    ZDTCookie cookie = CookieFor(key, epoch_);
+    ZDTCookie cookie = CookieFor(shard, key, shard.epoch);
     Buffer out(Endianness::BigEndian);
     WriteOfflineHeader(out, ZDTOfflineMsg::OpenConnectionReply1);
     out.WriteInt<uint64_t>(server_guid_);
     out.WriteInt<uint16_t>(mtu);
     out.WriteInt<uint8_t>(static_cast<uint8_t>(cookie.size()));
     out.Write(cookie.data(), cookie.size());
-    out.WriteInt<uint32_t>(epoch_);
-    socket_->SendTo(*from, out.data(), out.size());
+    out.WriteInt<uint32_t>(shard.epoch);
+    shard.socket->SendTo(*from, out.data(), out.size());
     return;
   }
 
@@ -544,56 +855,83 @@ void ZDTServerBackend::HandleOffline(Buffer& buffer,
     (void)target;
     uint16_t mtu = buffer.ReadInt<uint16_t>();
     uint64_t client_guid = buffer.ReadInt<uint64_t>();
+    // a client that offers nothing, or predates the byte, reads as 0
+    const bool sealed = config_.datagram_encryption &&
+                        (buffer.ReadInt<uint8_t>() & kZDTFeatureSealing) != 0;
 
     // validate the cookie against the source address (return-routability).
     bool valid = false;
-    if (epoch == epoch_) {
-      valid = ConstTimeEqual(cookie, CookieFor(key, epoch));
-    } else if (has_previous_secret_ && epoch == epoch_ - 1) {
+    if (epoch == shard.epoch) {
+      valid = ConstTimeEqual(cookie, CookieFor(shard, key, epoch));
+    } else if (shard.has_previous_secret && epoch == shard.epoch - 1) {
       valid = ConstTimeEqual(
-          cookie, ComputeCookie(secret_previous_.data(),
-                                secret_previous_.size(), key, epoch));
+          cookie, ComputeCookie(shard.secret_previous.data(),
+                                shard.secret_previous.size(), key, epoch));
     }
     if (!valid) {
-      ZNET_METRIC(metrics_.zdt.cookies_rejected++);
+      ZNET_METRIC(shard.metrics.zdt.cookies_rejected++);
       // silent drop: never reply to an unvalidated address.
       return;
     }
 
-    auto reply2 = [&]() {
+    auto reply2 = [&](ZDTConnectionId connection_id) {
       Buffer out(Endianness::BigEndian);
       WriteOfflineHeader(out, ZDTOfflineMsg::OpenConnectionReply2);
       out.WriteInt<uint64_t>(server_guid_);
       out.WriteInetAddress(*from);
       out.WriteInt<uint16_t>(mtu);
-      socket_->SendTo(*from, out.data(), out.size());
+      out.WriteInt<ZDTConnectionId>(connection_id);
+      out.WriteInt<uint8_t>(sealed ? kZDTFeatureSealing : 0);
+      shard.socket->SendTo(*from, out.data(), out.size());
     };
 
-    // duplicate Request2 (Reply2 was lost): re-answer idempotently.
-    auto existing = routes_.find(key);
-    if (existing != routes_.end() && !existing->second.session.expired()) {
-      reply2();
+    // duplicate Request2 (Reply2 was lost): re-answer idempotently, with the
+    // id already assigned. Looked up by the connection's current path, so
+    // once a peer has migrated away, a newcomer on its old address is not
+    // handed its id.
+    ZDTConnectionId existing = 0;
+    {
+      std::lock_guard<std::mutex> lock(registry_mutex_);
+      const ZDTConnectionId* known_id = registry_paths_.Find(peer);
+      const Route* known = known_id ? registry_.Find(*known_id) : nullptr;
+      if (known && !known->session.expired()) {
+        existing = known->id;
+      }
+    }
+    if (existing != 0) {
+      reply2(existing);
       return;
     }
-    if (config_.max_connections > 0 &&
-        static_cast<int>(routes_.size()) >= config_.max_connections) {
-      ZNET_METRIC(metrics_.zdt.handshakes_rejected++);
+    auto full = [&]() {
+      std::lock_guard<std::mutex> lock(registry_mutex_);
+      return config_.max_connections > 0 &&
+             registry_.size() >= static_cast<size_t>(config_.max_connections);
+    };
+    if (full()) {
+      // routes whose sessions are gone still count until the next reap
+      ReapRoutes(shard);
+    }
+    if (full()) {
+      ZNET_METRIC(shard.metrics.zdt.handshakes_rejected++);
       Buffer out(Endianness::BigEndian);
       WriteOfflineHeader(out, ZDTOfflineMsg::NoFreeConnections);
       out.WriteInt<uint64_t>(server_guid_);
-      socket_->SendTo(*from, out.data(), out.size());
+      shard.socket->SendTo(*from, out.data(), out.size());
       return;
     }
 
     // address proven, allocate the session now.
-    auto inbox = std::make_shared<ZDTInbox>();
+    auto inbox = std::make_shared<ZDTInbox>(config_.max_inbox_datagrams,
+                                            datagram_pool_, shards_.size());
     ZDTConnection connection;
     connection.mtu =
         mtu ? mtu : ZDTPayloadForLinkMTU(config_.mtu_ladder.back(), from->ipv());
     connection.local_guid = server_guid_;
     connection.remote_guid = client_guid;
+    connection.sealed = sealed;
     auto transport = std::make_unique<ZDTTransportLayer>(
-        socket_, from, config_, /*drains_own_socket=*/false, inbox, connection,
+        shard.socket, from, config_, /*drains_own_socket=*/false, inbox,
+        connection,
         child_session_options_.common);
     auto session = std::make_shared<PeerSession>(
         bind_address_, from, std::move(transport), ConnectionType::ZDT,
@@ -604,12 +942,29 @@ void ZDTServerBackend::HandleOffline(Buffer& buffer,
     route.session = session;
     route.inbox = inbox;
     route.peer = from;
+    route.path = peer;
     route.remote_guid = client_guid;
-    routes_[key] = std::move(route);
-    ZNET_METRIC(metrics_.connections_accepted++);
-    pending_accept_.push_back(session);
-    reply2();
-    ZNET_LOG_DEBUG("ZDT accepted handshake from {} (mtu={})", key, connection.mtu);
+    {
+      std::lock_guard<std::mutex> lock(registry_mutex_);
+      // random rather than counted, so an id says nothing about the others
+      // and a stale one is unlikely to name a live connection
+      while (route.id == 0 || registry_.Find(route.id) != nullptr) {
+        RAND_bytes(reinterpret_cast<unsigned char*>(&route.id),
+                   sizeof(route.id));
+      }
+      registry_.Insert(route.id, route);
+      registry_paths_.Insert(peer, route.id);
+    }
+    const ZDTConnectionId connection_id = route.id;
+    shard.routes.Insert(connection_id, std::move(route));
+    ZNET_METRIC(shard.metrics.connections_accepted++);
+    {
+      std::lock_guard<std::mutex> lock(shard.state_mutex);
+      shard.pending_accept.push_back(session);
+    }
+    reply2(connection_id);
+    ZNET_LOG_DEBUG("ZDT accepted handshake from {} (mtu={}, id={})", key,
+                   connection.mtu, connection_id);
     return;
   }
 }
@@ -617,15 +972,20 @@ void ZDTServerBackend::HandleOffline(Buffer& buffer,
 void ZDTServerBackend::StopReceiving() {
   std::lock_guard<std::mutex> lock(receive_thread_mutex_);
   receiving_ = false;
-  // the loop only re-checks that flag when RecvFrom returns, so without this
-  // the join below sits out a whole receive timeout. The read direction only:
-  // the sessions still on this socket have their own FINs to send, and
-  // Server::MainProcessor sends them after this returns.
-  if (socket_) {
-    ShutdownSocketRead(socket_->handle());
+  // the loops only re-check that flag when RecvBatch returns, so without this
+  // each join below sits out a whole receive timeout. The read direction only:
+  // the sessions still on these sockets have their own FINs to send, and
+  // Server::MainProcessor sends them after this returns. Every shard is shut
+  // before any is joined, so they all wind down together.
+  for (auto& shard : shards_) {
+    if (shard->socket) {
+      ShutdownSocketRead(shard->socket->handle());
+    }
   }
-  if (receive_thread_.joinable()) {
-    receive_thread_.join();
+  for (auto& shard : shards_) {
+    if (shard->receive_thread.joinable()) {
+      shard->receive_thread.join();
+    }
   }
 }
 
@@ -638,16 +998,24 @@ Result ZDTServerBackend::Close() {
     is_listening_ = false;
     is_bind_ = false;
   }
-  // stop and join before touching the tables, otherwise the receive thread is
-  // still routing into them. Joined outside every lock it might be waiting on,
-  // and harmless if the shutdown path already did it.
+  // stop and join before touching the tables, otherwise the receive threads
+  // are still routing into them. Joined outside every lock they might be
+  // waiting on, and harmless if the shutdown path already did it.
   StopReceiving();
-  std::lock_guard<std::mutex> lock(state_mutex_);
-  routes_.clear();
-  pending_accept_.clear();
-  source_rate_.clear();
-  if (socket_) {
-    socket_->Close();
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->state_mutex);
+    // the receive thread that owned these is joined
+    shard->routes.Clear();
+    shard->pending_accept.clear();
+    shard->source_rate.clear();
+    if (shard->socket) {
+      shard->socket->Close();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    registry_.Clear();
+    registry_paths_.Clear();
   }
   return Result::Success;
 }
@@ -658,23 +1026,50 @@ std::shared_ptr<PeerSession> ZDTServerBackend::Accept() {
   if (!is_listening_) {
     return nullptr;
   }
-  // the receive thread fills routes_/pending_accept_, this only harvests them.
-  std::lock_guard<std::mutex> lock(state_mutex_);
-  // reap routes whose sessions have been destroyed.
-  for (auto it = routes_.begin(); it != routes_.end();) {
-    if (it->second.session.expired()) {
-      it = routes_.erase(it);
-    } else {
-      ++it;
+  // the receive threads fill pending_accept, this only harvests it. Routes
+  // are theirs to reap.
+  const size_t count = shards_.size();
+  for (size_t i = 0; i < count; i++) {
+    Shard& shard = *shards_[(next_accept_ + i) % count];
+    std::lock_guard<std::mutex> lock(shard.state_mutex);
+    if (!shard.pending_accept.empty()) {
+      auto accepted = std::move(shard.pending_accept.front());
+      shard.pending_accept.pop_front();
+      // the next call starts after this shard
+      next_accept_ = (next_accept_ + i + 1) % count;
+      return accepted;
     }
   }
-  ZNET_METRIC(metrics_.connections_active = routes_.size());
-  if (pending_accept_.empty()) {
-    return nullptr;
+  return nullptr;
+}
+
+ServerMetrics ZDTServerBackend::metrics() const {
+  ServerMetrics out;
+  out.connection_type = ConnectionType::ZDT;
+  // each receive thread publishes its counters under the shard's lock
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->state_mutex);
+    const ServerMetrics& in = shard->published;
+    out.connections_accepted += in.connections_accepted;
+    out.zdt.handshakes_started += in.zdt.handshakes_started;
+    out.zdt.handshakes_rejected += in.zdt.handshakes_rejected;
+    out.zdt.cookies_rejected += in.zdt.cookies_rejected;
+    out.zdt.rate_limited += in.zdt.rate_limited;
+    out.zdt.datagrams_unroutable += in.zdt.datagrams_unroutable;
+    out.zdt.admission_rejected += in.zdt.admission_rejected;
+    out.zdt.datagrams_received += in.zdt.datagrams_received;
+    out.zdt.receive_calls += in.zdt.receive_calls;
+    out.zdt.receive_sockets += in.zdt.receive_sockets;
+    out.zdt.paths_migrated += in.zdt.paths_migrated;
   }
-  auto session = pending_accept_.front();
-  pending_accept_.pop_front();
-  return session;
+#if ZNET_ENABLE_METRICS
+  {
+    // a migrated peer's route can sit in two shards; the registry has it once
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    out.connections_active = registry_.size();
+  }
+#endif
+  return out;
 }
 
 void ZDTServerBackend::AcceptAndReject() {
@@ -10,11 +10,75 @@
 
 #include "znet/backends/zdt/zdt_congestion.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace znet {
 namespace backends {
 
+namespace {
+
+// Startup's gain, 2/ln2: the smallest that doubles the delivery rate each
+// round trip. Drain undoes it with the inverse.
+constexpr double kBbrHighGain = 2.885;
+// the window leaves room for two round trips at the estimated rate, so acks
+// that arrive late or in clumps do not stall a pacer with more to send
+constexpr double kBbrWindowGain = 2.0;
+// ProbeBandwidth's cycle, one round trip per entry: probe a quarter above the
+// estimate, drain what that queued, then cruise
+constexpr double kBbrCycleGains[] = {1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+constexpr int kBbrCycleLength =
+    static_cast<int>(sizeof(kBbrCycleGains) / sizeof(kBbrCycleGains[0]));
+// a rate that grows less than this in a round trip counts as not growing
+constexpr double kBbrFullRateGrowth = 1.25;
+constexpr int kBbrFullRateRounds = 3;
+// the delay controller's pacing headroom over window / srtt, Linux TCP's
+// defaults: room to double in slow start, a fifth more once past it
+constexpr double kDelayPacingSlowStartGain = 2.0;
+constexpr double kDelayPacingGain = 1.2;
+// what the pacer lets go back to back after an idle spell
+constexpr std::chrono::microseconds kPacingQuantum{1000};
+
+}  // namespace
+
+void ZDTPacer::SetRate(double datagrams_per_second) {
+  if (datagrams_per_second <= 0.0) {
+    rate_ = 0.0;
+    interval_ = std::chrono::steady_clock::duration::zero();
+    next_send_ = TimePoint{};
+    return;
+  }
+  rate_ = datagrams_per_second;
+  interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / rate_));
+}
+
+void ZDTPacer::OnSent(TimePoint now) {
+  if (rate_ <= 0.0) {
+    return;
+  }
+  // a sender that went quiet has not banked the sends it skipped, only a
+  // quantum's worth, so a burst after idling stays short
+  const TimePoint earliest =
+      now - std::max<std::chrono::steady_clock::duration>(kPacingQuantum,
+                                                           interval_ * 2);
+  if (next_send_ < earliest) {
+    next_send_ = earliest;
+  }
+  next_send_ += interval_;
+}
+
+std::unique_ptr<ZDTCongestionController> MakeZDTCongestionController(
+    ZDTCongestionAlgorithm algorithm) {
+  switch (algorithm) {
+    case ZDTCongestionAlgorithm::Bbr:
+      return std::make_unique<ZDTBbrController>();
+    case ZDTCongestionAlgorithm::Delay:
+      break;
+  }
+  return std::make_unique<ZDTDelayController>();
+}
+
 void ZDTRttEstimator::OnSample(std::chrono::steady_clock::duration sample,
                                TimePoint now,
                                std::chrono::milliseconds rto_min,
@@ -23,6 +87,7 @@ void ZDTRttEstimator::OnSample(std::chrono::steady_clock::duration sample,
   if (ms < 0.0) {
     return;
   }
+  latest_ms_ = ms;
   if (!has_rtt_) {
     has_rtt_ = true;
     srtt_ms_ = ms;
@@ -44,17 +109,35 @@ void ZDTRttEstimator::OnSample(std::chrono::steady_clock::duration sample,
   rto_ = compat::Clamp(rto, rto_min, rto_max);
 }
 
+void ZDTDelayController::OnAck(const ZDTAckEvent& ack,
+                               const ZDTRttEstimator& rtt) {
+  if (rtt.has_rtt()) {
+    srtt_ms_ = rtt.srtt_ms();
+  }
+  OnAckArrived(ack.peer_ack);
+  OnAcked(ack.acked_datagrams, rtt, ack.next_seq, ack.cap);
+}
+
+double ZDTDelayController::pacing_rate() const {
+  if (srtt_ms_ <= 0.0) {
+    return 0.0;
+  }
+  const double gain =
+      cwnd_ < ssthresh_ ? kDelayPacingSlowStartGain : kDelayPacingGain;
+  return gain * cwnd_ * 1000.0 / srtt_ms_;
+}
+
 // leaving recovery on the first ack of something sent after the loss is what
 // keeps one burst from reducing the window more than once
-void ZDTCongestionController::OnAckArrived(WireSeq peer_ack) {
+void ZDTDelayController::OnAckArrived(WireSeq peer_ack) {
   if (in_loss_recovery_ && !SeqLess(peer_ack, loss_recovery_until_)) {
     in_loss_recovery_ = false;
   }
 }
 
-void ZDTCongestionController::OnAcked(int acked_datagrams,
-                                      const ZDTRttEstimator& rtt,
-                                      WireSeq next_seq, int cap) {
+void ZDTDelayController::OnAcked(int acked_datagrams,
+                                 const ZDTRttEstimator& rtt,
+                                 WireSeq next_seq, int cap) {
   if (acked_datagrams <= 0) {
     return;
   }
@@ -78,8 +161,8 @@ void ZDTCongestionController::OnAcked(int acked_datagrams,
   }
 }
 
-void ZDTCongestionController::OnRetransmitTimeout(const ZDTRttEstimator& rtt,
-                                                  WireSeq next_seq) {
+void ZDTDelayController::OnRetransmitTimeout(const ZDTRttEstimator& rtt,
+                                             WireSeq next_seq) {
   if (rtt.IsQueueing()) {
     // guarded like the delay path: a burst of timeouts is one event, and
     // collapsing once per message in it would take several round trips of
@@ -101,5 +184,224 @@ void ZDTCongestionController::OnRetransmitTimeout(const ZDTRttEstimator& rtt,
   }
 }
 
+void ZDTBbrController::OnAck(const ZDTAckEvent& ack,
+                             const ZDTRttEstimator& rtt) {
+  UpdateMinRtt(ack, rtt);
+  if (in_loss_recovery_ && !SeqLess(ack.peer_ack, loss_recovery_until_)) {
+    in_loss_recovery_ = false;
+    cwnd_ = std::max(cwnd_, prior_cwnd_);
+  }
+
+  // the ack that opens a round trip retired datagrams delivered before it
+  // began, so only the ones after it count towards its rate
+  if (!round_open_) {
+    if (ack.acked_datagrams > 0) {
+      round_open_ = true;
+      round_start_ = ack.now;
+      round_end_ = ack.next_seq;
+      round_acked_ = 0;
+      round_app_limited_ = false;
+    }
+  } else {
+    round_acked_ += ack.acked_datagrams;
+    if (!SeqLess(ack.peer_ack, round_end_)) {
+      EndRound(ack);
+    }
+  }
+
+  UpdateMode(ack);
+  UpdatePacingRate(rtt);
+
+  if (ack.acked_datagrams <= 0) {
+    return;
+  }
+  const double acked = static_cast<double>(ack.acked_datagrams);
+  if (in_loss_recovery_) {
+    // packet conservation: one out for each one the ack says left the path
+    cwnd_ = std::max(cwnd_, static_cast<double>(ack.in_flight) + acked);
+  } else {
+    const double target = Bdp() * (mode_ == Mode::ProbeBandwidth
+                                       ? kBbrWindowGain
+                                       : kBbrHighGain);
+    if (filled_pipe_) {
+      cwnd_ = std::min(cwnd_ + acked, target);
+    } else if (target <= 0.0 || cwnd_ < target) {
+      // the estimate lags the window during Startup; growing by what was
+      // acked is what lets the rate double and be measured doing it
+      cwnd_ += acked;
+    }
+  }
+  cwnd_ = compat::Clamp(cwnd_, static_cast<double>(kZDTBbrMinWindow),
+                        static_cast<double>(std::max(ack.cap, kZDTBbrMinWindow)));
+}
+
+void ZDTBbrController::OnRetransmitTimeout(const ZDTRttEstimator& rtt,
+                                           WireSeq next_seq) {
+  (void)rtt;
+  if (in_loss_recovery_) {
+    return;
+  }
+  in_loss_recovery_ = true;
+  loss_recovery_until_ = next_seq;
+  prior_cwnd_ = cwnd_;
+  cwnd_ = static_cast<double>(kZDTBbrMinWindow);
+}
+
+double ZDTBbrController::bottleneck_rate() const {
+  double best = 0.0;
+  for (double rate : rates_) {
+    best = std::max(best, rate);
+  }
+  return best;
+}
+
+void ZDTBbrController::EndRound(const ZDTAckEvent& ack) {
+  const double seconds =
+      std::chrono::duration<double>(ack.now - round_start_).count();
+  if (seconds > 0.0 && round_acked_ > 0) {
+    const double sample = static_cast<double>(round_acked_) / seconds;
+    // a round the sender left idle measured the application, not the path.
+    // it only counts when it beats the estimate anyway, and otherwise does not
+    // age the others out either
+    if (!round_app_limited_ || sample > bottleneck_rate()) {
+      rates_[rate_slot_] = sample;
+      rate_slot_ = (rate_slot_ + 1) % rates_.size();
+    }
+  }
+
+  if (!filled_pipe_ && !round_app_limited_) {
+    const double rate = bottleneck_rate();
+    if (rate >= full_rate_ * kBbrFullRateGrowth) {
+      full_rate_ = rate;
+      full_rate_rounds_ = 0;
+    } else if (++full_rate_rounds_ >= kBbrFullRateRounds) {
+      filled_pipe_ = true;
+    }
+  }
+
+  round_start_ = ack.now;
+  round_end_ = ack.next_seq;
+  round_acked_ = 0;
+  round_app_limited_ = false;
+}
+
+void ZDTBbrController::UpdateMinRtt(const ZDTAckEvent& ack,
+                                    const ZDTRttEstimator& rtt) {
+  if (!rtt.has_rtt()) {
+    return;
+  }
+  const double sample = rtt.latest_ms();
+  const bool expired =
+      min_rtt_ms_ > 0.0 &&
+      ack.now - min_rtt_stamp_ > std::chrono::milliseconds(kZDTRttMinWindowMs);
+  if (min_rtt_ms_ <= 0.0 || sample < min_rtt_ms_ || expired) {
+    min_rtt_ms_ = sample;
+    min_rtt_stamp_ = ack.now;
+  }
+  if (expired && mode_ != Mode::ProbeRtt) {
+    mode_ = Mode::ProbeRtt;
+    probe_rtt_done_ = TimePoint{};
+  }
+}
+
+void ZDTBbrController::UpdateMode(const ZDTAckEvent& ack) {
+  switch (mode_) {
+    case Mode::Startup:
+      if (filled_pipe_) {
+        mode_ = Mode::Drain;
+      }
+      break;
+    case Mode::Drain:
+      if (static_cast<double>(ack.in_flight) <= Bdp()) {
+        EnterProbeBandwidth(ack.now);
+      }
+      break;
+    case Mode::ProbeBandwidth: {
+      const double gain = kBbrCycleGains[cycle_index_];
+      const bool full_length =
+          std::chrono::duration<double, std::milli>(ack.now - cycle_start_)
+              .count() > min_rtt_ms_;
+      const double in_flight = static_cast<double>(ack.in_flight);
+      bool advance = full_length;
+      if (gain > 1.0) {
+        // a probe lasts until it has actually put the extra in flight
+        advance = full_length &&
+                  (in_flight >= gain * Bdp() || round_app_limited_);
+      } else if (gain < 1.0) {
+        // and the drain after it ends early once the queue is gone
+        advance = full_length || in_flight <= Bdp();
+      }
+      if (advance) {
+        cycle_index_ = (cycle_index_ + 1) % kBbrCycleLength;
+        cycle_start_ = ack.now;
+      }
+      break;
+    }
+    case Mode::ProbeRtt:
+      // hold the window at the floor until the queue has drained to it, then
+      // for kZDTBbrProbeRttMs and at least one round trip past that
+      if (probe_rtt_done_ == TimePoint{}) {
+        if (ack.in_flight <= kZDTBbrMinWindow) {
+          probe_rtt_done_ =
+              ack.now + std::chrono::milliseconds(kZDTBbrProbeRttMs);
+          probe_rtt_round_end_ = ack.next_seq;
+        }
+      } else if (ack.now >= probe_rtt_done_ &&
+                 !SeqLess(ack.peer_ack, probe_rtt_round_end_)) {
+        min_rtt_stamp_ = ack.now;
+        if (filled_pipe_) {
+          EnterProbeBandwidth(ack.now);
+        } else {
+          mode_ = Mode::Startup;
+        }
+      }
+      break;
+  }
+}
+
+void ZDTBbrController::EnterProbeBandwidth(TimePoint now) {
+  mode_ = Mode::ProbeBandwidth;
+  // starting on a cruise phase rather than the probe, so the first round
+  // trips after Drain do not rebuild the queue it just emptied
+  cycle_index_ = 2;
+  cycle_start_ = now;
+}
+
+void ZDTBbrController::UpdatePacingRate(const ZDTRttEstimator& rtt) {
+  double rate = bottleneck_rate();
+  if (rate <= 0.0) {
+    // nothing measured yet: spread the initial window over the round trip
+    if (!rtt.has_rtt() || rtt.srtt_ms() <= 0.0) {
+      return;
+    }
+    rate = cwnd_ * 1000.0 / rtt.srtt_ms();
+  }
+  const double target = PacingGain() * rate;
+  // until the pipe is full a lower rate means a noisy round, not a slower
+  // path, and Startup must not talk itself down
+  if (filled_pipe_ || target > pacing_rate_) {
+    pacing_rate_ = target;
+  }
+}
+
+double ZDTBbrController::PacingGain() const {
+  switch (mode_) {
+    case Mode::Startup:
+      return kBbrHighGain;
+    case Mode::Drain:
+      return 1.0 / kBbrHighGain;
+    case Mode::ProbeBandwidth:
+      return kBbrCycleGains[cycle_index_];
+    case Mode::ProbeRtt:
+      break;
+  }
+  return 1.0;
+}
+
+// bandwidth-delay product in datagrams: what the path holds without a queue
+double ZDTBbrController::Bdp() const {
+  return bottleneck_rate() * min_rtt_ms_ / 1000.0;
+}
+
 }  // namespace backends
 }  // namespace znet
@@ -0,0 +1,179 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#include "znet/backends/zdt/zdt_fec.h"
+
+#include <algorithm>
+
+namespace znet {
+namespace backends {
+
+namespace {
+
+// what identifies a message on its channel, besides message_seq: reliable
+// and unreliable keep separate sequence spaces
+uint8_t IdentityFlags(uint8_t flags) {
+  return static_cast<uint8_t>(flags & (kRecReliable | kRecOrdered));
+}
+
+uint16_t ReadU16(const uint8_t* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void XorInto(std::vector<uint8_t>& into, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    into[i] = static_cast<uint8_t>(into[i] ^ data[i]);
+  }
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// ZDTFecEncoder
+// ---------------------------------------------------------------------------
+
+ZDTFecEncoder::ZDTFecEncoder(size_t group_size)
+    : group_size_(std::min(std::max<size_t>(group_size, 2), kZDTFecMaxGroup)) {}
+
+void ZDTFecEncoder::Add(const ZDTRecord& record, const uint8_t* data,
+                        size_t len) {
+  if (len > xor_.size()) {
+    xor_.resize(len, 0);
+  }
+  XorInto(xor_, data, len);
+  longest_ = std::max(longest_, len);
+  Member& member = members_[count_++];
+  member.flags = IdentityFlags(record.flags);
+  member.seq = record.message_seq;
+  member.length = static_cast<uint16_t>(len);
+}
+
+void ZDTFecEncoder::Finish(Buffer& out) {
+  out.WriteInt<uint8_t>(static_cast<uint8_t>(count_));
+  for (size_t i = 0; i < count_; i++) {
+    out.WriteInt<uint8_t>(members_[i].flags);
+    out.WriteInt<uint8_t>(static_cast<uint8_t>(members_[i].seq >> 8));
+    out.WriteInt<uint8_t>(static_cast<uint8_t>(members_[i].seq));
+    out.WriteInt<uint8_t>(static_cast<uint8_t>(members_[i].length >> 8));
+    out.WriteInt<uint8_t>(static_cast<uint8_t>(members_[i].length));
+  }
+  out.Write(reinterpret_cast<const char*>(xor_.data()), longest_);
+  std::fill(xor_.begin(), xor_.begin() + static_cast<std::ptrdiff_t>(longest_),
+            uint8_t{0});
+  count_ = 0;
+  longest_ = 0;
+}
+
+// ---------------------------------------------------------------------------
+// ZDTFecDecoder
+// ---------------------------------------------------------------------------
+
+bool ZDTFecDecoder::OnRecord(const ZDTRecord& record, const uint8_t* data,
+                             size_t len) {
+  const uint8_t flags = IdentityFlags(record.flags);
+  if (Entry* held = Find(flags, record.message_seq)) {
+    // a retransmit of one received is for the channel's own dedup to judge;
+    // one rebuilt here was never seen by it, and the copy that finally
+    // arrives is the duplicate
+    return !held->recovered;
+  }
+  Entry& entry = Claim(flags, record.message_seq);
+  entry.bytes.assign(data, data + len);
+  return true;
+}
+
+bool ZDTFecDecoder::Recover(const uint8_t* parity, size_t len,
+                            ZDTRecord& out_record, const uint8_t*& out_data) {
+  if (len < 1) {
+    return false;
+  }
+  const size_t count = parity[0];
+  if (count == 0 || count > kZDTFecMaxGroup ||
+      len < 1 + count * kZDTFecMemberSize) {
+    return false;
+  }
+  const uint8_t* members = parity + 1;
+  const uint8_t* xor_bytes = members + count * kZDTFecMemberSize;
+  const size_t xor_len = len - 1 - count * kZDTFecMemberSize;
+
+  const uint8_t* missing = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* member = members + i * kZDTFecMemberSize;
+    if (ReadU16(member + 3) > xor_len) {
+      return false;  // longer than the parity covering it
+    }
+    if (Find(IdentityFlags(member[0]), ReadU16(member + 1)) == nullptr) {
+      if (missing != nullptr) {
+        return false;  // XOR rebuilds one, not two
+      }
+      missing = member;
+    }
+  }
+  if (missing == nullptr) {
+    return false;
+  }
+
+  rebuilt_.assign(xor_bytes, xor_bytes + xor_len);
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* member = members + i * kZDTFecMemberSize;
+    if (member == missing) {
+      continue;
+    }
+    const Entry* held = Find(IdentityFlags(member[0]), ReadU16(member + 1));
+    // what arrived has to be what the sender XORed, or the result is garbage
+    if (held->bytes.size() != ReadU16(member + 3)) {
+      return false;
+    }
+    XorInto(rebuilt_, held->bytes.data(), held->bytes.size());
+  }
+  const uint16_t length = ReadU16(missing + 3);
+  rebuilt_.resize(length);
+
+  out_record = ZDTRecord{};
+  out_record.flags = IdentityFlags(missing[0]);
+  out_record.message_seq = ReadU16(missing + 1);
+  out_record.length = length;
+  out_data = rebuilt_.data();
+
+  Entry& entry = Claim(out_record.flags, out_record.message_seq);
+  entry.recovered = true;
+  entry.bytes.assign(rebuilt_.begin(), rebuilt_.end());
+  return true;
+}
+
+size_t ZDTFecDecoder::StateBytes() const {
+  size_t bytes = sizeof(*this) + rebuilt_.capacity();
+  for (const Entry& entry : entries_) {
+    bytes += entry.bytes.capacity();
+  }
+  return bytes;
+}
+
+ZDTFecDecoder::Entry* ZDTFecDecoder::Find(uint8_t flags, WireSeq seq) {
+  for (Entry& entry : entries_) {
+    if (entry.live && entry.seq == seq && entry.flags == flags) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+ZDTFecDecoder::Entry& ZDTFecDecoder::Claim(uint8_t flags, WireSeq seq) {
+  Entry& entry = entries_[next_];
+  next_ = (next_ + 1) % entries_.size();
+  entry.flags = flags;
+  entry.seq = seq;
+  entry.live = true;
+  entry.recovered = false;
+  return entry;
+}
+
+}  // namespace backends
+}  // namespace znet
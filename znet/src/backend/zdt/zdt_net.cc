@@ -20,17 +20,108 @@
 #include "znet/util.h"
 
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstring>
 #include <thread>
 
+#ifdef ZNET_TARGET_LINUX
+#include <netinet/udp.h>
+// older libc headers predate the offloads; the values are the kernel ABI
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+// likewise SO_TXTIME (4.19); struct sock_txtime is two 32-bit fields
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+#ifndef SCM_TXTIME
+#define SCM_TXTIME SO_TXTIME
+#endif
+#include <time.h>
+#endif
+
 namespace znet {
 namespace backends {
 
+// ---------------------------------------------------------------------------
+// PeerKey
+// ---------------------------------------------------------------------------
+
+PeerKey PeerKey::From(const sockaddr* addr) {
+  PeerKey key;
+  if (addr == nullptr) {
+    return key;
+  }
+  if (addr->sa_family == AF_INET) {
+    const auto* in = reinterpret_cast<const sockaddr_in*>(addr);
+    key.family = 4;
+    key.port = in->sin_port;
+    std::memcpy(key.address.data(), &in->sin_addr, 4);
+  } else if (addr->sa_family == AF_INET6) {
+    const auto* in6 = reinterpret_cast<const sockaddr_in6*>(addr);
+    key.family = 6;
+    key.port = in6->sin6_port;
+    key.scope = static_cast<uint32_t>(in6->sin6_scope_id);
+    std::memcpy(key.address.data(), &in6->sin6_addr, 16);
+  }
+  return key;
+}
+
+namespace {
+
+// splitmix64's finalizer: every input bit reaches every output bit, so
+// addresses differing only in the port still spread across the table
+uint64_t MixBits(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+}  // namespace
+
+size_t PeerKey::Hash() const {
+  uint64_t words[3];
+  static_assert(sizeof(PeerKey) == sizeof(words), "PeerKey has padding");
+  std::memcpy(words, this, sizeof(words));
+  return static_cast<size_t>(
+      MixBits(words[0] ^ MixBits(words[1] ^ MixBits(words[2]))));
+}
+
+std::shared_ptr<InetAddress> PeerKey::ToInetAddress() const {
+  if (family == 4) {
+    IPv4Address ip{};
+    std::memcpy(ip.bytes, address.data(), sizeof(ip.bytes));
+    return std::make_shared<InetAddressIPv4>(ip, ntohs(port));
+  }
+  if (family == 6) {
+    IPv6Address ip{};
+    std::memcpy(ip.bytes, address.data(), sizeof(ip.bytes));
+    return std::make_shared<InetAddressIPv6>(ip, ntohs(port));
+  }
+  return nullptr;
+}
+
 // ---------------------------------------------------------------------------
 // UDPSocket
 // ---------------------------------------------------------------------------
 
+#if !ZNET_HAS_CXX17
+// before C++17 a static constexpr member is not implicitly inline, and
+// std::min() binding it by reference needs it defined somewhere
+constexpr size_t UDPSocket::kMaxBatch;
+constexpr size_t UDPSocket::kMaxOffloadBytes;
+#endif
+
 UDPSocket::~UDPSocket() {
   Close();
 }
@@ -70,6 +161,19 @@ bool UDPSocket::SendTo(const InetAddress& addr, const void* data, size_t len) {
   return static_cast<size_t>(n) == len;
 }
 
+namespace {
+
+bool WouldBlockOnRecv() {
+#ifdef ZNET_TARGET_WIN
+  const int err = WSAGetLastError();
+  return err == WSAEWOULDBLOCK || err == WSAETIMEDOUT;
+#else
+  return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+}  // namespace
+
 RecvResult UDPSocket::RecvFrom(void* data, size_t cap, size_t& out_len,
                                std::shared_ptr<InetAddress>& out_from) {
   sockaddr_storage from{};
@@ -77,22 +181,303 @@ RecvResult UDPSocket::RecvFrom(void* data, size_t cap, size_t& out_len,
   ssize_t n = SocketRecvFrom(handle(), data, cap,
                              reinterpret_cast<sockaddr*>(&from), &from_len);
   if (n < 0) {
-#ifdef ZNET_TARGET_WIN
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT) {
-      return RecvResult::WouldBlock;
+    return WouldBlockOnRecv() ? RecvResult::WouldBlock : RecvResult::Error;
+  }
+  out_len = static_cast<size_t>(n);
+  out_from = std::shared_ptr<InetAddress>(
+      InetAddress::from(reinterpret_cast<sockaddr*>(&from)));
+  return RecvResult::Received;
+}
+
+#ifdef ZNET_TARGET_LINUX
+namespace {
+
+// control room for what either direction carries: going out, a u16 segment
+// size and a u64 launch time; coming in, an int segment size
+union OffloadControl {
+  char buffer[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint64_t))];
+  cmsghdr align;
+};
+
+// steady_clock is CLOCK_MONOTONIC on Linux, the clock EnableTxTime() names
+uint64_t LaunchNanos(std::chrono::steady_clock::time_point launch) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          launch.time_since_epoch())
+          .count());
+}
+
+// a segmented send is one UDP datagram as far as the length field goes
+constexpr size_t kMaxSegmentedBytes = 65507;
+
+}  // namespace
+#endif
+
+size_t UDPSocket::SendBatchTo(
+    const InetAddress& addr, const SocketSlice* datagrams, size_t count,
+    const std::chrono::steady_clock::time_point* launch) {
+  size_t sent = 0;
+#ifdef ZNET_TARGET_LINUX
+  if (!tx_time_) {
+    launch = nullptr;
+  }
+  std::array<mmsghdr, kMaxBatch> messages;
+  std::array<iovec, kMaxBatch> vectors;
+  std::array<OffloadControl, kMaxBatch> controls;
+  std::array<size_t, kMaxBatch> spans;  // datagrams in each message
+  size_t next = 0;
+  while (next < count) {
+    const bool offload = send_offload_.load(std::memory_order_relaxed);
+    size_t message_count = 0;
+    size_t vector_count = 0;
+    size_t cursor = next;
+    while (cursor < count && vector_count < kMaxBatch) {
+      // with the offload, one message is a run of datagrams of one size; the
+      // kernel cuts it back up at that size, so only the last may be shorter
+      const size_t segment = datagrams[cursor].len;
+      size_t run = 1;
+      size_t bytes = segment;
+      while (offload && cursor + run < count &&
+             vector_count + run < kMaxBatch) {
+        const size_t len = datagrams[cursor + run].len;
+        if (len > segment || bytes + len > kMaxSegmentedBytes) {
+          break;
+        }
+        // one message leaves at one time, so a run shares its launch
+        if (launch != nullptr && launch[cursor + run] != launch[cursor]) {
+          break;
+        }
+        bytes += len;
+        run++;
+        if (len < segment) {
+          break;
+        }
+      }
+      for (size_t i = 0; i < run; i++) {
+        vectors[vector_count + i].iov_base =
+            const_cast<void*>(datagrams[cursor + i].data);
+        vectors[vector_count + i].iov_len = datagrams[cursor + i].len;
+      }
+      mmsghdr& message = messages[message_count];
+      message = mmsghdr{};
+      message.msg_hdr.msg_name = const_cast<sockaddr*>(addr.handle_ptr());
+      message.msg_hdr.msg_namelen = addr.addr_size();
+      message.msg_hdr.msg_iov = &vectors[vector_count];
+      message.msg_hdr.msg_iovlen = run;
+      const bool timed =
+          launch != nullptr &&
+          launch[cursor] != std::chrono::steady_clock::time_point{};
+      if (run > 1 || timed) {
+        OffloadControl& control = controls[message_count];
+        std::memset(&control, 0, sizeof(control));
+        message.msg_hdr.msg_control = control.buffer;
+        message.msg_hdr.msg_controllen =
+            (run > 1 ? CMSG_SPACE(sizeof(uint16_t)) : 0) +
+            (timed ? CMSG_SPACE(sizeof(uint64_t)) : 0);
+        cmsghdr* header = CMSG_FIRSTHDR(&message.msg_hdr);
+        if (run > 1) {
+          header->cmsg_level = SOL_UDP;
+          header->cmsg_type = UDP_SEGMENT;
+          header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+          const uint16_t segment_size = static_cast<uint16_t>(segment);
+          std::memcpy(CMSG_DATA(header), &segment_size, sizeof(segment_size));
+          header = CMSG_NXTHDR(&message.msg_hdr, header);
+        }
+        if (timed) {
+          header->cmsg_level = SOL_SOCKET;
+          header->cmsg_type = SCM_TXTIME;
+          header->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+          const uint64_t nanos = LaunchNanos(launch[cursor]);
+          std::memcpy(CMSG_DATA(header), &nanos, sizeof(nanos));
+        }
+      }
+      spans[message_count++] = run;
+      vector_count += run;
+      cursor += run;
+    }
+    const int n = sendmmsg(handle(), messages.data(),
+                           static_cast<unsigned int>(message_count), 0);
+    if (n < 0) {
+      const int error = errno;
+      if (spans[0] > 1 &&
+          (error == EIO || error == EINVAL || error == EOPNOTSUPP)) {
+        // the route cannot take the offload after all (no checksum offload,
+        // a tunnel); the same datagrams go again, one message each
+        if (send_offload_.exchange(false, std::memory_order_relaxed)) {
+          ZNET_LOG_WARN("ZDT: UDP segmentation offload refused ({}), "
+                        "sending datagrams individually.",
+                        GetLastErrorInfo());
+        }
+        continue;
+      }
+      // sendmmsg() reports only the first failure, so that message is the one
+      // refused; the rest still get their own attempt. Anything else, a full
+      // buffer above all, says nothing about the offload, which every session
+      // on this socket shares, so it stays on.
+      ZNET_LOG_DEBUG("ZDT: sendmmsg {} failed: {}", addr.readable(),
+                     GetLastErrorInfo());
+      next += spans[0];
+      continue;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(n); i++) {
+      sent += spans[i];
+      next += spans[i];
     }
+  }
 #else
-    if (errno == EWOULDBLOCK || errno == EAGAIN) {
-      return RecvResult::WouldBlock;
+  (void)launch;
+  for (size_t i = 0; i < count; i++) {
+    if (SendTo(addr, datagrams[i].data, datagrams[i].len)) {
+      sent++;
     }
+  }
 #endif
-    return RecvResult::Error;
+  return sent;
+}
+
+RecvResult UDPSocket::RecvBatch(DatagramSlot* slots, size_t count,
+                                size_t& out_count) {
+  out_count = 0;
+  if (count == 0) {
+    return RecvResult::WouldBlock;
   }
-  out_len = static_cast<size_t>(n);
-  out_from = std::shared_ptr<InetAddress>(
-      InetAddress::from(reinterpret_cast<sockaddr*>(&from)));
+#ifdef ZNET_TARGET_LINUX
+  count = std::min(count, kMaxBatch);
+  std::array<mmsghdr, kMaxBatch> messages;
+  std::array<iovec, kMaxBatch> vectors;
+  std::array<sockaddr_storage, kMaxBatch> from;
+  std::array<OffloadControl, kMaxBatch> controls;
+  for (size_t i = 0; i < count; i++) {
+    vectors[i].iov_base = slots[i].data;
+    vectors[i].iov_len = slots[i].cap;
+    messages[i] = mmsghdr{};
+    messages[i].msg_hdr.msg_name = &from[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    if (receive_offload_) {
+      messages[i].msg_hdr.msg_control = controls[i].buffer;
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+    }
+  }
+  // MSG_WAITFORONE: block (up to the receive timeout) for the first datagram
+  // only, then return with whatever else was already queued
+  const int n = recvmmsg(handle(), messages.data(),
+                         static_cast<unsigned int>(count), MSG_WAITFORONE,
+                         nullptr);
+  if (n < 0) {
+    return WouldBlockOnRecv() ? RecvResult::WouldBlock : RecvResult::Error;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(n); i++) {
+    slots[i].len = messages[i].msg_len;
+    slots[i].from = PeerKey::From(reinterpret_cast<sockaddr*>(&from[i]));
+    slots[i].segment_size = 0;
+    if (!receive_offload_) {
+      continue;
+    }
+    for (cmsghdr* header = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+         header != nullptr;
+         header = CMSG_NXTHDR(&messages[i].msg_hdr, header)) {
+      if (header->cmsg_level == SOL_UDP && header->cmsg_type == UDP_GRO) {
+        int segment_size = 0;
+        std::memcpy(&segment_size, CMSG_DATA(header), sizeof(segment_size));
+        if (segment_size > 0 &&
+            static_cast<size_t>(segment_size) < slots[i].len) {
+          slots[i].segment_size = static_cast<size_t>(segment_size);
+        }
+      }
+    }
+  }
+  out_count = static_cast<size_t>(n);
+  return RecvResult::Received;
+#else
+  sockaddr_storage from{};
+  socklen_t from_len = sizeof(from);
+  const ssize_t first =
+      SocketRecvFrom(handle(), slots[0].data, slots[0].cap,
+                     reinterpret_cast<sockaddr*>(&from), &from_len);
+  if (first < 0) {
+    return WouldBlockOnRecv() ? RecvResult::WouldBlock : RecvResult::Error;
+  }
+  slots[0].len = static_cast<size_t>(first);
+  slots[0].from = PeerKey::From(reinterpret_cast<sockaddr*>(&from));
+  slots[0].segment_size = 0;
+  out_count = 1;
+#ifndef ZNET_TARGET_WIN
+  // the rest without waiting; Windows has no per-call non-blocking flag, so
+  // there a call takes the one datagram
+  while (out_count < count) {
+    DatagramSlot& slot = slots[out_count];
+    from_len = sizeof(from);
+    const ssize_t n = recvfrom(handle(), slot.data, slot.cap, MSG_DONTWAIT,
+                               reinterpret_cast<sockaddr*>(&from), &from_len);
+    if (n < 0) {
+      break;  // nothing more queued, or an error the next call will report
+    }
+    slot.len = static_cast<size_t>(n);
+    slot.from = PeerKey::From(reinterpret_cast<sockaddr*>(&from));
+    slot.segment_size = 0;
+    out_count++;
+  }
+#endif
   return RecvResult::Received;
+#endif
+}
+
+bool UDPSocket::EnableSendOffload() {
+#ifdef ZNET_TARGET_LINUX
+  // a probe only: the size goes with each send, so the socket-wide default
+  // stays off and a lone datagram is never segmented
+  int value = 0;
+  socklen_t len = sizeof(value);
+  if (getsockopt(handle(), SOL_UDP, UDP_SEGMENT, &value, &len) != 0) {
+    return false;
+  }
+  send_offload_.store(true, std::memory_order_relaxed);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool UDPSocket::EnableReceiveOffload() {
+#ifdef ZNET_TARGET_LINUX
+  const int enabled = 1;
+  if (setsockopt(handle(), SOL_UDP, UDP_GRO, &enabled, sizeof(enabled)) != 0) {
+    return false;
+  }
+  receive_offload_ = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool UDPSocket::EnableReusePort() {
+#ifdef ZNET_TARGET_LINUX
+  const int enabled = 1;
+  return setsockopt(handle(), SOL_SOCKET, SO_REUSEPORT, &enabled,
+                    sizeof(enabled)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool UDPSocket::EnableTxTime() {
+#ifdef ZNET_TARGET_LINUX
+  struct {
+    clockid_t clockid;
+    uint32_t flags;
+  } config{CLOCK_MONOTONIC, 0};
+  if (setsockopt(handle(), SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) !=
+      0) {
+    return false;
+  }
+  tx_time_ = true;
+  return true;
+#else
+  return false;
+#endif
 }
 
 bool UDPSocket::SetBlocking(bool blocking) {
@@ -199,28 +584,169 @@ Result UDPSocket::Close() {
   return Result::Success;
 }
 
+// ---------------------------------------------------------------------------
+// ZDTDatagramPool
+// ---------------------------------------------------------------------------
+
+ZDTDatagramPool::ZDTDatagramPool(size_t max_pooled, size_t producers)
+    : producers_(std::max<size_t>(producers, 1)),
+      per_producer_(std::max<size_t>(max_pooled / producers_, 1)),
+      free_(new FreeList[producers_]) {}
+
+Buffer ZDTDatagramPool::Copy(const char* data, size_t len, bool& out_hit,
+                             size_t producer) {
+  std::vector<Buffer>& free = free_[producer].buffers;
+  Buffer datagram(Endianness::BigEndian);
+  out_hit = !free.empty();
+  if (out_hit) {
+    datagram = std::move(free.back());
+    free.pop_back();
+  } else {
+    // sized for any datagram, so it never regrows once it is circulating
+    datagram.ReserveExact(std::max<size_t>(len, ZNET_MAX_BUFFER_SIZE));
+  }
+  datagram.Write(data, len);
+  return datagram;
+}
+
+void ZDTDatagramPool::Recycle(Buffer&& datagram, size_t producer) {
+  std::vector<Buffer>& free = free_[producer].buffers;
+  if (free.size() < per_producer_) {
+    datagram.Reset();
+    free.push_back(std::move(datagram));
+  }
+}
+
+void ZDTDatagramPool::Recycle(std::vector<Buffer>& datagrams, size_t producer) {
+  for (Buffer& datagram : datagrams) {
+    Recycle(std::move(datagram), producer);
+  }
+  datagrams.clear();
+}
+
+void ZDTDatagramPool::Refill(SpscQueue<Buffer>& returned, size_t producer) {
+  std::vector<Buffer>& free = free_[producer].buffers;
+  // while the list lasts, what comes back waits in the queue: refilling on
+  // every push would cost an acquire on the consumer's cursor per datagram
+  if (!free.empty()) {
+    return;
+  }
+  Buffer datagram;
+  while (free.size() < per_producer_ && returned.Pop(datagram)) {
+    free.push_back(std::move(datagram));
+  }
+}
+
 // ---------------------------------------------------------------------------
 // ZDTInbox
 // ---------------------------------------------------------------------------
 
-bool ZDTInbox::Push(Buffer&& datagram, size_t limit) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (queue_.size() >= limit) {
-    dropped_++;
-    return false;
+ZDTInbox::ZDTInbox(size_t limit, std::shared_ptr<ZDTDatagramPool> pool,
+                   size_t producers)
+    : pool_(std::move(pool)),
+      limit_(limit),
+      producers_(std::max<size_t>(producers, 1)),
+      lanes_(new std::atomic<Lane*>[producers_]),
+      drained_(new size_t[producers_]()) {
+  for (size_t i = 0; i < producers_; i++) {
+    lanes_[i].store(nullptr, std::memory_order_relaxed);
   }
-  queue_.push_back(std::move(datagram));
-  return true;
 }
 
-void ZDTInbox::Drain(std::deque<Buffer>& out) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  out.swap(queue_);
+ZDTInbox::~ZDTInbox() {
+  for (size_t i = 0; i < producers_; i++) {
+    delete lanes_[i].load(std::memory_order_relaxed);
+  }
+}
+
+bool ZDTInbox::Push(const char* data, size_t len, size_t producer) {
+  Lane* lane = lanes_[producer].load(std::memory_order_relaxed);
+  if (!lane) {
+    // most inboxes only ever hear from one shard, so the others never
+    // allocate a lane. release: the consumer must see it constructed.
+    lane = new Lane(limit_,
+                    pool_ ? std::min(limit_, pool_->per_producer()) : 1);
+    lanes_[producer].store(lane, std::memory_order_release);
+  }
+  bool hit = false;
+  Buffer datagram(Endianness::BigEndian);
+  if (pool_) {
+    pool_->Refill(lane->returned, producer);
+    datagram = pool_->Copy(data, len, hit, producer);
+  } else {
+    datagram = Buffer(data, len, Endianness::BigEndian);
+  }
+  if (lane->datagrams.Push(std::move(datagram))) {
+    if (pool_) {
+      (hit ? pool_hits_ : pool_misses_).fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+  if (pool_) {
+    pool_->Recycle(std::move(datagram), producer);
+  }
+  return false;
+}
+
+void ZDTInbox::Drain(std::vector<Buffer>& out) {
+  for (size_t i = 0; i < producers_; i++) {
+    if (Lane* lane = lanes_[i].load(std::memory_order_acquire)) {
+      drained_[i] += lane->datagrams.DrainTo(out);
+    }
+  }
+}
+
+void ZDTInbox::Recycle(std::vector<Buffer>& drained) {
+  if (pool_) {
+    // in the order Drain() appended them. Any buffer fits any producer, so a
+    // miscount would only send one to the wrong pool share
+    size_t next = 0;
+    for (size_t i = 0; i < producers_ && next < drained.size(); i++) {
+      Lane* lane = lanes_[i].load(std::memory_order_acquire);
+      const size_t end = std::min(drained.size(), next + drained_[i]);
+      for (; lane && next < end; next++) {
+        drained[next].Reset();
+        if (!lane->returned.Push(std::move(drained[next]))) {
+          break;  // the producer has its share waiting already
+        }
+      }
+      next = end;
+    }
+  }
+  for (size_t i = 0; i < producers_; i++) {
+    drained_[i] = 0;
+  }
+  // what did not go back is freed here, on the consumer's thread
+  drained.clear();
 }
 
 size_t ZDTInbox::dropped() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return dropped_;
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+size_t ZDTInbox::pool_hits() const {
+  return pool_hits_.load(std::memory_order_relaxed);
+}
+
+size_t ZDTInbox::pool_misses() const {
+  return pool_misses_.load(std::memory_order_relaxed);
+}
+
+void ZDTInbox::SetPeer(std::shared_ptr<InetAddress> peer) {
+  std::lock_guard<std::mutex> lock(peer_mutex_);
+  peer_ = std::move(peer);
+  has_peer_.store(true, std::memory_order_release);
+}
+
+std::shared_ptr<InetAddress> ZDTInbox::TakePeer() {
+  // checked every tick, and almost always false
+  if (!has_peer_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(peer_mutex_);
+  has_peer_.store(false, std::memory_order_relaxed);
+  return std::move(peer_);
 }
 
 }  // namespace backends
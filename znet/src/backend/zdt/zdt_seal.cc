@@ -0,0 +1,168 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#include "znet/backends/zdt/zdt_seal.h"
+
+#include <openssl/crypto.h>
+
+#include <cstring>
+#include <limits>
+
+namespace znet {
+namespace backends {
+
+namespace {
+
+constexpr size_t kNonceLen = 12;  // 4 salt + 8 packet sequence
+
+void BuildNonce(const unsigned char* salt, SequenceId seq,
+                unsigned char* out) {
+  std::memcpy(out, salt, 4);
+  for (size_t i = 0; i < 8; i++) {
+    out[4 + i] = static_cast<unsigned char>((seq >> (8 * (7 - i))) & 0xFFu);
+  }
+}
+
+// what OpenSSL's int lengths can take; a datagram never comes close
+bool FitsInt(size_t len) {
+  return len <= static_cast<size_t>(std::numeric_limits<int>::max());
+}
+
+}  // namespace
+
+ZDTDatagramSealer::~ZDTDatagramSealer() {
+  EVP_CIPHER_CTX_free(seal_ctx_);
+  EVP_CIPHER_CTX_free(open_ctx_);
+  OPENSSL_cleanse(&keys_, sizeof(keys_));
+}
+
+void ZDTDatagramSealer::Install(const DatagramKeys& keys) {
+  keys_ = keys;
+  seal_keyed_ = false;
+  open_keyed_ = false;
+  installed_ = true;
+}
+
+bool ZDTDatagramSealer::Seal(WireSeq packet_seq, const uint8_t* header,
+                             size_t header_len, uint8_t* body,
+                             size_t body_len) {
+  if (!installed_ || !FitsInt(header_len) || !FitsInt(body_len)) {
+    return false;
+  }
+  if (!seal_ctx_) {
+    seal_ctx_ = EVP_CIPHER_CTX_new();
+    if (!seal_ctx_) {
+      return false;
+    }
+  }
+  // packet_seq skips 0 on wraparound, so the full value is rebuilt rather
+  // than counted: that keeps its low bits equal to what the header says
+  const SequenceId seq = ReconstructSeq(packet_seq, sent_ + 1);
+  unsigned char nonce[kNonceLen];
+  BuildNonce(keys_.tx_salt, seq, nonce);
+  // keyed once; every later datagram only resets the nonce
+  if (!seal_keyed_) {
+    const EVP_CIPHER* cipher = GetCipherSuiteEvp(keys_.suite);
+    if (!cipher ||
+        1 != EVP_EncryptInit_ex(seal_ctx_, cipher, nullptr, nullptr, nullptr) ||
+        1 != EVP_CIPHER_CTX_ctrl(seal_ctx_, EVP_CTRL_AEAD_SET_IVLEN,
+                                 static_cast<int>(kNonceLen), nullptr) ||
+        1 != EVP_EncryptInit_ex(seal_ctx_, nullptr, nullptr, keys_.tx_key,
+                                nonce)) {
+      return false;
+    }
+    seal_keyed_ = true;
+  } else if (1 != EVP_EncryptInit_ex(seal_ctx_, nullptr, nullptr, nullptr,
+                                     nonce)) {
+    return false;
+  }
+  int len = 0;
+  if (1 != EVP_EncryptUpdate(seal_ctx_, nullptr, &len, header,
+                             static_cast<int>(header_len))) {
+    return false;
+  }
+  // every suite is a stream cipher, so in place is safe and the length is
+  // unchanged
+  if (body_len > 0 &&
+      1 != EVP_EncryptUpdate(seal_ctx_, body, &len, body,
+                             static_cast<int>(body_len))) {
+    return false;
+  }
+  if (1 != EVP_EncryptFinal_ex(seal_ctx_, body + body_len, &len) ||
+      1 != EVP_CIPHER_CTX_ctrl(seal_ctx_, EVP_CTRL_AEAD_GET_TAG,
+                               static_cast<int>(kZDTSealTagSize),
+                               body + body_len)) {
+    return false;
+  }
+  sent_ = seq;
+  return true;
+}
+
+bool ZDTDatagramSealer::Open(WireSeq packet_seq, const uint8_t* header,
+                             size_t header_len, uint8_t* body, size_t len) {
+  if (!installed_ || len < kZDTSealTagSize || !FitsInt(header_len) ||
+      !FitsInt(len)) {
+    return false;
+  }
+  if (!open_ctx_) {
+    open_ctx_ = EVP_CIPHER_CTX_new();
+    if (!open_ctx_) {
+      return false;
+    }
+  }
+  const size_t body_len = len - kZDTSealTagSize;
+  const SequenceId seq = ReconstructSeq(packet_seq, opened_ + 1);
+  unsigned char nonce[kNonceLen];
+  BuildNonce(keys_.rx_salt, seq, nonce);
+  if (!open_keyed_) {
+    const EVP_CIPHER* cipher = GetCipherSuiteEvp(keys_.suite);
+    if (!cipher ||
+        1 != EVP_DecryptInit_ex(open_ctx_, cipher, nullptr, nullptr, nullptr) ||
+        1 != EVP_CIPHER_CTX_ctrl(open_ctx_, EVP_CTRL_AEAD_SET_IVLEN,
+                                 static_cast<int>(kNonceLen), nullptr) ||
+        1 != EVP_DecryptInit_ex(open_ctx_, nullptr, nullptr, keys_.rx_key,
+                                nonce)) {
+      return false;
+    }
+    open_keyed_ = true;
+  } else if (1 != EVP_DecryptInit_ex(open_ctx_, nullptr, nullptr, nullptr,
+                                     nonce)) {
+    return false;
+  }
+  int out = 0;
+  if (1 != EVP_DecryptUpdate(open_ctx_, nullptr, &out, header,
+                             static_cast<int>(header_len))) {
+    return false;
+  }
+  if (body_len > 0 &&
+      1 != EVP_DecryptUpdate(open_ctx_, body, &out, body,
+                             static_cast<int>(body_len))) {
+    return false;
+  }
+  if (1 != EVP_CIPHER_CTX_ctrl(open_ctx_, EVP_CTRL_AEAD_SET_TAG,
+                               static_cast<int>(kZDTSealTagSize),
+                               body + body_len) ||
+      1 != EVP_DecryptFinal_ex(open_ctx_, body + body_len, &out)) {
+    return false;  // forged or altered
+  }
+  // only a datagram that authenticated may move the window, or one forged
+  // packet_seq far ahead would lock out every real one behind it
+  if (!replay_.Accept(seq)) {
+    return false;
+  }
+  if (seq > opened_) {
+    opened_ = seq;
+  }
+  peer_sealing_ = true;
+  return true;
+}
+
+}  // namespace backends
+}  // namespace znet
@@ -18,6 +18,7 @@
 #include "znet/util.h"
 
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstring>
 #include <thread>
@@ -27,12 +28,26 @@ namespace backends {
 
 using steady_clock = std::chrono::steady_clock;
 
+namespace {
+
+// delivered message buffers kept for reuse. They come back as fast as the
+// session consumes them, so this only needs to cover what one tick delivers
+// before the session gets to it.
+constexpr size_t kMessagePoolSize = 64;
+
+// where sent_packets_ starts. It doubles from here only while datagrams still
+// awaiting an ack would otherwise lose their slots.
+constexpr size_t kMinSentRing = 64;
+
+// finished reassemblies kept for their buffers. Few, since each can hold a
+// whole message of up to 255 fragments.
+constexpr size_t kSpareReassemblies = 2;
+// the buffers one spare may keep: a message of a few fragments, which is the
+// common case worth not reallocating for
+constexpr size_t kMaxSpareReassemblyBytes = 16 * 1024;
+
+}  // namespace
 
-ZDTTransportLayer::TransmissionLog ZDTTransportLayer::MakeLog(WireSeq seq) {
-  TransmissionLog log;
-  log.Add(seq);
-  return log;
-}
 // ---------------------------------------------------------------------------
 // ZDTTransportLayer
 // ---------------------------------------------------------------------------
@@ -47,16 +62,32 @@ ZDTTransportLayer::ZDTTransportLayer(std::shared_ptr<UDPSocket> socket,
       peer_(std::move(peer)),
       config_(std::move(config)),
       drains_own_socket_(drains_own_socket),
-      inbox_(inbox ? std::move(inbox) : std::make_shared<ZDTInbox>()),
+      inbox_(inbox ? std::move(inbox)
+                   : std::make_shared<ZDTInbox>(config_.max_inbox_datagrams)),
       connection_(connection),
       // config_, not the parameter, which has been moved from by this point
       outbound_(config_.outbound_queue_capacity),
+      send_batch_(std::min(std::max<size_t>(config_.send_batch, 1),
+                           UDPSocket::kMaxBatch)),
       keepalive_interval_(common.keepalive_interval),
       idle_timeout_(common.idle_timeout),
       last_recv_(steady_clock::now()),
-      last_send_(steady_clock::now()) {
+      last_send_(steady_clock::now()),
+      congestion_(MakeZDTCongestionController(config_.congestion_algorithm)),
+      pacing_(config_.pacing) {
   rtt_.Reset(compat::Clamp(std::chrono::milliseconds(200), config_.rto_min,
                            config_.rto_max));
+  // the model-based controller is built around being paced
+  if (pacing_ == ZDTPacing::Off &&
+      config_.congestion_algorithm == ZDTCongestionAlgorithm::Bbr) {
+    pacing_ = ZDTPacing::Worker;
+  }
+  if (pacing_ == ZDTPacing::Kernel && !(socket_ && socket_->tx_time())) {
+    pacing_ = ZDTPacing::Worker;
+  }
+  for (uint8_t channel : config_.fec_channels) {
+    fec_channels_.set(channel);
+  }
   recv_scratch_.ReserveExact(ZNET_MAX_BUFFER_SIZE);
 }
 
@@ -69,9 +100,40 @@ std::shared_ptr<Buffer> ZDTTransportLayer::Receive() {
   if (ready_.empty()) {
     return nullptr;
   }
-  auto buffer = ready_.front();
+  Inbound inbound = std::move(ready_.front());
   ready_.pop_front();
-  return buffer;
+  last_receive_sealed_ = inbound.sealed;
+  return std::move(inbound.payload);
+}
+
+bool ZDTTransportLayer::InstallDatagramKeys(const DatagramKeys& keys) {
+  ZNET_ZDT_ENTER_DOMAIN(worker_domain_);
+  if (!connection_.sealed) {
+    return false;
+  }
+  sealer_.Install(keys);
+  // what the FEC decoders hold arrived unauthenticated, and a message rebuilt
+  // from here on counts as sealed, so they start over
+  for (auto& entry : channels_) {
+    entry.second.fec_receive.reset();
+  }
+  return true;
+}
+
+bool ZDTTransportLayer::OpenDatagram(Buffer& buffer, size_t header_begin,
+                                     const ZDTHeader& header) {
+  const size_t body = buffer.read_cursor();
+  auto* data = reinterpret_cast<uint8_t*>(buffer.data_mutable());
+  if (!sealer_.Open(header.packet_seq, data + header_begin,
+                    body - header_begin, data + body, buffer.size() - body)) {
+    return false;
+  }
+  buffer.set_write_cursor(buffer.size() - kZDTSealTagSize);
+  return true;
+}
+
+size_t ZDTTransportLayer::BundleBudget() const {
+  return bundle_budget_.load(std::memory_order_relaxed);
 }
 
 bool ZDTTransportLayer::Send(std::shared_ptr<Buffer> buffer, SendOptions options) {
@@ -91,10 +153,7 @@ bool ZDTTransportLayer::Send(std::shared_ptr<Buffer> buffer, SendOptions options
 }
 
 void ZDTTransportLayer::OnDatagram(const uint8_t* data, size_t len) {
-  // the copy into a parse-ready buffer happens here, outside the inbox lock
-  Buffer datagram(reinterpret_cast<const char*>(data), len,
-                  Endianness::BigEndian);
-  if (!inbox_->Push(std::move(datagram), config_.max_inbox_datagrams)) {
+  if (!inbox_->Push(reinterpret_cast<const char*>(data), len)) {
     ZNET_METRIC(metrics_.zdt.inbound_dropped++);
   }
 }
@@ -103,19 +162,23 @@ void ZDTTransportLayer::FillMetrics(SessionMetrics& out) const {
 #if ZNET_ENABLE_METRICS
   out.zdt = metrics_.zdt;
   out.zdt.inbound_dropped += inbox_->dropped();
+  out.zdt.pool_hits += inbox_->pool_hits();
+  out.zdt.pool_misses += inbox_->pool_misses();
   out.common.wire_bytes_sent = metrics_.common.wire_bytes_sent;
   out.common.wire_bytes_received = metrics_.common.wire_bytes_received;
   // live state, sampled at call time
   out.zdt.srtt_us = static_cast<uint32_t>(rtt_.srtt_ms() * 1000.0);
   out.zdt.rtt_min_us = static_cast<uint32_t>(rtt_.rtt_min_ms() * 1000.0);
   out.zdt.rto_us = static_cast<uint32_t>(rtt_.rto().count() * 1000);
-  out.zdt.cwnd = static_cast<uint32_t>(congestion_.cwnd());
+  out.zdt.cwnd = static_cast<uint32_t>(congestion_->cwnd());
+  out.zdt.pacing_rate = static_cast<uint32_t>(pacer_.rate());
   // datagrams, not messages: this is the quantity the congestion window bounds
   // and the one worth reading against cwnd and max_datagrams_in_flight.
-  // Coalescing puts many messages in one datagram, so unacked_.size() is a
+  // Coalescing puts many messages in one datagram, so unacked_count_ is a
   // different and much larger number.
   out.zdt.in_flight = static_cast<uint32_t>(in_flight_datagrams_);
   out.zdt.mtu = connection_.mtu;
+  out.zdt.state_bytes = StateBytes();
 #else
   (void)out;
 #endif
@@ -133,26 +196,45 @@ void ZDTTransportLayer::DrainSocket() {
       break;
     }
     recv_scratch_.CommitWrite(len);
-    inbox_->Push(Buffer(recv_scratch_.data(), recv_scratch_.size(),
-                        Endianness::BigEndian),
-                 config_.max_inbox_datagrams);
+    inbox_->Push(recv_scratch_.data(), recv_scratch_.size());
   }
 }
 
 void ZDTTransportLayer::ProcessInbound() {
-  // cleared here, not after the loop: the FIN path returns early and Drain()
-  // swaps, so leftovers would land back in the inbox and be processed twice.
-  inbound_scratch_.clear();
+  // the last drain's datagrams go back here, not after the loop: the FIN path
+  // returns early and Drain() appends, so leftovers would be processed twice.
+  // Every record in them has been copied out.
+  inbox_->Recycle(inbound_scratch_);
   inbox_->Drain(inbound_scratch_);
+  // the server's receive thread verified the peer now sends from elsewhere
+  if (std::shared_ptr<InetAddress> moved = inbox_->TakePeer()) {
+    ZNET_LOG_DEBUG("ZDT: peer {} moved to {}", peer_->readable(),
+                   moved->readable());
+    std::lock_guard<std::mutex> lock(peer_mutex_);
+    peer_ = std::move(moved);
+  }
   for (Buffer& buffer : inbound_scratch_) {
     if (buffer.size() == 0 ||
         !(static_cast<uint8_t>(buffer.data()[0]) & kFlagOnline)) {
       continue;  // stray/offline datagram on a connected transport
     }
+    const size_t header_begin = buffer.read_cursor();
     ZDTHeader header;
     if (!ReadZDTHeader(buffer, header)) {
       continue;
     }
+    // authenticated before anything in it is believed, the acks included
+    inbound_sealed_ = (header.flags & kFlagSealed) != 0;
+    if (inbound_sealed_) {
+      if (!OpenDatagram(buffer, header_begin, header)) {
+        continue;  // forged, altered, replayed, or here before the keys
+      }
+    } else if (sealer_.peer_sealing() && !(header.flags & kFlagFin)) {
+      // the peer seals everything once it starts, so this is stale or forged.
+      // The exception is the FIN Close() writes from the application's
+      // thread, which has no cipher state to seal it with
+      continue;
+    }
     last_recv_ = steady_clock::now();
     ZNET_METRIC(metrics_.zdt.datagrams_received++);
     ZNET_METRIC(metrics_.common.wire_bytes_received += buffer.size());
@@ -176,6 +258,12 @@ void ZDTTransportLayer::ProcessInbound() {
       SendControl(kFlagPong);
       continue;
     }
+    // with the keys here, the peer's messages come sealed, or will when it
+    // retransmits them. Left unacked rather than taken on trust
+    if (!inbound_sealed_ && sealer_.installed() &&
+        buffer.readable_bytes() > 0) {
+      continue;
+    }
     // everything after the header is a run of records. a datagram with none is
     // a bare ack, pong or keepalive, already handled above.
     bool accepted_all = true;
@@ -208,20 +296,78 @@ void ZDTTransportLayer::ProcessInbound() {
 
 bool ZDTTransportLayer::OnRecord(const ZDTRecord& record, const uint8_t* data,
                                  size_t len) {
+  if (record.flags & kRecParity) {
+    OnParity(record, data, len);
+    return true;
+  }
   if (record.flags & kRecFragment) {
     return OnDataFragment(record, data, len);
   }
-  DeliverMessage(record,
-                 std::make_shared<Buffer>(reinterpret_cast<const char*>(data),
-                                          len));
+  auto channel = channels_.find(record.channel);
+  if (channel != channels_.end() && channel->second.fec_receive &&
+      !channel->second.fec_receive->OnRecord(record, data, len)) {
+    ZNET_METRIC(metrics_.zdt.duplicates_dropped++);
+    return true;  // parity got here first
+  }
+  DeliverMessage(record, MessageBuffer(data, len), inbound_sealed_);
   return true;
 }
 
+void ZDTTransportLayer::OnParity(const ZDTRecord& record, const uint8_t* data,
+                                 size_t len) {
+  ChannelState& channel = channels_[record.channel];
+  if (!channel.fec_receive) {
+    // the channel's messages are remembered from here on. Nothing before
+    // this parity was, so its own group cannot be rebuilt
+    channel.fec_receive.reset(new ZDTFecDecoder());
+    return;
+  }
+  ZDTRecord rebuilt;
+  const uint8_t* payload = nullptr;
+  if (!channel.fec_receive->Recover(data, len, rebuilt, payload)) {
+    return;
+  }
+  rebuilt.channel = record.channel;
+  ZNET_METRIC(metrics_.zdt.fec_recovered++);
+  // never a fragment, so it is whole. A reliable one is still resent, since
+  // its datagram went unacked, and dropped on arrival as a duplicate
+  DeliverMessage(rebuilt, MessageBuffer(payload, rebuilt.length),
+                 inbound_sealed_);
+}
+
+std::shared_ptr<Buffer> ZDTTransportLayer::MessageBuffer(const uint8_t* data,
+                                                         size_t len) {
+  // the oldest buffer handed out is the likeliest to be back: once the session
+  // and its handler let go, the pool holds the only reference
+  if (!message_pool_.empty() && message_pool_.front().use_count() == 1) {
+    // pairs with the release in whichever thread dropped the last other
+    // reference, so its reads of the old contents finish before these writes
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::shared_ptr<Buffer> buffer = std::move(message_pool_.front());
+    message_pool_.pop_front();
+    buffer->Reset();
+    buffer->SetReadLimit(0);
+    buffer->set_endianness(Endianness::LittleEndian);
+    buffer->Write(reinterpret_cast<const char*>(data), len);
+    message_pool_.push_back(buffer);
+    ZNET_METRIC(metrics_.zdt.pool_hits++);
+    return buffer;
+  }
+  ZNET_METRIC(metrics_.zdt.pool_misses++);
+  auto buffer = std::make_shared<Buffer>();
+  // room for any record, so a reused buffer never regrows
+  buffer->ReserveExact(std::max<size_t>(len, connection_.mtu));
+  buffer->Write(reinterpret_cast<const char*>(data), len);
+  if (message_pool_.size() >= kMessagePoolSize) {
+    // still held by the application; it is freed whenever that lets go
+    message_pool_.pop_front();
+  }
+  message_pool_.push_back(buffer);
+  return buffer;
+}
+
 void ZDTTransportLayer::FlushOutbound() {
-  uint16_t mtu = connection_.mtu != 0
-                     ? connection_.mtu
-                     : ZDTPayloadForLinkMTU(config_.mtu_ladder.back(),
-                                            peer_->ipv());
+  uint16_t mtu = static_cast<uint16_t>(DatagramBudget());
   const size_t floor = kZDTHeaderReserve + kZDTFragRecordHeaderSize + 1;
   if (mtu < floor) {
     mtu = static_cast<uint16_t>(floor);
@@ -232,34 +378,49 @@ void ZDTTransportLayer::FlushOutbound() {
   // many the encoder emitted.
   const size_t unfrag_capacity = mtu - kZDTHeaderReserve - kZDTRecordHeaderSize;
   const size_t frag_capacity = mtu - kZDTHeaderReserve - kZDTFragRecordHeaderSize;
+  if (config_.bundle_messages) {
+    bundle_budget_.store(unfrag_capacity, std::memory_order_relaxed);
+  }
 
   // pack into as few datagrams as the MTU allows rather than one each
   std::vector<PendingRecord>& batch = batch_scratch_;
   batch.clear();
   batch.reserve(SentInfo::kMaxKeys);
   size_t batch_bytes = kZDTHeaderReserve;
+  // the channels whose open parity group already has a member in the batch
+  std::bitset<256> grouped_in_batch;
   auto flush_batch = [&]() {
     if (batch.empty()) {
       return;
     }
     WireSeq packet = SendBatch(0, batch.data(), batch.size());
     for (const PendingRecord& pending : batch) {
-      if (!pending.reliable) {
-        continue;
-      }
-      auto it = unacked_.find(pending.key);
-      if (it != unacked_.end()) {
-        it->second.packets.Add(packet);
+      if (pending.reliable) {
+        Unacked(pending.slot).packets.Add(packet);
       }
     }
     batch.clear();
     batch_bytes = kZDTHeaderReserve;
+    grouped_in_batch.reset();
+  };
+
+  // closes a channel's parity group. The parity starts a datagram of its own,
+  // never sharing one with the messages it covers: losing that datagram would
+  // lose the parity with them.
+  auto send_parity = [&](uint8_t channel, ZDTFecEncoder& fec) {
+    flush_batch();
+    if (!fec_parity_) {
+      fec_parity_ = std::make_shared<Buffer>(Endianness::BigEndian);
+    }
+    fec_parity_->Reset();
+    fec.Finish(*fec_parity_);
+    const size_t length = fec_parity_->size();
+    batch.push_back(MakeRecord(fec_parity_, 0, length, kRecParity, channel, 0,
+                               0, 1, /*reliable=*/false));
+    batch_bytes += ZDTRecordSize(/*fragment=*/false, length);
+    ZNET_METRIC(metrics_.zdt.fec_parity_sent++);
   };
 
-  // bound the gap between the newest send and the oldest unacked message to half
-  // a wire period, so a late retransmit can never reconstruct onto a live message.
-  // cwnd normally keeps the gap far below this.
-  constexpr SequenceId kMaxSeqGap = (SequenceId{1} << 16) / 2;
   const TimePoint now = steady_clock::now();
 
   // packs one message: batched when it fits a shared datagram, split into
@@ -286,8 +447,29 @@ void ZDTTransportLayer::FlushOutbound() {
 
     // small enough for one datagram, so it can share one with its neighbours.
     if (total <= unfrag_capacity) {
+      // a protected message joins its channel's open group, closing it first
+      // if the parity would outgrow a datagram. One too large for any group
+      // goes unprotected.
+      ZDTFecEncoder* fec = nullptr;
+      if (fec_channels_.test(channel)) {
+        if (!state.fec_send) {
+          state.fec_send.reset(new ZDTFecEncoder(config_.fec_group_size));
+        }
+        if (!state.fec_send->Fits(total, unfrag_capacity) &&
+            state.fec_send->count() > 0 &&
+            ZDTFecEncoder::ParitySize(1, total) <= unfrag_capacity) {
+          send_parity(channel, *state.fec_send);
+        }
+        if (state.fec_send->Fits(total, unfrag_capacity)) {
+          fec = state.fec_send.get();
+        }
+      }
       size_t need = ZDTRecordSize(/*fragment=*/false, total);
-      if (batch_bytes + need > mtu || batch.size() >= SentInfo::kMaxKeys) {
+      // parity rebuilds one missing member, so no datagram may carry two of
+      // a group: a burst of small messages would otherwise share one, and
+      // losing it would take the group past repair
+      if (batch_bytes + need > mtu || batch.size() >= SentInfo::kMaxKeys ||
+          (fec != nullptr && grouped_in_batch.test(channel))) {
         flush_batch();
       }
       PendingRecord pending =
@@ -296,10 +478,18 @@ void ZDTTransportLayer::FlushOutbound() {
       if (reliable) {
         // filed before the send so window accounting is right while the batch
         // fills; flush_batch() logs the packet_seq once it goes out.
-        TrackReliable(pending, read_base, now, TransmissionLog{});
+        pending.slot = TrackReliable(pending, read_base, now);
+      }
+      if (fec != nullptr) {
+        fec->Add(pending.record,
+                 reinterpret_cast<const uint8_t*>(pending.payload), total);
+        grouped_in_batch.set(channel);
       }
       batch.push_back(std::move(pending));
       batch_bytes += need;
+      if (fec != nullptr && fec->full()) {
+        send_parity(channel, *fec);
+      }
       return;
     }
 
@@ -321,9 +511,12 @@ void ZDTTransportLayer::FlushOutbound() {
       PendingRecord pending =
           MakeRecord(queued.payload, read_base + rel_offset, length, frag_flags,
                      channel, message_seq, i, frag_count, reliable);
+      if (reliable) {
+        pending.slot = TrackReliable(pending, read_base + rel_offset, now);
+      }
       WireSeq packet = SendBatch(0, &pending, 1);
       if (reliable) {
-        TrackReliable(pending, read_base + rel_offset, now, MakeLog(packet));
+        Unacked(pending.slot).packets.Add(packet);
       }
     }
   };
@@ -361,7 +554,7 @@ void ZDTTransportLayer::FlushOutbound() {
       if (next_reliable) {
         // both windows are global, but the lane is only skipped: another
         // lane's front may be unreliable and free to go
-        if (unacked_.size() >= static_cast<size_t>(config_.max_messages_in_flight)) {
+        if (unacked_count_ >= static_cast<size_t>(config_.max_messages_in_flight)) {
           continue;
         }
         // the real congestion window: anything past what an ack can describe
@@ -369,15 +562,17 @@ void ZDTTransportLayer::FlushOutbound() {
         if (in_flight_datagrams_ >= static_cast<size_t>(SendWindow())) {
           continue;
         }
-        if (!unacked_.empty()) {
-          auto oldest = unacked_.lower_bound(MsgKey{lane.channel, true, 0, 0});
-          if (oldest != unacked_.end() &&
-              oldest->first.channel == lane.channel &&
-              oldest->first.reliable &&
-              channels_[lane.channel].rel_send - oldest->first.message_seq >=
-                  kMaxSeqGap) {
-            continue;  // stalled until its oldest unacked message is retired
-          }
+        // and the pacer, when the window is spread over the round trip
+        if (PacedUntil() > now) {
+          continue;
+        }
+        // and the gap between the newest send and the oldest unacked
+        // message; see kZDTMaxSeqGap. cwnd normally keeps it far below this.
+        const ChannelState& state = channels_[lane.channel];
+        if (state.unacked_oldest != kNoSlot &&
+            state.rel_send - Unacked(state.unacked_oldest).message_seq >=
+                kZDTMaxSeqGap) {
+          continue;  // stalled until its oldest unacked message is retired
         }
       }
       QueuedOut queued = std::move(lane.messages.front());
@@ -387,13 +582,19 @@ void ZDTTransportLayer::FlushOutbound() {
       sent_any = true;
     }
     if (!sent_any) {
-      break;  // every lane is empty or refused by the window
+      break;  // every lane is empty or refused by the window or the pacer
     }
     // rotate so a window with room for fewer messages than there are lanes
     // serves a different lane first next time
     staged_cursor_ = (staged_cursor_ + 1) % lanes;
   }
   flush_batch();  // whatever is left over goes out now, not next tick
+  // nothing left to send with the window open: the acks for this flight will
+  // measure the application's rate, not the path's
+  if (staged_count_ == 0 &&
+      in_flight_datagrams_ < static_cast<size_t>(SendWindow())) {
+    congestion_->OnAppLimited();
+  }
 }
 
 size_t ZDTTransportLayer::StageOutbound() {
@@ -435,29 +636,81 @@ ZDTTransportLayer::PendingRecord ZDTTransportLayer::MakeRecord(
   pending.payload = owner->data() + offset;
   pending.payload_len = length;
   pending.reliable = reliable;
-  pending.key = MsgKey{channel, reliable, frag_index, message_seq};
+  pending.message_seq = message_seq;
   return pending;
 }
 
-void ZDTTransportLayer::TrackReliable(const PendingRecord& pending,
-                                      size_t offset, TimePoint now,
-                                      TransmissionLog log) {
-  // rtt_.rto() can shrink, so this message may fall due before the cached deadline
-  next_retransmit_scan_ = std::min(next_retransmit_scan_, now + rtt_.rto());
+uint32_t ZDTTransportLayer::TrackReliable(const PendingRecord& pending,
+                                          size_t offset, TimePoint now) {
   // the probe measures silence after the newest send, so every send pushes it
   tail_probes_fired_ = 0;
   tail_probe_at_ = now + TailProbeDelay();
-  unacked_[pending.key] = OutReliable{pending.owner,             // message
-                                      offset,                    // offset
-                                      pending.payload_len,       // length
-                                      pending.record.channel,    // channel
-                                      pending.record.message_seq,// message_seq
-                                      pending.record.frag_index, // frag_index
-                                      pending.record.frag_count, // frag_count
-                                      pending.record.flags,      // data_flags
-                                      now,                       // last_send
-                                      1,                         // send_count
-                                      log};              // packets
+  const uint32_t slot = AllocateUnacked(pending.record.channel);
+  OutReliable& msg = Unacked(slot);
+  msg.message = pending.owner;
+  msg.offset = offset;
+  msg.length = pending.payload_len;
+  msg.message_seq = pending.message_seq;
+  msg.frag_index = pending.record.frag_index;
+  msg.frag_count = pending.record.frag_count;
+  msg.data_flags = pending.record.flags;
+  msg.last_send = now;
+  msg.send_count = 1;
+  retransmits_.OnSend(&msg, now + RetransmitDelay(msg.send_count));
+  return slot;
+}
+
+uint32_t ZDTTransportLayer::AllocateUnacked(uint8_t channel) {
+  if (unacked_free_.empty()) {
+    const uint32_t base =
+        static_cast<uint32_t>(unacked_blocks_.size()) * kUnackedBlock;
+    unacked_blocks_.emplace_back(new OutReliable[kUnackedBlock]);
+    // room for every slot to be free at once, so releasing never allocates
+    unacked_free_.reserve(unacked_blocks_.size() * kUnackedBlock);
+    for (uint32_t i = kUnackedBlock; i > 0; i--) {
+      unacked_free_.push_back(base + i - 1);  // lowest on top
+    }
+  }
+  const uint32_t slot = unacked_free_.back();
+  unacked_free_.pop_back();
+  unacked_count_++;
+  OutReliable& msg = Unacked(slot);
+  msg.live = true;
+  msg.slot = slot;
+  msg.channel = channel;
+  // messages go out in message_seq order, so appending keeps the list sorted
+  // and its head is the channel's oldest
+  ChannelState& state = channels_[channel];
+  msg.channel_older = state.unacked_newest;
+  msg.channel_newer = kNoSlot;
+  if (state.unacked_newest != kNoSlot) {
+    Unacked(state.unacked_newest).channel_newer = slot;
+  } else {
+    state.unacked_oldest = slot;
+  }
+  state.unacked_newest = slot;
+  return slot;
+}
+
+void ZDTTransportLayer::ReleaseUnacked(uint32_t slot) {
+  OutReliable& msg = Unacked(slot);
+  ChannelState& state = channels_[msg.channel];
+  (msg.channel_newer != kNoSlot ? Unacked(msg.channel_newer).channel_older
+                                : state.unacked_newest) = msg.channel_older;
+  (msg.channel_older != kNoSlot ? Unacked(msg.channel_older).channel_newer
+                                : state.unacked_oldest) = msg.channel_newer;
+  msg.live = false;
+  msg.generation++;
+  msg.message.reset();  // the buffer goes back to the application now
+  msg.packets = TransmissionLog{};
+  unacked_free_.push_back(slot);
+  unacked_count_--;
+}
+
+ZDTTransportLayer::OutReliable* ZDTTransportLayer::FindUnacked(
+    UnackedRef ref) {
+  OutReliable& msg = Unacked(ref.slot);
+  return msg.live && msg.generation == ref.generation ? &msg : nullptr;
 }
 
 void ZDTTransportLayer::SendControl(uint8_t flags) {
@@ -471,6 +724,13 @@ WireSeq ZDTTransportLayer::SendBatch(uint8_t extra_flags,
   }
   ZDTHeader header;
   header.flags = static_cast<uint8_t>(kFlagOnline | extra_flags);
+  if (connection_.peer_connection_id != 0) {
+    header.flags |= kFlagConnectionId;
+    header.connection_id = connection_.peer_connection_id;
+  }
+  if (sealing_) {
+    header.flags |= kFlagSealed;
+  }
   header.packet_seq = next_packet_seq_++;
   if (next_packet_seq_ == 0) {
     next_packet_seq_ = 1;  // skip the reserved sentinel on wraparound
@@ -483,11 +743,9 @@ WireSeq ZDTTransportLayer::SendBatch(uint8_t extra_flags,
     record_bytes += ZDTRecordSize(batch[i].record.flags & kRecFragment,
                                   batch[i].payload_len);
   }
-  const size_t mtu = connection_.mtu != 0
-                         ? connection_.mtu
-                         : ZDTPayloadForLinkMTU(config_.mtu_ladder.back(),
-                                                peer_->ipv());
-  const size_t used = kZDTHeaderSize + record_bytes;
+  const size_t mtu = DatagramBudget();
+  const size_t used = kZDTHeaderSize + record_bytes +
+                      (header.connection_id != 0 ? kZDTConnectionIdSize : 0);
   // how far back is worth describing: anything older the peer has already seen
   // acked, or it could not have kept sending. The +64 is slack for reordering.
   const size_t reportable = static_cast<size_t>(SendWindowCap()) + 64;
@@ -501,11 +759,14 @@ WireSeq ZDTTransportLayer::SendBatch(uint8_t extra_flags,
   }
 #endif
 
-  send_scratch_.Reset();
   Buffer& datagram = send_scratch_;
+  if (held_.empty()) {
+    datagram.Reset();
+  }
+  const size_t offset = datagram.size();
   WriteZDTHeader(datagram, header);
-  RetireSentPacket(header.packet_seq);
-  SentInfo& info = sent_packets_[header.packet_seq];
+  const size_t body = datagram.size();
+  SentInfo& info = ClaimSent(header.packet_seq);
   for (size_t i = 0; i < count; i++) {
     const PendingRecord& pending = batch[i];
     WriteZDTRecord(datagram, pending.record);
@@ -514,35 +775,165 @@ WireSeq ZDTTransportLayer::SendBatch(uint8_t extra_flags,
     }
     if (pending.reliable) {
       // every reliable message here is retired when this packet is acked
-      info.Add(pending.key);
+      info.Add(UnackedRef{pending.slot, Unacked(pending.slot).generation});
     }
   }
-  socket_->SendTo(*peer_, datagram.data(), datagram.size());
-  ZNET_METRIC(metrics_.zdt.datagrams_sent++);
-  ZNET_METRIC(metrics_.common.wire_bytes_sent += datagram.size());
+  bool sealed = true;
+  if (sealing_) {
+    // in place, once the records are down; the tag goes after them
+    const size_t body_len = datagram.size() - body;
+    datagram.SkipWrite(kZDTSealTagSize);
+    auto* data = reinterpret_cast<uint8_t*>(datagram.data_mutable());
+    sealed = sealer_.Seal(header.packet_seq, data + offset, body - offset,
+                          data + body, body_len);
+    if (!sealed) {
+      // never sent in the clear: what it carried is resent as if lost
+      ZNET_LOG_ERROR("ZDT: failed to seal a datagram to {}, dropping it.",
+                     peer_->readable());
+      datagram.set_write_cursor(offset);
+    }
+  }
+  // reliable data is what the pacer spaces. under Kernel pacing the datagram
+  // goes down now with its slot attached, and the kernel does the waiting
+  const TimePoint now = steady_clock::now();
+  TimePoint launch{};
+  if (info.key_count > 0 && pacing_ == ZDTPacing::Kernel &&
+      pacer_.NextSendTime() > now) {
+    launch = pacer_.NextSendTime();
+  }
+  if (sealed) {
+    held_.push_back(HeldDatagram{offset, datagram.size() - offset, launch});
+    ZNET_METRIC(metrics_.zdt.datagrams_sent++);
+    ZNET_METRIC(metrics_.common.wire_bytes_sent += datagram.size() - offset);
+  }
+  if (send_scope_depth_ == 0 || held_.size() >= send_batch_) {
+    SendHeld();
+  }
 
-  last_send_ = steady_clock::now();
+  last_send_ = now;
   needs_ack_ = false;  // this datagram piggybacked our current ack
-  info.send_time = last_send_;
+  info.send_time = std::max(now, launch);
   if (info.key_count > 0) {
     in_flight_datagrams_++;
+    if (pacing_ != ZDTPacing::Off) {
+      pacer_.OnSent(now);
+    }
   }
   return header.packet_seq;
 }
 
-void ZDTTransportLayer::RetireSentPacket(
-    std::unordered_map<uint16_t, SentInfo>::iterator it) {
-  if (it == sent_packets_.end()) {
+size_t ZDTTransportLayer::DatagramBudget() const {
+  const size_t mtu = connection_.mtu != 0
+                         ? connection_.mtu
+                         : ZDTPayloadForLinkMTU(config_.mtu_ladder.back(),
+                                                peer_->ipv());
+  // reserved from the first datagram, before there are keys, so a message
+  // packed then still fits once its retransmit is sealed
+  if (connection_.sealed && mtu > kZDTSealTagSize) {
+    return mtu - kZDTSealTagSize;
+  }
+  return mtu;
+}
+
+void ZDTTransportLayer::SendHeld() {
+  if (held_.empty()) {
     return;
   }
-  if (it->second.key_count > 0 && in_flight_datagrams_ > 0) {
+  // a close that landed mid-batch already sent the FIN; anything behind it
+  // would only reach a peer that has dropped the route
+  if (!is_closed_ && socket_ && peer_) {
+    if (pacing_ == ZDTPacing::Kernel) {
+      std::array<SocketSlice, UDPSocket::kMaxBatch> slices;
+      std::array<TimePoint, UDPSocket::kMaxBatch> launches;
+      for (size_t i = 0; i < held_.size(); i++) {
+        slices[i] = SocketSlice{send_scratch_.data() + held_[i].offset,
+                                held_[i].length};
+        launches[i] = held_[i].launch;
+      }
+      socket_->SendBatchTo(*peer_, slices.data(), held_.size(),
+                           launches.data());
+    } else if (held_.size() == 1) {
+      socket_->SendTo(*peer_, send_scratch_.data() + held_[0].offset,
+                      held_[0].length);
+    } else {
+      std::array<SocketSlice, UDPSocket::kMaxBatch> slices;
+      for (size_t i = 0; i < held_.size(); i++) {
+        slices[i] = SocketSlice{send_scratch_.data() + held_[i].offset,
+                                held_[i].length};
+      }
+      socket_->SendBatchTo(*peer_, slices.data(), held_.size());
+    }
+    ZNET_METRIC(metrics_.zdt.send_calls++);
+  }
+  held_.clear();
+}
+
+ZDTTransportLayer::SentInfo* ZDTTransportLayer::FindSent(WireSeq packet_seq) {
+  if (sent_packets_.empty()) {
+    return nullptr;
+  }
+  SentInfo& info = sent_packets_[packet_seq & (sent_packets_.size() - 1)];
+  return info.live && info.seq == packet_seq ? &info : nullptr;
+}
+
+ZDTTransportLayer::SentInfo& ZDTTransportLayer::ClaimSent(WireSeq packet_seq) {
+  if (sent_packets_.empty()) {
+    sent_packets_.resize(kMinSentRing);
+  }
+  // the slot's occupant went out a ring's length of packet_seqs ago. while it
+  // could still be acked, double the ring instead of forgetting it
+  for (;;) {
+    const SentInfo& occupant =
+        sent_packets_[packet_seq & (sent_packets_.size() - 1)];
+    if (!occupant.live || occupant.key_count == 0 ||
+        sent_packets_.size() >= kZDTAckHistoryBits) {
+      break;
+    }
+    std::vector<SentInfo> grown(sent_packets_.size() * 2);
+    for (SentInfo& info : sent_packets_) {
+      if (!info.live) {
+        continue;
+      }
+      SentInfo& target = grown[info.seq & (grown.size() - 1)];
+      // the live entries span less than the old ring, so they cannot collide
+      // in one twice its size. the packet_seq wrap skipping 0 is the exception
+      // that proves it, and the newer entry wins there as anywhere else
+      if (target.live &&
+          static_cast<WireSeq>(next_packet_seq_ - target.seq) <
+              static_cast<WireSeq>(next_packet_seq_ - info.seq)) {
+        RetireSentPacket(info);
+        continue;
+      }
+      if (target.live) {
+        RetireSentPacket(target);
+      }
+      target = info;
+    }
+    sent_packets_.swap(grown);
+  }
+  SentInfo& info = sent_packets_[packet_seq & (sent_packets_.size() - 1)];
+  if (info.live) {
+    RetireSentPacket(info);
+  }
+  info.seq = packet_seq;
+  info.live = true;
+  info.key_count = 0;
+  sent_live_++;
+  return info;
+}
+
+void ZDTTransportLayer::RetireSentPacket(SentInfo& info) {
+  if (info.key_count > 0 && in_flight_datagrams_ > 0) {
     in_flight_datagrams_--;
   }
-  sent_packets_.erase(it);
+  info.live = false;
+  sent_live_--;
 }
 
-void ZDTTransportLayer::RetireSentPacket(uint16_t packet_seq) {
-  RetireSentPacket(sent_packets_.find(packet_seq));
+void ZDTTransportLayer::RetireSentPacket(WireSeq packet_seq) {
+  if (SentInfo* info = FindSent(packet_seq)) {
+    RetireSentPacket(*info);
+  }
 }
 
 
@@ -558,7 +949,24 @@ int ZDTTransportLayer::SendWindowCap() const {
 }
 
 int ZDTTransportLayer::SendWindow() const {
-  return congestion_.Window(SendWindowCap());
+  return congestion_->Window(SendWindowCap());
+}
+
+steady_clock::time_point ZDTTransportLayer::PacedUntil() const {
+  switch (pacing_) {
+    case ZDTPacing::Worker:
+      return pacer_.NextSendTime();
+    case ZDTPacing::Kernel:
+      // the kernel holds what is stamped ahead, so the worker only stops
+      // building datagrams a round trip out, where acks will have moved the
+      // rate on before they leave
+      return pacer_.NextSendTime() -
+             std::chrono::duration_cast<steady_clock::duration>(
+                 std::chrono::duration<double, std::milli>(rtt_.srtt_ms()));
+    case ZDTPacing::Off:
+      break;
+  }
+  return TimePoint{};
 }
 
 // the congestion signal is queueing delay, not loss. Reno-style halving on
@@ -573,31 +981,29 @@ int ZDTTransportLayer::SendWindow() const {
 // congestion and the window sits at its floor on a path with no queue at all.
 // Adding an absolute margin does open the window there, and is worth 18-65% at
 // 1 KiB and above, but it costs ~30% at 64 B and makes that case bimodal, so it
-// is not simply a better rule. See benchmarks/README.md.
+// is not simply a better rule. See benchmarks/README.md. ZDTBbrController
+// reads neither ratio nor loss, and is the option for such links.
 void ZDTTransportLayer::OnNak(WireSeq packet_seq) {
-  auto it = sent_packets_.find(packet_seq);
-  if (it == sent_packets_.end()) {
+  SentInfo* info = FindSent(packet_seq);
+  if (info == nullptr) {
     return;  // already retired, or too old to still be tracked
   }
-  // an epoch last_send is the fast-retransmit marker: it puts the message past
-  // any threshold, and tells the scan this was a reported loss rather than a
-  // timeout. the scan is skipped until the soonest deadline, so it also has to
-  // be pulled forward or the resend still waits out the RTO.
-  for (const MsgKey& key : it->second) {
-    auto msg = unacked_.find(key);
-    if (msg != unacked_.end()) {
-      msg->second.last_send = TimePoint{};
-      next_retransmit_scan_ = TimePoint::min();
+  // an epoch last_send is the fast-retransmit marker: it tells the scan this
+  // was a reported loss rather than a timeout. the schedule has to be told as
+  // well, or the resend still waits out the RTO.
+  for (UnackedRef ref : *info) {
+    if (OutReliable* msg = FindUnacked(ref)) {
+      msg->last_send = TimePoint{};
+      retransmits_.OnLost(msg);
     }
   }
   // the peer reports this gap until filled, and it never will: the resend goes
   // out under a fresh packet_seq. drop it so one loss triggers one retransmit.
-  RetireSentPacket(it);
+  RetireSentPacket(*info);
   ZNET_METRIC(metrics_.zdt.naks_received++);
 }
 
 void ZDTTransportLayer::ProcessAcks(const ZDTHeader& header) {
-  congestion_.OnAckArrived(header.ack);
   int newly_acked = 0;
   uint32_t offset = 0;
   for (uint8_t b = 0; b < header.block_count && offset < kZDTAckHistoryBits;
@@ -613,14 +1019,25 @@ void ZDTTransportLayer::ProcessAcks(const ZDTHeader& header) {
       offset++;
     }
   }
+  ZDTAckEvent ack;
+  ack.peer_ack = header.ack;
+  ack.acked_datagrams = newly_acked;
+  ack.in_flight = static_cast<int>(in_flight_datagrams_);
+  ack.next_seq = next_packet_seq_;
+  ack.cap = SendWindowCap();
+  ack.now = steady_clock::now();
+  congestion_->OnAck(ack, rtt_);
+  if (pacing_ != ZDTPacing::Off) {
+    pacer_.SetRate(congestion_->pacing_rate());
+  }
   if (newly_acked > 0) {
-    congestion_.OnAcked(newly_acked, rtt_, next_packet_seq_, SendWindowCap());
     // progress breaks the silence; a duplicate ack does not, because a peer
     // that answers without retiring anything is describing exactly the stall
     // the probe exists to break
     tail_probes_fired_ = 0;
-    tail_probe_at_ = unacked_.empty() ? TimePoint::max()
-                                      : steady_clock::now() + TailProbeDelay();
+    tail_probe_at_ = unacked_count_ == 0
+                         ? TimePoint::max()
+                         : steady_clock::now() + TailProbeDelay();
   }
 }
 
@@ -628,57 +1045,54 @@ bool ZDTTransportLayer::AckPacket(WireSeq packet_seq) {
   if (packet_seq == 0) {
     return false;  // reserved sentinel: the peer had nothing to acknowledge yet
   }
-  auto it = sent_packets_.find(packet_seq);
-  if (it == sent_packets_.end()) {
+  SentInfo* info = FindSent(packet_seq);
+  if (info == nullptr) {
     return false;
   }
   // packet_seq is unique per transmission, so there is no Karn ambiguity.
   const TimePoint now = steady_clock::now();
-  rtt_.OnSample(now - it->second.send_time, now, config_.rto_min,
-                config_.rto_max);
+  rtt_.OnSample(now - info->send_time, now, config_.rto_min, config_.rto_max);
   // one datagram can carry several reliable messages; acking it retires all of
   // them. dropping each message's other transmissions keeps a sent_packets_
-  // entry from outliving the unacked_ entry that owns it. the entry is walked
-  // in place rather than copied out (SentInfo is about 1 KB), which is safe
-  // because erasing other entries leaves this one's reference valid; only its
-  // own erase must wait until the walk is done, so the walk skips it.
-  for (const MsgKey& key : it->second) {
-    auto msg = unacked_.find(key);
-    if (msg == unacked_.end()) {
+  // entry from outliving the unacked_ slot that owns it. the entry is walked
+  // in place rather than copied out (SentInfo is half a kilobyte), which is
+  // safe because retiring other entries never touches this slot; only its own
+  // retirement must wait until the walk is done, so the walk skips it.
+  for (UnackedRef ref : *info) {
+    OutReliable* msg = FindUnacked(ref);
+    if (msg == nullptr) {
       continue;
     }
-    for (WireSeq seq : msg->second.packets) {
+    for (WireSeq seq : msg->packets) {
       if (seq != packet_seq) {
         RetireSentPacket(seq);
       }
     }
-    unacked_.erase(msg);
+    retransmits_.Remove(msg);
+    ReleaseUnacked(ref.slot);
   }
-  RetireSentPacket(it);
+  RetireSentPacket(*info);
   return true;
 }
 
 void ZDTTransportLayer::RetransmitUnacked() {
-  auto now = steady_clock::now();
-  // walking every unacked message on every tick costs more than the retransmits
-  // themselves: the window holds hundreds of entries and almost none are ever
-  // due. Skip the scan until the soonest deadline actually arrives.
-  if (now < next_retransmit_scan_) {
-    return;
-  }
-  TimePoint earliest = TimePoint::max();
+  const TimePoint now = steady_clock::now();
   bool timed_out = false;
-  for (auto& entry : unacked_) {
-    OutReliable& msg = entry.second;
+  // the schedule's root is the soonest deadline, so this touches only what is
+  // due: the window holds hundreds of entries and almost none ever are.
+  while (OutReliable* msg = retransmits_.Due(now)) {
+    if (msg->last_send == now) {
+      break;  // resent in this pass; a zero RTO would resend it again at once
+    }
     // OnNak already decided this one is lost; it is not evidence of a queue.
-    const bool nak_forced = msg.last_send == TimePoint{};
-    int backoff = std::min(msg.send_count - 1, 6);
-    auto threshold = std::min(rtt_.rto() * (1 << backoff), config_.rto_max);
-    if (now - msg.last_send < threshold) {
-      earliest = std::min(earliest, msg.last_send + threshold);
+    const bool nak_forced = msg->last_send == TimePoint{};
+    // due by the RTO of its last send. one that has grown since moves it back
+    const auto threshold = RetransmitDelay(msg->send_count);
+    if (!nak_forced && now - msg->last_send < threshold) {
+      retransmits_.Reschedule(msg, msg->last_send + threshold);
       continue;
     }
-    if (msg.send_count >= config_.max_retries) {
+    if (msg->send_count >= config_.max_retries) {
       ZNET_LOG_WARN("ZDT: reliable message to {} exceeded {} retries, closing.",
                     peer_->readable(), config_.max_retries);
       Close();
@@ -687,26 +1101,35 @@ void ZDTTransportLayer::RetransmitUnacked() {
     // one per datagram: batching would tie unrelated messages' recovery
     // together, and retransmits should be rare.
     PendingRecord pending =
-        MakeRecord(msg.message, msg.offset, msg.length, msg.data_flags,
-                   msg.channel, entry.first.message_seq, msg.frag_index,
-                   msg.frag_count, /*reliable=*/true);
+        MakeRecord(msg->message, msg->offset, msg->length, msg->data_flags,
+                   msg->channel, msg->message_seq, msg->frag_index,
+                   msg->frag_count, /*reliable=*/true);
+    pending.slot = msg->slot;
     WireSeq packet = SendBatch(0, &pending, 1);
-    msg.packets.Add(packet);
+    msg->packets.Add(packet);
     ZNET_METRIC(metrics_.zdt.retransmits++);
-    msg.last_send = now;
-    msg.send_count++;
+    msg->last_send = now;
+    msg->send_count++;
+    retransmits_.OnSend(msg, now + RetransmitDelay(msg->send_count));
     // a resend breaks the silence as well, so the tail probe restarts from it
     // (fired count kept: this is recovery traffic, not ack progress)
     tail_probe_at_ = now + TailProbeDelay();
     if (!nak_forced) {
       timed_out = true;
     }
-    earliest = std::min(earliest, now + threshold);
   }
   if (timed_out) {
-    congestion_.OnRetransmitTimeout(rtt_, next_packet_seq_);
+    congestion_->OnRetransmitTimeout(rtt_, next_packet_seq_);
+    if (pacing_ != ZDTPacing::Off) {
+      pacer_.SetRate(congestion_->pacing_rate());
+    }
   }
-  next_retransmit_scan_ = earliest;
+}
+
+std::chrono::milliseconds ZDTTransportLayer::RetransmitDelay(
+    int send_count) const {
+  const int backoff = std::min(send_count - 1, 6);
+  return std::min(rtt_.rto() * (1 << backoff), config_.rto_max);
 }
 
 std::chrono::steady_clock::duration ZDTTransportLayer::TailProbeDelay() const {
@@ -725,23 +1148,18 @@ std::chrono::steady_clock::duration ZDTTransportLayer::TailProbeDelay() const {
 }
 
 void ZDTTransportLayer::MaybeTailProbe(TimePoint now) {
-  if (now < tail_probe_at_ || unacked_.empty()) {
+  if (now < tail_probe_at_ || unacked_count_ == 0) {
     return;
   }
-  // the newest transmission is the likeliest tail loss. >= so that within one
-  // burst, whose sends share a timestamp, the highest key (the actual tail)
-  // wins.
-  auto newest = unacked_.begin();
-  for (auto it = unacked_.begin(); it != unacked_.end(); ++it) {
-    if (it->second.last_send >= newest->second.last_send) {
-      newest = it;
-    }
-  }
-  OutReliable& msg = newest->second;
+  // the newest transmission is the likeliest tail loss. the schedule keeps
+  // send order, so within one burst the last record packed (the actual tail)
+  // is the one taken.
+  OutReliable& msg = *retransmits_.newest();
   PendingRecord pending =
       MakeRecord(msg.message, msg.offset, msg.length, msg.data_flags,
-                 msg.channel, newest->first.message_seq, msg.frag_index,
+                 msg.channel, msg.message_seq, msg.frag_index,
                  msg.frag_count, /*reliable=*/true);
+  pending.slot = msg.slot;
   WireSeq packet = SendBatch(0, &pending, 1);
   msg.packets.Add(packet);
   ZNET_METRIC(metrics_.zdt.tail_probes++);
@@ -752,15 +1170,27 @@ void ZDTTransportLayer::MaybeTailProbe(TimePoint now) {
 }
 
 void ZDTTransportLayer::PruneSentPackets() {
+  if (sent_live_ == 0) {
+    sent_oldest_ = next_packet_seq_;
+    return;
+  }
   auto now = steady_clock::now();
   auto max_age = config_.rto_max * 4;
-  for (auto it = sent_packets_.begin(); it != sent_packets_.end();) {
-    if (now - it->second.send_time > max_age) {
-      auto stale = it++;
-      RetireSentPacket(stale);
-    } else {
-      ++it;
+  // anything further back than the ring has lost its slot already
+  if (static_cast<WireSeq>(next_packet_seq_ - sent_oldest_) >
+      sent_packets_.size()) {
+    sent_oldest_ = static_cast<WireSeq>(next_packet_seq_ - sent_packets_.size());
+  }
+  // send times rise with packet_seq, so the walk stops at the first entry
+  // young enough to keep, and over the connection passes each packet_seq once
+  while (sent_oldest_ != next_packet_seq_) {
+    if (SentInfo* info = FindSent(sent_oldest_)) {
+      if (now - info->send_time <= max_age) {
+        break;
+      }
+      RetireSentPacket(*info);
     }
+    sent_oldest_++;
   }
 }
 
@@ -775,14 +1205,15 @@ SequenceId ZDTTransportLayer::ReconstructSeqFor(const ZDTRecord& record) {
 }
 
 void ZDTTransportLayer::DeliverMessage(const ZDTRecord& record,
-                                       std::shared_ptr<Buffer> payload) {
+                                       std::shared_ptr<Buffer> payload,
+                                       bool sealed) {
   const bool reliable = record.flags & kRecReliable;
   const bool ordered = record.flags & kRecOrdered;
   const SequenceId seq = ReconstructSeqFor(record);
 
   // unreliable + unordered: no state, and nothing retransmits, so no dedup.
   if (!reliable && !ordered) {
-    ready_.push_back(std::move(payload));
+    ready_.push_back(Inbound{std::move(payload), sealed});
     return;
   }
 
@@ -794,7 +1225,7 @@ void ZDTTransportLayer::DeliverMessage(const ZDTRecord& record,
     if (!channel.unrel_started || seq > channel.unrel_last) {
       channel.unrel_started = true;
       channel.unrel_last = seq;
-      ready_.push_back(std::move(payload));
+      ready_.push_back(Inbound{std::move(payload), sealed});
     } else {
       ZNET_METRIC(metrics_.zdt.duplicates_dropped++);
     }
@@ -806,16 +1237,21 @@ void ZDTTransportLayer::DeliverMessage(const ZDTRecord& record,
   // `rel_delivered_ahead` holds delivered seqs at/above it that arrived early.
   if (reliable && !ordered) {
     if (seq < channel.rel_expected ||
-        channel.rel_delivered_ahead.count(seq) != 0) {
+        channel.rel_delivered_ahead.Has(channel.rel_expected, seq)) {
       ZNET_METRIC(metrics_.zdt.duplicates_dropped++);
       return;  // duplicate
     }
-    ready_.push_back(std::move(payload));
-    channel.rel_delivered_ahead.insert(seq);
-    while (channel.rel_delivered_ahead.count(channel.rel_expected) != 0) {
-      channel.rel_delivered_ahead.erase(channel.rel_expected);
+    if (seq == channel.rel_expected) {
+      ready_.push_back(Inbound{std::move(payload), sealed});
       channel.rel_expected++;
+      while (channel.rel_delivered_ahead.Take(channel.rel_expected) != 0) {
+        channel.rel_expected++;
+      }
+    } else if (channel.rel_delivered_ahead.Put(channel.rel_expected, seq, 1)) {
+      ready_.push_back(Inbound{std::move(payload), sealed});
     }
+    // a refused Put is further ahead than any sender may run; see
+    // kZDTMaxSeqGap. Nothing honest sends it, so it is not delivered
     return;
   }
 
@@ -825,17 +1261,16 @@ void ZDTTransportLayer::DeliverMessage(const ZDTRecord& record,
     return;  // already delivered (duplicate / retransmit)
   }
   if (seq == channel.rel_expected) {
-    ready_.push_back(std::move(payload));
+    ready_.push_back(Inbound{std::move(payload), sealed});
     channel.rel_expected++;
-    auto it = channel.rel_reorder.find(channel.rel_expected);
-    while (it != channel.rel_reorder.end()) {
-      ready_.push_back(std::move(it->second));
-      channel.rel_reorder.erase(it);
+    while (Inbound next = channel.rel_reorder.Take(channel.rel_expected)) {
+      ready_.push_back(std::move(next));
       channel.rel_expected++;
-      it = channel.rel_reorder.find(channel.rel_expected);
     }
   } else {
-    channel.rel_reorder.emplace(seq, std::move(payload));  // future
+    // future. refused, like the unordered case, past kZDTMaxSeqGap
+    channel.rel_reorder.Put(channel.rel_expected, seq,
+                            Inbound{std::move(payload), sealed});
   }
 }
 
@@ -857,6 +1292,8 @@ void ZDTTransportLayer::Update() {
   if (is_closed_) {
     return;
   }
+  // retransmits, probes and keepalives leave with the flush's new data
+  SendScope send_scope(*this);
   if (drains_own_socket_) {
     DrainSocket();
   }
@@ -883,6 +1320,7 @@ void ZDTTransportLayer::Flush() {
   if (is_closed_) {
     return;
   }
+  SendScope send_scope(*this);
   FlushOutbound();
   // if we still owe an ack and no outgoing datagram carried it, send a
   // standalone one.
@@ -891,6 +1329,41 @@ void ZDTTransportLayer::Flush() {
   }
 }
 
+steady_clock::time_point ZDTTransportLayer::NextDeadline() const {
+  if (is_closed_) {
+    return TimePoint::max();
+  }
+  const TimePoint now = steady_clock::now();
+  // an ack owed, messages the window held back or that Send() queued since
+  // the flush, or deliveries not yet picked up: all of it is next-tick work
+  if (needs_ack_ || outbound_.size() > 0 || !ready_.empty()) {
+    return now;
+  }
+  // unless only the pacer is holding them, which says exactly when it lets
+  // go; the worker wakes early for that rather than at its next tick
+  if (staged_count_ > 0) {
+    return std::max(now, PacedUntil());
+  }
+  TimePoint due = TimePoint::max();
+  if (unacked_count_ > 0) {
+    due = std::min(retransmits_.next_due(), tail_probe_at_);
+  }
+  // the newest record ages out last, so once it has they all have
+  if (sent_live_ > 0) {
+    due = std::min(due, last_send_ + config_.rto_max * 4);
+  }
+  for (size_t i = 0; i < reassembly_active_; i++) {
+    due = std::min(due, reassembly_[i].first_seen + config_.reassembly_timeout);
+  }
+  if (idle_timeout_.count() > 0) {
+    due = std::min(due, last_recv_ + idle_timeout_);
+  }
+  if (keepalive_interval_.count() > 0) {
+    due = std::min(due, last_send_ + keepalive_interval_);
+  }
+  return due;
+}
+
 Result ZDTTransportLayer::Close(CloseOptions options) {
   (void)options;
   if (is_closed_.exchange(true)) {
@@ -901,13 +1374,18 @@ Result ZDTTransportLayer::Close(CloseOptions options) {
   // SendBatch: no packet_seq, no sent_packets_ record, no ack. packet_seq 0 is
   // the reserved "nothing to acknowledge" sentinel the peer already ignores,
   // and concurrent sendto() on one socket is safe.
-  if (socket_ && peer_) {
+  std::shared_ptr<InetAddress> peer = this->peer();
+  if (socket_ && peer) {
     ZDTHeader header;
     header.flags = static_cast<uint8_t>(kFlagOnline | kFlagFin);
+    if (connection_.peer_connection_id != 0) {
+      header.flags |= kFlagConnectionId;
+      header.connection_id = connection_.peer_connection_id;
+    }
     header.packet_seq = 0;
     Buffer datagram(Endianness::BigEndian);
     WriteZDTHeader(datagram, header);
-    socket_->SendTo(*peer_, datagram.data(), datagram.size());
+    socket_->SendTo(*peer, datagram.data(), datagram.size());
   }
   if (drains_own_socket_ && socket_) {
     // shut down rather than close: the session's worker may be inside
@@ -923,65 +1401,162 @@ bool ZDTTransportLayer::OnDataFragment(const ZDTRecord& record,
     return true;  // malformed, but nothing to retransmit that would help
   }
   bool reliable = record.flags & kRecReliable;
-  MsgKey key{record.channel, reliable, 0, ReconstructSeqFor(record)};
-  auto existing = reassembly_.find(key);
-  if (existing == reassembly_.end() &&
-      (reassembly_.size() >= config_.max_reassemblies ||
-       reassembly_bytes_ >= config_.max_reassembly_bytes)) {
-    // at capacity, and this fragment would start a new message. refusing to
-    // acknowledge it makes the sender try again once we have room; accepting
-    // and then dropping it would lose the message, because the sender retires a
-    // fragment the moment it is acked. Fragments for messages already in
-    // progress are always taken, so the backlog can still drain.
-    ZNET_METRIC(metrics_.zdt.reassemblies_dropped++);
-    return !reliable;  // unreliable senders never retransmit, so let it go
-  }
-  Reassembly& assembly = reassembly_[key];
-  if (assembly.frag_count == 0) {
-    assembly.frag_count = record.frag_count;
-    assembly.first_seen = steady_clock::now();
+  const SequenceId seq = ReconstructSeqFor(record);
+  // only a handful of messages are ever in progress at once, so a scan
+  size_t index = 0;
+  while (index < reassembly_active_ &&
+         !(reassembly_[index].seq == seq &&
+           reassembly_[index].channel == record.channel &&
+           reassembly_[index].reliable == reliable)) {
+    index++;
+  }
+  if (index == reassembly_active_) {
+    if (reassembly_active_ >= config_.max_reassemblies ||
+        reassembly_bytes_ >= config_.max_reassembly_bytes) {
+      // at capacity, and this fragment would start a new message. refusing to
+      // acknowledge it makes the sender try again once we have room; accepting
+      // and then dropping it would lose the message, because the sender retires
+      // a fragment the moment it is acked. Fragments for messages already in
+      // progress are always taken, so the backlog can still drain.
+      ZNET_METRIC(metrics_.zdt.reassemblies_dropped++);
+      return !reliable;  // unreliable senders never retransmit, so let it go
+    }
+    if (index == reassembly_.size()) {
+      reassembly_.emplace_back();
+    }
+    // a spare keeps its buffers' capacity; everything else starts over
+    Reassembly& fresh = reassembly_[index];
+    fresh.channel = record.channel;
+    fresh.reliable = reliable;
+    fresh.seq = seq;
+    fresh.frag_count = record.frag_count;
+    fresh.received = 0;
+    fresh.fragment_len = 0;
+    fresh.held = 0;
+    fresh.have.reset();
+    fresh.bytes.clear();
+    fresh.tail.clear();
+    fresh.first_seen = steady_clock::now();
+    fresh.sealed = true;
+    reassembly_active_++;
   }
+  Reassembly& assembly = reassembly_[index];
   if (assembly.frag_count != record.frag_count) {
     return true;  // inconsistent fragment count for this message
   }
-  std::vector<uint8_t>& slot = assembly.fragments[record.frag_index];
-  reassembly_bytes_ -= slot.size();  // a retransmit overwrites its own copy
-  slot.assign(data, data + len);
-  reassembly_bytes_ += slot.size();
-  if (assembly.fragments.size() != assembly.frag_count) {
+  if (assembly.have.test(record.frag_index)) {
+    return true;  // a retransmit of one already held
+  }
+  if (record.frag_index + 1 == record.frag_count) {
+    assembly.tail.assign(data, data + len);
+    assembly.held += len;
+    reassembly_bytes_ += len;
+  } else {
+    if (assembly.fragment_len == 0 && len > 0) {
+      // the first body fragment commits the whole body, so that is what the
+      // ceiling is held to; charging only what has arrived would let one
+      // fragment per message reserve hundreds of times its size
+      const size_t span = static_cast<size_t>(record.frag_count - 1) * len;
+      if (reassembly_bytes_ + span > config_.max_reassembly_bytes) {
+        ZNET_METRIC(metrics_.zdt.reassemblies_dropped++);
+        if (assembly.received == 0) {
+          FinishReassembly(index);  // nothing of it is held yet
+        }
+        return !reliable;
+      }
+      assembly.fragment_len = len;
+      assembly.bytes.resize(span);
+      assembly.held += span;
+      reassembly_bytes_ += span;
+    }
+    if (len != assembly.fragment_len) {
+      return true;  // the sender cuts every fragment but the last to one size
+    }
+    std::memcpy(assembly.bytes.data() + record.frag_index * len, data, len);
+  }
+  assembly.have.set(record.frag_index);
+  assembly.sealed = assembly.sealed && inbound_sealed_;
+  assembly.received++;
+  if (assembly.received != assembly.frag_count) {
     return true;  // still incomplete
   }
   auto full = std::make_shared<Buffer>();
-  for (auto& fragment : assembly.fragments) {  // std::map -> ascending index
-    if (!fragment.second.empty()) {
-      full->Write(fragment.second.data(), fragment.second.size());
-    }
-    reassembly_bytes_ -= fragment.second.size();
+  full->ReserveExact(assembly.bytes.size() + assembly.tail.size());
+  if (!assembly.bytes.empty()) {
+    full->Write(reinterpret_cast<const char*>(assembly.bytes.data()),
+                assembly.bytes.size());
+  }
+  if (!assembly.tail.empty()) {
+    full->Write(reinterpret_cast<const char*>(assembly.tail.data()),
+                assembly.tail.size());
   }
-  reassembly_.erase(key);
+  const bool sealed = assembly.sealed;
+  FinishReassembly(index);
   // hand the reassembled whole up as a plain message, not a fragment
   ZDTRecord whole = record;
   whole.flags = static_cast<uint8_t>(record.flags & ~kRecFragment);
   whole.frag_index = 0;
   whole.frag_count = 1;
-  DeliverMessage(whole, std::move(full));
+  DeliverMessage(whole, std::move(full), sealed);
   return true;
 }
 
+void ZDTTransportLayer::FinishReassembly(size_t index) {
+  reassembly_bytes_ -= reassembly_[index].held;
+  reassembly_active_--;
+  if (index != reassembly_active_) {
+    std::swap(reassembly_[index], reassembly_[reassembly_active_]);
+  }
+  // a burst of large messages should not pin its peak for good
+  while (reassembly_.size() > reassembly_active_ + kSpareReassemblies) {
+    reassembly_.pop_back();
+  }
+  // and a spare only keeps buffers small enough to sit outside
+  // max_reassembly_bytes, which counts the active entries alone
+  if (reassembly_active_ < reassembly_.size()) {
+    Reassembly& spare = reassembly_[reassembly_active_];
+    if (spare.bytes.capacity() + spare.tail.capacity() >
+        kMaxSpareReassemblyBytes) {
+      std::vector<uint8_t>().swap(spare.bytes);
+      std::vector<uint8_t>().swap(spare.tail);
+    }
+  }
+}
+
 void ZDTTransportLayer::PruneReassembly() {
   auto now = steady_clock::now();
-  for (auto it = reassembly_.begin(); it != reassembly_.end();) {
-    if (now - it->second.first_seen > config_.reassembly_timeout) {
-      for (const auto& fragment : it->second.fragments) {
-        reassembly_bytes_ -= fragment.second.size();
-      }
+  for (size_t i = 0; i < reassembly_active_;) {
+    if (now - reassembly_[i].first_seen > config_.reassembly_timeout) {
       ZNET_METRIC(metrics_.zdt.reassemblies_dropped++);
-      it = reassembly_.erase(it);
+      FinishReassembly(i);  // moves the last active entry into i
     } else {
-      ++it;
+      i++;
     }
   }
 }
 
+size_t ZDTTransportLayer::StateBytes() const {
+  size_t bytes = sent_packets_.capacity() * sizeof(SentInfo);
+  bytes += unacked_blocks_.size() * kUnackedBlock * sizeof(OutReliable);
+  bytes += unacked_free_.capacity() * sizeof(uint32_t);
+  bytes += retransmits_.capacity() * sizeof(OutReliable*);
+  for (const auto& entry : channels_) {
+    bytes += sizeof(entry);
+    bytes += entry.second.rel_reorder.capacity() * sizeof(Inbound);
+    bytes += entry.second.rel_delivered_ahead.capacity();
+    if (entry.second.fec_send) {
+      bytes += entry.second.fec_send->StateBytes();
+    }
+    if (entry.second.fec_receive) {
+      bytes += entry.second.fec_receive->StateBytes();
+    }
+  }
+  bytes += reassembly_.capacity() * sizeof(Reassembly);
+  for (const Reassembly& assembly : reassembly_) {
+    bytes += assembly.bytes.capacity() + assembly.tail.capacity();
+  }
+  return bytes;
+}
+
 }  // namespace backends
 }  // namespace znet
@@ -35,6 +35,9 @@ namespace backends {
 
 void WriteZDTHeader(Buffer& buffer, const ZDTHeader& header) {
   buffer.WriteInt<uint8_t>(header.flags);
+  if (header.flags & kFlagConnectionId) {
+    buffer.WriteInt<ZDTConnectionId>(header.connection_id);
+  }
   buffer.WriteInt<uint16_t>(header.packet_seq);
   buffer.WriteInt<uint16_t>(header.ack);
   buffer.WriteInt<uint8_t>(header.block_count);
@@ -52,6 +55,13 @@ bool ReadZDTHeader(Buffer& buffer, ZDTHeader& out_header) {
   if (!(out_header.flags & kFlagOnline)) {
     return false;  // offline (handshake) message, not an online datagram
   }
+  out_header.connection_id = 0;
+  if (out_header.flags & kFlagConnectionId) {
+    if (buffer.readable_bytes() < kZDTConnectionIdSize + kZDTHeaderSize - 1) {
+      return false;
+    }
+    out_header.connection_id = buffer.ReadInt<ZDTConnectionId>();
+  }
   out_header.packet_seq = buffer.ReadInt<uint16_t>();
   out_header.ack = buffer.ReadInt<uint16_t>();
   uint8_t count = buffer.ReadInt<uint8_t>();
@@ -68,6 +78,22 @@ bool ReadZDTHeader(Buffer& buffer, ZDTHeader& out_header) {
   return true;
 }
 
+bool PeekZDTConnectionId(const char* data, size_t len, ZDTConnectionId& out_id) {
+  if (len < 1 + kZDTConnectionIdSize) {
+    return false;
+  }
+  const auto flags = static_cast<uint8_t>(data[0]);
+  if (!(flags & kFlagOnline) || !(flags & kFlagConnectionId)) {
+    return false;
+  }
+  // big-endian, as WriteZDTHeader() put it
+  out_id = 0;
+  for (size_t i = 1; i <= kZDTConnectionIdSize; i++) {
+    out_id = (out_id << 8) | static_cast<uint8_t>(data[i]);
+  }
+  return true;
+}
+
 void WriteZDTRecord(Buffer& buffer, const ZDTRecord& record) {
   buffer.WriteInt<uint8_t>(record.flags);
   buffer.WriteInt<uint8_t>(record.channel);
@@ -0,0 +1,152 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#include "znet/cipher_suite.h"
+#include "znet/detail/platform.h"
+
+#include <openssl/opensslconf.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define ZNET_CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ZNET_CPU_ARM64
+#if defined(ZNET_TARGET_LINUX)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#elif defined(ZNET_TARGET_WIN)
+#include "znet/detail/sys_net.h"  // windows.h, after winsock2
+#endif
+#endif
+
+namespace znet {
+
+namespace {
+
+bool DetectHardwareAes() {
+#if defined(ZNET_CPU_X86)
+  // CPUID leaf 1, ECX bit 25
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 1);
+  return (info[2] & (1 << 25)) != 0;
+#else
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ecx & bit_AES) != 0;
+#endif
+#elif defined(ZNET_CPU_ARM64)
+#if defined(ZNET_TARGET_APPLE)
+  return true;  // every Apple arm64 core has the crypto extension
+#elif defined(ZNET_TARGET_LINUX)
+  return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(ZNET_TARGET_WIN)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != 0;
+#else
+  return false;
+#endif
+#else
+  // nothing to ask on this CPU; assuming software AES at worst costs an AES
+  // machine the ChaCha20-Poly1305 it would have been nearly as fast with
+  return false;
+#endif
+}
+
+bool Contains(const std::vector<CipherSuite>& list, CipherSuite suite) {
+  return std::find(list.begin(), list.end(), suite) != list.end();
+}
+
+}  // namespace
+
+std::string GetCipherSuiteString(CipherSuite suite) {
+  switch (suite) {
+    case CipherSuite::None:
+      return "None";
+    case CipherSuite::Aes256Gcm:
+      return "AES-256-GCM";
+    case CipherSuite::Aes128Gcm:
+      return "AES-128-GCM";
+    case CipherSuite::ChaCha20Poly1305:
+      return "ChaCha20-Poly1305";
+    default:
+      return "Unknown";
+  }
+}
+
+bool HasHardwareAes() {
+  static const bool has = DetectHardwareAes();
+  return has;
+}
+
+bool IsCipherSuiteAvailable(CipherSuite suite) {
+  switch (suite) {
+    case CipherSuite::Aes256Gcm:
+    case CipherSuite::Aes128Gcm:
+      return true;
+    case CipherSuite::ChaCha20Poly1305:
+#if defined(OPENSSL_NO_CHACHA) || defined(OPENSSL_NO_POLY1305)
+      return false;
+#else
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+std::vector<CipherSuite> DefaultCipherSuites() {
+  std::vector<CipherSuite> out;
+  if (HasHardwareAes()) {
+    out = {CipherSuite::Aes256Gcm, CipherSuite::Aes128Gcm,
+           CipherSuite::ChaCha20Poly1305};
+  } else {
+    out = {CipherSuite::ChaCha20Poly1305, CipherSuite::Aes128Gcm,
+           CipherSuite::Aes256Gcm};
+  }
+  out.erase(std::remove_if(out.begin(), out.end(),
+                           [](CipherSuite suite) {
+                             return !IsCipherSuiteAvailable(suite);
+                           }),
+            out.end());
+  return out;
+}
+
+bool SelectCipherSuite(const std::vector<CipherSuite>& server,
+                       const std::vector<CipherSuite>& client,
+                       CipherSuite& out) {
+  const CipherSuite chacha = CipherSuite::ChaCha20Poly1305;
+  const bool someone_wants_chacha =
+      (!server.empty() && server.front() == chacha) ||
+      (!client.empty() && client.front() == chacha);
+  if (someone_wants_chacha && Contains(server, chacha) &&
+      Contains(client, chacha) && IsCipherSuiteAvailable(chacha)) {
+    out = chacha;
+    return true;
+  }
+  for (CipherSuite suite : server) {
+    if (suite != CipherSuite::None && Contains(client, suite) &&
+        IsCipherSuiteAvailable(suite)) {
+      out = suite;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace znet
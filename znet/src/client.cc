@@ -93,16 +93,32 @@ Result Client::Connect() {
     // too, so holding it while working would block the receive thread for a
     // whole tick. nothing else is guarded by it.
     std::unique_lock<std::mutex> lock(signal_->mutex, std::defer_lock);
-    auto rest_of_tick = [this, paced, &lock]() {
+    // how long until the session's next deadline, when that falls inside
+    // `limit`: a paced send coming due, say. one already past is next-tick
+    // work, as it is on a server worker
+    auto until_deadline = [this](Scheduler::Duration limit) {
+      const auto until =
+          client_session_->NextDeadline() - std::chrono::steady_clock::now();
+      if (until <= std::chrono::steady_clock::duration::zero()) {
+        return limit;
+      }
+      return std::min(limit,
+                      std::chrono::duration_cast<Scheduler::Duration>(until) +
+                          Scheduler::Duration(1));
+    };
+    auto rest_of_tick = [this, paced, &lock, &until_deadline]() {
       if (!paced) {
         // this loop is the only reader, so block on the socket itself: it
         // returns the moment data lands. The old hot spin had the same
         // latency and a whole core's worth of cost.
-        backend_->WaitReadable(std::chrono::milliseconds(10));
+        const auto wait = until_deadline(std::chrono::milliseconds(10));
+        backend_->WaitReadable(std::max(
+            std::chrono::milliseconds(1),
+            std::chrono::duration_cast<std::chrono::milliseconds>(wait)));
         return;
       }
       scheduler_.End();
-      auto remaining = scheduler_.remaining();
+      auto remaining = until_deadline(scheduler_.remaining());
       lock.lock();
       if (remaining > Scheduler::Duration::zero()) {
         signal_->cv.wait_for(lock, remaining, [this]() {
@@ -37,6 +37,38 @@ void DumpUndecodableBuffer(Buffer& buffer, size_t frame_start) {
 
 }  // namespace
 
+namespace detail {
+
+FrameVerdict FinishFrame(Buffer& buffer, PacketId id, bool decoded,
+                         size_t body_start, size_t size) {
+  if (!decoded) {
+    ZNET_LOG_WARN("Packet {} was not deserialized!", id);
+    // it may have read part of the frame, so rewind and skip the whole
+    // declared length to land on the next one
+    buffer.set_read_cursor(body_start);
+    buffer.SkipRead(size);
+    buffer.SetReadLimit(0);
+    return FrameVerdict::Refused;
+  }
+  size_t read_bytes = buffer.read_cursor() - body_start;
+  if (read_bytes < size) {
+    ZNET_LOG_WARN("Packet {} size mismatch! Expected {}, read {}.",
+                  id, size, read_bytes);
+    buffer.set_read_cursor(body_start);
+    buffer.SkipRead(size);
+  } else if (read_bytes > size) {
+    ZNET_LOG_WARN("Packet {} size mismatch! Expected {}, read {}. This will drop the packet and rest of the buffer.",
+                  id, size, read_bytes);
+    // overrunning the read limit means the framing is no longer trustworthy,
+    // so nothing after this point can be located. no rewind: the buffer goes.
+    return FrameVerdict::Overrun;
+  }
+  buffer.SetReadLimit(0);
+  return FrameVerdict::Decoded;
+}
+
+}  // namespace detail
+
 DecodeStats Codec::Deserialize(std::shared_ptr<Buffer> buffer,
                                PacketHandlerBase& handler,
                                bool dump_on_failure) {
@@ -49,6 +81,8 @@ DecodeStats Codec::Deserialize(std::shared_ptr<Buffer> buffer,
       DumpUndecodableBuffer(*buffer, frame_start);
     }
   };
+  const DenseDecodeFn* dense_table = handler.dense_table();
+  const size_t dense_size = handler.dense_table_size();
   while (buffer->readable_bytes() > 0) {
     const size_t frame_start = buffer->read_cursor();
     auto packet_id = buffer->ReadVarInt<PacketId>();
@@ -70,61 +104,65 @@ DecodeStats Codec::Deserialize(std::shared_ptr<Buffer> buffer,
       break;
     }
     size_t read_cursor = buffer->read_cursor();
-    auto it = serializers_.find(packet_id);
-    if (it == serializers_.end()) {
-      ZNET_LOG_WARN("Serializer for packet {} does not exist! (have {} serializers)", packet_id, serializers_.size());
-      buffer->SkipRead(size);
-      continue;
+    // a dense handler's table decodes and dispatches in one call, ahead of
+    // the serializers here
+    const bool dense = packet_id < dense_size && dense_table[packet_id];
+    auto it = serializers_.end();
+    if (!dense) {
+      it = serializers_.find(packet_id);
+      if (it == serializers_.end()) {
+        ZNET_LOG_WARN("Serializer for packet {} does not exist! (have {} serializers)", packet_id, serializers_.size());
+        buffer->SkipRead(size);
+        continue;
+      }
     }
     // fences the serializer inside its own frame, so a malformed one cannot
     // read into the next packet
     buffer->SetReadLimit(read_cursor + size);
-    PacketSerializerBase& serializer = *it->second;
-    std::shared_ptr<Packet> pk = serializer.Deserialize(buffer);
-    if (!pk) {
-      ZNET_LOG_WARN("Packet {} was not deserialized!", packet_id);
-      note_invalid(frame_start);
-      // it may have read part of the frame, so rewind and skip the whole
-      // declared length to land on the next one
-      buffer->set_read_cursor(read_cursor);
-      buffer->SkipRead(size);
-      buffer->SetReadLimit(0);
-      continue;
+    detail::FrameVerdict verdict;
+    if (dense) {
+      verdict = dense_table[packet_id](handler, buffer, packet_id,
+                                       read_cursor, size);
+    } else {
+      std::shared_ptr<Packet> pk = it->second->Deserialize(buffer);
+      verdict = detail::FinishFrame(*buffer, packet_id, pk != nullptr,
+                                    read_cursor, size);
+      if (verdict == detail::FrameVerdict::Decoded) {
+        handler.Handle(pk);
+      }
     }
-    size_t read_cursor_end = buffer->read_cursor();
-    size_t read_bytes = read_cursor_end - read_cursor;
-    if (read_bytes < size) {
-      ZNET_LOG_WARN("Packet {} size mismatch! Expected {}, read {}.",
-                    packet_id, size, read_bytes);
-      buffer->set_read_cursor(read_cursor);
-      buffer->SkipRead(size);
-    } else if (read_bytes > size) {
-      ZNET_LOG_WARN("Packet {} size mismatch! Expected {}, read {}. This will drop the packet and rest of the buffer.",
-                    packet_id, size, read_bytes);
+    if (verdict == detail::FrameVerdict::Refused) {
+      note_invalid(frame_start);
+    } else if (verdict == detail::FrameVerdict::Overrun) {
       note_invalid(frame_start);
-      // overrunning the read limit means the framing is no longer trustworthy,
-      // so nothing after this point can be located. no rewind: the buffer goes.
       stats.framing_lost = true;
       break;
     }
-    buffer->SetReadLimit(0);
-    handler.Handle(pk);
   }
   return stats;
 }
 
 std::shared_ptr<Buffer> Codec::Serialize(std::shared_ptr<Packet> packet,
                                          size_t headroom) {
+  std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+  if (headroom != 0) {
+    buffer->ReserveHeadroom(headroom);
+  }
+  if (!SerializeInto(packet, buffer)) {
+    return nullptr;
+  }
+  return buffer;
+}
+
+bool Codec::SerializeInto(const std::shared_ptr<Packet>& packet,
+                          const std::shared_ptr<Buffer>& buffer) {
   auto it = serializers_.find(packet->id());
   if (it == serializers_.end()) {
     ZNET_LOG_WARN("Failed to find a serializer for packet {}!", packet->id());
-    return nullptr;
+    return false;
   }
   PacketSerializerBase& serializer = *it->second;
-  std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
-  if (headroom != 0) {
-    buffer->ReserveHeadroom(headroom);
-  }
+  const size_t frame_start = buffer->write_cursor();
   buffer->WriteVarInt(packet->id());
   // four bytes, not size_t: a frame is bounded far below 4 GiB and the old
   // eight-byte field was pure overhead on every message
@@ -135,7 +173,9 @@ std::shared_ptr<Buffer> Codec::Serialize(std::shared_ptr<Packet> packet,
   if (!out) {
     ZNET_LOG_WARN("Serializer for packet {} produced nothing, dropping packet!",
                   packet->id());
-    return nullptr;
+    // the frames already in front of this one are still good
+    buffer->set_write_cursor(frame_start);
+    return false;
   }
   // a serializer holding the bytes already, a cached encoding or a payload it
   // is forwarding, can hand back its own buffer rather than write them through
@@ -148,7 +188,7 @@ std::shared_ptr<Buffer> Codec::Serialize(std::shared_ptr<Packet> packet,
   buffer->set_write_cursor(write_cursor - sizeof(uint32_t));
   buffer->WriteInt(static_cast<uint32_t>(size));
   buffer->set_write_cursor(write_cursor_end);
-  return buffer;
+  return true;
 }
 
 void Codec::Add(PacketId id, std::unique_ptr<PacketSerializerBase> serializer) {
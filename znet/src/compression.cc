@@ -10,6 +10,11 @@
 
 #include "znet/compression.h"
 
+#ifdef ZNET_USE_ZSTD
+#include "zdict.h"
+#include "zstd.h"
+#endif
+
 namespace znet {
 
 template <CompressionType Type>
@@ -19,7 +24,8 @@ template <>
 struct CompressionCodec<CompressionType::None> {
   static CompressionType type() { return CompressionType::None; }
 
-  static std::shared_ptr<Buffer> HandleIn(std::shared_ptr<Buffer> buffer) {
+  static std::shared_ptr<Buffer> HandleIn(std::shared_ptr<Buffer> buffer,
+                                          std::shared_ptr<Buffer>*) {
     return buffer;
   }
 
@@ -49,6 +55,10 @@ std::string GetCompressionTypeString(CompressionType type) {
       return "None";
     case CompressionType::Zstandard:
       return "Zstandard";
+    case CompressionType::ZstandardDictionary:
+      return "Zstandard with dictionary";
+    case CompressionType::ZstandardStream:
+      return "Zstandard stream";
     default:
       return "Unknown";
   }
@@ -56,11 +66,76 @@ std::string GetCompressionTypeString(CompressionType type) {
 
 #ifdef ZNET_USE_ZSTD
 
-#include "zstd.h"
+namespace {
+
+// every message is compressed at this level, with a dictionary or without
+constexpr int kZstdLevel = 2;
+
+// a scratch that grew past this for one outsized message is let go rather
+// than held for the rest of the session; the next one starts small again
+constexpr size_t kMaxRetainedScratch = 256 * 1024;
+
+// where a decompressed payload goes: the caller's scratch, rewound, when
+// nothing else still holds it, and otherwise a new buffer that becomes the
+// scratch from then on. A handler keeping the previous payload is allowed, so
+// it cannot be overwritten under it. Without a scratch it is always new.
+std::shared_ptr<Buffer> TakeScratch(std::shared_ptr<Buffer>* scratch) {
+  if (!scratch) {
+    return std::make_shared<Buffer>();
+  }
+  std::shared_ptr<Buffer>& held = *scratch;
+  if (!held || held.use_count() > 1 || held->capacity() > kMaxRetainedScratch) {
+    held = std::make_shared<Buffer>();
+    return held;
+  }
+  held->Reset();
+  held->SetReadLimit(0);
+  return held;
+}
+
+// The one-shot ZSTD_compress/ZSTD_decompress build a context, with its hash
+// tables and window, for every message and free it again, which for a small
+// message costs more than the compression itself. One of each per thread is
+// reused instead: whichever thread holds a session's encode claim compresses
+// and its worker decompresses, and no context is ever used by two at once.
+// Sessions with different dictionaries share them, since each call states
+// its own dictionary.
+struct ZstdContexts {
+  ZSTD_CCtx* cctx = nullptr;
+  ZSTD_DCtx* dctx = nullptr;
+
+  ~ZstdContexts() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+ZstdContexts& ThreadContexts() {
+  thread_local ZstdContexts contexts;
+  return contexts;
+}
+
+ZSTD_CCtx* ThreadCCtx() {
+  ZstdContexts& contexts = ThreadContexts();
+  if (!contexts.cctx) {
+    contexts.cctx = ZSTD_createCCtx();
+  }
+  return contexts.cctx;
+}
+
+ZSTD_DCtx* ThreadDCtx() {
+  ZstdContexts& contexts = ThreadContexts();
+  if (!contexts.dctx) {
+    contexts.dctx = ZSTD_createDCtx();
+  }
+  return contexts.dctx;
+}
 
-std::shared_ptr<Buffer> DecompressZstd(std::shared_ptr<Buffer> buffer) {
-  std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>();
+}  // namespace
 
+std::shared_ptr<Buffer> DecompressZstd(std::shared_ptr<Buffer> buffer,
+                                       std::shared_ptr<Buffer>* scratch,
+                                       const CompressionDictionary* dictionary) {
   size_t decompressed_bound = ZSTD_getFrameContentSize(
       buffer->read_cursor_data(), buffer->readable_bytes());
   if (decompressed_bound == ZSTD_CONTENTSIZE_ERROR ||
@@ -69,15 +144,30 @@ std::shared_ptr<Buffer> DecompressZstd(std::shared_ptr<Buffer> buffer) {
                    ZSTD_getErrorName(decompressed_bound));
     return nullptr;
   }
+  ZSTD_DCtx* dctx = ThreadDCtx();
+  if (!dctx) {
+    ZNET_LOG_ERROR("Failed to create a zstd decompression context!");
+    return nullptr;
+  }
 
+  std::shared_ptr<Buffer> new_buffer = TakeScratch(scratch);
+  // a no-op once a reused scratch has grown to the session's message sizes
   new_buffer->ReserveExact(decompressed_bound);
-  size_t decompressed_size =
-      ZSTD_decompress(new_buffer->write_cursor_data(), decompressed_bound,
-                      buffer->read_cursor_data(), buffer->readable_bytes());
+  size_t decompressed_size;
+  if (dictionary) {
+    decompressed_size = ZSTD_decompress_usingDDict(
+        dctx, new_buffer->write_cursor_data(), decompressed_bound,
+        buffer->read_cursor_data(), buffer->readable_bytes(),
+        dictionary->decompression_dict());
+  } else {
+    decompressed_size = ZSTD_decompressDCtx(
+        dctx, new_buffer->write_cursor_data(), decompressed_bound,
+        buffer->read_cursor_data(), buffer->readable_bytes());
+  }
 
   if (ZSTD_isError(decompressed_size)) {
     ZNET_LOG_ERROR("Failed to decompress buffer with zstd: {}",
-                   ZSTD_getErrorName(decompressed_bound));
+                   ZSTD_getErrorName(decompressed_size));
     return nullptr;
   }
 
@@ -85,7 +175,13 @@ std::shared_ptr<Buffer> DecompressZstd(std::shared_ptr<Buffer> buffer) {
   return new_buffer;
 }
 
-std::shared_ptr<Buffer> CompressZstd(std::shared_ptr<Buffer> buffer) {
+std::shared_ptr<Buffer> CompressZstd(std::shared_ptr<Buffer> buffer,
+                                     const CompressionDictionary* dictionary) {
+  ZSTD_CCtx* cctx = ThreadCCtx();
+  if (!cctx) {
+    ZNET_LOG_ERROR("Failed to create a zstd compression context!");
+    return nullptr;
+  }
   size_t max_size = ZSTD_compressBound(buffer->readable_bytes());
 
   // front room for the compression type byte, the encryption byte and the
@@ -95,10 +191,24 @@ std::shared_ptr<Buffer> CompressZstd(std::shared_ptr<Buffer> buffer) {
   new_buffer->ReserveHeadroom(kFront);
   new_buffer->ReserveExact(kFront + max_size);
 
-  size_t compressed_size =
-      ZSTD_compress(new_buffer->write_cursor_data(), max_size,
-                    buffer->read_cursor_data(), buffer->readable_bytes(),
-                    2);  // compression level
+  size_t compressed_size;
+  if (dictionary) {
+    // the handshake already settled which dictionary this is, so the four
+    // bytes of ID zstd would put in every frame are left out: on the small
+    // messages a dictionary is for, that is a few percent of the result
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    ZSTD_CCtx_refCDict(cctx, dictionary->compression_dict());
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0);
+    compressed_size =
+        ZSTD_compress2(cctx, new_buffer->write_cursor_data(), max_size,
+                       buffer->read_cursor_data(), buffer->readable_bytes());
+  } else {
+    // ignores whatever parameters a dictionary call left on the context
+    compressed_size =
+        ZSTD_compressCCtx(cctx, new_buffer->write_cursor_data(), max_size,
+                          buffer->read_cursor_data(), buffer->readable_bytes(),
+                          kZstdLevel);
+  }
 
   if (ZSTD_isError(compressed_size)) {
     ZNET_LOG_ERROR("Failed to compress buffer with zstd: {}",
@@ -112,38 +222,255 @@ std::shared_ptr<Buffer> CompressZstd(std::shared_ptr<Buffer> buffer) {
 
 template <>
 struct CompressionCodec<CompressionType::Zstandard> {
-  static CompressionType type() { return CompressionType::Zstandard; }
-
-  static std::shared_ptr<Buffer> HandleIn(std::shared_ptr<Buffer> buffer) {
-    return DecompressZstd(buffer);
+  static std::shared_ptr<Buffer> HandleIn(
+      std::shared_ptr<Buffer> buffer, std::shared_ptr<Buffer>* scratch,
+      const CompressionDictionary* dictionary) {
+    return DecompressZstd(buffer, scratch, dictionary);
   }
 
-  static std::shared_ptr<Buffer> HandleOut(std::shared_ptr<Buffer> buffer) {
-    auto compressed = CompressZstd(buffer);
+  static std::shared_ptr<Buffer> HandleOut(
+      std::shared_ptr<Buffer> buffer, const CompressionDictionary* dictionary) {
+    auto compressed = CompressZstd(buffer, dictionary);
     if (!compressed) {
       return nullptr;
     }
+    const CompressionType type = dictionary
+                                     ? CompressionType::ZstandardDictionary
+                                     : CompressionType::Zstandard;
     // CompressZstd left front room, so the type byte goes in place; this
     // used to be a whole second buffer and a copy of the ciphertext-to-be
-    if (!compressed->PrependInt8(GetCompressionTypeRaw(type()))) {
+    if (!compressed->PrependInt8(GetCompressionTypeRaw(type))) {
       return nullptr;
     }
     return compressed;
   }
 };
+
+std::shared_ptr<CompressionDictionary> CompressionDictionary::Train(
+    const std::vector<std::string>& samples, size_t max_size) {
+  std::string joined;
+  std::vector<size_t> sizes;
+  sizes.reserve(samples.size());
+  for (const std::string& sample : samples) {
+    joined += sample;
+    sizes.push_back(sample.size());
+  }
+  std::string trained(max_size, '\0');
+  const size_t size = ZDICT_trainFromBuffer(
+      &trained[0], trained.size(), joined.data(), sizes.data(),
+      static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(size)) {
+    ZNET_LOG_ERROR("Failed to train a zstd dictionary from {} samples: {}",
+                   samples.size(), ZDICT_getErrorName(size));
+    return nullptr;
+  }
+  return FromBytes(trained.data(), size);
+}
+
+std::shared_ptr<CompressionDictionary> CompressionDictionary::FromBytes(
+    const void* data, size_t size) {
+  const unsigned id = ZDICT_getDictID(data, size);
+  if (id == 0) {
+    ZNET_LOG_ERROR(
+        "Refusing a zstd dictionary without an ID; load a trained one.");
+    return nullptr;
+  }
+  std::shared_ptr<CompressionDictionary> dictionary(new CompressionDictionary());
+  dictionary->bytes_.assign(static_cast<const char*>(data), size);
+  dictionary->id_ = id;
+  // digested once here rather than per message; both copy what they need
+  dictionary->cdict_ = ZSTD_createCDict(data, size, kZstdLevel);
+  dictionary->ddict_ = ZSTD_createDDict(data, size);
+  if (!dictionary->cdict_ || !dictionary->ddict_) {
+    ZNET_LOG_ERROR("Failed to load the zstd dictionary {}.", id);
+    return nullptr;
+  }
+  return dictionary;
+}
+
+CompressionDictionary::~CompressionDictionary() {
+  ZSTD_freeCDict(cdict_);
+  ZSTD_freeDDict(ddict_);
+}
+
+namespace compr {
+
+namespace {
+
+// a protocol constant, not a tuning knob: a decoder refuses any window larger
+// than the one it was built for, so both ends have to use the same. 128 KiB
+// holds dozens of typical messages, which is where the redundancy is.
+constexpr int kStreamWindowLog = 17;
+
+// the stream carries no content sizes, so a message that decompresses without
+// end could only be stopped by running out of memory. Nothing a session
+// should send comes near this.
+constexpr size_t kMaxStreamMessage = 16 * 1024 * 1024;
+
+}  // namespace
+
+StreamCompressor::StreamCompressor(const CompressionDictionary* dictionary) {
+  stream_ = ZSTD_createCCtx();
+  if (!stream_) {
+    return;
+  }
+  ZSTD_CCtx_setParameter(stream_, ZSTD_c_compressionLevel, kZstdLevel);
+  ZSTD_CCtx_setParameter(stream_, ZSTD_c_windowLog, kStreamWindowLog);
+  if (dictionary) {
+    ZSTD_CCtx_refCDict(stream_, dictionary->compression_dict());
+    ZSTD_CCtx_setParameter(stream_, ZSTD_c_dictIDFlag, 0);
+  }
+}
+
+StreamCompressor::~StreamCompressor() { ZSTD_freeCCtx(stream_); }
+
+std::shared_ptr<Buffer> StreamCompressor::Compress(const Buffer& buffer) {
+  if (!stream_) {
+    ZNET_LOG_ERROR("Failed to create a zstd compression stream!");
+    return nullptr;
+  }
+  // front room as in CompressZstd, plus the sequence byte; both go into it
+  // below
+  constexpr size_t kFront = 5;
+  const size_t size = buffer.readable_bytes();
+  auto out = std::make_shared<Buffer>();
+  out->ReserveHeadroom(kFront);
+  out->ReserveExact(kFront + ZSTD_compressBound(size));
+
+  ZSTD_inBuffer in{buffer.read_cursor_data(), size, 0};
+  for (;;) {
+    ZSTD_outBuffer chunk{out->write_cursor_data(), out->writable_bytes(), 0};
+    const size_t remaining =
+        ZSTD_compressStream2(stream_, &chunk, &in, ZSTD_e_flush);
+    if (ZSTD_isError(remaining)) {
+      ZNET_LOG_ERROR("Failed to compress into the zstd stream: {}",
+                     ZSTD_getErrorName(remaining));
+      return nullptr;
+    }
+    out->CommitWrite(chunk.pos);
+    if (remaining == 0) {
+      break;  // all of it flushed; the peer can decode up to here
+    }
+    out->ReserveIncremental(remaining);
+  }
+  if (!out->PrependInt8(sequence_++) ||
+      !out->PrependInt8(GetCompressionTypeRaw(CompressionType::ZstandardStream))) {
+    return nullptr;
+  }
+  return out;
+}
+
+StreamDecompressor::StreamDecompressor(const CompressionDictionary* dictionary) {
+  stream_ = ZSTD_createDCtx();
+  if (!stream_) {
+    return;
+  }
+  ZSTD_DCtx_setParameter(stream_, ZSTD_d_windowLogMax, kStreamWindowLog);
+  if (dictionary) {
+    ZSTD_DCtx_refDDict(stream_, dictionary->decompression_dict());
+  }
+}
+
+StreamDecompressor::~StreamDecompressor() { ZSTD_freeDCtx(stream_); }
+
+std::shared_ptr<Buffer> StreamDecompressor::Decompress(
+    const Buffer& buffer, std::shared_ptr<Buffer>* scratch) {
+  if (!stream_) {
+    ZNET_LOG_ERROR("Failed to create a zstd decompression stream!");
+    return nullptr;
+  }
+  const size_t size = buffer.readable_bytes();
+  // a message the sender compressed but this end never got leaves every later
+  // one referring to history that is not here. zstd has no way to notice, and
+  // often decodes them to plausible garbage; the count does notice.
+  if (size == 0 || static_cast<uint8_t>(*buffer.read_cursor_data()) != sequence_) {
+    ZNET_LOG_ERROR("Stream message out of sequence, expected {}.", sequence_);
+    return nullptr;
+  }
+  sequence_++;
+  std::shared_ptr<Buffer> out = TakeScratch(scratch);
+  // a guess; the stream does not say. A warm scratch is usually big enough
+  out->ReserveExact(size * 4 < 256 ? 256 : size * 4);
+
+  ZSTD_inBuffer in{buffer.read_cursor_data() + 1, size - 1, 0};
+  for (;;) {
+    ZSTD_outBuffer chunk{out->write_cursor_data(), out->writable_bytes(), 0};
+    const size_t result = ZSTD_decompressStream(stream_, &chunk, &in);
+    if (ZSTD_isError(result)) {
+      ZNET_LOG_ERROR("Failed to decompress from the zstd stream: {}",
+                     ZSTD_getErrorName(result));
+      return nullptr;
+    }
+    out->CommitWrite(chunk.pos);
+    // room left over means the decoder had nothing more to give
+    if (in.pos == in.size && chunk.pos < chunk.size) {
+      break;
+    }
+    if (out->size() >= kMaxStreamMessage) {
+      ZNET_LOG_ERROR("Stream message decompresses past {} bytes, refusing.",
+                     kMaxStreamMessage);
+      return nullptr;
+    }
+    out->ReserveIncremental(out->capacity());
+  }
+  return out;
+}
+
+}  // namespace compr
+
+#else
+
+namespace compr {
+
+StreamCompressor::StreamCompressor(const CompressionDictionary*) {}
+StreamCompressor::~StreamCompressor() = default;
+
+std::shared_ptr<Buffer> StreamCompressor::Compress(const Buffer&) {
+  ZNET_LOG_ERROR("Cannot compress a stream without zstd.");
+  return nullptr;
+}
+
+StreamDecompressor::StreamDecompressor(const CompressionDictionary*) {}
+StreamDecompressor::~StreamDecompressor() = default;
+
+std::shared_ptr<Buffer> StreamDecompressor::Decompress(
+    const Buffer&, std::shared_ptr<Buffer>*) {
+  ZNET_LOG_ERROR("Cannot decompress a stream without zstd.");
+  return nullptr;
+}
+
+}  // namespace compr
+
+std::shared_ptr<CompressionDictionary> CompressionDictionary::Train(
+    const std::vector<std::string>&, size_t) {
+  ZNET_LOG_ERROR("Cannot train a compression dictionary without zstd.");
+  return nullptr;
+}
+
+std::shared_ptr<CompressionDictionary> CompressionDictionary::FromBytes(
+    const void*, size_t) {
+  ZNET_LOG_ERROR("Cannot load a compression dictionary without zstd.");
+  return nullptr;
+}
+
+CompressionDictionary::~CompressionDictionary() = default;
+
 #endif
 
 namespace compr {
 
-std::shared_ptr<Buffer> HandleOutWithType(CompressionType type,
-                                          std::shared_ptr<Buffer> buffer) {
+std::shared_ptr<Buffer> HandleOutWithType(
+    CompressionType type, std::shared_ptr<Buffer> buffer,
+    const CompressionDictionary* dictionary) {
   switch (type) {
     case CompressionType::None:
       return CompressionCodec<CompressionType::None>::HandleOut(buffer);
     case CompressionType::Zstandard: {
 #ifdef ZNET_USE_ZSTD
-      return CompressionCodec<CompressionType::Zstandard>::HandleOut(buffer);
+      return CompressionCodec<CompressionType::Zstandard>::HandleOut(
+          buffer, dictionary);
 #else
+      (void)dictionary;
       static bool warnZstd = false;
       if (!warnZstd) {
         ZNET_LOG_WARN(
@@ -160,15 +487,27 @@ std::shared_ptr<Buffer> HandleOutWithType(CompressionType type,
   }
 }
 
-std::shared_ptr<Buffer> HandleInWithType(CompressionType type,
-                                         std::shared_ptr<Buffer> buffer) {
+std::shared_ptr<Buffer> HandleInWithType(
+    CompressionType type, std::shared_ptr<Buffer> buffer,
+    std::shared_ptr<Buffer>* scratch, const CompressionDictionary* dictionary) {
   switch (type) {
     case CompressionType::None:
-      return CompressionCodec<CompressionType::None>::HandleIn(buffer);
-    case CompressionType::Zstandard: {
+      return CompressionCodec<CompressionType::None>::HandleIn(buffer, scratch);
+    case CompressionType::Zstandard:
+    case CompressionType::ZstandardDictionary: {
 #ifdef ZNET_USE_ZSTD
-      return CompressionCodec<CompressionType::Zstandard>::HandleIn(buffer);
+      if (type == CompressionType::Zstandard) {
+        dictionary = nullptr;
+      } else if (!dictionary) {
+        ZNET_LOG_ERROR(
+            "Message was compressed with a dictionary this session never "
+            "agreed on, dropping.");
+        return nullptr;
+      }
+      return CompressionCodec<CompressionType::Zstandard>::HandleIn(
+          buffer, scratch, dictionary);
 #else
+      (void)dictionary;
       static bool warnZstd = false;
       if (!warnZstd) {
         ZNET_LOG_WARN(
@@ -180,15 +519,21 @@ std::shared_ptr<Buffer> HandleInWithType(CompressionType type,
       return nullptr;
 #endif
     }
+    case CompressionType::ZstandardStream:
+      // only the session's own stream can read these; see MessagePipeline
+      ZNET_LOG_ERROR("Stream-compressed message outside a stream, dropping.");
+      return nullptr;
     default:
       return nullptr;
   }
 }
 
-std::shared_ptr<Buffer> HandleInDynamic(std::shared_ptr<Buffer> buffer) {
+std::shared_ptr<Buffer> HandleInDynamic(std::shared_ptr<Buffer> buffer,
+                                        std::shared_ptr<Buffer>* scratch,
+                                        const CompressionDictionary* dictionary) {
   CompressionType type =
       static_cast<CompressionType>(buffer->ReadInt<CompressionTypeRaw>());
-  return HandleInWithType(type, buffer);
+  return HandleInWithType(type, buffer, scratch, dictionary);
 }
 
 }  // namespace compr
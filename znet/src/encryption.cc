@@ -14,6 +14,7 @@
 #include <openssl/evp.h>
 #include <openssl/kdf.h>
 
+#include <algorithm>
 #include <vector>
 
 namespace znet {
@@ -78,6 +79,24 @@ UniquePKey CloneKey(const UniquePKey& k) {
   return UniquePKey(k.get());
 }
 
+const EVP_CIPHER* GetCipherSuiteEvp(CipherSuite suite) {
+  if (!IsCipherSuiteAvailable(suite)) {
+    return nullptr;
+  }
+  switch (suite) {
+    case CipherSuite::Aes256Gcm:
+      return EVP_aes_256_gcm();
+    case CipherSuite::Aes128Gcm:
+      return EVP_aes_128_gcm();
+#if !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+    case CipherSuite::ChaCha20Poly1305:
+      return EVP_chacha20_poly1305();
+#endif
+    default:
+      return nullptr;
+  }
+}
+
 UniquePKey GenerateKey() {
   /* Create the context for generating the parameters */
   EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DH, nullptr);
@@ -149,8 +168,9 @@ namespace {
 // both sides derive it from the shared secret. Counters run per stream, so
 // the stream has to be in the nonce for (key, nonce) pairs to stay unique.
 // It needs no separate authentication: altering it derives a different nonce,
-// and the tag then fails. GCM is a stream cipher, so the ciphertext is exactly
-// as long as the plaintext.
+// and the tag then fails. Every suite is a stream cipher with a 12-byte nonce
+// and a 16-byte tag, so the layout is the same whichever was negotiated and the
+// ciphertext is exactly as long as the plaintext.
 constexpr size_t kNonceLen = 12;  // 4 salt + 1 stream + 7 counter
 constexpr size_t kNonceSaltLen = 4;
 constexpr size_t kCounterLen = 7;
@@ -158,10 +178,58 @@ constexpr size_t kHeaderLen = 1 + kCounterLen;  // stream + counter, on the wire
 constexpr size_t kTagLen = 16;
 // 7 bytes of counter: 2^56 messages on one stream before it would repeat.
 constexpr uint64_t kMaxCounter = (uint64_t{1} << (8 * kCounterLen)) - 1;
+static_assert(EncryptionLayer::kMaxMessageOverhead == 1 + kHeaderLen + kTagLen,
+              "the advertised overhead has to match the layout");
 
 constexpr uint8_t kModePlaintext = 0;
 constexpr uint8_t kModeAesCbc = 1;  // retired: unauthenticated, see HandleDecrypt
-constexpr uint8_t kModeAesGcm = 2;
+constexpr uint8_t kModeAesGcm = 2;  // AES-256-GCM, from before suites
+// no per-message crypto: the transport sealed the datagram it rode in (see
+// TransportLayer::InstallDatagramKeys), and the byte says so
+constexpr uint8_t kModeSealed = 3;
+constexpr uint8_t kModeAes128Gcm = 4;
+constexpr uint8_t kModeChaCha20Poly1305 = 5;
+
+// a mode byte per suite rather than one for all of them: the byte is in the
+// associated data, so a message cannot be passed off as another suite's
+uint8_t ModeFor(CipherSuite suite) {
+  switch (suite) {
+    case CipherSuite::Aes128Gcm:
+      return kModeAes128Gcm;
+    case CipherSuite::ChaCha20Poly1305:
+      return kModeChaCha20Poly1305;
+    default:
+      return kModeAesGcm;
+  }
+}
+
+bool IsAeadMode(uint8_t mode) {
+  return mode == kModeAesGcm || mode == kModeAes128Gcm ||
+         mode == kModeChaCha20Poly1305;
+}
+
+// a peer that predates suites sends no list, and both offers and selects
+// AES-256-GCM without saying so
+std::vector<CipherSuite> SuitesFromWire(const std::vector<CipherSuiteRaw>& raw) {
+  if (raw.empty()) {
+    return {CipherSuite::Aes256Gcm};
+  }
+  std::vector<CipherSuite> out;
+  out.reserve(raw.size());
+  for (CipherSuiteRaw suite : raw) {
+    out.push_back(static_cast<CipherSuite>(suite));
+  }
+  return out;
+}
+
+std::vector<CipherSuiteRaw> SuitesToWire(const std::vector<CipherSuite>& suites) {
+  std::vector<CipherSuiteRaw> out;
+  out.reserve(suites.size());
+  for (CipherSuite suite : suites) {
+    out.push_back(static_cast<CipherSuiteRaw>(suite));
+  }
+  return out;
+}
 
 // Big-endian, so a packet capture reads in order.
 void WriteCounter(unsigned char* out, uint64_t counter) {
@@ -288,17 +356,19 @@ bool DeriveKeyFromSharedSecret(const unsigned char* shared_secret,
 }
 
 // `ctx` is owned by the caller and reused across messages. `set_key` is true
-// only the first time, so the AES key schedule is derived once per session
-// instead of once per message; later calls reset the nonce and nothing else.
+// only the first time, so the key schedule is derived once per session instead
+// of once per message; later calls reset the nonce and nothing else. `cipher`
+// is the negotiated suite's and only read on that first call.
 //
 // `aad` is authenticated but not encrypted: the mode byte goes through it, so a
 // flipped mode fails the tag instead of steering the receiver somewhere else.
 //
 // Returns the ciphertext length, or -1 on failure. Zero is a valid length (an
 // empty plaintext), which is why failure is not folded into it.
-int EncryptData(EVP_CIPHER_CTX* ctx, bool set_key, const unsigned char* key,
-                const unsigned char* nonce, const unsigned char* aad,
-                int aad_len, const unsigned char* plaintext, int plaintext_len,
+int EncryptData(EVP_CIPHER_CTX* ctx, const EVP_CIPHER* cipher, bool set_key,
+                const unsigned char* key, const unsigned char* nonce,
+                const unsigned char* aad, int aad_len,
+                const unsigned char* plaintext, int plaintext_len,
                 unsigned char* ciphertext, unsigned char* tag) {
   if (!ctx) {
     ZNET_LOG_ERROR("Failed to create EVP_CIPHER_CTX.");
@@ -306,8 +376,8 @@ int EncryptData(EVP_CIPHER_CTX* ctx, bool set_key, const unsigned char* key,
   }
 
   if (set_key) {
-    if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr,
-                                nullptr) ||
+    if (!cipher ||
+        1 != EVP_EncryptInit_ex(ctx, cipher, nullptr, nullptr, nullptr) ||
         1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN,
                                  static_cast<int>(kNonceLen), nullptr) ||
         1 != EVP_EncryptInit_ex(ctx, nullptr, nullptr, key, nonce)) {
@@ -354,19 +424,19 @@ int EncryptData(EVP_CIPHER_CTX* ctx, bool set_key, const unsigned char* key,
 // here means the message was forged, tampered with, or replayed under a
 // different nonce, and the caller must drop it: nothing decrypted is
 // trustworthy until EVP_DecryptFinal_ex has passed.
-int DecryptData(EVP_CIPHER_CTX* ctx, bool set_key, const unsigned char* key,
-                const unsigned char* nonce, const unsigned char* aad,
-                int aad_len, const unsigned char* ciphertext,
-                int ciphertext_len, const unsigned char* tag,
-                unsigned char* plaintext) {
+int DecryptData(EVP_CIPHER_CTX* ctx, const EVP_CIPHER* cipher, bool set_key,
+                const unsigned char* key, const unsigned char* nonce,
+                const unsigned char* aad, int aad_len,
+                const unsigned char* ciphertext, int ciphertext_len,
+                const unsigned char* tag, unsigned char* plaintext) {
   if (!ctx) {
     ZNET_LOG_ERROR("Failed to create EVP_CIPHER_CTX");
     return -1;
   }
 
   if (set_key) {
-    if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr,
-                                nullptr) ||
+    if (!cipher ||
+        1 != EVP_DecryptInit_ex(ctx, cipher, nullptr, nullptr, nullptr) ||
         1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN,
                                  static_cast<int>(kNonceLen), nullptr) ||
         1 != EVP_DecryptInit_ex(ctx, nullptr, nullptr, key, nonce)) {
@@ -430,8 +500,17 @@ EncryptionLayer::EncryptionLayer(PeerSession& session) : session_(session) {
   session_.SetCodec(std::move(codec));
 }
 
-void EncryptionLayer::Initialize(bool send, bool want_encryption) {
+void EncryptionLayer::Initialize(bool send, bool want_encryption,
+                                 const std::vector<CipherSuite>& cipher_suites) {
   want_encryption_ = want_encryption;
+  cipher_suites_ =
+      cipher_suites.empty() ? DefaultCipherSuites() : cipher_suites;
+  cipher_suites_.erase(
+      std::remove_if(cipher_suites_.begin(), cipher_suites_.end(),
+                     [](CipherSuite suite) {
+                       return !IsCipherSuiteAvailable(suite);
+                     }),
+      cipher_suites_.end());
   if (send) {
     SendHandshake();
   }
@@ -492,6 +571,36 @@ bool EncryptionLayer::DeriveDirectionalKeys() {
   return DeriveExporterSecret();
 }
 
+// The transport's keys, for sealing whole datagrams. Labels of their own, so
+// they share nothing with the per-message keys above: both nonces are salt ||
+// counter, and under one key the two counters would collide.
+bool EncryptionLayer::DeriveDatagramKeys(DatagramKeys& out) {
+  static const char kClientToServer[] = "znet datagram c2s v1";
+  static const char kServerToClient[] = "znet datagram s2c v1";
+  const char* tx_label =
+      session_.is_initiator() ? kClientToServer : kServerToClient;
+  const char* rx_label =
+      session_.is_initiator() ? kServerToClient : kClientToServer;
+
+  out.suite = suite_;
+  unsigned char tx_material[sizeof(out.tx_key) + sizeof(out.tx_salt)];
+  unsigned char rx_material[sizeof(out.rx_key) + sizeof(out.rx_salt)];
+  const bool derived =
+      DeriveKeyFromSharedSecret(shared_secret_, shared_secret_len_, tx_label,
+                                tx_material, sizeof(tx_material)) &&
+      DeriveKeyFromSharedSecret(shared_secret_, shared_secret_len_, rx_label,
+                                rx_material, sizeof(rx_material));
+  if (derived) {
+    memcpy(out.tx_key, tx_material, sizeof(out.tx_key));
+    memcpy(out.tx_salt, tx_material + sizeof(out.tx_key), sizeof(out.tx_salt));
+    memcpy(out.rx_key, rx_material, sizeof(out.rx_key));
+    memcpy(out.rx_salt, rx_material + sizeof(out.rx_key), sizeof(out.rx_salt));
+  }
+  OPENSSL_cleanse(tx_material, sizeof(tx_material));
+  OPENSSL_cleanse(rx_material, sizeof(rx_material));
+  return derived;
+}
+
 // The root the exporter expands from, bound to a transcript of both public keys
 // as well as the secret they produced.
 //
@@ -594,8 +703,19 @@ ReplayWindow& EncryptionLayer::RxWindow(uint8_t stream) {
 }
 
 std::shared_ptr<Buffer> EncryptionLayer::HandleDecrypt(
-    std::shared_ptr<Buffer> buffer) {
+    std::shared_ptr<Buffer> buffer, bool sealed) {
   auto mode = buffer->ReadInt<uint8_t>();
+  if (mode == kModeSealed) {
+    // vouched for by the datagram rather than by itself, so only believed
+    // when the transport says that datagram authenticated. An unsealed one
+    // claiming this is the same downgrade as a plaintext message.
+    if (!datagram_sealed_ || !sealed) {
+      ZNET_LOG_ERROR(
+          "Message claims a sealed datagram it did not arrive in, dropping.");
+      return nullptr;
+    }
+    return buffer;
+  }
   if (mode == kModePlaintext) {
     // Once keys exist the session is encrypted, and a plaintext message is an
     // attacker stripping the encryption rather than a peer being helpful.
@@ -615,7 +735,7 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleDecrypt(
         "older znet. Dropping.");
     return nullptr;
   }
-  if (mode != kModeAesGcm) {
+  if (!IsAeadMode(mode)) {
     ZNET_LOG_ERROR("Encryption mode {} is not known/supported!", mode);
     return nullptr;
   }
@@ -623,6 +743,13 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleDecrypt(
     ZNET_LOG_ERROR("Encrypted message before the key exchange finished, dropping.");
     return nullptr;
   }
+  if (mode != ModeFor(suite_)) {
+    ZNET_LOG_ERROR(
+        "Message encrypted with mode {}, but the session negotiated {}, "
+        "dropping.",
+        mode, GetCipherSuiteString(suite_));
+    return nullptr;
+  }
   // Read() only sets an error flag when short, leaving the destination
   // indeterminate, so the length is checked before anything is copied out.
   if (buffer->readable_bytes() < kHeaderLen + kTagLen) {
@@ -634,34 +761,34 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleDecrypt(
   const uint8_t stream = header[0];
   const uint64_t counter = ReadCounter(header + 1);
 
+  const size_t body_start = buffer->read_cursor();
   const size_t remaining = buffer->readable_bytes();
   const auto cipher_len = static_cast<int>(remaining - kTagLen);
-  const auto* body = reinterpret_cast<const unsigned char*>(
-      buffer->data() + buffer->read_cursor());
+  auto* body = reinterpret_cast<unsigned char*>(buffer->data_mutable() +
+                                                body_start);
   const unsigned char* tag = body + cipher_len;
 
   unsigned char nonce[kNonceLen];
   BuildNonce(rx_salt_, stream, counter, nonce);
 
-  // GCM's plaintext is at most cipher_len, so the returned buffer is laid out
-  // up front and decrypted straight into place; the scratch vector this used
-  // to fill was a second allocation and a full copy on every message.
-  auto out = std::make_shared<Buffer>();
-  out->ReserveExact(static_cast<size_t>(cipher_len));
+  // decrypted over its own ciphertext: every suite is a stream cipher, so the
+  // plaintext is the same length and OpenSSL allows the exact overlap. The
+  // buffer is the transport's alone by now, and a message that fails the tag
+  // is dropped, so nothing ever sees the half-written bytes. This used to be a
+  // fresh buffer per message.
   if (!dec_ctx_) {
     dec_ctx_ = EVP_CIPHER_CTX_new();
     dec_keyed_ = false;
   }
-  const unsigned char aad[1] = {kModeAesGcm};
+  const unsigned char aad[1] = {mode};
   const bool set_dec_key = !dec_keyed_;
   int actual_len =
-      DecryptData(dec_ctx_, set_dec_key, rx_key_, nonce, aad,
-                  static_cast<int>(sizeof(aad)), body, cipher_len, tag,
-                  reinterpret_cast<unsigned char*>(out->write_cursor_data()));
+      DecryptData(dec_ctx_, GetCipherSuiteEvp(suite_), set_dec_key, rx_key_,
+                  nonce, aad, static_cast<int>(sizeof(aad)), body, cipher_len,
+                  tag, body);
   if (actual_len >= 0) {
     dec_keyed_ = true;
   }
-  buffer->SkipRead(remaining);
   if (actual_len < 0) {
     ZNET_LOG_ERROR(
         "Message failed authentication (stream {}, counter {}), dropping: it "
@@ -675,36 +802,54 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleDecrypt(
                    stream, counter);
     return nullptr;
   }
-  out->CommitWrite(static_cast<size_t>(actual_len));
-  return out;
+  // the plaintext is what is readable now; the tag behind it is not
+  buffer->set_write_cursor(body_start + static_cast<size_t>(actual_len));
+  return buffer;
 }
 
 std::shared_ptr<Buffer> EncryptionLayer::HandleIn(
-    std::shared_ptr<Buffer> buffer) {
-  return HandleDecrypt(buffer);
+    std::shared_ptr<Buffer> buffer, bool sealed) {
+  return HandleDecrypt(buffer, sealed);
 }
 
 std::shared_ptr<Buffer> EncryptionLayer::HandleOut(
     std::shared_ptr<Buffer> buffer, uint8_t stream) {
-  // the message starts at the read cursor, not at zero: the send pipeline
-  // reserves headroom for the byte prepended below
-  if (buffer->readable_bytes() >
+  // in place when the message only gains its mode byte and the send pipeline
+  // left headroom for it; the ciphertext always goes into a new buffer
+  if (!enable_encryption_ || datagram_sealed_) {
+    const uint8_t mode = enable_encryption_ ? kModeSealed : kModePlaintext;
+    if (buffer->PrependInt8(mode)) {
+      return buffer;
+    }
+  }
+  return HandleOut(*buffer, stream);
+}
+
+std::shared_ptr<Buffer> EncryptionLayer::HandleOut(const Buffer& buffer,
+                                                   uint8_t stream) {
+  if (buffer.readable_bytes() >
       static_cast<size_t>(std::numeric_limits<int>::max())) {
     ZNET_LOG_ERROR("Buffer length is too large");
     return nullptr;
   }
-  int buffer_len = static_cast<int>(buffer->readable_bytes());
-  if (enable_encryption_) {
+  int buffer_len = static_cast<int>(buffer.readable_bytes());
+  // the transport encrypts and authenticates the whole datagram, so the
+  // message needs only the byte that says so
+  uint8_t mode = kModePlaintext;
+  if (enable_encryption_ && datagram_sealed_) {
+    mode = kModeSealed;
+  } else if (enable_encryption_) {
+    const uint8_t aead_mode = ModeFor(suite_);
     std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>();
-    // GCM is a stream cipher: the ciphertext is exactly as long as the input.
-    // The output is laid out up front and encrypted straight into place; the
-    // scratch ciphertext vector this used to build was a second allocation
-    // and a full copy on every message. The two front bytes let the TCP
-    // transport frame in place afterwards.
+    // every suite is a stream cipher: the ciphertext is exactly as long as the
+    // input. The output is laid out up front and encrypted straight into
+    // place; the scratch ciphertext vector this used to build was a second
+    // allocation and a full copy on every message. The two front bytes let the
+    // TCP transport frame in place afterwards.
     new_buffer->ReserveHeadroom(2);
     new_buffer->ReserveExact(2 + 1 + kHeaderLen +
                              static_cast<size_t>(buffer_len) + kTagLen);
-    new_buffer->WriteInt<uint8_t>(kModeAesGcm);
+    new_buffer->WriteInt<uint8_t>(aead_mode);
     const size_t header_pos = new_buffer->write_cursor();
     new_buffer->SkipWrite(kHeaderLen);  // backfilled once the counter is taken
     auto* ciphertext_dst =
@@ -712,7 +857,7 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleOut(
 
     unsigned char tag[kTagLen];
     unsigned char nonce[kNonceLen];
-    const unsigned char aad[1] = {kModeAesGcm};
+    const unsigned char aad[1] = {aead_mode};
     uint64_t counter;
     int ciphertext_len;
     {
@@ -734,10 +879,10 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleOut(
       }
       const bool set_key = !cipher_keyed_;
       ciphertext_len =
-          EncryptData(enc_ctx_, set_key, tx_key_, nonce, aad,
-                      static_cast<int>(sizeof(aad)),
+          EncryptData(enc_ctx_, GetCipherSuiteEvp(suite_), set_key, tx_key_,
+                      nonce, aad, static_cast<int>(sizeof(aad)),
                       reinterpret_cast<const unsigned char*>(
-                          buffer->read_cursor_data()),
+                          buffer.read_cursor_data()),
                       buffer_len, ciphertext_dst, tag);
       if (ciphertext_len >= 0) {
         cipher_keyed_ = true;
@@ -760,15 +905,11 @@ std::shared_ptr<Buffer> EncryptionLayer::HandleOut(
     new_buffer->set_write_cursor(end);
     return new_buffer;
   }
-  // in place when there is headroom left, otherwise a fresh buffer
-  if (buffer->PrependInt8(0)) {  // no encryption
-    return buffer;
-  }
   auto new_buffer = std::make_shared<Buffer>();
   new_buffer->ReserveHeadroom(2);  // room for the transport's frame
   new_buffer->ReserveExact(static_cast<size_t>(buffer_len) + 3);
-  new_buffer->WriteInt<uint8_t>(0);  // no encryption
-  new_buffer->Write(buffer->read_cursor_data(), static_cast<size_t>(buffer_len));
+  new_buffer->WriteInt<uint8_t>(mode);
+  new_buffer->Write(buffer.read_cursor_data(), static_cast<size_t>(buffer_len));
   return new_buffer;
 }
 
@@ -783,6 +924,14 @@ void EncryptionLayer::OnHandshakePacket(
     // the server states the parameters outright; adopt them.
     session_.SetNegotiatedCompression(
         static_cast<CompressionType>(packet->compression_));
+    if (!session_.SetNegotiatedDictionary(packet->dictionary_id_)) {
+      ZNET_LOG_ERROR(
+          "Server selected compression dictionary {}, which this end did not "
+          "offer, closing the connection!",
+          packet->dictionary_id_);
+      session_.Close();
+      return;
+    }
     if (!packet->encryption_) {
       negotiated_ = true;
       ZNET_LOG_DEBUG("Server selected an unencrypted session.");
@@ -798,8 +947,29 @@ void EncryptionLayer::OnHandshakePacket(
       session_.Close();
       return;
     }
+    // the server names exactly one, and it has to be one this end offered
+    const std::vector<CipherSuite> selected =
+        SuitesFromWire(packet->cipher_suites_);
+    if (selected.size() != 1 ||
+        std::find(cipher_suites_.begin(), cipher_suites_.end(),
+                  selected.front()) == cipher_suites_.end()) {
+      ZNET_LOG_ERROR(
+          "Server selected a cipher suite this end did not offer, closing the "
+          "connection!");
+      session_.Close();
+      return;
+    }
+    suite_ = selected.front();
   } else {
     // accepting side: our own policy decides, the client only supplies a key.
+    // A dictionary is the one exception: it takes both ends having it, so
+    // without a match the session compresses plainly instead.
+    const uint32_t dictionary_id = session_.offered_dictionary_id();
+    const bool use_dictionary =
+        dictionary_id != 0 && packet->dictionary_id_ == dictionary_id &&
+        (session_.negotiated_compression() == CompressionType::Zstandard ||
+         session_.negotiated_compression() == CompressionType::ZstandardStream);
+    session_.SetNegotiatedDictionary(use_dictionary ? dictionary_id : 0);
     if (!want_encryption_) {
       negotiated_ = true;
       ZNET_LOG_DEBUG("Server selected an unencrypted session.");
@@ -817,6 +987,14 @@ void EncryptionLayer::OnHandshakePacket(
       session_.Close();
       return;
     }
+    if (!SelectCipherSuite(cipher_suites_, SuitesFromWire(packet->cipher_suites_),
+                           suite_)) {
+      ZNET_LOG_ERROR(
+          "Client offered no cipher suite this server allows, closing the "
+          "connection!");
+      session_.Close();
+      return;
+    }
   }
 
   peer_pkey_ = std::move(packet->pub_key_);
@@ -835,7 +1013,15 @@ void EncryptionLayer::OnHandshakePacket(
   }
   key_filled_ = true;
   negotiated_ = true;
-  ZNET_LOG_DEBUG("Handshake key exchange complete, initiator={}", session_.is_initiator());
+  // the transport opens the peer's sealed datagrams from now on. Ours stay
+  // unsealed until SendReady(), when the peer is known to hold the keys too
+  DatagramKeys datagram_keys;
+  if (DeriveDatagramKeys(datagram_keys)) {
+    datagram_sealed_ = session_.transport().InstallDatagramKeys(datagram_keys);
+  }
+  OPENSSL_cleanse(&datagram_keys, sizeof(datagram_keys));
+  ZNET_LOG_DEBUG("Handshake key exchange complete, initiator={}, suite={}",
+                 session_.is_initiator(), GetCipherSuiteString(suite_));
 
   if (!sent_handshake_) {
     SendHandshake();
@@ -880,9 +1066,19 @@ void EncryptionLayer::SendHandshake() {
   if (offer_key && pub_key_) {
     packet->pub_key_ = CloneKey(pub_key_);
   }
+  // the initiator's offer; the server's selection, made before it gets here
+  if (session_.is_initiator()) {
+    packet->cipher_suites_ = SuitesToWire(cipher_suites_);
+  } else if (suite_ != CipherSuite::None) {
+    packet->cipher_suites_ = {static_cast<CipherSuiteRaw>(suite_)};
+  }
   packet->encryption_ = want_encryption_;
   packet->compression_ =
       GetCompressionTypeRaw(session_.negotiated_compression());
+  // the initiator's offer; the server's answer, settled before it gets here
+  packet->dictionary_id_ = session_.is_initiator()
+                               ? session_.offered_dictionary_id()
+                               : session_.compression_dictionary_id();
   session_.SendImmediate(packet);
   sent_handshake_ = true;
 }
@@ -890,6 +1086,12 @@ void EncryptionLayer::SendHandshake() {
 void EncryptionLayer::SendReady() {
   // the negotiated outcome, not what this side asked for
   enable_encryption_ = key_filled_;
+  // the peer has derived its keys by now: the initiator gets here on the
+  // acceptor's key, the acceptor on the initiator's ready. So this ready, and
+  // everything after it, may go out sealed
+  if (enable_encryption_ && datagram_sealed_) {
+    session_.transport().StartSealing();
+  }
   auto packet = std::make_shared<ConnectionReadyPacket>();
   packet->magic_ = "343693b5-2b04-4d56-a3b5-48582ca37c7d";
   session_.SendImmediate(packet);
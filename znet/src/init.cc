@@ -9,6 +9,7 @@
 //
 
 #include "znet/init.h"
+#include "znet/cipher_suite.h"
 #include "znet/detail/sys_net.h"
 #include "znet/logger.h"
 #include "znet/version.h"
@@ -28,6 +29,7 @@ class Initializer {
   Initializer() {
     ZNET_LOG_INFO("Initializing znet {}...", VersionString());
     ZNET_LOG_INFO(" - compression_zstd: {}", ZSTD_ENABLED_STR);
+    ZNET_LOG_INFO(" - hardware_aes: {}", HasHardwareAes());
 
 #ifdef ZNET_TARGET_WIN
     WORD wVersionRequested;
@@ -18,44 +18,190 @@ namespace znet {
 std::shared_ptr<Buffer> MessagePipeline::Encode(
     const std::shared_ptr<Packet>& packet, uint8_t stream,
     size_t* out_payload_bytes) {
+  auto buffer = Serialize(packet);
+  if (!buffer) {
+    return nullptr;
+  }
+  if (out_payload_bytes != nullptr) {
+    *out_payload_bytes = buffer->readable_bytes();
+  }
+  return Seal(std::move(buffer), stream);
+}
+
+std::shared_ptr<Buffer> MessagePipeline::Serialize(
+    const std::shared_ptr<Packet>& packet) {
+  if (!codec_) {
+    ZNET_LOG_WARN("Session {} has no codec, dropping packet!", id_);
+    return nullptr;
+  }
+  return codec_->Serialize(packet, kSendHeadroom);
+}
+
+bool MessagePipeline::Append(const std::shared_ptr<Buffer>& payload,
+                             const std::shared_ptr<Packet>& packet) {
   if (!codec_) {
     ZNET_LOG_WARN("Session {} has no codec, dropping packet!", id_);
+    return false;
+  }
+  return codec_->SerializeInto(packet, payload);
+}
+
+std::shared_ptr<Buffer> MessagePipeline::SplitOff(Buffer& payload,
+                                                  size_t offset) {
+  auto tail = std::make_shared<Buffer>();
+  tail->ReserveHeadroom(kSendHeadroom);
+  tail->Write(payload.data() + offset, payload.write_cursor() - offset);
+  payload.set_write_cursor(offset);
+  return tail;
+}
+
+std::shared_ptr<Buffer> MessagePipeline::Seal(std::shared_ptr<Buffer> buffer,
+                                              uint8_t stream) {
+  sealed_into_stream_ = false;
+  buffer = Compress(std::move(buffer));
+  if (!buffer) {
     return nullptr;
   }
-  auto buffer = codec_->Serialize(packet, kSendHeadroom);
+  buffer = encryption_.HandleOut(std::move(buffer), stream);
   if (!buffer) {
+    ZNET_LOG_ERROR("Session {} encryption failed, dropping packet!", id_);
     return nullptr;
   }
+  return buffer;
+}
+
+std::shared_ptr<Buffer> MessagePipeline::EncodeShared(
+    SharedMessage& message, uint8_t stream, size_t* out_payload_bytes) {
+  if (!codec_ || out_compression_ == CompressionType::ZstandardStream) {
+    return Encode(message.packet(), stream, out_payload_bytes);
+  }
+  const CompressionDictionary* dictionary =
+      out_compression_ == CompressionType::Zstandard ? dictionary_.get()
+                                                     : nullptr;
+  // the threshold only matters when something would be compressed
+  size_t threshold = 0;
+  if (out_compression_ != CompressionType::None) {
+    threshold = dictionary ? context_threshold_ : compression_threshold_;
+  }
+  const SharedMessage::Key key{out_compression_, dictionary, threshold};
+  std::shared_ptr<const Buffer> payload;
+  size_t payload_bytes = 0;
+  {
+    std::lock_guard<std::mutex> lock(message.mutex_);
+    for (const SharedMessage::Encoding& encoding : message.encodings_) {
+      if (encoding.key == key) {
+        payload = encoding.payload;
+        payload_bytes = encoding.payload_bytes;
+        break;
+      }
+    }
+    if (!payload) {
+      auto buffer = Serialize(message.packet());
+      if (!buffer) {
+        return nullptr;
+      }
+      payload_bytes = buffer->readable_bytes();
+      buffer = Compress(std::move(buffer));
+      if (!buffer) {
+        return nullptr;
+      }
+      payload = buffer;
+      message.encodings_.push_back(
+          SharedMessage::Encoding{key, payload, payload_bytes});
+    }
+  }
   if (out_payload_bytes != nullptr) {
-    *out_payload_bytes = buffer->readable_bytes();
+    *out_payload_bytes = payload_bytes;
+  }
+  // reads the shared payload and writes this session's own message
+  auto buffer = encryption_.HandleOut(*payload, stream);
+  if (!buffer) {
+    ZNET_LOG_ERROR("Session {} encryption failed, dropping packet!", id_);
+    return nullptr;
   }
+  return buffer;
+}
+
+std::shared_ptr<Buffer> MessagePipeline::Compress(
+    std::shared_ptr<Buffer> buffer) {
   // small messages skip compression: the coder tables cost more than they can
-  // ever save back.
+  // ever save back. A dictionary or a stream's history moves that point down a
+  // long way.
   CompressionType compression = out_compression_;
-  if (buffer->readable_bytes() < compression_threshold_) {
+  const CompressionDictionary* dictionary =
+      compression == CompressionType::Zstandard ||
+              compression == CompressionType::ZstandardStream
+          ? dictionary_.get()
+          : nullptr;
+  const size_t threshold =
+      dictionary || compression == CompressionType::ZstandardStream
+          ? context_threshold_
+          : compression_threshold_;
+  if (buffer->readable_bytes() < threshold) {
     compression = CompressionType::None;
   }
-  buffer = compr::HandleOutWithType(compression, std::move(buffer));
-  if (!buffer) {
-    ZNET_LOG_ERROR("Session {} compression failed, dropping packet!", id_);
-    return nullptr;
+  if (compression == CompressionType::ZstandardStream) {
+    // whatever the stream takes in it keeps, sent or not, so a message the
+    // transport might refuse is turned away before it gets there. Measured
+    // against incompressible bytes: how well these compress is only known
+    // after the fact.
+    if (message_limit_ != 0 &&
+        buffer->readable_bytes() > PayloadBudget(message_limit_)) {
+      ZNET_LOG_ERROR(
+          "Session {} message of {} bytes could outgrow the transport's {} "
+          "once compressed, dropping packet!",
+          id_, buffer->readable_bytes(), message_limit_);
+      return nullptr;
+    }
+    sealed_into_stream_ = true;
+    if (!stream_out_) {
+      stream_out_.reset(new compr::StreamCompressor(dictionary));
+    }
+    buffer = stream_out_->Compress(*buffer);
+  } else {
+    buffer =
+        compr::HandleOutWithType(compression, std::move(buffer), dictionary);
   }
-  buffer = encryption_.HandleOut(std::move(buffer), stream);
   if (!buffer) {
-    ZNET_LOG_ERROR("Session {} encryption failed, dropping packet!", id_);
+    ZNET_LOG_ERROR("Session {} compression failed, dropping packet!", id_);
     return nullptr;
   }
   return buffer;
 }
 
+size_t MessagePipeline::PayloadBudget(size_t message_budget) {
+  // the compression type byte and a stream's sequence byte, then what LZ4 and
+  // zstd can each add to bytes they fail to shrink: under one in 255, and a
+  // frame header
+  const size_t compression = 2 + message_budget / 255 + 64;
+  const size_t overhead = compression + EncryptionLayer::kMaxMessageOverhead;
+  return message_budget > overhead ? message_budget - overhead : 0;
+}
+
 std::shared_ptr<Buffer> MessagePipeline::Decode(
-    std::shared_ptr<Buffer> buffer) {
-  buffer = encryption_.HandleIn(std::move(buffer));
+    std::shared_ptr<Buffer> buffer, bool sealed) {
+  buffer = encryption_.HandleIn(std::move(buffer), sealed);
   if (!buffer) {
     ZNET_LOG_ERROR("Session {} decryption returned null!", id_);
     return nullptr;
   }
-  buffer = compr::HandleInDynamic(std::move(buffer));
+  const bool streamed =
+      buffer->readable_bytes() > 0 &&
+      static_cast<CompressionType>(static_cast<CompressionTypeRaw>(
+          *buffer->read_cursor_data())) == CompressionType::ZstandardStream;
+  if (streamed) {
+    buffer->SkipRead(sizeof(CompressionTypeRaw));
+    if (!stream_in_) {
+      stream_in_.reset(new compr::StreamDecompressor(dictionary_.get()));
+    }
+    buffer = stream_in_->Decompress(*buffer, &decompress_scratch_);
+    // what the stream held is now out of step with the peer's, and every
+    // message after this one would decode to garbage or not at all
+    stream_broken_ = !buffer;
+  } else {
+    buffer = compr::HandleInDynamic(std::move(buffer), &decompress_scratch_,
+                                    dictionary_.get());
+  }
   if (!buffer) {
     ZNET_LOG_ERROR("Session {} decompression returned null!", id_);
     return nullptr;
@@ -359,7 +359,8 @@ void Host::CompletePunch(size_t index, const std::shared_ptr<InetAddress>& from,
   Punch punch = std::move(punches_[index]);
   punches_.erase(punches_.begin() + static_cast<long>(index));
 
-  auto inbox = std::make_shared<ZDTInbox>();
+  auto inbox =
+      std::make_shared<ZDTInbox>(config_.session_options.zdt.max_inbox_datagrams);
   auto transport = std::make_unique<ZDTTransportLayer>(
       socket_, from, config_.session_options.zdt, /*drains_own_socket=*/false,
       inbox, punch.connection, config_.session_options.common);
@@ -50,14 +50,30 @@ PeerSession::PeerSession(std::shared_ptr<InetAddress> local_address,
       // the parameter, not options_, so this does not depend on declaration
       // order between the two
       outbound_(options.common.send_queue_capacity) {
-  pipeline_.SetCompressionThreshold(options_.common.compression_threshold);
+  pipeline_.SetCompressionThreshold(
+      options_.common.compression_threshold,
+      options_.common.dictionary_compression_threshold);
   pipeline_.SetDumpOnDecodeFailure(options_.common.dump_on_decode_failure);
   // only the accepting side's options count; an initiator adopts whatever the
   // server announces at handshake
   negotiated_compression_ =
       is_initiator ? CompressionType::None
                    : ResolveCompressionType(options_.common.compression);
-  encryption_layer_.Initialize(is_initiator, options_.common.encryption);
+  // a stream needs every message once and in order, which only TCP promises.
+  // Without zstd it goes the way of a plain Zstandard, which warns once
+#ifdef ZNET_USE_ZSTD
+  const bool can_stream = connection_type == ConnectionType::TCP;
+#else
+  const bool can_stream = false;
+#endif
+  if (negotiated_compression_ == CompressionType::ZstandardStream &&
+      !can_stream) {
+    negotiated_compression_ = CompressionType::Zstandard;
+  }
+  encryption_layer_.Initialize(is_initiator, options_.common.encryption,
+                               options_.common.cipher_suites);
+  // an idle session being sent to is one more reason to wake the owner
+  outbound_.SetWakeCallback([this]() { Wake(); });
   if (self_managed) {
     task_.Run([this]() {
       while (IsAlive() && !task_.IsStopRequested()) {
@@ -91,15 +107,23 @@ bool PeerSession::Process() {
   // throughput is capped at the caller's tick rate. The bound keeps one busy
   // session from starving the others sharing this worker.
   std::shared_ptr<Buffer> buffer;
+  backlogged_ = true;
   for (uint32_t i = 0; i < kMaxReceivesPerProcess; i++) {
     buffer = transport_layer_->Receive();
     if (!buffer) {
+      backlogged_ = false;
       break;
     }
     worked = true;
     ZNET_METRIC(metrics_.common.message_bytes_received += buffer->readable_bytes());
-    buffer = pipeline_.Decode(std::move(buffer));
+    buffer = pipeline_.Decode(std::move(buffer),
+                              transport_layer_->LastReceiveSealed());
     if (!buffer) {
+      if (pipeline_.inbound_stream_broken()) {
+        ZNET_LOG_ERROR("Session {} lost its compression stream, closing.", id_);
+        Close();
+        break;
+      }
       continue;
     }
     if (handler_ && pipeline_.has_codec()) {
@@ -138,7 +162,34 @@ Result PeerSession::Close(CloseOptions options) {
   if (!transport_layer_) {
     return Result::InvalidTransport;
   }
-  return transport_layer_->Close(options);
+  const Result result = transport_layer_->Close(options);
+  if (result == Result::Success) {
+    // an owner that only looks at sessions with work would otherwise not
+    // notice this one until its next timer
+    Wake();
+  }
+  return result;
+}
+
+void PeerSession::SetWakeCallback(std::function<void()> wake) {
+  assert(!wake_.load(std::memory_order_relaxed) &&
+         "the wake callback is set once; Wake() may be reading it");
+  wake_storage_ = std::make_unique<std::function<void()>>(std::move(wake));
+  wake_.store(wake_storage_.get(), std::memory_order_release);
+}
+
+void PeerSession::Wake() {
+  const std::function<void()>* wake = wake_.load(std::memory_order_acquire);
+  if (wake && *wake) {
+    (*wake)();
+  }
+}
+
+std::chrono::steady_clock::time_point PeerSession::NextDeadline() const {
+  if (backlogged_ || outbound_.size() > 0 || !IsAlive()) {
+    return std::chrono::steady_clock::now();
+  }
+  return transport_layer_->NextDeadline();
 }
 
 bool PeerSession::IsAlive() const {
@@ -153,32 +204,137 @@ void PeerSession::Ready() {
   if (negotiated_compression_ != CompressionType::None) {
     SetOutCompression(negotiated_compression_);
   }
+  pipeline_.SetMessageLimit(transport_layer_->MaxMessageSize());
   // last, and with release: the codec, the compression type and the derived
   // keys are all written above, and this publishes them. SendPacket() refuses
   // until it sees this.
   is_ready_.store(true, std::memory_order_release);
 }
 
+uint32_t PeerSession::offered_dictionary_id() const {
+  const auto& dictionary = options_.common.compression_dictionary;
+  return dictionary ? dictionary->id() : 0;
+}
+
+bool PeerSession::SetNegotiatedDictionary(uint32_t id) {
+  if (id != 0 && id != offered_dictionary_id()) {
+    return false;
+  }
+  dictionary_id_ = id;
+  // installed now, not at Ready(): the peer may compress with it from its
+  // first message after the handshake, and this end has to read that
+  pipeline_.SetCompressionDictionary(
+      id != 0 ? options_.common.compression_dictionary : nullptr);
+  return true;
+}
+
 bool PeerSession::EncodeAndSend(const std::shared_ptr<Packet>& packet,
                                 SendOptions options) {
+  auto payload = pipeline_.Serialize(packet);
+  if (!payload) {
+    return false;
+  }
+  return SealAndSend(std::move(payload), options, 1);
+}
+
+bool PeerSession::SealAndSend(std::shared_ptr<Buffer> payload,
+                              SendOptions options, uint32_t packets) {
+  const size_t payload_bytes = payload->readable_bytes();
   // the transport decides what "in order relative to each other" means for
   // these options, and the cipher's sequence has to be scoped the same way
+  auto buffer = pipeline_.Seal(std::move(payload),
+                               transport_layer_->OrderingDomain(options));
+  if (!buffer || !Transmit(std::move(buffer), options, payload_bytes, packets)) {
+    AbandonMessage();
+    return false;
+  }
+  return true;
+}
+
+bool PeerSession::EncodeSharedAndSend(SharedMessage& message,
+                                      SendOptions options) {
   size_t payload_bytes = 0;
-  auto buffer = pipeline_.Encode(
-      packet, transport_layer_->OrderingDomain(options), &payload_bytes);
-  if (!buffer) {
+  auto buffer = pipeline_.EncodeShared(
+      message, transport_layer_->OrderingDomain(options), &payload_bytes);
+  if (!buffer || !Transmit(std::move(buffer), options, payload_bytes, 1)) {
+    AbandonMessage();
     return false;
   }
+  return true;
+}
+
+bool PeerSession::Transmit(std::shared_ptr<Buffer> message,
+                           SendOptions options, size_t payload_bytes,
+                           uint32_t packets) {
+  (void)payload_bytes;  // only counted
+  (void)packets;
   ZNET_METRIC(metrics_.common.payload_bytes_sent += payload_bytes);
-  ZNET_METRIC(metrics_.common.message_bytes_sent += buffer->readable_bytes());
-  if (!transport_layer_->Send(buffer, options)) {
+  ZNET_METRIC(metrics_.common.message_bytes_sent += message->readable_bytes());
+  if (!transport_layer_->Send(std::move(message), options)) {
     ZNET_METRIC(metrics_.common.send_failures++);
     return false;
   }
   ZNET_METRIC(metrics_.common.messages_sent++);
+  ZNET_METRIC(metrics_.common.packets_sent += packets);
   return true;
 }
 
+void PeerSession::AbandonMessage() {
+  // the peer's stream never sees this message while this end's goes on from
+  // it, so everything compressed from here would refer to bytes the peer does
+  // not have. Nothing can bring the two back in step but a new connection.
+  if (pipeline_.sealed_into_stream() && IsAlive()) {
+    ZNET_LOG_ERROR("Session {} could not send into its compression stream, "
+                   "closing.", id_);
+    Close();
+  }
+}
+
+void PeerSession::Bundle(const std::shared_ptr<Packet>& packet,
+                         SendOptions options, size_t budget) {
+  // only packets sent alike can share a message: it goes out once, with one
+  // set of options, and in one ordering domain
+  if (bundle_ && options != bundle_options_) {
+    SendBundle();
+  }
+  if (!bundle_) {
+    bundle_ = pipeline_.Serialize(packet);
+    if (!bundle_) {
+      return;
+    }
+    bundle_options_ = options;
+    bundle_packets_ = 1;
+  } else {
+    const size_t end = bundle_->write_cursor();
+    if (!pipeline_.Append(bundle_, packet)) {
+      return;  // dropped alone; what was bundled before it is intact
+    }
+    if (bundle_->readable_bytes() <= budget) {
+      bundle_packets_++;
+      return;
+    }
+    // over the budget: this packet starts the next message instead
+    auto next = pipeline_.SplitOff(*bundle_, end);
+    SendBundle();
+    bundle_ = std::move(next);
+    bundle_options_ = options;
+    bundle_packets_ = 1;
+  }
+  // nothing more fits behind a packet that fills the budget on its own
+  if (bundle_->readable_bytes() >= budget) {
+    SendBundle();
+  }
+}
+
+void PeerSession::SendBundle() {
+  if (!bundle_) {
+    return;
+  }
+  SealAndSend(std::move(bundle_), bundle_options_, bundle_packets_);
+  bundle_.reset();
+  bundle_packets_ = 0;
+}
+
 bool PeerSession::SendImmediate(std::shared_ptr<Packet> packet,
                                 SendOptions options) {
   if (!packet || !IsAlive()) {
@@ -219,14 +375,48 @@ Result PeerSession::SendPacket(std::shared_ptr<Packet> packet,
   return Result::Success;
 }
 
+Result PeerSession::SendShared(std::shared_ptr<SharedMessage> message,
+                               SendOptions options) {
+  if (!message || !message->packet()) {
+    return Result::InvalidArgument;
+  }
+  if (!IsAlive()) {
+    return Result::NotConnected;
+  }
+  if (!IsReady()) {
+    return Result::NotReady;
+  }
+  if (!outbound_.Push(std::move(message), options)) {
+    ZNET_LOG_DEBUG("Session {} outbound queue is full ({}), refusing the send.",
+                   id_, outbound_.capacity());
+    return Result::QueueFull;
+  }
+  return Result::Success;
+}
+
 bool PeerSession::DrainOutbound() {
-  return outbound_.Drain([this](OutboundQueue::Item& item) {
-    if (!IsAlive()) {
-      return false;  // keep draining, so a dead session releases what it holds
-    }
-    EncodeAndSend(item.packet, item.options);
-    return true;
-  });
+  // read once per drain: ZDT moves it with the path MTU, on its worker
+  const size_t budget =
+      MessagePipeline::PayloadBudget(transport_layer_->BundleBudget());
+  const bool encoded = outbound_.Drain(
+      [this, budget](OutboundQueue::Item& item) {
+        if (!IsAlive()) {
+          return false;  // keep draining, so a dead session releases what it holds
+        }
+        if (item.shared) {
+          // encoded apart from any bundle, which has to go out ahead of it
+          SendBundle();
+          EncodeSharedAndSend(*item.shared, item.options);
+        } else {
+          Bundle(item.packet, item.options, budget);
+        }
+        return true;
+      },
+      [this] { SendBundle(); });
+  if (encoded) {
+    transport_layer_->EndSendBatch();
+  }
+  return encoded;
 }
 
 
@@ -29,6 +29,7 @@ Server::Server(const ServerConfig& config) : Interface(), config_(config) {
   for (uint32_t i = 0; i < core_count; i++) {
     tasks_.push_back(std::make_unique<TaskData>());
     TaskData& data = *tasks_.back();
+    data.index_ = tasks_.size() - 1;
     data.task_ = std::make_unique<Task>();
     data.task_->Run([this, &data]() { WorkerLoop(data); });
   }
@@ -40,11 +41,15 @@ void Server::WorkerLoop(TaskData& data) {
 
   while (!data.task_->IsStopRequested()) {
     // nothing to drive yet: sleep until a session is handed over, with no
-    // deadline, since no tick is owed on an empty worker
+    // deadline, since no tick is owed on an empty worker. a wake still ends
+    // it, since it means something was posted to groups_, which would
+    // otherwise pile up here unapplied
     if (data.sessions_.count() == 0 || !backend_->IsAlive()) {
       std::unique_lock<std::mutex> lock(signal.mutex);
       signal.cv.wait(lock, [&]() {
-        return data.sessions_.count() != 0 || data.task_->IsStopRequested();
+        return data.sessions_.count() != 0 ||
+               signal.woken.load(std::memory_order_relaxed) ||
+               data.task_->IsStopRequested();
       });
       if (data.task_->IsStopRequested()) {
         break;
@@ -54,14 +59,36 @@ void Server::WorkerLoop(TaskData& data) {
     // per-task scheduler: Scheduler holds tick state, so workers cannot share
     // one instance.
     data.scheduler_.Start();
-    data.sessions_.With(
-        [this](SessionMap& sessions) { CleanupAndProcessSessions(sessions); });
+    // before the ready list is taken, so the sessions a group send or a
+    // broadcast queues to are on it and go out in this pass
+    data.sessions_.With([&data](SessionMap& sessions) {
+      data.groups_.Apply(sessions);
+    });
+    {
+      std::lock_guard<std::mutex> lock(signal.mutex);
+      data.ready_.swap(signal.ready);
+    }
+    data.sessions_.With([this, &data](SessionMap& sessions) {
+      ProcessReadySessions(data, sessions);
+    });
     data.scheduler_.End();
 
-    // sit out the rest of the tick, but return early when a backend with its
-    // own receive thread reports work; otherwise an arriving datagram is not
-    // looked at, let alone acked, until the next tick
-    const auto remaining = data.scheduler_.remaining();
+    // sit out the rest of the tick, but return early when a session is woken:
+    // otherwise an arriving datagram is not looked at, let alone acked, until
+    // the next tick
+    auto remaining = data.scheduler_.remaining();
+    // or when a session's deadline falls inside it, a paced send coming due
+    // say. one already past is next-tick work and waits like any other
+    if (!data.timers_.empty()) {
+      const auto until =
+          data.timers_.top().due - std::chrono::steady_clock::now();
+      if (until > std::chrono::steady_clock::duration::zero()) {
+        remaining = std::min(
+            remaining,
+            std::chrono::duration_cast<Scheduler::Duration>(until) +
+                Scheduler::Duration(1));
+      }
+    }
     if (remaining > Scheduler::Duration::zero()) {
       std::unique_lock<std::mutex> lock(signal.mutex);
       signal.cv.wait_for(lock, remaining, [&]() {
@@ -103,18 +130,11 @@ Result Server::Bind() {
   if (result == Result::Success) {
     // the backend may have resolved an auto-assigned port
     bind_address_ = backend_->bind_address();
-    // registered before Listen() starts any receive thread
-    backend_->SetWakeCallback([this]() {
-      for (auto& data : tasks_) {
-        // skip workers holding no sessions: they cannot be the datagram's
-        // owner, and waking them costs a thread switch each. see SessionSet
-        // for why a stale count is safe here.
-        if (data->sessions_.count() == 0) {
-          continue;
-        }
-        data->signal_->Raise();
-      }
-    });
+    // registered before Listen() starts any receive thread. The session knows
+    // its own worker, so only that one wakes, and only for that session. A
+    // session still pending has no wake callback yet: the loop here ticks
+    // those anyway.
+    backend_->SetReadyCallback([](PeerSession& session) { session.Wake(); });
   }
   return result;
 }
@@ -156,6 +176,93 @@ void Server::SetTicksPerSecond(uint16_t tps) {
   }
 }
 
+Result Server::Broadcast(std::shared_ptr<Packet> packet,
+                         std::function<bool(PeerSession&)> filter,
+                         SendOptions options) {
+  if (!packet) {
+    return Result::InvalidArgument;
+  }
+  auto message = std::make_shared<SharedMessage>(std::move(packet));
+  // posted rather than walked here: a caller on one worker, in a handler,
+  // holds that worker's sessions, and waiting on another's could deadlock
+  // against it doing the same
+  std::lock_guard<std::mutex> lock(tasks_mutex_);
+  for (auto& data : tasks_) {
+    if (data->groups_.PostBroadcast(message, filter, options)) {
+      data->signal_->Raise();
+    }
+  }
+  return Result::Success;
+}
+
+GroupId Server::CreateGroup() {
+  return next_group_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Server::DestroyGroup(GroupId group) {
+  std::lock_guard<std::mutex> lock(tasks_mutex_);
+  for (auto& data : tasks_) {
+    if (data->groups_.PostDestroy(group)) {
+      data->signal_->Raise();
+    }
+  }
+}
+
+bool Server::AddToGroup(GroupId group,
+                        const std::shared_ptr<PeerSession>& session) {
+  if (!session || !session->IsAlive()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(tasks_mutex_);
+  TaskData* data = OwnerOf(*session);
+  if (!data) {
+    return false;
+  }
+  // only the owner: no other worker can have it in a group
+  if (data->groups_.PostAdd(group, session)) {
+    data->signal_->Raise();
+  }
+  return true;
+}
+
+bool Server::RemoveFromGroup(GroupId group,
+                             const std::shared_ptr<PeerSession>& session) {
+  if (!session) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(tasks_mutex_);
+  TaskData* data = OwnerOf(*session);
+  if (!data) {
+    return false;
+  }
+  if (data->groups_.PostRemove(group, session)) {
+    data->signal_->Raise();
+  }
+  return true;
+}
+
+Result Server::SendToGroup(GroupId group, std::shared_ptr<Packet> packet,
+                           SendOptions options) {
+  if (!packet) {
+    return Result::InvalidArgument;
+  }
+  auto message = std::make_shared<SharedMessage>(std::move(packet));
+  // every worker, members there or not: which ones have any is theirs to
+  // know, and asking would take the lock the posting avoids
+  std::lock_guard<std::mutex> lock(tasks_mutex_);
+  for (auto& data : tasks_) {
+    if (data->groups_.PostSend(group, message, options)) {
+      data->signal_->Raise();
+    }
+  }
+  return Result::Success;
+}
+
+Server::TaskData* Server::OwnerOf(const PeerSession& session) {
+  const size_t index = session.worker_index();
+  return index < tasks_.size() ? tasks_[index].get() : nullptr;
+}
+
 bool Server::IsAlive() const {
   return backend_->IsAlive();
 }
@@ -181,11 +288,18 @@ void Server::MainProcessor() {
   ServerShutdownEvent shutdown_event{*this};
   event_callback()(shutdown_event);
 
-  // the receive thread's wake callback reaches into tasks_, so it has to be
-  // joined before they are destroyed. the socket stays open until Close() so
-  // pending sessions can still send their FINs.
+  // nothing should still be reporting sessions while their workers wind
+  // down. the socket stays open until Close() so pending sessions can still
+  // send their FINs.
   backend_->StopReceiving();
-  tasks_.clear();
+  // taken out under the lock but joined outside it: a worker may be in a
+  // handler waiting on the lock to post a send
+  std::vector<std::unique_ptr<TaskData>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    tasks.swap(tasks_);
+  }
+  tasks.clear();
   DisconnectPending();
   backend_->Close();
 
@@ -231,21 +345,7 @@ void Server::CleanupAndProcessSessions(SessionMap& sessions) {
   }
 
   for (auto&& address : remove) {
-    auto session = sessions[address];
-    // one that never became ready died still handshaking, and the application
-    // was never told it connected, so a disconnect event would be unpaired.
-    if (session->IsReady()) {
-      IncomingClientDisconnectedEvent event{session};
-      event_callback()(event);
-      ZNET_LOG_DEBUG("Client disconnected: {}",
-                     session->remote_address()->readable());
-    }
-    // the map is about to drop its reference, and a handler holding one back
-    // to the session would be the only thing left pointing at either of them.
-    // see PeerSession::ReleaseHandler. this runs on the worker, the same
-    // thread that dispatches into the handler, so it cannot race one.
-    session->ReleaseHandler();
-    sessions.erase(address);
+    DropSession(sessions, sessions.find(address));
   }
 
   for (auto&& item : sessions) {
@@ -253,6 +353,84 @@ void Server::CleanupAndProcessSessions(SessionMap& sessions) {
   }
 }
 
+void Server::ProcessReadySessions(TaskData& data, SessionMap& sessions) {
+  const auto now = std::chrono::steady_clock::now();
+  for (const auto& weak : data.ready_) {
+    auto session = weak.lock();
+    if (!session) {
+      continue;
+    }
+    // off the list before it runs, so a wake landing mid-pass lists it again
+    session->ClearQueued();
+    TickSession(data, sessions, session, now);
+  }
+  data.ready_.clear();
+
+  // against the tick's start, so a session refiled during this pass waits for
+  // the next one rather than running twice
+  while (!data.timers_.empty() && data.timers_.top().due <= now) {
+    const Timer timer = data.timers_.top();
+    data.timers_.pop();
+    auto session = timer.session.lock();
+    if (!session || session->scheduled_deadline() != timer.due) {
+      continue;  // the session left, or was filed again since
+    }
+    TickSession(data, sessions, session, now);
+  }
+}
+
+void Server::TickSession(TaskData& data, SessionMap& sessions,
+                         const std::shared_ptr<PeerSession>& session,
+                         std::chrono::steady_clock::time_point now) {
+  // a wake can race the session's hand-over to this worker, or outlive its
+  // removal from it
+  auto it = sessions.find(session->remote_address());
+  if (it == sessions.end() || it->second != session) {
+    return;
+  }
+  // this pass does whatever a due timer was filed for, so the entry is spent
+  if (session->scheduled_deadline() <= now) {
+    session->set_scheduled_deadline(
+        std::chrono::steady_clock::time_point::max());
+  }
+  if (session->IsAlive()) {
+    session->Process();
+  }
+  if (!session->IsAlive()) {
+    session->set_scheduled_deadline(
+        std::chrono::steady_clock::time_point::max());
+    data.groups_.Forget(*session);
+    DropSession(sessions, it);
+    return;
+  }
+  // only an earlier deadline is filed. A later one can wait for the entry
+  // already pending, which costs one early pass that refiles it; filing every
+  // time would add an entry per session per tick.
+  const auto due = session->NextDeadline();
+  if (due < session->scheduled_deadline()) {
+    session->set_scheduled_deadline(due);
+    data.timers_.push(Timer{due, session});
+  }
+}
+
+void Server::DropSession(SessionMap& sessions, SessionMap::iterator it) {
+  const std::shared_ptr<PeerSession> session = it->second;
+  // one that never became ready died still handshaking, and the application
+  // was never told it connected, so a disconnect event would be unpaired.
+  if (session->IsReady()) {
+    IncomingClientDisconnectedEvent event{session};
+    event_callback()(event);
+    ZNET_LOG_DEBUG("Client disconnected: {}",
+                   session->remote_address()->readable());
+  }
+  // the map is about to drop its reference, and a handler holding one back
+  // to the session would be the only thing left pointing at either of them.
+  // see PeerSession::ReleaseHandler. this runs on the worker, the same
+  // thread that dispatches into the handler, so it cannot race one.
+  session->ReleaseHandler();
+  sessions.erase(it);
+}
+
 void Server::DisconnectPending() {
   for (auto&& item : pending_sessions_) {
     item.second->Close();
@@ -299,14 +477,30 @@ void Server::ProcessSessions() {
 
 void Server::SubmitSession(TaskData& data, std::shared_ptr<PeerSession> session) {
   auto signal = data.signal_;
-  session->SetWakeCallback([signal]() { signal->Raise(); });
+  // the callback belongs to the session, so it only runs while the session
+  // is alive and the raw pointer is safe. the weak one is what gets listed.
+  PeerSession* raw = session.get();
+  std::weak_ptr<PeerSession> weak = session;
+  session->SetWakeCallback([signal, raw, weak]() {
+    if (raw->TryQueue()) {
+      signal->RaiseFor(weak);
+      return;
+    }
+    // listed already, but perhaps by the worker itself mid-pass, which woke
+    // nothing: it may be asleep with the session on its list
+    signal->Raise();
+  });
+  // before the application first sees it, so it can be added to a group from
+  // the connect event
+  session->set_worker_index(data.index_);
   IncomingClientConnectedEvent event{session};
   event_callback()(event);
   data.sessions_.With([&](SessionMap& sessions) {
     sessions[session->remote_address()] = session;
   });
   ZNET_LOG_DEBUG("New connection is ready. {}", session->remote_address()->readable());
-  data.signal_->Raise();
+  // its first pass; everything after comes from wakes and deadlines
+  session->Wake();
 }
 
 Server::TaskData* Server::SelectNextTask() {
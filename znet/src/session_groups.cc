@@ -0,0 +1,205 @@
+//
+//    Copyright 2026 Metehan Gezer
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#include "znet/session_groups.h"
+
+#include <algorithm>
+
+namespace znet {
+
+bool SessionGroups::PostAdd(GroupId group,
+                            std::shared_ptr<PeerSession> session) {
+  return Post(Op{OpType::Add, group, std::move(session), nullptr, {}, nullptr});
+}
+
+bool SessionGroups::PostRemove(GroupId group,
+                               std::shared_ptr<PeerSession> session) {
+  return Post(
+      Op{OpType::Remove, group, std::move(session), nullptr, {}, nullptr});
+}
+
+bool SessionGroups::PostDestroy(GroupId group) {
+  return Post(Op{OpType::Destroy, group, nullptr, nullptr, {}, nullptr});
+}
+
+bool SessionGroups::PostSend(GroupId group,
+                             std::shared_ptr<SharedMessage> message,
+                             SendOptions options) {
+  return Post(Op{OpType::Send, group, nullptr, std::move(message), options,
+                 nullptr});
+}
+
+bool SessionGroups::PostBroadcast(std::shared_ptr<SharedMessage> message,
+                                  std::function<bool(PeerSession&)> filter,
+                                  SendOptions options) {
+  return Post(Op{OpType::Broadcast, 0, nullptr, std::move(message), options,
+                 std::move(filter)});
+}
+
+bool SessionGroups::Post(Op op) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  posted_.push_back(std::move(op));
+  return posted_.size() == 1;
+}
+
+void SessionGroups::Apply(const SessionMap& sessions) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (posted_.empty()) {
+      return;
+    }
+    applying_.swap(posted_);
+  }
+  for (Op& op : applying_) {
+    switch (op.type) {
+      case OpType::Add:
+        Add(op.group, std::move(op.session));
+        break;
+      case OpType::Remove:
+        Remove(op.group, *op.session);
+        break;
+      case OpType::Destroy:
+        Destroy(op.group);
+        break;
+      case OpType::Send:
+        Send(op.group, op.message, op.options);
+        break;
+      case OpType::Broadcast:
+        // a closed session is not forgotten here: it is still on the worker,
+        // which forgets it when it drops it
+        for (const auto& item : sessions) {
+          if (!op.filter || op.filter(*item.second)) {
+            item.second->SendShared(op.message, op.options);
+          }
+        }
+        break;
+    }
+  }
+  // the sessions and messages go now, not when the next batch is swapped in
+  applying_.clear();
+}
+
+void SessionGroups::Forget(PeerSession& session) {
+  auto it = memberships_.find(&session);
+  if (it == memberships_.end()) {
+    return;
+  }
+  // moved out first: Erase() edits the entry this would be walking
+  const std::vector<GroupId> in = std::move(it->second);
+  for (GroupId id : in) {
+    auto group = groups_.find(id);
+    if (group != groups_.end()) {
+      Erase(id, group->second, session);
+      if (group->second.members.empty()) {
+        groups_.erase(group);
+      }
+    }
+  }
+}
+
+size_t SessionGroups::members(GroupId group) const {
+  auto it = groups_.find(group);
+  return it == groups_.end() ? 0 : it->second.members.size();
+}
+
+void SessionGroups::Add(GroupId id, std::shared_ptr<PeerSession> session) {
+  // gone before the add got here: the worker has already forgotten it, and
+  // would never be told again
+  if (!session->IsAlive()) {
+    return;
+  }
+  Group& group = groups_[id];
+  if (!group.index.emplace(session.get(), group.members.size()).second) {
+    return;  // already in it
+  }
+  memberships_[session.get()].push_back(id);
+  group.members.push_back(std::move(session));
+}
+
+void SessionGroups::Remove(GroupId id, PeerSession& session) {
+  auto it = groups_.find(id);
+  if (it == groups_.end()) {
+    return;
+  }
+  Erase(id, it->second, session);
+  if (it->second.members.empty()) {
+    groups_.erase(it);
+  }
+}
+
+void SessionGroups::Destroy(GroupId id) {
+  auto it = groups_.find(id);
+  if (it == groups_.end()) {
+    return;
+  }
+  for (const auto& member : it->second.members) {
+    auto in = memberships_.find(member.get());
+    std::vector<GroupId>& ids = in->second;
+    ids.erase(std::find(ids.begin(), ids.end(), id));
+    if (ids.empty()) {
+      memberships_.erase(in);
+    }
+  }
+  groups_.erase(it);
+}
+
+void SessionGroups::Send(GroupId id,
+                         const std::shared_ptr<SharedMessage>& message,
+                         SendOptions options) {
+  auto it = groups_.find(id);
+  if (it == groups_.end()) {
+    return;
+  }
+  Group& group = it->second;
+  for (size_t i = 0; i < group.members.size();) {
+    if (group.members[i]->SendShared(message, options) ==
+        Result::NotConnected) {
+      // closed, and about to be dropped. held here, since leaving its last
+      // group may let go of it; Erase() moves the last member into this slot,
+      // so the index stays put
+      const std::shared_ptr<PeerSession> closed = group.members[i];
+      Forget(*closed);
+      if (groups_.find(id) == groups_.end()) {
+        return;  // that was the last one
+      }
+      continue;
+    }
+    i++;
+  }
+}
+
+void SessionGroups::Erase(GroupId id, Group& group, PeerSession& session) {
+  auto at = group.index.find(&session);
+  if (at == group.index.end()) {
+    return;
+  }
+  const size_t slot = at->second;
+  group.index.erase(at);
+  if (slot != group.members.size() - 1) {
+    group.members[slot] = std::move(group.members.back());
+    group.index[group.members[slot].get()] = slot;
+  }
+  group.members.pop_back();
+
+  auto in = memberships_.find(&session);
+  if (in == memberships_.end()) {
+    return;
+  }
+  std::vector<GroupId>& ids = in->second;
+  auto listed = std::find(ids.begin(), ids.end(), id);
+  if (listed != ids.end()) {
+    ids.erase(listed);
+  }
+  if (ids.empty()) {
+    memberships_.erase(in);
+  }
+}
+
+}  // namespace znet